@@ -7,4 +7,13 @@ float square(float x) {
     return x * x;
 }
 
+// Inverse of packed_model_vertex::encode_octahedral.
+vec3 decode_octahedral(vec2 e) {
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (v.z < 0.0) {
+        v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(v);
+}
+
 #endif
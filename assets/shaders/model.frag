@@ -38,6 +38,7 @@ uniform sampler2D material_roughness;
 uniform sampler2D material_metallic;
 
 uniform sampler2D lightmap_texture;
+uniform float lightmap_rgbm_range; // Zero unless the lightmap is RGBM encoded.
 uniform samplerCube environment_cubemap_texture;
 uniform samplerCube irradiance_cubemap_texture;
 uniform samplerCube prefilter_cubemap_texture;
@@ -84,7 +85,8 @@ void main() {
 	vec3 albedo = pow(albedo_sample.rgb, vec3(2.2)); // Convert from sRGB to linear.
 	float roughness = texture(material_roughness, io_texture_coordinates).r;
 	float metallic = texture(material_metallic, io_texture_coordinates).r;
-	vec3 lightmap = texture(lightmap_texture, io_lightmap_coordinates).rgb;
+	vec4 lightmap_sample = texture(lightmap_texture, io_lightmap_coordinates);
+	vec3 lightmap = (lightmap_rgbm_range > 0.0) ? lightmap_sample.rgb * (lightmap_sample.a * lightmap_rgbm_range) : lightmap_sample.rgb;
 
 	vec3 reflectivity = mix(vec3(MIN_REFLECTIVITY), albedo, metallic);
 
@@ -1,9 +1,12 @@
+#include "math.glsl"
+
+// Must match packed_model_vertex::tangent_sign_bias.
+const float tangent_sign_bias = 1.0 / 32767.0;
+
 layout (location = 0) in vec3 in_position;
-layout (location = 1) in vec3 in_normal;
-layout (location = 2) in vec3 in_tangent;
-layout (location = 3) in vec3 in_bitangent;
-layout (location = 4) in vec2 in_texture_coordinates;
-layout (location = 5) in vec2 in_lightmap_coordinates;
+layout (location = 1) in vec4 in_normal_and_tangent;
+layout (location = 2) in vec2 in_texture_coordinates;
+layout (location = 3) in vec2 in_lightmap_coordinates;
 
 out vec3 io_fragment_position;
 out float io_fragment_depth;
@@ -30,9 +33,12 @@ void main() {
 	io_fragment_position = vec3(model_matrix * vec4(in_position, 1.0));
 	vec4 fragment_in_view_space = view_matrix * vec4(io_fragment_position, 1.0);
 	io_fragment_depth = fragment_in_view_space.z;
-	io_normal = normal_matrix * in_normal;
-	io_tangent = normal_matrix * in_tangent;
-	io_bitangent = normal_matrix * in_bitangent;
+	float bitangent_sign = (in_normal_and_tangent.w < 0.0) ? -1.0 : 1.0;
+	vec3 normal = decode_octahedral(in_normal_and_tangent.xy);
+	vec3 tangent = decode_octahedral(vec2(in_normal_and_tangent.z, (abs(in_normal_and_tangent.w) - tangent_sign_bias) / (1.0 - tangent_sign_bias) * 2.0 - 1.0));
+	io_normal = normal_matrix * normal;
+	io_tangent = normal_matrix * tangent;
+	io_bitangent = normal_matrix * (bitangent_sign * cross(normal, tangent));
 	io_texture_coordinates = in_texture_coordinates;
 	io_lightmap_coordinates = lightmap_offset + in_lightmap_coordinates * lightmap_scale;
 
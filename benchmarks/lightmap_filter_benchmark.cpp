@@ -0,0 +1,88 @@
+#include "core/opengl.hpp"
+#include "render/lightmap_filter.hpp"
+
+#include <algorithm>     // std::min
+#include <chrono>        // std::chrono
+#include <cstddef>       // std::size_t
+#include <cstdio>        // stdout
+#include <cstdlib>       // EXIT_SUCCESS, EXIT_FAILURE, std::strtoull
+#include <exception>     // std::exception
+#include <fmt/format.h>  // fmt::print
+#include <lightmapper.h> // lmImageDilate, lmImageSmooth
+#include <random>        // std::mt19937, std::uniform_int_distribution, std::uniform_real_distribution
+#include <vector>        // std::vector
+
+static constexpr auto channel_count = lightmap_filter::channel_count;
+
+// Scatter rectangular charts with gaps between them over an empty atlas, similar to what xatlas produces.
+static auto make_lightmap(std::size_t resolution) -> std::vector<float> {
+	auto pixels = std::vector<float>(resolution * resolution * channel_count, 0.0f);
+	auto generator = std::mt19937{1234};
+	auto size_distribution = std::uniform_int_distribution<std::size_t>{4, 64};
+	auto color_distribution = std::uniform_real_distribution<float>{0.1f, 4.0f};
+	for (auto y = std::size_t{4}; y + 68 < resolution; y += 72) {
+		for (auto x = std::size_t{4}; x + 68 < resolution; x += 72) {
+			const auto width = size_distribution(generator);
+			const auto height = size_distribution(generator);
+			const auto color = color_distribution(generator);
+			for (auto chart_y = y; chart_y < y + height; ++chart_y) {
+				for (auto chart_x = x; chart_x < x + width; ++chart_x) {
+					auto* const pixel = &pixels[(chart_y * resolution + chart_x) * channel_count];
+					pixel[0] = color;
+					pixel[1] = color * 0.5f;
+					pixel[2] = color * 0.25f;
+					pixel[3] = 1.0f;
+				}
+			}
+		}
+	}
+	return pixels;
+}
+
+template <typename Function>
+static auto measure(const char* name, std::size_t iterations, Function&& function) -> double {
+	auto best = std::chrono::duration<double, std::milli>::max();
+	for (auto i = std::size_t{0}; i < iterations; ++i) {
+		const auto start_time = std::chrono::steady_clock::now();
+		function();
+		best = std::min(best, std::chrono::duration<double, std::milli>{std::chrono::steady_clock::now() - start_time});
+	}
+	fmt::print(stdout, "{:<40} {:>10.2f} ms\n", name, best.count());
+	return best.count();
+}
+
+auto main(int argc, char* argv[]) -> int {
+	try {
+		const auto resolution = (argc > 1) ? static_cast<std::size_t>(std::strtoull(argv[1], nullptr, 10)) : std::size_t{4096};
+		const auto iterations = (argc > 2) ? static_cast<std::size_t>(std::strtoull(argv[2], nullptr, 10)) : std::size_t{3};
+		const auto source = make_lightmap(resolution);
+		const auto size = static_cast<int>(resolution);
+		const auto channels = static_cast<int>(channel_count);
+		fmt::print(stdout, "Lightmap post-processing at {}x{}, best of {}:\n", resolution, resolution, iterations);
+
+		auto pixels = std::vector<float>{};
+		auto temp = std::vector<float>(source.size());
+		const auto baseline = measure("lmImageDilate x32 + lmImageSmooth", iterations, [&] {
+			pixels = source;
+			for (int i = 0; i < 16; ++i) {
+				lmImageDilate(pixels.data(), temp.data(), size, size, channels);
+				lmImageDilate(temp.data(), pixels.data(), size, size, channels);
+			}
+			lmImageSmooth(pixels.data(), temp.data(), size, size, channels);
+			lmImageDilate(temp.data(), pixels.data(), size, size, channels);
+		});
+		const auto filtered = measure("lightmap_filter::smooth + dilate", iterations, [&] {
+			pixels = source;
+			lightmap_filter::smooth(pixels, temp, resolution);
+			lightmap_filter::dilate(temp, pixels, resolution);
+		});
+		fmt::print(stdout, "Speedup: {:.1f}x\n", baseline / filtered);
+	} catch (const std::exception& e) {
+		fmt::print(stderr, "Fatal error: {}\n", e.what());
+		return EXIT_FAILURE;
+	} catch (...) {
+		fmt::print(stderr, "Fatal error!\n");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,146 @@
+#include "core/glsl.hpp"
+#include "resources/mesh_optimizer.hpp"
+
+#include <algorithm>            // std::ranges::sort
+#include <assimp/Importer.hpp>  // Assimp::Importer
+#include <assimp/postprocess.h> // ai...
+#include <assimp/scene.h>       // ai...
+#include <chrono>               // std::chrono
+#include <cstddef>              // std::size_t
+#include <cstdint>              // std::uint32_t
+#include <cstdio>               // stdout, stderr
+#include <cstdlib>              // EXIT_SUCCESS, EXIT_FAILURE
+#include <exception>            // std::exception
+#include <filesystem>           // std::filesystem::...
+#include <fmt/format.h>         // fmt::format, fmt::print
+#include <stdexcept>            // std::runtime_error
+#include <string>               // std::string
+#include <vector>               // std::vector
+
+// The components that model::import welds vertices by. The lightmap coordinates of model_vertex are left out, since they start out as copies of the
+// texture coordinates.
+struct benchmark_vertex final {
+	vec3 position{};
+	vec3 normal{};
+	vec3 tangent{};
+	vec3 bitangent{};
+	vec2 texture_coordinates{};
+};
+
+// Same as model::import, so that the vertex counts and ratios match the meshes that are actually optimized.
+static constexpr auto weld_epsilon = 1e-5f;
+
+struct benchmark_mesh final {
+	std::vector<benchmark_vertex> vertices{};
+	std::vector<std::uint32_t> indices{};
+};
+
+// Weighted by triangle and vertex counts, so that the totals describe the whole asset rather than the average mesh.
+struct asset_statistics final {
+	std::size_t vertex_count = 0;
+	std::size_t triangle_count = 0;
+	double transformed_vertex_count = 0.0;
+
+	auto add(const vertex_cache_statistics& statistics, std::size_t vertices, std::size_t triangles) -> void {
+		vertex_count += vertices;
+		triangle_count += triangles;
+		transformed_vertex_count += static_cast<double>(statistics.acmr) * static_cast<double>(triangles);
+	}
+
+	auto add(const asset_statistics& other) -> void {
+		vertex_count += other.vertex_count;
+		triangle_count += other.triangle_count;
+		transformed_vertex_count += other.transformed_vertex_count;
+	}
+
+	[[nodiscard]] auto acmr() const -> double {
+		return (triangle_count == 0) ? 0.0 : transformed_vertex_count / static_cast<double>(triangle_count);
+	}
+
+	[[nodiscard]] auto atvr() const -> double {
+		return (vertex_count == 0) ? 0.0 : transformed_vertex_count / static_cast<double>(vertex_count);
+	}
+};
+
+// Read the meshes of a model in file order, with the same post-processing and welding as model::import but without optimizing them.
+static auto import_meshes(const std::string& filename) -> std::vector<benchmark_mesh> {
+	auto importer = Assimp::Importer{};
+	const auto* const scene = importer.ReadFile(filename, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals | aiProcess_CalcTangentSpace);
+	if (!scene || (scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) != 0) {
+		throw std::runtime_error{fmt::format("Failed to load model \"{}\": {}", filename, importer.GetErrorString())};
+	}
+	auto result = std::vector<benchmark_mesh>{};
+	for (auto i = 0u; i < scene->mNumMeshes; ++i) {
+		const auto& mesh = *scene->mMeshes[i];
+		auto& data = result.emplace_back();
+		data.vertices.reserve(mesh.mNumVertices);
+		const auto zero_vector = aiVector3D{};
+		for (auto j = 0u; j < mesh.mNumVertices; ++j) {
+			const auto& position = mesh.mVertices[j];
+			const auto& normal = (mesh.mNormals) ? mesh.mNormals[j] : zero_vector;
+			const auto& tangent = (mesh.mTangents) ? mesh.mTangents[j] : zero_vector;
+			const auto& bitangent = (mesh.mBitangents) ? mesh.mBitangents[j] : zero_vector;
+			const auto& texture_coordinates = (mesh.mTextureCoords[0]) ? mesh.mTextureCoords[0][j] : zero_vector;
+			data.vertices.push_back(benchmark_vertex{
+				.position = vec3{position.x, position.y, position.z},
+				.normal = vec3{normal.x, normal.y, normal.z},
+				.tangent = vec3{tangent.x, tangent.y, tangent.z},
+				.bitangent = vec3{bitangent.x, bitangent.y, bitangent.z},
+				.texture_coordinates = vec2{texture_coordinates.x, texture_coordinates.y},
+			});
+		}
+		for (auto j = 0u; j < mesh.mNumFaces; ++j) {
+			if (const auto& face = mesh.mFaces[j]; face.mNumIndices == 3) {
+				data.indices.insert(data.indices.end(), face.mIndices, face.mIndices + 3);
+			}
+		}
+		mesh_optimizer::weld_vertices(data.vertices, data.indices, weld_epsilon);
+	}
+	return result;
+}
+
+auto main(int argc, char* argv[]) -> int {
+	try {
+		const auto directory = std::filesystem::path{(argc > 1) ? argv[1] : "assets/models"};
+		auto filenames = std::vector<std::string>{};
+		auto importer = Assimp::Importer{};
+		for (const auto& entry : std::filesystem::recursive_directory_iterator{directory}) {
+			if (entry.is_regular_file() && importer.IsExtensionSupported(entry.path().extension().string())) {
+				filenames.push_back(entry.path().generic_string());
+			}
+		}
+		std::ranges::sort(filenames);
+
+		fmt::print(stdout, "Post-transform vertex cache of {} entries (FIFO):\n", mesh_optimizer::cache_size);
+		fmt::print(stdout, "{:<48} {:>10} {:>10} {:>8} {:>8} {:>8} {:>8} {:>10}\n", "Asset", "Vertices", "Triangles", "ACMR", "ACMR", "ATVR", "ATVR", "Time");
+		fmt::print(stdout, "{:<48} {:>10} {:>10} {:>8} {:>8} {:>8} {:>8} {:>10}\n", "", "", "", "before", "after", "before", "after", "");
+		auto total_before = asset_statistics{};
+		auto total_after = asset_statistics{};
+		for (const auto& filename : filenames) {
+			auto meshes = import_meshes(filename);
+			auto before = asset_statistics{};
+			auto after = asset_statistics{};
+			const auto start_time = std::chrono::steady_clock::now();
+			for (auto& mesh : meshes) {
+				const auto triangle_count = mesh.indices.size() / 3;
+				before.add(mesh_optimizer::analyze_vertex_cache(mesh.indices, mesh.vertices.size()), mesh.vertices.size(), triangle_count);
+				mesh_optimizer::optimize(mesh.vertices, mesh.indices);
+				after.add(mesh_optimizer::analyze_vertex_cache(mesh.indices, mesh.vertices.size()), mesh.vertices.size(), triangle_count);
+			}
+			const auto duration = std::chrono::duration<double, std::milli>{std::chrono::steady_clock::now() - start_time};
+			fmt::print(stdout, "{:<48} {:>10} {:>10} {:>8.3f} {:>8.3f} {:>8.3f} {:>8.3f} {:>7.1f} ms\n", filename, before.vertex_count, before.triangle_count, before.acmr(), after.acmr(),
+				before.atvr(), after.atvr(), duration.count());
+			total_before.add(before);
+			total_after.add(after);
+		}
+		fmt::print(stdout, "{:<48} {:>10} {:>10} {:>8.3f} {:>8.3f} {:>8.3f} {:>8.3f}\n", "Total", total_before.vertex_count, total_before.triangle_count, total_before.acmr(),
+			total_after.acmr(), total_before.atvr(), total_after.atvr());
+	} catch (const std::exception& e) {
+		fmt::print(stderr, "Fatal error: {}\n", e.what());
+		return EXIT_FAILURE;
+	} catch (...) {
+		fmt::print(stderr, "Fatal error!\n");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -2,25 +2,28 @@
 #define APPLICATION_HPP
 
 #include "../core/glsl.hpp"
+#include "../core/profiler.hpp"
 #include "../render/rendering_pipeline.hpp"
 #include "../resources/font.hpp"
 #include "../resources/framebuffer.hpp"
 #include "../resources/texture.hpp"
 #include "../resources/viewport.hpp"
+#include "../utilities/file_watcher.hpp"
 #include "asset_manager.hpp"
+#include "command_line.hpp"
 #include "render_loop.hpp"
 #include "world.hpp"
 
 #include <algorithm>    // std::ranges::min_element, std::ranges::max_element
+#include <chrono>       // std::chrono
 #include <cstddef>      // std::size_t
 #include <cstdio>       // stderr
 #include <fmt/format.h> // fmt::format, fmt::print
 #include <imgui.h>      // ImGui
 #include <memory>       // std::shared_ptr
 #include <numeric>      // std::accumulate
-#include <span>         // std::span
 #include <stdexcept>    // std::exception
-#include <string>       // std::u8string
+#include <string>       // std::string, std::u8string
 #include <string_view>  // std::u8string_view
 
 class application final : public render_loop {
@@ -37,11 +40,40 @@ public:
 		.msaa_level = 4,
 	};
 
-	explicit application(std::span<char*> arguments)
-		: render_loop(arguments, options) {
+	// Time per frame that may be spent uploading assets that finished loading in the background.
+	static constexpr auto asset_upload_budget = std::chrono::milliseconds{4};
+
+	// Memory that assets which are no longer in the scene may keep using, so that adding them back does not load them again.
+	static constexpr auto retained_asset_cpu_size = std::size_t{256} << 20;
+	static constexpr auto retained_asset_gpu_size = std::size_t{512} << 20;
+
+	// Memory for the larger levels of model textures, which are streamed in as they are seen up close.
+	static constexpr auto streamed_texture_gpu_size = std::size_t{512} << 20;
+
+	explicit application(const command_line_options& arguments)
+		: render_loop(options)
+		, m_asset_manager(asset_manager_options{
+			  .compress_textures = arguments.compress_textures,
+			  .retained_cpu_size = retained_asset_cpu_size,
+			  .retained_gpu_size = retained_asset_gpu_size,
+			  .streamed_texture_gpu_size = streamed_texture_gpu_size,
+			  .release_model_cpu_data = arguments.release_model_cpu_data,
+		  })
+		, m_world(arguments.world, m_asset_manager)
+		, m_trace_output(arguments.trace_output) {
 		m_renderer.gui().enable();
+		m_renderer.model().stream_textures(m_asset_manager.streamed_textures());
+	}
+
+	~application() override {
+		save_trace();
 	}
 
+	application(const application&) = delete;
+	application(application&&) = delete;
+	auto operator=(const application&) -> application& = delete;
+	auto operator=(application&&) -> application& = delete;
+
 private:
 	auto resize(int width, int height) -> void override {
 		m_viewport = viewport{0, 0, width, height};
@@ -75,6 +107,10 @@ private:
 	}
 
 	auto update(float elapsed_time, float delta_time) -> void override {
+		reload_changed_files();
+		m_asset_manager.update(asset_upload_budget);
+		m_asset_manager.cleanup();
+		profiler::get().update();
 		m_world.update(elapsed_time, delta_time);
 		m_renderer.update();
 	}
@@ -120,6 +156,10 @@ private:
 					fmt::print(stderr, "Failed to reload shaders!\n");
 				}
 			}
+			ImGui::Text("Streamed textures: %zu/%zu MiB", m_asset_manager.streamed_textures().resident_size() >> 20, streamed_texture_gpu_size >> 20);
+			if (!m_trace_output.empty() && ImGui::Button("Save trace")) {
+				save_trace();
+			}
 			ImGui::End();
 
 			ImGui::Begin("Camera");
@@ -158,6 +198,49 @@ private:
 		}
 	}
 
+	[[nodiscard]] static auto watch_assets() -> file_watcher {
+		try {
+			return file_watcher{"assets"};
+		} catch (const std::exception& e) {
+			fmt::print(stderr, "Hot reloading is disabled: {}\n", e.what());
+		}
+		return file_watcher{};
+	}
+
+	// Rebuild whatever was loaded from the asset files that have been saved since the last update.
+	auto reload_changed_files() -> void {
+		const auto filenames = m_file_watcher.poll();
+		if (filenames.empty()) {
+			return;
+		}
+		m_asset_manager.reload_changed_assets(filenames);
+		try {
+			auto width = 0;
+			auto height = 0;
+			SDL_GetWindowSize(get_window(), &width, &height);
+			m_asset_manager.reload_changed_shaders(filenames);
+			m_renderer.reload_changed_shaders(filenames, width, height);
+		} catch (const std::exception& e) {
+			fmt::print(stderr, "Failed to reload shaders: {}\n", e.what());
+		} catch (...) {
+			fmt::print(stderr, "Failed to reload shaders!\n");
+		}
+	}
+
+	auto save_trace() noexcept -> void {
+		if (m_trace_output.empty()) {
+			return;
+		}
+		try {
+			profiler::get().save_chrome_trace(m_trace_output.c_str());
+			fmt::print(stderr, "Trace saved as \"{}\".\n", m_trace_output);
+		} catch (const std::exception& e) {
+			fmt::print(stderr, "Failed to save trace: {}\n", e.what());
+		} catch (...) {
+			fmt::print(stderr, "Failed to save trace!\n");
+		}
+	}
+
 	auto draw_fps_counter() -> void {
 		const auto fps = latest_measured_fps();
 		auto fps_color = vec4{0.0f, 1.0f, 0.0f, 1.0f};
@@ -175,18 +258,20 @@ private:
 			fps_color = vec4{1.0f, 1.0f, 1.0f, 1.0f};
 			fps_icon = u8"⏩";
 		}
-		m_renderer.text().draw_text(m_main_font, {2.0f, 27.0f}, {1.0f, 1.0f}, fps_color, fmt::format("     FPS: {}", fps));
-		m_renderer.text().draw_text(m_emoji_font, {2.0f, 27.0f}, {1.0f, 1.0f}, fps_color, std::u8string{fps_icon});
+		m_renderer.text().draw_text(*m_main_font, {2.0f, 27.0f}, {1.0f, 1.0f}, fps_color, fmt::format("     FPS: {}", fps));
+		m_renderer.text().draw_text(*m_emoji_font, {2.0f, 27.0f}, {1.0f, 1.0f}, fps_color, std::u8string{fps_icon});
 	}
 
-	asset_manager m_asset_manager{};
+	asset_manager m_asset_manager;
 	rendering_pipeline m_renderer{get_window(), get_gl_context()};
 	std::shared_ptr<font> m_main_font = m_asset_manager.load_font("assets/fonts/liberation/LiberationSans-Regular.ttf", 32u);
 	std::shared_ptr<font> m_emoji_font = m_asset_manager.load_font("assets/fonts/noto-emoji/NotoEmoji-Regular.ttf", 32u);
-	world m_world{"assets/worlds/world1", m_asset_manager};
+	world m_world;
+	std::string m_trace_output;
 	viewport m_viewport{};
 	camera m_camera{m_world.controller().position(), m_world.controller().forward(), m_world.controller().up(), camera_options{}};
 	float m_max_fps = options.max_fps;
+	file_watcher m_file_watcher = watch_assets();
 };
 
 #endif
@@ -2,187 +2,609 @@
 #define ASSET_MANAGER_HPP
 
 #include "../core/opengl.hpp"
+#include "../core/profiler.hpp"
 #include "../render/cubemap_generator.hpp"
+#include "../resources/asset_registry.hpp"
+#include "../resources/cooked_cubemap.hpp"
+#include "../resources/cooked_model.hpp"
+#include "../resources/cooked_texture.hpp"
 #include "../resources/cubemap.hpp"
 #include "../resources/font.hpp"
 #include "../resources/image.hpp"
 #include "../resources/model.hpp"
 #include "../resources/texture.hpp"
+#include "../resources/texture_streamer.hpp"
+#include "../utilities/string_interner.hpp"
+#include "../utilities/thread_pool.hpp"
 
-#include <fmt/format.h>  // fmt::format
-#include <memory>        // std::unique_ptr, std::shared_ptr, std::weak_ptr, std::make_shared
+#include <algorithm>     // std::ranges::all_of, std::ranges::find, std::ranges::sort
+#include <array>         // std::array
+#include <bit>           // std::bit_cast
+#include <chrono>        // std::chrono
+#include <cstddef>       // std::size_t
+#include <cstdint>       // std::uint8_t, std::uint32_t, std::uint64_t
+#include <cstdio>        // stderr
+#include <deque>         // std::deque
+#include <exception>     // std::exception
+#include <filesystem>    // std::filesystem::path
+#include <fmt/format.h>  // fmt::print
+#include <functional>    // std::function, std::ranges::greater
+#include <future>        // std::future, std::future_status
+#include <limits>        // std::numeric_limits
+#include <memory>        // std::shared_ptr, std::weak_ptr, std::make_shared
+#include <optional>      // std::optional
+#include <span>          // std::span
 #include <string>        // std::string
 #include <string_view>   // std::string_view
-#include <unordered_map> // std::unordered_map, std::erase_if
+#include <unordered_map> // std::erase_if
 #include <utility>       // std::move
+#include <vector>        // std::vector
+
+struct asset_manager_options final {
+	bool compress_textures = false;           // Block compress model textures, if the GPU supports it.
+	std::size_t retained_cpu_size = 0;         // Bytes of CPU memory that assets which are no longer used may keep alive in case they are loaded again.
+	std::size_t retained_gpu_size = 0;         // Bytes of GPU memory that assets which are no longer used may keep alive in case they are loaded again.
+	std::size_t streamed_texture_gpu_size = 0; // Bytes of GPU memory for model texture levels that are streamed in as they are seen up close. 0 uploads every level at load time.
+	bool release_model_cpu_data = false;       // Free the CPU copies of model geometry after upload. Lightmap generation reads them back from the GPU when needed.
+};
+
+// Approximate memory usage of an asset, used to keep retained assets within budget.
+struct asset_size final {
+	std::size_t cpu = 0;
+	std::size_t gpu = 0;
+};
 
 class asset_manager final {
 public:
+	explicit asset_manager(const asset_manager_options& options = {})
+		: m_texture_streamer(texture_streamer_options{.gpu_size = options.streamed_texture_gpu_size})
+		, m_retained_cpu_size(options.retained_cpu_size)
+		, m_retained_gpu_size(options.retained_gpu_size)
+		, m_compress_textures(options.compress_textures)
+		, m_release_model_cpu_data(options.release_model_cpu_data) {}
+
 	[[nodiscard]] auto load_font(const char* filename, unsigned int size) -> std::shared_ptr<font> {
-		const auto it = m_fonts.try_emplace(fmt::format("{}@{}", filename, size)).first;
-		if (auto ptr = it->second.lock()) {
-			return ptr;
-		}
-		auto ptr = std::make_shared<font>(m_font_library.get(), filename, size);
-		it->second = ptr;
-		return ptr;
+		return load(m_fonts, make_key(filename, {}, size), [&] {
+			const auto zone = profiler::gpu_zone("load_font", filename);
+			return font{m_font_library.get(), filename, size};
+		});
 	}
 
-	[[nodiscard]] auto load_image(std::string filename) -> std::shared_ptr<image> {
-		const auto it = m_images.try_emplace(std::move(filename)).first;
-		if (auto ptr = it->second.lock()) {
-			return ptr;
-		}
-		auto ptr = std::make_shared<image>(image::load(it->first.c_str()));
-		it->second = ptr;
-		return ptr;
+	[[nodiscard]] auto load_image(std::string_view filename) -> std::shared_ptr<image> {
+		const auto key = make_key(filename);
+		return load(m_images, key, [&] {
+			const auto zone = profiler::zone("decode_image", filename);
+			return image::load(m_names.get(key.name).c_str());
+		});
 	}
 
-	[[nodiscard]] auto load_image_hdr(std::string filename) -> std::shared_ptr<image> {
-		const auto it = m_images_hdr.try_emplace(std::move(filename)).first;
-		if (auto ptr = it->second.lock()) {
-			return ptr;
-		}
-		auto ptr = std::make_shared<image>(image::load_hdr(it->first.c_str()));
-		it->second = ptr;
-		return ptr;
+	[[nodiscard]] auto load_image_hdr(std::string_view filename) -> std::shared_ptr<image> {
+		const auto key = make_key(filename);
+		return load(m_images_hdr, key, [&] {
+			const auto zone = profiler::zone("decode_image", filename);
+			return image::load_hdr(m_names.get(key.name).c_str());
+		});
 	}
 
 	[[nodiscard]] auto load_cubemap(std::string_view filename_prefix, std::string_view extension) -> std::shared_ptr<cubemap_texture> {
-		const auto it = m_cubemaps.try_emplace(fmt::format("{}%{}", filename_prefix, extension)).first;
-		if (auto ptr = it->second.lock()) {
-			return ptr;
-		}
-		auto ptr = std::make_shared<cubemap_texture>(cubemap_texture::load(filename_prefix, extension));
-		it->second = ptr;
-		return ptr;
+		return load(m_cubemaps, make_key(filename_prefix, extension), [&] {
+			const auto zone = profiler::gpu_zone("load_cubemap", filename_prefix);
+			return cubemap_texture::load(filename_prefix, extension);
+		});
 	}
 
 	[[nodiscard]] auto load_cubemap_hdr(std::string_view filename_prefix, std::string_view extension) -> std::shared_ptr<cubemap_texture> {
-		const auto it = m_cubemaps_hdr.try_emplace(fmt::format("{}%{}", filename_prefix, extension)).first;
-		if (auto ptr = it->second.lock()) {
-			return ptr;
-		}
-		auto ptr = std::make_shared<cubemap_texture>(cubemap_texture::load_hdr(filename_prefix, extension));
-		it->second = ptr;
-		return ptr;
+		return load(m_cubemaps_hdr, make_key(filename_prefix, extension), [&] {
+			const auto zone = profiler::gpu_zone("load_cubemap", filename_prefix);
+			return cubemap_texture::load_hdr(filename_prefix, extension);
+		});
 	}
 
 	[[nodiscard]] auto load_cubemap_equirectangular(const char* filename, std::size_t resolution) -> std::shared_ptr<cubemap_texture> {
-		const auto it = m_cubemaps.try_emplace(fmt::format("{}@{}", filename, resolution)).first;
-		if (auto ptr = it->second.lock()) {
-			return ptr;
-		}
-		const auto img = image::load(filename, {.flip_vertically = true});
-		const auto internal_format = texture::internal_pixel_format_ldr(img.channel_count());
-		const auto format = texture::pixel_format(img.channel_count());
-		const auto equirectangular_texture = texture::create_2d(
-			internal_format, img.width(), img.height(), format, GL_UNSIGNED_BYTE, img.data(), cubemap_texture::equirectangular_options);
-		auto ptr = std::make_shared<cubemap_texture>(m_cubemap_generator.generate_cubemap_from_equirectangular_2d(internal_format, equirectangular_texture, resolution));
-		it->second = ptr;
-		return ptr;
+		return load(m_cubemaps_equirectangular, make_key(filename, {}, resolution), [&] {
+			const auto zone = profiler::gpu_zone("load_cubemap_equirectangular", filename);
+			const auto img = [&] {
+				const auto decode_zone = profiler::zone("decode_image", filename);
+				return image::load(filename, {.flip_vertically = true});
+			}();
+			const auto internal_format = texture::internal_pixel_format_ldr(img.channel_count());
+			const auto format = texture::pixel_format(img.channel_count());
+			const auto equirectangular_texture = texture::create_2d(
+				internal_format, img.width(), img.height(), format, GL_UNSIGNED_BYTE, img.data(), cubemap_texture::equirectangular_options);
+			return m_cubemap_generator.generate_cubemap_from_equirectangular_2d(internal_format, equirectangular_texture, resolution);
+		});
 	}
 
 	[[nodiscard]] auto load_cubemap_equirectangular_hdr(const char* filename, std::size_t resolution) -> std::shared_ptr<cubemap_texture> {
-		const auto it = m_cubemaps_hdr.try_emplace(fmt::format("{}@{}", filename, resolution)).first;
-		if (auto ptr = it->second.lock()) {
-			return ptr;
-		}
-		const auto img = image::load_hdr(filename, {.flip_vertically = true});
-		const auto internal_format = texture::internal_pixel_format_hdr(img.channel_count());
-		const auto format = texture::pixel_format(img.channel_count());
-		const auto equirectangular_texture = texture::create_2d(internal_format, img.width(), img.height(), format, GL_FLOAT, img.data(), cubemap_texture::equirectangular_options);
-		auto ptr = std::make_shared<cubemap_texture>(m_cubemap_generator.generate_cubemap_from_equirectangular_2d(internal_format, equirectangular_texture, resolution));
-		it->second = ptr;
-		return ptr;
+		return load(m_cubemaps_equirectangular_hdr, make_key(filename, {}, resolution), [&] {
+			const auto zone = profiler::gpu_zone("load_cubemap_equirectangular", filename);
+			const auto img = [&] {
+				const auto decode_zone = profiler::zone("decode_image", filename);
+				return image::load_hdr(filename, {.flip_vertically = true});
+			}();
+			return create_cubemap_equirectangular_hdr(img, resolution);
+		});
 	}
 
 	[[nodiscard]] auto load_environment_cubemap(std::string_view filename_prefix, std::string_view extension) -> std::shared_ptr<environment_cubemap> {
-		auto environment = load_cubemap(filename_prefix, extension);
-		auto irradiance = m_cubemap_generator.generate_irradiance_map(irradiance_map_internal_format, *environment, irradiance_map_resolution);
-		auto prefilter = m_cubemap_generator.generate_prefilter_map(prefilter_map_internal_format, *environment, prefilter_map_resolution, prefilter_map_mip_level_count);
-		return std::make_shared<environment_cubemap>(std::move(environment), std::move(irradiance), std::move(prefilter));
+		const auto source_filenames = cubemap_texture::get_face_filenames(filename_prefix, extension);
+		return std::make_shared<environment_cubemap>(create_environment_cubemap(load_cubemap(filename_prefix, extension), source_filenames));
 	}
 
 	[[nodiscard]] auto load_environment_cubemap_hdr(std::string_view filename_prefix, std::string_view extension) -> std::shared_ptr<environment_cubemap> {
-		auto environment = load_cubemap_hdr(filename_prefix, extension);
-		auto irradiance = m_cubemap_generator.generate_irradiance_map(irradiance_map_internal_format, *environment, irradiance_map_resolution);
-		auto prefilter = m_cubemap_generator.generate_prefilter_map(prefilter_map_internal_format, *environment, prefilter_map_resolution, prefilter_map_mip_level_count);
-		return std::make_shared<environment_cubemap>(std::move(environment), std::move(irradiance), std::move(prefilter));
+		const auto source_filenames = cubemap_texture::get_face_filenames(filename_prefix, extension);
+		return std::make_shared<environment_cubemap>(create_environment_cubemap(load_cubemap_hdr(filename_prefix, extension), source_filenames));
 	}
 
 	[[nodiscard]] auto load_environment_cubemap_equirectangular(const char* filename, std::size_t resolution) -> std::shared_ptr<environment_cubemap> {
-		auto environment = load_cubemap_equirectangular(filename, resolution);
-		auto irradiance = m_cubemap_generator.generate_irradiance_map(irradiance_map_internal_format, *environment, irradiance_map_resolution);
-		auto prefilter = m_cubemap_generator.generate_prefilter_map(prefilter_map_internal_format, *environment, prefilter_map_resolution, prefilter_map_mip_level_count);
-		return std::make_shared<environment_cubemap>(std::move(environment), std::move(irradiance), std::move(prefilter));
+		const auto source_filenames = std::array{std::string{filename}};
+		return std::make_shared<environment_cubemap>(create_environment_cubemap(load_cubemap_equirectangular(filename, resolution), source_filenames));
 	}
 
 	[[nodiscard]] auto load_environment_cubemap_equirectangular_hdr(const char* filename, std::size_t resolution) -> std::shared_ptr<environment_cubemap> {
-		auto environment = load_cubemap_equirectangular_hdr(filename, resolution);
-		auto irradiance = m_cubemap_generator.generate_irradiance_map(irradiance_map_internal_format, *environment, irradiance_map_resolution);
-		auto prefilter = m_cubemap_generator.generate_prefilter_map(prefilter_map_internal_format, *environment, prefilter_map_resolution, prefilter_map_mip_level_count);
-		return std::make_shared<environment_cubemap>(std::move(environment), std::move(irradiance), std::move(prefilter));
+		const auto source_filenames = std::array{std::string{filename}};
+		return std::make_shared<environment_cubemap>(create_environment_cubemap(load_cubemap_equirectangular_hdr(filename, resolution), source_filenames));
+	}
+
+	// Start loading an environment in the background. The returned environment is uniformly white until the load has been finished by update().
+	[[nodiscard]] auto load_environment_cubemap_equirectangular_hdr_async(std::string filename, std::size_t resolution) -> std::shared_ptr<environment_cubemap> {
+		auto result = std::make_shared<environment_cubemap>(environment_cubemap::create_default());
+		auto decoded_image = m_thread_pool.submit([filename] {
+			const auto zone = profiler::zone("decode_image", filename);
+			return std::make_shared<image>(image::load_hdr(filename.c_str(), {.flip_vertically = true}));
+		});
+		add_pending_load(filename,
+			std::move(decoded_image),
+			[this, key = make_key(filename, {}, resolution), resolution, environment = std::weak_ptr{result}](const std::shared_ptr<image>& decoded_image) {
+				if (const auto ptr = environment.lock()) {
+					auto cubemap = load(m_cubemaps_equirectangular_hdr, key, [&] {
+						return create_cubemap_equirectangular_hdr(*decoded_image, resolution);
+					});
+					const auto source_filenames = std::array{m_names.get(key.name)};
+					*ptr = create_environment_cubemap(std::move(cubemap), source_filenames);
+				}
+			});
+		return result;
 	}
 
-	[[nodiscard]] auto load_model(std::string filename, std::string_view textures_filename_prefix) -> std::shared_ptr<model> {
-		const auto it = m_models.try_emplace(std::move(filename)).first;
-		if (auto ptr = it->second.lock()) {
-			return ptr;
+	[[nodiscard]] auto load_model(std::string_view filename, std::string_view textures_filename_prefix) -> std::shared_ptr<model> {
+		const auto key = make_key(filename, textures_filename_prefix);
+		return load(m_models, key, [&] {
+			const auto zone = profiler::zone("load_model", filename);
+			auto data = cooked_model::import(m_names.get(key.name).c_str(), textures_filename_prefix);
+			auto textures = model::import_textures(data.texture_filenames, model::get_loaded_textures(m_model_texture_cache), m_thread_pool, m_compress_textures);
+			auto result = model::create(std::move(data), textures, m_model_texture_cache, m_compress_textures, &m_texture_streamer);
+			if (m_release_model_cpu_data) {
+				result.release_cpu_data();
+			}
+			return result;
+		});
+	}
+
+	// Start loading a model in the background. The returned model has no meshes until the load has been finished by update().
+	// Importing, texture decoding and mip generation run on the thread pool, while the GL uploads are left for the main thread.
+	[[nodiscard]] auto load_model_async(std::string_view filename, std::string_view textures_filename_prefix) -> std::shared_ptr<model> {
+		const auto key = make_key(filename, textures_filename_prefix);
+		if (const auto handle = m_models.find(key)) {
+			m_models.set_last_use(handle, ++m_use_time);
+			return m_models.share(handle);
 		}
-		auto ptr = std::make_shared<model>(model::load(it->first.c_str(), textures_filename_prefix, m_model_texture_cache));
-		it->second = ptr;
-		return ptr;
+		const auto handle = m_models.insert(key, std::make_shared<model>(model::create_empty()));
+		m_models.set_last_use(handle, ++m_use_time);
+		load_model_in_background(handle);
+		return m_models.share(handle);
+	}
+
+	// Finish background loads whose CPU work is done by uploading them on the calling thread, which must own the GL context, and stream model textures.
+	// Stops starting new uploads once the time budget has been used up, but always finishes at least one load if any is ready.
+	// Loads that fail are reported on stderr and keep their placeholder.
+	auto update(std::chrono::steady_clock::duration time_budget) -> void {
+		const auto start_time = std::chrono::steady_clock::now();
+		for (auto it = m_pending_loads.begin(); it != m_pending_loads.end();) {
+			if (!it->is_ready()) {
+				++it;
+				continue;
+			}
+			try {
+				const auto zone = profiler::gpu_zone("finish_load", it->name);
+				it->finish();
+			} catch (const std::exception& e) {
+				fmt::print(stderr, "Failed to load \"{}\": {}\n", it->name, e.what());
+			} catch (...) {
+				fmt::print(stderr, "Failed to load \"{}\"!\n", it->name);
+			}
+			it = m_pending_loads.erase(it);
+			if (std::chrono::steady_clock::now() - start_time >= time_budget) {
+				break;
+			}
+		}
+		m_texture_streamer.update();
+	}
+
+	// Block until every background load has finished. Errors are propagated to the caller.
+	auto wait() -> void {
+		while (!m_pending_loads.empty()) {
+			auto load = std::move(m_pending_loads.front());
+			m_pending_loads.pop_front();
+			const auto zone = profiler::gpu_zone("finish_load", load.name);
+			load.finish();
+		}
+	}
+
+	[[nodiscard]] auto pending_load_count() const noexcept -> std::size_t {
+		return m_pending_loads.size();
+	}
+
+	// Whether models free the CPU copies of their geometry once it has been uploaded. Code that reads them back must release them again when it is done.
+	[[nodiscard]] auto releases_model_cpu_data() const noexcept -> bool {
+		return m_release_model_cpu_data;
+	}
+
+	// While deferred, models that have finished loading in the background stay pending instead of replacing the model they were loaded for, so that code which
+	// holds on to their meshes, such as a lightmap bake, is not left with dangling pointers. They are swapped in by the first update() after that.
+	auto defer_model_swaps(bool defer) noexcept -> void {
+		m_defer_model_swaps = defer;
+	}
+
+	// Incremented every time a model is replaced by a load or a reload, so that data derived from the meshes of models can be rebuilt when it changes.
+	[[nodiscard]] auto model_swap_count() const noexcept -> std::uint64_t {
+		return m_model_swap_count;
 	}
 
-	auto clear() noexcept -> void {
+	// Renderers report how large model textures appear on screen to the streamer, which uploads the levels they need in update().
+	[[nodiscard]] auto streamed_textures() noexcept -> texture_streamer& {
+		return m_texture_streamer;
+	}
+
+	auto clear() -> void {
 		m_models.clear();
+		m_cubemaps_equirectangular_hdr.clear();
+		m_cubemaps_equirectangular.clear();
 		m_cubemaps_hdr.clear();
 		m_cubemaps.clear();
 		m_model_texture_cache.clear();
+		m_texture_streamer.clear();
 		m_images_hdr.clear();
 		m_images.clear();
 		m_fonts.clear();
 	}
 
+	// Release the least recently loaded assets that are no longer used until the rest fit within the retention budget.
 	auto cleanup() -> void {
-		static constexpr auto has_expired = [](const auto& kv) {
-			return kv.second.expired();
-		};
-		std::erase_if(m_models, has_expired);
-		std::erase_if(m_cubemaps_hdr, has_expired);
-		std::erase_if(m_cubemaps, has_expired);
-		std::erase_if(m_model_texture_cache, has_expired);
-		std::erase_if(m_images_hdr, has_expired);
-		std::erase_if(m_images, has_expired);
-		std::erase_if(m_fonts, has_expired);
+		m_unused_assets.clear();
+		collect_unused_assets(m_images, get_image_size<std::uint8_t>);
+		collect_unused_assets(m_images_hdr, get_image_size<float>);
+		collect_unused_assets(m_cubemaps, get_cubemap_size);
+		collect_unused_assets(m_cubemaps_hdr, get_cubemap_size);
+		collect_unused_assets(m_cubemaps_equirectangular, get_cubemap_size);
+		collect_unused_assets(m_cubemaps_equirectangular_hdr, get_cubemap_size);
+		collect_unused_assets(m_models, get_model_size);
+		std::ranges::sort(m_unused_assets, std::ranges::greater{}, &unused_asset::last_use);
+
+		// Use times are unique, so everything used at or before the first asset that does not fit is released.
+		auto release_time = std::uint64_t{0};
+		auto cpu_size = std::size_t{0};
+		auto gpu_size = std::size_t{0};
+		for (const auto& unused : m_unused_assets) {
+			if (cpu_size + unused.size.cpu > m_retained_cpu_size || gpu_size + unused.size.gpu > m_retained_gpu_size) {
+				release_time = unused.last_use;
+				break;
+			}
+			cpu_size += unused.size.cpu;
+			gpu_size += unused.size.gpu;
+		}
+		const auto model_count = m_models.size();
+		release_unused_assets(m_models, release_time);
+		if (m_models.size() != model_count) {
+			release_unused_model_textures();
+		}
+		release_unused_assets(m_cubemaps_equirectangular_hdr, release_time);
+		release_unused_assets(m_cubemaps_equirectangular, release_time);
+		release_unused_assets(m_cubemaps_hdr, release_time);
+		release_unused_assets(m_cubemaps, release_time);
+		release_unused_assets(m_images_hdr, release_time);
+		release_unused_assets(m_images, release_time);
+		release_unused_assets(m_fonts, std::numeric_limits<std::uint64_t>::max()); // Fonts are cheap to keep but are not counted, so they are never retained.
 	}
 
 	auto reload_shaders() -> void {
 		m_cubemap_generator.reload_shaders();
 	}
 
+	// Rebuild only the shader programs that include any of the given files. Filenames must be in generic, lexically normal form.
+	auto reload_changed_shaders(std::span<const std::string> filenames) -> void {
+		m_cubemap_generator.reload_changed_shaders(filenames);
+	}
+
+	// Reload the models and model textures that were imported from any of the given files in the background. They keep their current contents until the
+	// new ones have been uploaded by update(). Filenames must be in generic, lexically normal form.
+	auto reload_changed_assets(std::span<const std::string> filenames) -> void {
+		const auto changed = [&](std::string_view filename) {
+			return std::ranges::find(filenames, std::filesystem::path{filename}.lexically_normal().generic_string()) != filenames.end();
+		};
+		for (const auto& [filename, texture_ptr] : m_model_texture_cache) {
+			if (texture_ptr && changed(filename)) {
+				reload_model_texture(filename, texture_ptr);
+			}
+		}
+		auto changed_models = std::vector<asset_handle<model>>{};
+		m_models.for_each([&](asset_handle<model> handle, const model&) {
+			if (changed(m_names.get(m_models.key(handle).name))) {
+				changed_models.push_back(handle);
+			}
+		});
+		for (const auto handle : changed_models) {
+			load_model_in_background(handle);
+		}
+	}
+
+	// Memory kept alive by assets that are only held by the asset manager.
+	[[nodiscard]] auto retained_size() const -> asset_size {
+		auto result = asset_size{};
+		const auto add_unused_size = [&](const auto& registry, auto get_size) {
+			registry.for_each([&](auto handle, const auto& asset) {
+				if (!registry.is_shared(handle)) {
+					const auto size = get_size(asset);
+					result.cpu += size.cpu;
+					result.gpu += size.gpu;
+				}
+			});
+		};
+		add_unused_size(m_images, get_image_size<std::uint8_t>);
+		add_unused_size(m_images_hdr, get_image_size<float>);
+		add_unused_size(m_cubemaps, get_cubemap_size);
+		add_unused_size(m_cubemaps_hdr, get_cubemap_size);
+		add_unused_size(m_cubemaps_equirectangular, get_cubemap_size);
+		add_unused_size(m_cubemaps_equirectangular_hdr, get_cubemap_size);
+		add_unused_size(m_models, get_model_size);
+		return result;
+	}
+
 private:
+	struct unused_asset final {
+		std::uint64_t last_use;
+		asset_size size;
+	};
+
+	struct loaded_model final {
+		model_data data{};
+		std::vector<std::future<cooked_texture>> textures{};
+	};
+
+	struct pending_load final {
+		std::string name;
+		std::function<bool()> is_ready;
+		std::function<void()> finish; // Waits for the background work if necessary, then uploads the result.
+	};
+
+	template <typename T, typename Finish>
+	auto add_pending_load(std::string name, std::future<T> result, Finish finish) -> void {
+		add_pending_load(
+			std::move(name),
+			std::move(result),
+			[](const T&) {
+				return true;
+			},
+			std::move(finish));
+	}
+
+	// Like above, for results that start more background work of their own, which must also be done before the load is ready.
+	template <typename T, typename IsReady, typename Finish>
+	auto add_pending_load(std::string name, std::future<T> result, IsReady is_ready, Finish finish) -> void {
+		auto shared_result = result.share();
+		m_pending_loads.push_back(pending_load{
+			.name = std::move(name),
+			.is_ready =
+				[shared_result, is_ready = std::move(is_ready)] {
+					if (shared_result.wait_for(std::chrono::seconds{0}) != std::future_status::ready) {
+						return false;
+					}
+					try {
+						return is_ready(shared_result.get());
+					} catch (const std::exception&) {
+						return true; // The error is reported when finishing.
+					}
+				},
+			.finish =
+				[shared_result, finish = std::move(finish)] {
+					finish(shared_result.get());
+				},
+		});
+	}
+
+	// Import a model and the textures of it that are not already loaded on the thread pool, and replace the model with the given handle once update() has
+	// uploaded it. Models are keyed by their filename and texture filename prefix.
+	auto load_model_in_background(asset_handle<model> handle) -> void {
+		const auto key = m_models.key(handle);
+		const auto& name = m_names.get(key.name);
+
+		// Textures that are already loaded do not need to be imported again. The others are imported in parallel as soon as the model file has been read.
+		const auto compress_textures = m_compress_textures;
+		auto loaded = m_thread_pool.submit(
+			[this, filename = name, prefix = m_names.get(key.variant), loaded_textures = model::get_loaded_textures(m_model_texture_cache), compress_textures] {
+				const auto zone = profiler::zone("load_model", filename);
+				auto loaded = std::make_shared<loaded_model>();
+				loaded->data = cooked_model::import(filename.c_str(), prefix);
+				loaded->textures = model::import_textures(loaded->data.texture_filenames, loaded_textures, m_thread_pool, compress_textures);
+				return loaded;
+			});
+		add_pending_load(
+			name,
+			std::move(loaded),
+			[this](const std::shared_ptr<loaded_model>& loaded) {
+				return !m_defer_model_swaps && std::ranges::all_of(loaded->textures, [](const std::future<cooked_texture>& texture) {
+					return !texture.valid() || texture.wait_for(std::chrono::seconds{0}) == std::future_status::ready;
+				});
+			},
+			[this, handle](const std::shared_ptr<loaded_model>& loaded) {
+				if (auto* const ptr = m_models.get(handle)) {
+					*ptr = model::create(std::move(loaded->data), loaded->textures, m_model_texture_cache, m_compress_textures, &m_texture_streamer);
+					if (m_release_model_cpu_data) {
+						ptr->release_cpu_data();
+					}
+					++m_model_swap_count;
+					release_unused_model_textures();
+				}
+			});
+	}
+
+	auto reload_model_texture(const std::string& filename, std::shared_ptr<texture> ptr) -> void {
+		const auto compress_textures = m_compress_textures;
+		auto imported = m_thread_pool.submit([filename, compress_textures] {
+			return std::make_shared<cooked_texture>(model::import_texture(filename, compress_textures));
+		});
+		add_pending_load(filename, std::move(imported), [this, target = std::weak_ptr{ptr}](const std::shared_ptr<cooked_texture>& imported) {
+			if (const auto ptr = target.lock()) {
+				m_texture_streamer.reload(ptr, std::move(*imported), model::default_texture_options);
+			}
+		});
+	}
+
+	[[nodiscard]] auto make_key(std::string_view name, std::string_view variant = {}, std::uint64_t parameter = 0) -> asset_key {
+		return asset_key{.name = m_names.intern(name), .variant = m_names.intern(variant), .parameter = parameter};
+	}
+
+	// Get the asset with the given key, or create it from the result of create() if it is not loaded, and mark it as the most recently used one.
+	template <typename T, typename Create>
+	auto load(asset_registry<T>& registry, const asset_key& key, Create&& create) -> std::shared_ptr<T> {
+		auto handle = registry.find(key);
+		if (!handle) {
+			handle = registry.insert(key, std::make_shared<T>(create()));
+		}
+		registry.set_last_use(handle, ++m_use_time);
+		return registry.share(handle);
+	}
+
+	template <typename T, typename GetSize>
+	auto collect_unused_assets(const asset_registry<T>& registry, GetSize get_size) -> void {
+		registry.for_each([&](asset_handle<T> handle, const T& asset) {
+			if (!registry.is_shared(handle)) {
+				m_unused_assets.push_back(unused_asset{.last_use = registry.last_use(handle), .size = get_size(asset)});
+			}
+		});
+	}
+
+	// Model textures are only owned by the cache once the models that used them are gone.
+	auto release_unused_model_textures() -> void {
+		std::erase_if(m_model_texture_cache, [](const auto& kv) {
+			return !kv.second || kv.second.use_count() == 1;
+		});
+	}
+
+	template <typename T>
+	static auto release_unused_assets(asset_registry<T>& registry, std::uint64_t release_time) -> void {
+		registry.release_if([&](asset_handle<T> handle) {
+			return !registry.is_shared(handle) && registry.last_use(handle) <= release_time;
+		});
+	}
+
+	template <typename T>
+	[[nodiscard]] static auto get_image_size(const image& img) -> asset_size {
+		return asset_size{.cpu = img.width() * img.height() * img.channel_count() * sizeof(T)};
+	}
+
+	[[nodiscard]] static auto get_cubemap_size(const cubemap_texture& cubemap) -> asset_size {
+		const auto& tex = cubemap.get_texture();
+		return asset_size{.gpu = texture::level_size(tex.internal_format(), tex.width(), tex.height()) * 6};
+	}
+
+	// Textures shared with other models are counted in full, which errs on the side of releasing too much.
+	[[nodiscard]] static auto get_model_size(const model& m) -> asset_size {
+		auto result = asset_size{};
+		for (const auto& mesh : m.meshes()) {
+			result.cpu += mesh.cpu_size();
+			result.gpu += mesh.gpu_size();
+		}
+		for (const auto& tex : m.textures()) {
+			result.gpu += texture::level_size(tex->internal_format(), tex->width(), tex->height()) * 4 / 3; // Including the mip chain.
+		}
+		return result;
+	}
+
+	[[nodiscard]] auto create_cubemap_equirectangular_hdr(const image& img, std::size_t resolution) -> cubemap_texture {
+		const auto internal_format = texture::internal_pixel_format_hdr(img.channel_count());
+		const auto format = texture::pixel_format(img.channel_count());
+		const auto equirectangular_texture = texture::create_2d(internal_format, img.width(), img.height(), format, GL_FLOAT, img.data(), cubemap_texture::equirectangular_options);
+		return m_cubemap_generator.generate_cubemap_from_equirectangular_2d(internal_format, equirectangular_texture, resolution);
+	}
+
+	// The irradiance and prefilter maps are cached next to the first source file, keyed by the sources, the generator shaders and every generator parameter.
+	[[nodiscard]] auto create_environment_cubemap(std::shared_ptr<cubemap_texture> environment, std::span<const std::string> source_filenames) -> environment_cubemap {
+		const auto zone = profiler::gpu_zone("create_environment_cubemap", source_filenames.front());
+		const auto irradiance_filename = cooked_cubemap::get_filename(source_filenames.front(), "irradiance");
+		const auto prefilter_filename = cooked_cubemap::get_filename(source_filenames.front(), "prefilter");
+		const auto key = get_environment_cubemap_key(environment->get_texture(), source_filenames);
+		if (key) {
+			try {
+				auto irradiance = cooked_cubemap::load(irradiance_filename.c_str(), *key).upload(cubemap_generator::irradiance_map_options);
+				auto prefilter = cooked_cubemap::load(prefilter_filename.c_str(), *key).upload(cubemap_generator::prefilter_map_options);
+				return environment_cubemap{std::move(environment), std::move(irradiance), std::move(prefilter)};
+			} catch (const cooked_cubemap_error&) {
+				// Missing, stale or written by an older version. Generate them again below.
+			} catch (const mapped_file_error&) {
+			}
+		}
+		auto irradiance = m_cubemap_generator.generate_irradiance_map(irradiance_map_internal_format, *environment, irradiance_map_resolution);
+		auto prefilter = m_cubemap_generator.generate_prefilter_map(prefilter_map_internal_format, *environment, prefilter_map_resolution, prefilter_map_mip_level_count);
+		if (key) {
+			try {
+				cooked_cubemap::download(irradiance, 1).save(irradiance_filename.c_str(), *key);
+				cooked_cubemap::download(prefilter, prefilter_map_mip_level_count).save(prefilter_filename.c_str(), *key);
+			} catch (const std::exception& e) {
+				fmt::print(stderr, "Failed to cook environment \"{}\": {}\n", source_filenames.front(), e.what());
+			}
+		}
+		return environment_cubemap{std::move(environment), std::move(irradiance), std::move(prefilter)};
+	}
+
+	[[nodiscard]] static auto get_environment_cubemap_key(const texture& environment, std::span<const std::string> source_filenames) -> std::optional<std::uint64_t> {
+		auto filenames = std::vector<std::string>(source_filenames.begin(), source_filenames.end());
+		filenames.emplace_back(cubemap_generator::vertex_shader_filename);
+		filenames.emplace_back(cubemap_generator::irradiance_fragment_shader_filename);
+		filenames.emplace_back(cubemap_generator::prefilter_fragment_shader_filename);
+		return cooked_cubemap::get_key(filenames,
+			std::array{
+				std::uint64_t{environment.width()},
+				static_cast<std::uint64_t>(environment.internal_format()),
+				std::uint64_t{std::bit_cast<std::uint32_t>(cubemap_generator::irradiance_sample_delta_angle)},
+				std::uint64_t{cubemap_generator::prefilter_sample_count},
+				static_cast<std::uint64_t>(irradiance_map_internal_format),
+				std::uint64_t{irradiance_map_resolution},
+				static_cast<std::uint64_t>(prefilter_map_internal_format),
+				std::uint64_t{prefilter_map_resolution},
+				std::uint64_t{prefilter_map_mip_level_count},
+			});
+	}
+
 	static constexpr auto irradiance_map_internal_format = GLint{GL_RGB16F};
 	static constexpr auto irradiance_map_resolution = std::size_t{32};
 	static constexpr auto prefilter_map_internal_format = GLint{GL_RGB16F};
 	static constexpr auto prefilter_map_resolution = std::size_t{128};
 	static constexpr auto prefilter_map_mip_level_count = std::size_t{5};
 
-	using font_cache = std::unordered_map<std::string, std::weak_ptr<font>>;
-	using image_cache = std::unordered_map<std::string, std::weak_ptr<image>>;
-	using cubemap_cache = std::unordered_map<std::string, std::weak_ptr<cubemap_texture>>;
-	using model_cache = std::unordered_map<std::string, std::weak_ptr<model>>;
-
 	font_library m_font_library{};
 	cubemap_generator m_cubemap_generator{};
-	font_cache m_fonts{};
-	image_cache m_images{};
-	image_cache m_images_hdr{};
+	string_interner m_names{};
+	asset_registry<font> m_fonts{};
+	asset_registry<image> m_images{};
+	asset_registry<image> m_images_hdr{};
 	model_texture_cache m_model_texture_cache{};
-	cubemap_cache m_cubemaps{};
-	cubemap_cache m_cubemaps_hdr{};
-	model_cache m_models{};
+	texture_streamer m_texture_streamer;
+	asset_registry<cubemap_texture> m_cubemaps{};
+	asset_registry<cubemap_texture> m_cubemaps_hdr{};
+	asset_registry<cubemap_texture> m_cubemaps_equirectangular{};
+	asset_registry<cubemap_texture> m_cubemaps_equirectangular_hdr{};
+	asset_registry<model> m_models{};
+	std::vector<unused_asset> m_unused_assets{}; // Reused by cleanup() to avoid allocating every frame.
+	std::uint64_t m_use_time = 0;
+	std::size_t m_retained_cpu_size;
+	std::size_t m_retained_gpu_size;
+	std::deque<pending_load> m_pending_loads{};
+	bool m_compress_textures;
+	bool m_release_model_cpu_data;
+	bool m_defer_model_swaps = false;
+	std::uint64_t m_model_swap_count = 0;
+	thread_pool m_thread_pool{}; // Declared last so that the workers are stopped before anything they might refer to is destroyed.
 };
 
 #endif
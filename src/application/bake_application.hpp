@@ -0,0 +1,124 @@
+#ifndef BAKE_APPLICATION_HPP
+#define BAKE_APPLICATION_HPP
+
+#include "../core/opengl.hpp"
+#include "../core/profiler.hpp"
+#include "../render/lightmap_bake_telemetry.hpp"
+#include "asset_manager.hpp"
+#include "command_line.hpp"
+#include "render_loop.hpp"
+#include "world.hpp"
+
+#include <SDL.h>        // SDL_Event
+#include <chrono>       // std::chrono
+#include <cstdio>       // stdout, stderr
+#include <fmt/format.h> // fmt::print
+#include <string>       // std::string
+#include <utility>      // std::move
+
+// Bakes the lightmap of a world in a hidden window and saves it, for batch bakes from the command line.
+// On machines without a display, SDL can be told to use its offscreen video driver by setting SDL_VIDEODRIVER=offscreen.
+class bake_application final : public render_loop {
+public:
+	static constexpr auto options = render_loop_options{
+		.window_title = "TSBK03 Lightmap Baker",
+		.window_width = 64,
+		.window_height = 64,
+		.window_resizable = false,
+		.window_hidden = true,
+		.tick_rate = 60,
+		.min_fps = 10,
+		.max_fps = 0,
+		.v_sync = false,
+		.msaa_level = 0,
+	};
+
+	explicit bake_application(command_line_options arguments)
+		: render_loop(options)
+		, m_arguments(std::move(arguments)) {}
+
+	auto bake() -> void {
+		using clock = std::chrono::steady_clock;
+		const auto seconds = [](clock::duration duration) {
+			return std::chrono::duration<double>{duration}.count();
+		};
+
+		const auto start_time = clock::now();
+		auto assets = asset_manager{asset_manager_options{
+			.compress_textures = m_arguments.compress_textures,
+			.release_model_cpu_data = m_arguments.release_model_cpu_data,
+		}};
+		auto baked_world = world{m_arguments.world, assets};
+		assets.wait();
+		const auto bounce_count = m_arguments.bounce_count.value_or(world::default_lightmap_bounce_count);
+		const auto output = (m_arguments.output.empty()) ? baked_world.get_lightmap_filename() : m_arguments.output;
+		const auto load_time = clock::now();
+
+		auto telemetry = lightmap_bake_telemetry{};
+		fmt::print(stderr, "Generating lightmap coordinates...\n");
+		const auto resolution = m_arguments.resolution.value_or(baked_world.generate_lightmap_coordinates(m_arguments.texels_per_unit, telemetry));
+		const auto coordinates_time = clock::now();
+
+		fmt::print(stderr, "\nBaking {}x{} lightmap with {} bounce(s)...\n", resolution, resolution, bounce_count);
+		baked_world.bake_lightmap(
+			lightmap_bake_options{
+				.resolution = resolution,
+				.bounce_count = bounce_count,
+				.encoding = m_arguments.encoding,
+				.hemisphere_size = static_cast<int>(m_arguments.hemisphere_size),
+				.denoise = m_arguments.denoise,
+			},
+			telemetry);
+		glFinish();
+		const auto bake_time = clock::now();
+
+		baked_world.write_lightmap(output.c_str());
+		const auto save_time = clock::now();
+
+		fmt::print(stderr, "\nLightmap saved as \"{}\".\n", output);
+		fmt::print(stderr, "  Objects:     {}\n", baked_world.get_scene().objects.size());
+		fmt::print(stderr, "  Load:        {:.3f} s\n", seconds(load_time - start_time));
+		fmt::print(stderr, "  Coordinates: {:.3f} s\n", seconds(coordinates_time - load_time));
+		fmt::print(stderr, "  Bake:        {:.3f} s\n", seconds(bake_time - coordinates_time));
+		fmt::print(stderr, "  Save:        {:.3f} s\n", seconds(save_time - bake_time));
+		fmt::print(stderr, "  Total:       {:.3f} s\n", seconds(save_time - start_time));
+
+		if (m_arguments.telemetry_output.empty()) {
+			fmt::print(stdout, "{}", telemetry.to_json());
+		} else {
+			telemetry.save_json(m_arguments.telemetry_output.c_str());
+			fmt::print(stderr, "Telemetry saved as \"{}\".\n", m_arguments.telemetry_output);
+		}
+
+		if (!m_arguments.trace_output.empty()) {
+			profiler::get().save_chrome_trace(m_arguments.trace_output.c_str());
+			fmt::print(stderr, "Trace saved as \"{}\".\n", m_arguments.trace_output);
+		}
+	}
+
+private:
+	auto resize(int width, int height) -> void override {
+		(void)width;
+		(void)height;
+	}
+
+	auto handle_event(const SDL_Event& e) -> void override {
+		(void)e;
+	}
+
+	auto tick(unsigned int tick_count, float delta_time) -> void override {
+		(void)tick_count;
+		(void)delta_time;
+	}
+
+	auto update(float elapsed_time, float delta_time) -> void override {
+		(void)elapsed_time;
+		(void)delta_time;
+	}
+
+	auto display() -> void override {}
+
+	command_line_options m_arguments;
+};
+
+#endif
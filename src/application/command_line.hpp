@@ -0,0 +1,151 @@
+#ifndef COMMAND_LINE_HPP
+#define COMMAND_LINE_HPP
+
+#include "../resources/lightmap_encoder.hpp"
+
+#include <bit>          // std::has_single_bit
+#include <charconv>     // std::from_chars
+#include <cstddef>      // std::size_t
+#include <fmt/format.h> // fmt::format
+#include <optional>     // std::optional
+#include <span>         // std::span
+#include <stdexcept>    // std::runtime_error
+#include <string>       // std::string
+#include <string_view>  // std::string_view
+#include <system_error> // std::errc
+
+struct command_line_error : std::runtime_error {
+	explicit command_line_error(const auto& message)
+		: std::runtime_error(message) {}
+};
+
+struct command_line_options final {
+	std::string world = "assets/worlds/world1";
+	std::string output{};
+	std::string telemetry_output{};
+	std::string trace_output{};
+	std::optional<std::size_t> resolution{};
+	float texels_per_unit = 8.0f;
+	std::optional<std::size_t> bounce_count{};
+	lightmap_encoding encoding = lightmap_encoding::bc6h;
+	std::size_t hemisphere_size = 64;
+	bool denoise = false;
+	bool compress_textures = false;
+	bool release_model_cpu_data = false;
+	bool bake = false;
+	bool help = false;
+};
+
+class command_line final {
+public:
+	static constexpr auto usage = std::string_view{
+		"Usage: tsbk03 [options]\n"
+		"\n"
+		"Options:\n"
+		"  --world <directory>      World to load (default: assets/worlds/world1).\n"
+		"  --bake <directory>       Bake the lightmap of a world without showing a window, save it and exit.\n"
+		"  --out <file>             Where to save the baked lightmap (default: <world>/lightmap.bin).\n"
+		"  --telemetry <file>       Where to save the bake telemetry as JSON (default: print it to stdout).\n"
+		"  --resolution <texels>    Lightmap resolution when baking (default: chosen from the texel density).\n"
+		"  --texels-per-unit <n>    Lightmap texel density in texels per world unit when baking (default: 8).\n"
+		"  --bounces <count>        Number of light bounces when baking.\n"
+		"  --encoding <encoding>    Lightmap encoding when baking: rgba16f, rgb9e5, rgbm or bc6h (default: bc6h).\n"
+		"  --hemisphere-size <n>    Hemisphere resolution when baking: 16, 32, 64 or 128 (default: 64).\n"
+		"  --denoise                Denoise the lightmap when baking, so that smaller hemispheres can be used.\n"
+		"  --compress-textures      Block compress model textures (BC1/BC3/BC4/BC5) to save video memory.\n"
+		"  --release-mesh-data      Free the CPU copies of model geometry after upload, and read them back when baking.\n"
+		"  --trace <file>           Record where loading time goes and save it as a Chrome trace on exit.\n"
+		"  --help                   Show this message.\n"};
+
+	[[nodiscard]] static auto parse(std::span<char* const> arguments) -> command_line_options {
+		auto result = command_line_options{};
+		for (auto i = std::size_t{1}; i < arguments.size(); ++i) {
+			const auto argument = std::string_view{arguments[i]};
+			const auto value = [&]() -> std::string_view {
+				if (i + 1 >= arguments.size()) {
+					throw command_line_error{fmt::format("Missing value for \"{}\"!", argument)};
+				}
+				return arguments[++i];
+			};
+			if (argument == "--help" || argument == "-h") {
+				result.help = true;
+			} else if (argument == "--world") {
+				result.world = value();
+			} else if (argument == "--bake") {
+				result.world = value();
+				result.bake = true;
+			} else if (argument == "--out") {
+				result.output = value();
+			} else if (argument == "--telemetry") {
+				result.telemetry_output = value();
+			} else if (argument == "--resolution") {
+				result.resolution = parse_size(argument, value(), 1, 16384);
+			} else if (argument == "--texels-per-unit") {
+				result.texels_per_unit = parse_float(argument, value(), 0.01f, 1024.0f);
+			} else if (argument == "--bounces") {
+				result.bounce_count = parse_size(argument, value(), 1, 64);
+			} else if (argument == "--encoding") {
+				result.encoding = parse_encoding(value());
+			} else if (argument == "--hemisphere-size") {
+				result.hemisphere_size = parse_size(argument, value(), 16, 128);
+				if (!std::has_single_bit(result.hemisphere_size)) {
+					throw command_line_error{fmt::format("Invalid value \"{}\" for \"{}\" (expected a power of two)!", result.hemisphere_size, argument)};
+				}
+			} else if (argument == "--denoise") {
+				result.denoise = true;
+			} else if (argument == "--compress-textures") {
+				result.compress_textures = true;
+			} else if (argument == "--release-mesh-data") {
+				result.release_model_cpu_data = true;
+			} else if (argument == "--trace") {
+				result.trace_output = value();
+			} else {
+				throw command_line_error{fmt::format("Unknown option \"{}\"! Use --help to list the available options.", argument)};
+			}
+		}
+		if (!result.output.empty() && !result.bake) {
+			throw command_line_error{"--out can only be used together with --bake!"};
+		}
+		if (!result.telemetry_output.empty() && !result.bake) {
+			throw command_line_error{"--telemetry can only be used together with --bake!"};
+		}
+		return result;
+	}
+
+private:
+	[[nodiscard]] static auto parse_size(std::string_view option, std::string_view value, std::size_t min, std::size_t max) -> std::size_t {
+		auto result = std::size_t{};
+		const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+		if (error != std::errc{} || end != value.data() + value.size() || result < min || result > max) {
+			throw command_line_error{fmt::format("Invalid value \"{}\" for \"{}\" (expected an integer between {} and {})!", value, option, min, max)};
+		}
+		return result;
+	}
+
+	[[nodiscard]] static auto parse_float(std::string_view option, std::string_view value, float min, float max) -> float {
+		auto result = 0.0f;
+		const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+		if (error != std::errc{} || end != value.data() + value.size() || !(result >= min && result <= max)) {
+			throw command_line_error{fmt::format("Invalid value \"{}\" for \"{}\" (expected a number between {} and {})!", value, option, min, max)};
+		}
+		return result;
+	}
+
+	[[nodiscard]] static auto parse_encoding(std::string_view value) -> lightmap_encoding {
+		if (value == "rgba16f") {
+			return lightmap_encoding::rgba16f;
+		}
+		if (value == "rgb9e5") {
+			return lightmap_encoding::rgb9e5;
+		}
+		if (value == "rgbm") {
+			return lightmap_encoding::rgbm;
+		}
+		if (value == "bc6h") {
+			return lightmap_encoding::bc6h;
+		}
+		throw command_line_error{fmt::format("Unknown lightmap encoding \"{}\"!", value)};
+	}
+};
+
+#endif
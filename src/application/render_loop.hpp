@@ -24,6 +24,7 @@ struct render_loop_options final {
 	int window_width = 1280;
 	int window_height = 720;
 	bool window_resizable = true;
+	bool window_hidden = false;
 	float tick_rate = 60;
 	float min_fps = 10;
 	float max_fps = 240;
@@ -33,15 +34,13 @@ struct render_loop_options final {
 
 class render_loop {
 public:
-	render_loop(std::span<char*> arguments, const render_loop_options& options)
+	explicit render_loop(const render_loop_options& options)
 		: m_clock_frequency(SDL_GetPerformanceFrequency())
 		, m_clock_interval(1.0f / static_cast<float>(m_clock_frequency))
 		, m_tick_interval(static_cast<Uint64>(std::ceil(static_cast<float>(m_clock_frequency) / options.tick_rate)))
 		, m_tick_delta_time(static_cast<float>(m_tick_interval) * m_clock_interval)
 		, m_min_frame_interval((options.max_fps == 0.0f) ? Uint64{0} : static_cast<Uint64>(std::ceil(static_cast<float>(m_clock_frequency) / options.max_fps)))
 		, m_max_ticks_per_frame((options.tick_rate <= options.min_fps) ? Uint64{1} : static_cast<Uint64>(options.tick_rate / options.min_fps)) {
-		(void)arguments; // TODO
-
 		constexpr auto set_attribute = [](SDL_GLattr attr, int value) -> void {
 			if (SDL_GL_SetAttribute(attr, value) != 0) {
 				throw std::runtime_error{fmt::format("Failed to set OpenGL attribute: {}", SDL_GetError())};
@@ -60,7 +59,8 @@ public:
 		set_attribute(SDL_GL_MULTISAMPLEBUFFERS, options.msaa_level > 0);
 		set_attribute(SDL_GL_MULTISAMPLESAMPLES, options.msaa_level);
 
-		auto window_flags = Uint32{SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN};
+		auto window_flags = Uint32{SDL_WINDOW_OPENGL};
+		window_flags |= (options.window_hidden) ? SDL_WINDOW_HIDDEN : SDL_WINDOW_SHOWN;
 		if (options.window_resizable) {
 			window_flags |= SDL_WINDOW_RESIZABLE;
 		}
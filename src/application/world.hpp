@@ -2,8 +2,11 @@
 #define WORLD_HPP
 
 #include "../core/glsl.hpp"
+#include "../render/lightmap_bake_telemetry.hpp"
+#include "../render/lightmap_baker.hpp"
 #include "../render/lightmap_generator.hpp"
 #include "../render/rendering_pipeline.hpp"
+#include "../resources/baked_lighting.hpp"
 #include "../resources/camera.hpp"
 #include "../resources/image.hpp"
 #include "../resources/lightmap.hpp"
@@ -13,26 +16,40 @@
 #include "flight_controller.hpp"
 
 #include <SDL.h>                        // SDL_...
+#include <algorithm>                    // std::clamp
 #include <chrono>                       // std::chrono
+#include <cmath>                        // std::round
 #include <cstddef>                      // std::size_t, std::ptrdiff_t
+#include <cstdint>                      // std::uint64_t
 #include <cstdio>                       // stderr
+#include <filesystem>                   // std::filesystem::exists
 #include <fmt/format.h>                 // fmt::format, fmt::print
 #include <glm/gtc/matrix_transform.hpp> // glm::translate, glm::scale
 #include <glm/gtc/type_ptr.hpp>         // glm::value_ptr
 #include <imgui.h>                      // ImGui
-#include <memory>                       // std::shared_ptr, std::make_shared
+#include <memory>                       // std::shared_ptr, std::make_shared, std::unique_ptr, std::make_unique
+#include <span>                         // std::span, std::as_bytes
+#include <sstream>                      // std::ostringstream
 #include <stdexcept>                    // std::exception
 #include <string>                       // std::string
-#include <string_view>                  // std::string_view
+#include <system_error>                 // std::error_code
+#include <utility>                      // std::move
+#include <vector>                       // std::vector
 
 class world final {
 public:
+	static constexpr auto default_lightmap_texels_per_unit = 8.0f;
+	static constexpr auto min_lightmap_resolution = std::size_t{64};
+	static constexpr auto max_lightmap_resolution = std::size_t{4096};
+	static constexpr auto default_lightmap_bounce_count = std::size_t{1};
+
 	world(std::string filename, asset_manager& asset_manager)
 		: m_filename(std::move(filename))
-		, m_point_light_model(asset_manager.load_model("assets/models/point_light.obj", "assets/textures/"))
-		, m_spot_light_model(asset_manager.load_model("assets/models/spot_light.obj", "assets/textures/"))
+		, m_asset_manager(asset_manager)
+		, m_point_light_model(asset_manager.load_model_async("assets/models/point_light.obj", "assets/textures/"))
+		, m_spot_light_model(asset_manager.load_model_async("assets/models/spot_light.obj", "assets/textures/"))
 		, m_scene{
-			  .sky = asset_manager.load_environment_cubemap_equirectangular_hdr("assets/textures/studio_country_hall_1k_dark.hdr", 512),
+			  .sky = asset_manager.load_environment_cubemap_equirectangular_hdr_async("assets/textures/studio_country_hall_1k_dark.hdr", 512),
 			  .directional_lights =
 				  {
 					  std::make_shared<directional_light>(directional_light_options{}),
@@ -57,45 +74,70 @@ public:
 			  .objects =
 				  {
 					  scene_object{scene_object_options{
-						  .model_ptr = asset_manager.load_model("assets/models/sponza/sponza.obj", "assets/textures/"),
+						  .model_ptr = asset_manager.load_model_async("assets/models/sponza/sponza.obj", "assets/textures/"),
 						  .position = vec3{0.0f, -3.0f, 0.0f},
 						  .scale = vec3{0.0254f},
 					  }},
 					  scene_object{scene_object_options{
-						  .model_ptr = asset_manager.load_model("assets/models/alarm_clock_01_1k.obj", "assets/textures/"),
+						  .model_ptr = asset_manager.load_model_async("assets/models/alarm_clock_01_1k.obj", "assets/textures/"),
 						  .position = vec3{2.0f, 0.0f, -3.0f},
 						  .scale = vec3{15.0f},
 					  }},
 					  scene_object{scene_object_options{
-						  .model_ptr = asset_manager.load_model("assets/models/suzanne.obj", "assets/textures/"),
+						  .model_ptr = asset_manager.load_model_async("assets/models/suzanne.obj", "assets/textures/"),
 						  .position = vec3{0.0f, 0.0f, 0.0f},
 						  .scale = vec3{1.0f},
 					  }},
 					  scene_object{scene_object_options{
-						  .model_ptr = asset_manager.load_model("assets/models/tea_set_01_1k.obj", "assets/textures/"),
+						  .model_ptr = asset_manager.load_model_async("assets/models/tea_set_01_1k.obj", "assets/textures/"),
 						  .position = vec3{4.0f, -1.0f, 0.0f},
 						  .scale = vec3{10.0f},
 					  }},
 					  scene_object{scene_object_options{
-						  .model_ptr = asset_manager.load_model("assets/models/brass_vase_01_1k.obj", "assets/textures/"),
+						  .model_ptr = asset_manager.load_model_async("assets/models/brass_vase_01_1k.obj", "assets/textures/"),
 						  .position = vec3{-3.0f, -1.0f, -2.0f},
 						  .scale = vec3{6.0f},
 					  }},
 					  scene_object{scene_object_options{
-						  .model_ptr = asset_manager.load_model("assets/models/Chandelier_03_1k.obj", "assets/textures/"),
+						  .model_ptr = asset_manager.load_model_async("assets/models/Chandelier_03_1k.obj", "assets/textures/"),
 						  .position = vec3{5.0f, 20.0f, -1.0f},
 						  .scale = vec3{6.0f},
 					  }},
 					  scene_object{scene_object_options{
-						  .model_ptr = asset_manager.load_model("assets/models/Chandelier_03_1k.obj", "assets/textures/"),
+						  .model_ptr = asset_manager.load_model_async("assets/models/Chandelier_03_1k.obj", "assets/textures/"),
 						  .position = vec3{-5.0f, 20.0f, -1.0f},
 						  .scale = vec3{6.0f},
 					  }},
 				  },
 		  } {
+		// Drawn with the default lightmap until the saved one can be applied to the loaded models.
 		lightmap_generator::reset_lightmap(m_scene);
 	}
 
+	[[nodiscard]] auto get_lightmap_filename() const -> std::string {
+		return fmt::format("{}/lightmap.bin", m_filename);
+	}
+
+	// Generate new lightmap coordinates for the scene and return the lightmap resolution that matches the texel density. Errors are propagated to the caller.
+	auto generate_lightmap_coordinates(float texels_per_unit, lightmap_bake_telemetry& telemetry) -> std::size_t {
+		const auto resolution = lightmap_generator::generate_lightmap_coordinates(m_scene, texels_per_unit, telemetry, lightmap_generator::progress_printer{});
+		return std::clamp(resolution, min_lightmap_resolution, max_lightmap_resolution);
+	}
+
+	// Bake the lightmap to completion without drawing anything. Errors are propagated to the caller.
+	auto bake_lightmap(lightmap_bake_options options, lightmap_bake_telemetry& telemetry) -> void {
+		options.sky_color = sky_color;
+		lightmap_generator::bake_lightmap(m_scene, options, telemetry, lightmap_generator::progress_printer{});
+	}
+
+	auto write_lightmap(const char* filename) const -> void {
+		baked_lighting::save(m_scene, filename);
+	}
+
+	[[nodiscard]] auto get_scene() const noexcept -> const scene& {
+		return m_scene;
+	}
+
 	auto handle_event(const SDL_Event& e) -> void {
 		m_controller.handle_event(e, mouse_sensitivity);
 	}
@@ -108,24 +150,63 @@ public:
 	auto update(float elapsed_time, float delta_time) -> void {
 		(void)elapsed_time;
 		m_controller.update(delta_time, move_acceleration, move_drag, yaw_speed, pitch_speed);
+
+		// The saved lightmap refers to the vertices of the loaded models, so it can only be applied once they are all in place, and must be applied again to
+		// models that have been reloaded since, or after a bake that did not finish. Until it is saved, the last finished bake is applied instead. Models are not
+		// swapped while a bake refers to their meshes.
+		update_lightmap_bake();
+		m_asset_manager.defer_model_swaps(m_lightmap_baker != nullptr);
+		if (m_model_swap_count != m_asset_manager.model_swap_count()) {
+			m_model_swap_count = m_asset_manager.model_swap_count();
+			m_lightmap_loaded = false;
+		}
+		if (!m_lightmap_loaded && m_asset_manager.pending_load_count() == 0) {
+			m_lightmap_loaded = true;
+			load_lightmap();
+		}
 	}
 
 	auto draw(rendering_pipeline& renderer) -> void {
 		if (renderer.gui().enabled()) {
 			ImGui::Begin("Lightmap");
-			if (ImGui::Button("Save lightmap")) {
-				save_lightmap();
+			if (!m_lightmap_loaded) {
+				ImGui::Text("Loading assets (%zu remaining)...", m_asset_manager.pending_load_count());
+			} else if (m_lightmap_baker) {
+				ImGui::Text("Bounce %zu/%zu", m_lightmap_baker->bounce_index() + 1, m_lightmap_baker->bounce_count());
+				ImGui::Text("Object %zu/%zu", m_lightmap_baker->object_index() + 1, m_lightmap_baker->object_count());
+				ImGui::ProgressBar(m_lightmap_baker->progress());
+				if (ImGui::Button("Cancel bake")) {
+					m_lightmap_baker.reset();
+					release_model_cpu_data();
+					m_lightmap_loaded = false; // The bake replaced the lightmap coordinates and placements of the saved lightmap.
+					fmt::print(stderr, "Baking lightmap: Cancelled!\n");
+				}
+			} else {
+				if (ImGui::Button("Save lightmap")) {
+					save_lightmap();
+				}
+				if (ImGui::Button("Bake lightmap")) {
+					start_lightmap_bake();
+				}
+				ImGui::SliderFloat("Texels per unit", &m_lightmap_texels_per_unit, 1.0f, 64.0f);
+				ImGui::Combo("Encoding", &m_lightmap_encoding, "RGBA16F\0RGB9E5\0RGBM\0BC6H\0");
+				ImGui::Combo("Hemisphere size", &m_lightmap_hemisphere_size_index, "16\0" "32\0" "64\0" "128\0");
+				ImGui::Checkbox("Denoise", &m_lightmap_denoise);
 			}
-			if (ImGui::Button("Bake lightmap")) {
-				bake_lightmap();
+			if (ImGui::TreeNode("Telemetry")) {
+				show_lightmap_telemetry((m_lightmap_baker) ? m_lightmap_baker->telemetry() : m_lightmap_telemetry);
+				ImGui::TreePop();
 			}
+			ImGui::SliderFloat("Bake budget (ms)", &m_lightmap_bake_budget, 1.0f, 100.0f);
+			ImGui::SliderInt("Hemispheres per frame", &m_lightmap_bake_hemispheres_per_frame, 1, 1000);
 			ImGui::End();
 
 			ImGui::Begin("Objects");
 			for (auto i = std::size_t{0}; i < m_scene.objects.size(); ++i) {
 				if (ImGui::TreeNodeEx(fmt::format("Object {}", i).c_str(), ImGuiTreeNodeFlags_DefaultOpen)) {
 					ImGui::SliderFloat3("Position", glm::value_ptr(m_scene.objects[i].transform[3]), -10.0f, 10.0f);
-					if (ImGui::Button("Remove")) {
+					ImGui::SliderFloat("Lightmap density", &m_scene.objects[i].lightmap_density, 0.1f, 4.0f);
+					if (!m_lightmap_baker && ImGui::Button("Remove")) {
 						m_scene.objects.erase(m_scene.objects.begin() + static_cast<std::ptrdiff_t>(i));
 						--i;
 					}
@@ -248,24 +329,24 @@ public:
 			}
 			ImGui::End();
 		}
-		renderer.skybox().draw_skybox(m_scene.sky->original());
-		renderer.model().draw_lightmap(m_scene.lightmap);
-		renderer.model().draw_environment(m_scene.sky);
+		renderer.skybox().draw_skybox(*m_scene.sky->original());
+		renderer.model().draw_lightmap((m_lightmap_baker) ? *m_lightmap_baker->preview() : *m_scene.lightmap);
+		renderer.model().draw_environment(*m_scene.sky);
 		for (const auto& light : m_scene.directional_lights) {
-			renderer.shadow().draw_directional_light(light);
-			renderer.model().draw_directional_light(light);
+			renderer.shadow().draw_directional_light(*light);
+			renderer.model().draw_directional_light(*light);
 		}
 		for (const auto& light : m_scene.point_lights) {
-			renderer.shadow().draw_point_light(light);
-			renderer.model().draw_point_light(light);
+			renderer.shadow().draw_point_light(*light);
+			renderer.model().draw_point_light(*light);
 			if (m_show_lights) {
 				renderer.model().draw_model(
-					m_point_light_model, glm::scale(glm::translate(mat4{1.0f}, light->position), vec3{0.5f}), m_scene.default_lightmap_offset, m_scene.default_lightmap_scale);
+					*m_point_light_model, glm::scale(glm::translate(mat4{1.0f}, light->position), vec3{0.5f}), m_scene.default_lightmap_offset, m_scene.default_lightmap_scale);
 			}
 		}
 		for (const auto& light : m_scene.spot_lights) {
-			renderer.shadow().draw_spot_light(light);
-			renderer.model().draw_spot_light(light);
+			renderer.shadow().draw_spot_light(*light);
+			renderer.model().draw_spot_light(*light);
 			if (m_show_lights) {
 				const auto world_up = vec3{0.0f, 1.0f, 0.0f};
 				const auto forward = light->direction;
@@ -280,12 +361,12 @@ public:
 							vec4{vec3{}, 1.0f},
 						},
 					vec3{0.5f});
-				renderer.model().draw_model(m_spot_light_model, transform, m_scene.default_lightmap_offset, m_scene.default_lightmap_scale);
+				renderer.model().draw_model(*m_spot_light_model, transform, m_scene.default_lightmap_offset, m_scene.default_lightmap_scale);
 			}
 		}
 		for (const auto& object : m_scene.objects) {
-			renderer.shadow().draw_model(object.model_ptr, object.transform);
-			renderer.model().draw_model(object.model_ptr, object.transform, object.lightmap_offset, object.lightmap_scale);
+			renderer.shadow().draw_model(*object.model_ptr, object.transform);
+			renderer.model().draw_model(*object.model_ptr, object.transform, object.lightmap_offset, object.lightmap_scale);
 		}
 	}
 
@@ -299,78 +380,162 @@ public:
 
 private:
 	static constexpr auto sky_color = vec3{1.0f, 1.0f, 1.0f};
-	static constexpr auto lightmap_resolution = std::size_t{654};
-	static constexpr auto lightmap_bounce_count = std::size_t{1};
 	static constexpr auto mouse_sensitivity = 2.0f;
 	static constexpr auto move_acceleration = 40.0f;
 	static constexpr auto move_drag = 4.0f;
 	static constexpr auto yaw_speed = 3.49066f;
 	static constexpr auto pitch_speed = 3.49066f;
 
-	[[nodiscard]] auto get_lightmap_filename() const -> std::string {
+	[[nodiscard]] auto get_lightmap_preview_filename() const -> std::string {
 		return fmt::format("{}/lightmap.png", m_filename);
 	}
 
-	auto bake_lightmap() -> void {
+	// Apply the lighting of the last bake if it has not been saved yet, so that it survives models being reloaded, and the saved lightmap otherwise.
+	auto load_lightmap() -> void {
+		const auto filename = get_lightmap_filename();
 		try {
-			struct progress_callback final {
-				auto operator()(std::string_view category, std::size_t bounce_index, std::size_t bounce_count, std::size_t object_index, std::size_t object_count,
-					std::size_t mesh_index, std::size_t mesh_count, float progress) -> bool {
-					using namespace std::chrono_literals;
-					if (const auto now = std::chrono::steady_clock::now(); now >= next_print_time) {
-						next_print_time = now + 100ms;
-						fmt::print(stderr, "\r  {}: ", category);
-						if (bounce_count != 0) {
-							fmt::print(stderr, "Bounce {}/{}: ", bounce_index + 1, bounce_count);
-						}
-						if (object_count != 0) {
-							fmt::print(stderr, "Object {}/{}: ", object_index + 1, object_count);
-						}
-						if (mesh_count != 0) {
-							fmt::print(stderr, "Mesh {}/{}: ", mesh_index + 1, mesh_count);
-						}
-						fmt::print(stderr, "{}%                              \r", progress * 100.0f);
-					}
-					return true;
-				}
+			if (!m_baked_lighting.empty()) {
+				baked_lighting::load(m_scene, std::as_bytes(std::span<const char>{m_baked_lighting}));
+			} else if (auto error = std::error_code{}; std::filesystem::exists(filename, error)) {
+				baked_lighting::load(m_scene, filename.c_str());
+				fmt::print(stderr, "Lightmap loaded from \"{}\".\n", filename);
+			} else {
+				lightmap_generator::reset_lightmap(m_scene);
+			}
+		} catch (const std::exception& e) {
+			fmt::print(stderr, "Failed to load lightmap: {}\n", e.what());
+			lightmap_generator::reset_lightmap(m_scene);
+		} catch (...) {
+			fmt::print(stderr, "Failed to load lightmap!\n");
+			lightmap_generator::reset_lightmap(m_scene);
+		}
+		release_model_cpu_data();
+	}
 
-				std::chrono::steady_clock::time_point next_print_time = std::chrono::steady_clock::now();
-			};
+	auto start_lightmap_bake() -> void {
+		try {
 			fmt::print(stderr, "Baking lightmap...\n");
-			lightmap_generator::generate_lightmap_coordinates(m_scene, progress_callback{});
-			lightmap_generator::bake_lightmap(m_scene, sky_color, lightmap_resolution, lightmap_bounce_count, progress_callback{});
-			fmt::print(stderr, "\nBaking lightmap: Done!\n");
+			auto telemetry = lightmap_bake_telemetry{};
+			const auto resolution = generate_lightmap_coordinates(m_lightmap_texels_per_unit, telemetry);
+			fmt::print(stderr, "\nLightmap resolution: {}x{}\n", resolution, resolution);
+			m_asset_manager.defer_model_swaps(true);
+			m_lightmap_baker = std::make_unique<lightmap_baker>(m_scene,
+				lightmap_bake_options{
+					.sky_color = sky_color,
+					.resolution = resolution,
+					.bounce_count = default_lightmap_bounce_count,
+					.encoding = static_cast<lightmap_encoding>(m_lightmap_encoding),
+					.hemisphere_size = 16 << m_lightmap_hemisphere_size_index,
+					.denoise = m_lightmap_denoise,
+				},
+				std::move(telemetry));
+		} catch (const std::exception& e) {
+			m_lightmap_loaded = false;
+			fmt::print(stderr, "Failed to bake lightmap: {}\n", e.what());
+		} catch (...) {
+			m_lightmap_loaded = false;
+			fmt::print(stderr, "Failed to bake lightmap!\n");
+		}
+		release_model_cpu_data();
+	}
+
+	auto update_lightmap_bake() -> void {
+		if (!m_lightmap_baker) {
+			return;
+		}
+		try {
+			const auto budget = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float, std::milli>{m_lightmap_bake_budget});
+			if (m_lightmap_baker->step(static_cast<std::size_t>(m_lightmap_bake_hemispheres_per_frame), budget)) {
+				m_lightmap_telemetry = m_lightmap_baker->telemetry();
+				m_lightmap_baker.reset();
+				fmt::print(stderr, "\nBaking lightmap: Done!\n{}", m_lightmap_telemetry.to_json());
+
+				// Kept until it is saved, to be applied again instead of the saved lightmap when models that were loading during the bake are swapped in.
+				auto stream = std::ostringstream{};
+				baked_lighting::save(m_scene, stream);
+				m_baked_lighting = std::move(stream).str();
+			}
 		} catch (const std::exception& e) {
+			m_lightmap_baker.reset();
+			m_lightmap_loaded = false;
 			fmt::print(stderr, "Failed to bake lightmap: {}\n", e.what());
 		} catch (...) {
+			m_lightmap_baker.reset();
+			m_lightmap_loaded = false;
 			fmt::print(stderr, "Failed to bake lightmap!\n");
 		}
+		release_model_cpu_data();
+	}
+
+	// Generating, baking, saving and applying lightmaps read the geometry of models back from the GPU when the asset manager has released it, and release it
+	// again here once they are done with it. The baker refers to the geometry until it is destroyed.
+	auto release_model_cpu_data() -> void {
+		if (!m_asset_manager.releases_model_cpu_data() || m_lightmap_baker) {
+			return;
+		}
+		for (const auto& object : m_scene.objects) {
+			object.model_ptr->release_cpu_data();
+		}
 	}
 
-	auto save_lightmap() const -> void {
+	static auto show_lightmap_telemetry(const lightmap_bake_telemetry& telemetry) -> void {
+		for (auto i = std::size_t{0}; i < lightmap_bake_telemetry::phase_count; ++i) {
+			const auto name = lightmap_bake_telemetry::phase_names[i];
+			ImGui::Text("%.*s: %.3f s", static_cast<int>(name.size()), name.data(), telemetry.phase_seconds(static_cast<lightmap_bake_phase>(i)));
+		}
+		ImGui::Text("Total: %.3f s", telemetry.total_seconds());
+		ImGui::Text("Hemispheres: %zu (%.0f/s)", telemetry.hemisphere_count(), telemetry.hemispheres_per_second());
+		ImGui::Text("Texels: %zu (%.0f/s)", telemetry.texel_count(), telemetry.texels_per_second());
+		ImGui::Text("Peak memory: %.1f MiB", static_cast<double>(telemetry.peak_memory()) / (1024.0 * 1024.0));
+	}
+
+	auto save_lightmap() -> void {
 		if (!m_scene.lightmap) {
 			fmt::print(stderr, "No lightmap to save!\n");
 			return;
 		}
 		try {
-			const auto& texture = m_scene.lightmap->get_texture();
-			const auto pixels = texture.read_pixels_2d(lightmap_texture::format);
 			const auto filename = get_lightmap_filename();
-			save_png(image_view{pixels.data(), texture.width(), texture.height(), lightmap_texture::channel_count}, filename.c_str(), {.flip_vertically = true});
+			baked_lighting::save(m_scene, filename.c_str());
+			m_baked_lighting = std::string{};
 			fmt::print(stderr, "Lightmap saved as \"{}\".\n", filename);
+
+			const auto& texture = m_scene.lightmap->get_texture();
+			const auto hdr_pixels = m_scene.lightmap->read_pixels();
+			auto pixels = std::vector<std::byte>{};
+			pixels.reserve(hdr_pixels.size());
+			for (const auto value : hdr_pixels) {
+				pixels.push_back(static_cast<std::byte>(std::round(clamp(value, 0.0f, 1.0f) * 255.0f)));
+			}
+			const auto preview_filename = get_lightmap_preview_filename();
+			save_png(image_view{pixels.data(), texture.width(), texture.height(), lightmap_texture::channel_count}, preview_filename.c_str(), {.flip_vertically = true});
+			fmt::print(stderr, "Lightmap preview saved as \"{}\".\n", preview_filename);
 		} catch (const std::exception& e) {
 			fmt::print(stderr, "Failed to save lightmap: {}\n", e.what());
 		} catch (...) {
 			fmt::print(stderr, "Failed to save lightmap!\n");
 		}
+		release_model_cpu_data();
 	}
 
 	std::string m_filename;
+	asset_manager& m_asset_manager;
 	std::shared_ptr<model> m_point_light_model;
 	std::shared_ptr<model> m_spot_light_model;
 	scene m_scene;
 	flight_controller m_controller{vec3{0.0f, 0.0f, 2.0f}, -1.57079632679f, 0.0f};
+	std::unique_ptr<lightmap_baker> m_lightmap_baker{};
+	lightmap_bake_telemetry m_lightmap_telemetry{};
+	float m_lightmap_bake_budget = 8.0f;
+	int m_lightmap_bake_hemispheres_per_frame = 100;
+	int m_lightmap_encoding = static_cast<int>(lightmap_encoding::bc6h);
+	float m_lightmap_texels_per_unit = default_lightmap_texels_per_unit;
+	int m_lightmap_hemisphere_size_index = 2;
+	bool m_lightmap_denoise = false;
 	bool m_show_lights = false;
+	bool m_lightmap_loaded = false;
+	std::uint64_t m_model_swap_count = 0;
+	std::string m_baked_lighting{}; // Lighting of the last finished bake in the format of the lightmap file, or empty once it has been saved.
 };
 
 #endif
@@ -0,0 +1,291 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include "handle.hpp"
+#include "opengl.hpp"
+
+#include <atomic>        // std::atomic
+#include <chrono>        // std::chrono
+#include <cstdint>       // std::uint32_t, std::int64_t
+#include <deque>         // std::deque
+#include <fmt/format.h>  // fmt::format, fmt::format_to
+#include <fstream>       // std::ofstream
+#include <ios>           // std::ios
+#include <iterator>      // std::back_inserter
+#include <mutex>         // std::mutex, std::scoped_lock
+#include <stdexcept>     // std::runtime_error
+#include <string>        // std::string
+#include <string_view>   // std::string_view
+#include <unordered_map> // std::unordered_map
+#include <utility>       // std::move
+#include <vector>        // std::vector
+
+struct profiler_error : std::runtime_error {
+	explicit profiler_error(const auto& message)
+		: std::runtime_error(message) {}
+};
+
+// Timeline of named zones on every thread and on the GPU, which can be saved as a Chrome trace and opened in chrome://tracing or https://ui.perfetto.dev.
+// Zones are only recorded while the profiler is enabled. Otherwise they cost a single check.
+class profiler final {
+	struct query_deleter final {
+		auto operator()(GLuint p) const noexcept -> void {
+			glDeleteQueries(1, &p);
+		}
+	};
+
+public:
+	using clock = std::chrono::steady_clock;
+
+	static constexpr auto gpu_thread_index = std::uint32_t{0};
+
+	// Records the time from construction to destruction as a zone on the calling thread.
+	class scoped_zone final {
+	public:
+		scoped_zone(const char* name, std::string_view detail)
+			: m_name(name)
+			, m_active(get().enabled()) {
+			if (m_active) {
+				m_detail = detail;
+				m_start_time = clock::now();
+			}
+		}
+
+		~scoped_zone() {
+			if (m_active) {
+				get().add_zone(m_name, std::move(m_detail), m_start_time, clock::now() - m_start_time, thread_index());
+			}
+		}
+
+		scoped_zone(const scoped_zone&) = delete;
+		scoped_zone(scoped_zone&&) = delete;
+		auto operator=(const scoped_zone&) -> scoped_zone& = delete;
+		auto operator=(scoped_zone&&) -> scoped_zone& = delete;
+
+	private:
+		const char* m_name;
+		std::string m_detail{};
+		clock::time_point m_start_time{};
+		bool m_active;
+	};
+
+	// Like scoped_zone, but also records the time that the GPU spends on the commands issued in the meantime as a zone on the GPU track.
+	// Must only be used on the thread that owns the GL context.
+	class scoped_gpu_zone final {
+	public:
+		scoped_gpu_zone(const char* name, std::string_view detail)
+			: m_cpu_zone(name, detail)
+			, m_name(name) {
+			if (get().enabled()) {
+				m_detail = detail;
+				m_begin_query = get().query_timestamp();
+			}
+		}
+
+		~scoped_gpu_zone() {
+			if (m_begin_query) {
+				auto& instance = get();
+				auto end_query = instance.query_timestamp();
+				instance.add_gpu_zone(m_name, std::move(m_detail), std::move(m_begin_query), std::move(end_query));
+			}
+		}
+
+		scoped_gpu_zone(const scoped_gpu_zone&) = delete;
+		scoped_gpu_zone(scoped_gpu_zone&&) = delete;
+		auto operator=(const scoped_gpu_zone&) -> scoped_gpu_zone& = delete;
+		auto operator=(scoped_gpu_zone&&) -> scoped_gpu_zone& = delete;
+
+	private:
+		scoped_zone m_cpu_zone;
+		const char* m_name;
+		std::string m_detail{};
+		unique_handle<query_deleter> m_begin_query{};
+	};
+
+	[[nodiscard]] static auto get() -> profiler& {
+		static auto instance = profiler{};
+		return instance;
+	}
+
+	// The name should be a string literal, since it is not copied. The detail, such as a filename, is only copied while the profiler is enabled.
+	[[nodiscard]] static auto zone(const char* name, std::string_view detail = {}) -> scoped_zone {
+		return scoped_zone{name, detail};
+	}
+
+	[[nodiscard]] static auto gpu_zone(const char* name, std::string_view detail = {}) -> scoped_gpu_zone {
+		return scoped_gpu_zone{name, detail};
+	}
+
+	// Start recording. The calling thread is shown as the main thread in the trace.
+	auto enable() -> void {
+		{
+			auto lock = std::scoped_lock{m_mutex};
+			m_thread_names.insert_or_assign(thread_index(), "Main thread");
+		}
+		m_enabled.store(true, std::memory_order_relaxed);
+	}
+
+	[[nodiscard]] auto enabled() const noexcept -> bool {
+		return m_enabled.load(std::memory_order_relaxed);
+	}
+
+	// Collect the GPU zones whose results are available without waiting. Must be called on the thread that owns the GL context.
+	auto update() -> void {
+		resolve_gpu_zones(false);
+	}
+
+	// Waits for the GPU to finish the recorded zones. Must be called on the thread that owns the GL context.
+	[[nodiscard]] auto to_chrome_trace() -> std::string {
+		resolve_gpu_zones(true);
+
+		auto lock = std::scoped_lock{m_mutex};
+		auto result = std::string{};
+		auto out = std::back_inserter(result);
+		fmt::format_to(out, "{{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+		fmt::format_to(out, "{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":\"GPU\"}}}}", gpu_thread_index);
+		for (const auto& [index, name] : m_thread_names) {
+			fmt::format_to(out, ",\n{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}", index, name);
+		}
+		for (const auto& event : m_events) {
+			fmt::format_to(out,
+				",\n{{\"name\":\"{}\",\"cat\":\"{}\",\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},\"pid\":1,\"tid\":{}",
+				event.name,
+				(event.thread == gpu_thread_index) ? "gpu" : "cpu",
+				microseconds(event.start_time - m_start_time),
+				microseconds(event.duration),
+				event.thread);
+			if (!event.detail.empty()) {
+				fmt::format_to(out, ",\"args\":{{\"detail\":\"");
+				append_json_escaped(result, event.detail);
+				fmt::format_to(out, "\"}}");
+			}
+			fmt::format_to(out, "}}");
+		}
+		fmt::format_to(out, "\n]}}\n");
+		return result;
+	}
+
+	auto save_chrome_trace(const char* filename) -> void {
+		const auto json = to_chrome_trace();
+		auto file = std::ofstream{filename, std::ios::trunc};
+		if (!file) {
+			throw profiler_error{fmt::format("Failed to open \"{}\" for writing!", filename)};
+		}
+		if (!file.write(json.data(), static_cast<std::streamsize>(json.size()))) {
+			throw profiler_error{fmt::format("Failed to write \"{}\"!", filename)};
+		}
+	}
+
+private:
+	struct zone_event final {
+		const char* name;
+		std::string detail;
+		clock::time_point start_time;
+		clock::duration duration;
+		std::uint32_t thread;
+	};
+
+	struct pending_gpu_zone final {
+		const char* name;
+		std::string detail;
+		unique_handle<query_deleter> begin_query;
+		unique_handle<query_deleter> end_query;
+	};
+
+	profiler() = default;
+
+	// Small sequential thread numbers read better in a trace than native thread IDs.
+	[[nodiscard]] static auto thread_index() -> std::uint32_t {
+		static auto next_index = std::atomic<std::uint32_t>{gpu_thread_index + 1};
+		static thread_local const auto index = next_index.fetch_add(1, std::memory_order_relaxed);
+		return index;
+	}
+
+	[[nodiscard]] static auto microseconds(clock::duration duration) noexcept -> double {
+		return std::chrono::duration<double, std::micro>{duration}.count();
+	}
+
+	static auto append_json_escaped(std::string& result, std::string_view str) -> void {
+		for (const auto ch : str) {
+			switch (ch) {
+				case '"': result.append("\\\""); break;
+				case '\\': result.append("\\\\"); break;
+				case '\n': result.append("\\n"); break;
+				case '\t': result.append("\\t"); break;
+				default:
+					if (static_cast<unsigned char>(ch) < 0x20) {
+						fmt::format_to(std::back_inserter(result), "\\u{:04x}", static_cast<unsigned int>(ch));
+					} else {
+						result.push_back(ch);
+					}
+					break;
+			}
+		}
+	}
+
+	auto add_zone(const char* name, std::string detail, clock::time_point start_time, clock::duration duration, std::uint32_t thread) -> void {
+		auto lock = std::scoped_lock{m_mutex};
+		m_events.push_back(zone_event{.name = name, .detail = std::move(detail), .start_time = start_time, .duration = duration, .thread = thread});
+	}
+
+	auto add_gpu_zone(const char* name, std::string detail, unique_handle<query_deleter> begin_query, unique_handle<query_deleter> end_query) -> void {
+		m_pending_gpu_zones.push_back(pending_gpu_zone{
+			.name = name,
+			.detail = std::move(detail),
+			.begin_query = std::move(begin_query),
+			.end_query = std::move(end_query),
+		});
+	}
+
+	[[nodiscard]] auto query_timestamp() -> unique_handle<query_deleter> {
+		if (!m_gpu_clock_calibrated) {
+			// GPU timestamps are placed on the CPU timeline by comparing both clocks once, which is accurate enough for the length of a trace.
+			auto gpu_time = GLint64{};
+			glGetInteger64v(GL_TIMESTAMP, &gpu_time);
+			m_gpu_calibration_cpu_time = clock::now();
+			m_gpu_calibration_gpu_time = gpu_time;
+			m_gpu_clock_calibrated = true;
+		}
+		auto query = unique_handle<query_deleter>{[] {
+			auto query = GLuint{};
+			glGenQueries(1, &query);
+			return query;
+		}()};
+		glQueryCounter(query.get(), GL_TIMESTAMP);
+		return query;
+	}
+
+	auto resolve_gpu_zones(bool wait) -> void {
+		while (!m_pending_gpu_zones.empty()) {
+			auto& zone = m_pending_gpu_zones.front();
+			if (!wait) {
+				auto available = GLint{GL_FALSE};
+				glGetQueryObjectiv(zone.end_query.get(), GL_QUERY_RESULT_AVAILABLE, &available);
+				if (available == GL_FALSE) {
+					break; // Queries finish in order, so none of the later ones are available either.
+				}
+			}
+			auto begin_time = GLuint64{};
+			auto end_time = GLuint64{};
+			glGetQueryObjectui64v(zone.begin_query.get(), GL_QUERY_RESULT, &begin_time);
+			glGetQueryObjectui64v(zone.end_query.get(), GL_QUERY_RESULT, &end_time);
+			const auto start_time = m_gpu_calibration_cpu_time +
+				std::chrono::duration_cast<clock::duration>(std::chrono::nanoseconds{static_cast<std::int64_t>(begin_time) - m_gpu_calibration_gpu_time});
+			const auto duration = std::chrono::duration_cast<clock::duration>(std::chrono::nanoseconds{static_cast<std::int64_t>(end_time - begin_time)});
+			add_zone(zone.name, std::move(zone.detail), start_time, duration, gpu_thread_index);
+			m_pending_gpu_zones.pop_front();
+		}
+	}
+
+	std::atomic<bool> m_enabled{false};
+	clock::time_point m_start_time = clock::now();
+	std::mutex m_mutex{};
+	std::vector<zone_event> m_events{};
+	std::unordered_map<std::uint32_t, std::string> m_thread_names{};
+	std::deque<pending_gpu_zone> m_pending_gpu_zones{}; // Only used on the GL thread.
+	clock::time_point m_gpu_calibration_cpu_time{};
+	std::int64_t m_gpu_calibration_gpu_time = 0;
+	bool m_gpu_clock_calibrated = false;
+};
+
+#endif
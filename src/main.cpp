@@ -1,7 +1,10 @@
 #include "application/application.hpp"
+#include "application/bake_application.hpp"
+#include "application/command_line.hpp"
+#include "core/profiler.hpp"
 
 #include <cstddef>      // std::size_t
-#include <cstdio>       // stderr
+#include <cstdio>       // stdout, stderr
 #include <cstdlib>      // EXIT_SUCCESS, EXIT_FAILURE
 #include <fmt/format.h> // fmt::print
 #include <span>         // std::span
@@ -9,7 +12,17 @@
 
 auto main(int argc, char* argv[]) -> int {
 	try {
-		application{std::span{argv, static_cast<std::size_t>(argc)}}.run();
+		const auto arguments = command_line::parse(std::span{argv, static_cast<std::size_t>(argc)});
+		if (!arguments.trace_output.empty()) {
+			profiler::get().enable();
+		}
+		if (arguments.help) {
+			fmt::print(stdout, "{}", command_line::usage);
+		} else if (arguments.bake) {
+			bake_application{arguments}.bake();
+		} else {
+			application{arguments}.run();
+		}
 	} catch (const std::exception& e) {
 		fmt::print(stderr, "Fatal error: {}\n", e.what());
 		return EXIT_FAILURE;
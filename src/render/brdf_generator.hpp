@@ -3,6 +3,7 @@
 
 #include "../core/glsl.hpp"
 #include "../core/opengl.hpp"
+#include "../core/profiler.hpp"
 #include "../resources/brdf.hpp"
 #include "../resources/framebuffer.hpp"
 #include "../resources/shader.hpp"
@@ -34,6 +35,7 @@ public:
 	}
 
 	[[nodiscard]] auto generate_lookup_table() const -> texture {
+		const auto zone = profiler::gpu_zone("generate_brdf_lookup_table");
 		const auto preserver = state_preserver{};
 		auto fbo = framebuffer{};
 		glBindFramebuffer(GL_FRAMEBUFFER, fbo.get());
@@ -3,6 +3,7 @@
 
 #include "../core/glsl.hpp"
 #include "../core/opengl.hpp"
+#include "../core/profiler.hpp"
 #include "../resources/cubemap.hpp"
 #include "../resources/framebuffer.hpp"
 #include "../resources/shader.hpp"
@@ -13,6 +14,8 @@
 #include <cstddef>                      // std::size_t
 #include <glm/gtc/matrix_transform.hpp> // glm::perspective, glm::lookAt
 #include <glm/gtc/type_ptr.hpp>         // glm::value_ptr
+#include <span>                         // std::span
+#include <string>                       // std::string
 #include <utility>                      // std::move
 
 class cubemap_generator final {
@@ -20,13 +23,45 @@ public:
 	static constexpr auto irradiance_sample_delta_angle = 0.025f;
 	static constexpr auto prefilter_sample_count = 1024u;
 
+	static constexpr auto vertex_shader_filename = "assets/shaders/cubemap.vert";
+	static constexpr auto equirectangular_fragment_shader_filename = "assets/shaders/equirectangular.frag";
+	static constexpr auto irradiance_fragment_shader_filename = "assets/shaders/irradiance.frag";
+	static constexpr auto prefilter_fragment_shader_filename = "assets/shaders/prefilter.frag";
+
+	static constexpr auto irradiance_map_options = texture_options{
+		.max_anisotropy = 1.0f,
+		.repeat = false,
+		.use_linear_filtering = true,
+		.use_mip_map = false,
+	};
+
+	static constexpr auto prefilter_map_options = texture_options{
+		.max_anisotropy = 1.0f,
+		.repeat = false,
+		.use_linear_filtering = true,
+		.use_mip_map = true,
+	};
+
 	auto reload_shaders() -> void {
 		m_equirectangular_shader = equirectangular_shader{};
 		m_irradiance_shader = irradiance_shader{};
 		m_prefilter_shader = prefilter_shader{};
 	}
 
+	auto reload_changed_shaders(std::span<const std::string> filenames) -> void {
+		if (m_equirectangular_shader.program.depends_on_any(filenames)) {
+			m_equirectangular_shader = equirectangular_shader{};
+		}
+		if (m_irradiance_shader.program.depends_on_any(filenames)) {
+			m_irradiance_shader = irradiance_shader{};
+		}
+		if (m_prefilter_shader.program.depends_on_any(filenames)) {
+			m_prefilter_shader = prefilter_shader{};
+		}
+	}
+
 	[[nodiscard]] auto generate_cubemap_from_equirectangular_2d(GLint internal_format, const texture& equirectangular_texture, std::size_t resolution) const -> cubemap_texture {
+		const auto zone = profiler::gpu_zone("generate_cubemap_from_equirectangular");
 		const auto preserver = state_preserver{GL_TEXTURE_2D, GL_TEXTURE_BINDING_2D};
 		auto fbo = framebuffer{};
 		glBindFramebuffer(GL_FRAMEBUFFER, fbo.get());
@@ -44,6 +79,7 @@ public:
 	}
 
 	[[nodiscard]] auto generate_irradiance_map(GLint internal_format, const cubemap_texture& cubemap, std::size_t resolution) const -> cubemap_texture {
+		const auto zone = profiler::gpu_zone("generate_irradiance_map");
 		const auto preserver = state_preserver{GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BINDING_CUBE_MAP};
 		auto fbo = framebuffer{};
 		glBindFramebuffer(GL_FRAMEBUFFER, fbo.get());
@@ -51,13 +87,13 @@ public:
 		glBindVertexArray(m_cubemap_mesh.get());
 		glActiveTexture(GL_TEXTURE0);
 		glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap.get());
-		auto result = texture::create_cubemap_uninitialized(
-			internal_format, resolution, {.max_anisotropy = 1.0f, .repeat = false, .use_linear_filtering = true, .use_mip_map = false});
+		auto result = texture::create_cubemap_uninitialized(internal_format, resolution, irradiance_map_options);
 		m_irradiance_shader.generate(result, 0, resolution);
 		return cubemap_texture{std::move(result)};
 	}
 
 	[[nodiscard]] auto generate_prefilter_map(GLint internal_format, const cubemap_texture& cubemap, std::size_t resolution, std::size_t mip_level_count) -> cubemap_texture {
+		const auto zone = profiler::gpu_zone("generate_prefilter_map");
 		const auto preserver = state_preserver{GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BINDING_CUBE_MAP};
 		auto fbo = framebuffer{};
 		glBindFramebuffer(GL_FRAMEBUFFER, fbo.get());
@@ -66,8 +102,7 @@ public:
 		glActiveTexture(GL_TEXTURE0);
 		glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap.get());
 		glUniform1f(m_prefilter_shader.cubemap_resolution.location(), static_cast<float>(cubemap.get_texture().width()));
-		auto result = texture::create_cubemap_uninitialized(
-			internal_format, resolution, {.max_anisotropy = 1.0f, .repeat = false, .use_linear_filtering = true, .use_mip_map = true});
+		auto result = texture::create_cubemap_uninitialized(internal_format, resolution, prefilter_map_options);
 		for (auto mip = std::size_t{0}; mip < mip_level_count; ++mip) {
 			const auto mip_resolution = static_cast<std::size_t>(static_cast<float>(resolution) * std::pow(0.5f, mip));
 			const auto roughness = static_cast<float>(mip) / static_cast<float>(mip_level_count - 1);
@@ -117,7 +152,7 @@ private:
 	struct cubemap_shader {
 		cubemap_shader(const char* fragment_shader_filename, const char* texture_uniform_name, shader_definition_list definitions)
 			: program({
-				  .vertex_shader_filename = "assets/shaders/cubemap.vert",
+				  .vertex_shader_filename = vertex_shader_filename,
 				  .fragment_shader_filename = fragment_shader_filename,
 				  .definitions = definitions,
 			  })
@@ -157,17 +192,17 @@ private:
 
 	struct equirectangular_shader final : cubemap_shader {
 		equirectangular_shader()
-			: cubemap_shader("assets/shaders/equirectangular.frag", "equirectangular_texture", {}) {}
+			: cubemap_shader(equirectangular_fragment_shader_filename, "equirectangular_texture", {}) {}
 	};
 
 	struct irradiance_shader final : cubemap_shader {
 		irradiance_shader()
-			: cubemap_shader("assets/shaders/irradiance.frag", "cubemap_texture", {{"SAMPLE_DELTA_ANGLE", irradiance_sample_delta_angle}}) {}
+			: cubemap_shader(irradiance_fragment_shader_filename, "cubemap_texture", {{"SAMPLE_DELTA_ANGLE", irradiance_sample_delta_angle}}) {}
 	};
 
 	struct prefilter_shader final : cubemap_shader {
 		prefilter_shader()
-			: cubemap_shader("assets/shaders/prefilter.frag", "cubemap_texture", {{"SAMPLE_COUNT", prefilter_sample_count}}) {}
+			: cubemap_shader(prefilter_fragment_shader_filename, "cubemap_texture", {{"SAMPLE_COUNT", prefilter_sample_count}}) {}
 
 		shader_uniform cubemap_resolution{program.get(), "cubemap_resolution"};
 		shader_uniform roughness{program.get(), "roughness"};
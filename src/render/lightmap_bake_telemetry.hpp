@@ -0,0 +1,205 @@
+#ifndef LIGHTMAP_BAKE_TELEMETRY_HPP
+#define LIGHTMAP_BAKE_TELEMETRY_HPP
+
+#include "../resources/lightmap_encoder.hpp"
+#include "../utilities/memory_usage.hpp"
+
+#include <algorithm>    // std::max
+#include <array>        // std::array
+#include <chrono>       // std::chrono
+#include <cstddef>      // std::size_t
+#include <fmt/format.h> // fmt::format, fmt::format_to
+#include <fstream>      // std::ofstream
+#include <ios>          // std::ios
+#include <iterator>     // std::back_inserter
+#include <stdexcept>    // std::runtime_error
+#include <string>       // std::string
+#include <string_view>  // std::string_view
+
+struct lightmap_bake_telemetry_error : std::runtime_error {
+	explicit lightmap_bake_telemetry_error(const auto& message)
+		: std::runtime_error(message) {}
+};
+
+enum class lightmap_bake_phase : std::size_t {
+	uv_unwrap,
+	packing,
+	shadow_render,
+	hemisphere_render,
+	readback,
+	post_process,
+	upload,
+};
+
+// Settings of a bake that affect its throughput, recorded next to the measurements.
+struct lightmap_bake_settings final {
+	std::size_t resolution = 0;
+	std::size_t bounce_count = 0;
+	lightmap_encoding encoding = lightmap_encoding::rgba16f;
+	int hemisphere_size = 0;
+	int interpolation_passes = 0;
+	float interpolation_threshold = 0.0f;
+	bool denoise = false;
+};
+
+// Wall time per phase and throughput of a lightmap bake.
+// GPU work is measured on the CPU, so rendering phases only include the time to submit commands, and the time spent waiting for the GPU ends up in readback.
+class lightmap_bake_telemetry final {
+public:
+	using clock = std::chrono::steady_clock;
+
+	static constexpr auto phase_count = std::size_t{7};
+	static constexpr auto phase_names = std::array<std::string_view, phase_count>{
+		"uv_unwrap",
+		"packing",
+		"shadow_render",
+		"hemisphere_render",
+		"readback",
+		"post_process",
+		"upload",
+	};
+
+	// The lightmapper renders each hemisphere as a center view and four side views.
+	static constexpr auto views_per_hemisphere = std::size_t{5};
+
+	// Adds the time from construction to destruction to a phase.
+	class scoped_timer final {
+	public:
+		scoped_timer(lightmap_bake_telemetry& telemetry, lightmap_bake_phase phase)
+			: m_telemetry(telemetry)
+			, m_phase(phase)
+			, m_start_time(clock::now()) {}
+
+		~scoped_timer() {
+			m_telemetry.add_time(m_phase, clock::now() - m_start_time);
+		}
+
+		scoped_timer(const scoped_timer&) = delete;
+		scoped_timer(scoped_timer&&) = delete;
+		auto operator=(const scoped_timer&) -> scoped_timer& = delete;
+		auto operator=(scoped_timer&&) -> scoped_timer& = delete;
+
+	private:
+		lightmap_bake_telemetry& m_telemetry;
+		lightmap_bake_phase m_phase;
+		clock::time_point m_start_time;
+	};
+
+	[[nodiscard]] auto time(lightmap_bake_phase phase) -> scoped_timer {
+		return scoped_timer{*this, phase};
+	}
+
+	auto add_time(lightmap_bake_phase phase, clock::duration duration) noexcept -> void {
+		m_phase_times[static_cast<std::size_t>(phase)] += duration;
+	}
+
+	auto add_hemisphere_views(std::size_t count) noexcept -> void {
+		m_hemisphere_view_count += count;
+	}
+
+	auto add_texels(std::size_t count) noexcept -> void {
+		m_texel_count += count;
+	}
+
+	auto set_settings(const lightmap_bake_settings& settings) noexcept -> void {
+		m_settings = settings;
+	}
+
+	auto update_peak_memory() noexcept -> void {
+		m_peak_memory = std::max(m_peak_memory, get_peak_memory_usage());
+	}
+
+	[[nodiscard]] auto settings() const noexcept -> const lightmap_bake_settings& {
+		return m_settings;
+	}
+
+	[[nodiscard]] auto phase_seconds(lightmap_bake_phase phase) const noexcept -> double {
+		return seconds(m_phase_times[static_cast<std::size_t>(phase)]);
+	}
+
+	[[nodiscard]] auto total_seconds() const noexcept -> double {
+		auto result = clock::duration{};
+		for (const auto& duration : m_phase_times) {
+			result += duration;
+		}
+		return seconds(result);
+	}
+
+	[[nodiscard]] auto hemisphere_count() const noexcept -> std::size_t {
+		return m_hemisphere_view_count / views_per_hemisphere;
+	}
+
+	[[nodiscard]] auto texel_count() const noexcept -> std::size_t {
+		return m_texel_count;
+	}
+
+	// Throughput of the hemisphere phases, which are the ones affected by the hemisphere size and interpolation settings.
+	[[nodiscard]] auto hemispheres_per_second() const noexcept -> double {
+		return per_second(static_cast<double>(hemisphere_count()));
+	}
+
+	[[nodiscard]] auto texels_per_second() const noexcept -> double {
+		return per_second(static_cast<double>(m_texel_count));
+	}
+
+	[[nodiscard]] auto peak_memory() const noexcept -> std::size_t {
+		return m_peak_memory;
+	}
+
+	[[nodiscard]] auto to_json() const -> std::string {
+		auto result = std::string{};
+		auto out = std::back_inserter(result);
+		fmt::format_to(out, "{{\n");
+		fmt::format_to(out, "  \"settings\": {{\n");
+		fmt::format_to(out, "    \"resolution\": {},\n", m_settings.resolution);
+		fmt::format_to(out, "    \"bounce_count\": {},\n", m_settings.bounce_count);
+		fmt::format_to(out, "    \"encoding\": \"{}\",\n", lightmap_encoder::get_name(m_settings.encoding));
+		fmt::format_to(out, "    \"hemisphere_size\": {},\n", m_settings.hemisphere_size);
+		fmt::format_to(out, "    \"interpolation_passes\": {},\n", m_settings.interpolation_passes);
+		fmt::format_to(out, "    \"interpolation_threshold\": {},\n", m_settings.interpolation_threshold);
+		fmt::format_to(out, "    \"denoise\": {}\n", m_settings.denoise);
+		fmt::format_to(out, "  }},\n");
+		fmt::format_to(out, "  \"phase_seconds\": {{\n");
+		for (auto i = std::size_t{0}; i < phase_count; ++i) {
+			fmt::format_to(out, "    \"{}\": {:.6f}{}\n", phase_names[i], seconds(m_phase_times[i]), (i + 1 < phase_count) ? "," : "");
+		}
+		fmt::format_to(out, "  }},\n");
+		fmt::format_to(out, "  \"total_seconds\": {:.6f},\n", total_seconds());
+		fmt::format_to(out, "  \"hemispheres\": {},\n", hemisphere_count());
+		fmt::format_to(out, "  \"hemispheres_per_second\": {:.1f},\n", hemispheres_per_second());
+		fmt::format_to(out, "  \"texels\": {},\n", m_texel_count);
+		fmt::format_to(out, "  \"texels_per_second\": {:.1f},\n", texels_per_second());
+		fmt::format_to(out, "  \"peak_memory_bytes\": {}\n", m_peak_memory);
+		fmt::format_to(out, "}}\n");
+		return result;
+	}
+
+	auto save_json(const char* filename) const -> void {
+		const auto json = to_json();
+		auto file = std::ofstream{filename, std::ios::trunc};
+		if (!file) {
+			throw lightmap_bake_telemetry_error{fmt::format("Failed to open \"{}\" for writing!", filename)};
+		}
+		if (!file.write(json.data(), static_cast<std::streamsize>(json.size()))) {
+			throw lightmap_bake_telemetry_error{fmt::format("Failed to write \"{}\"!", filename)};
+		}
+	}
+
+private:
+	[[nodiscard]] static auto seconds(clock::duration duration) noexcept -> double {
+		return std::chrono::duration<double>{duration}.count();
+	}
+
+	[[nodiscard]] auto per_second(double count) const noexcept -> double {
+		const auto duration = phase_seconds(lightmap_bake_phase::hemisphere_render) + phase_seconds(lightmap_bake_phase::readback);
+		return (duration > 0.0) ? count / duration : 0.0;
+	}
+
+	lightmap_bake_settings m_settings{};
+	std::array<clock::duration, phase_count> m_phase_times{};
+	std::size_t m_hemisphere_view_count = 0;
+	std::size_t m_texel_count = 0;
+	std::size_t m_peak_memory = 0;
+};
+
+#endif
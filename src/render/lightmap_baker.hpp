@@ -0,0 +1,417 @@
+#ifndef LIGHTMAP_BAKER_HPP
+#define LIGHTMAP_BAKER_HPP
+
+#include "../core/glsl.hpp"
+#include "../core/opengl.hpp"
+#include "../render/model_renderer.hpp"
+#include "../render/shadow_renderer.hpp"
+#include "../render/skybox_renderer.hpp"
+#include "../resources/camera.hpp"
+#include "../resources/lightmap.hpp"
+#include "../resources/model.hpp"
+#include "../resources/scene.hpp"
+#include "lightmap_bake_telemetry.hpp"
+#include "lightmap_denoiser.hpp"
+#include "lightmap_filter.hpp"
+#include "lightmap_surface_cache.hpp"
+
+#include <algorithm>            // std::fill, std::copy_n
+#include <array>                // std::array
+#include <chrono>               // std::chrono
+#include <cstddef>              // std::size_t, std::byte
+#include <cstdint>              // std::uint32_t
+#include <glm/gtc/type_ptr.hpp> // glm::value_ptr
+#include <lightmapper.h>        // lm..., LM_...
+#include <memory>               // std::unique_ptr, std::shared_ptr, std::make_shared
+#include <optional>             // std::optional, std::in_place
+#include <span>                 // std::span
+#include <type_traits>          // std::is_same_v
+#include <utility>              // std::move
+#include <vector>               // std::vector
+
+struct lightmap_bake_options final {
+	vec3 sky_color{1.0f, 1.0f, 1.0f};
+	std::size_t resolution = 512;
+	std::size_t bounce_count = 1;
+	lightmap_encoding encoding = lightmap_encoding::rgba16f;
+	int hemisphere_size = 64; // Must be a power of two. Rendering cost grows with its square.
+	bool denoise = false;     // Replace the 3x3 smoothing by the edge-aware denoiser, which allows much smaller hemispheres.
+	bool use_preview = true;
+};
+
+class lightmap_baker final {
+public:
+	static constexpr auto near_z = 0.001f;
+	static constexpr auto far_z = 100.0f;
+	static constexpr auto interpolation_passes = 2;
+	static constexpr auto interpolation_threshold = 0.01f;
+	static constexpr auto camera_to_surface_distance_modifier = 0.0f;
+	static constexpr auto preview_interval = std::chrono::milliseconds{500};
+
+	// The telemetry may already contain the timings of the lightmap coordinate generation that preceded the bake.
+	lightmap_baker(scene& scene, const lightmap_bake_options& options, lightmap_bake_telemetry telemetry = {})
+		: m_scene(scene)
+		, m_options(options)
+		, m_telemetry(std::move(telemetry))
+		, m_lightmapper(lmCreate(options.hemisphere_size, near_z, far_z, options.sky_color.x, options.sky_color.y, options.sky_color.z, interpolation_passes,
+			  interpolation_threshold, camera_to_surface_distance_modifier))
+		, m_pixels(options.resolution * options.resolution * lightmap_texture::channel_count, 0.0f) {
+		if (!m_lightmapper) {
+			throw lightmap_error{"Failed to initialize lightmapper!"};
+		}
+
+		// The lightmap coordinates and the surface cache only depend on the scene, so they are built once here and reused for every bounce. The lightmapper only
+		// holds one mesh at a time, so set_geometry() still passes each mesh to it again on every bounce. The surface cache is only built for the denoiser.
+		auto covered_area = 0.0;
+		for (auto object_index = std::size_t{0}; object_index < m_scene.objects.size(); ++object_index) {
+			const auto& object = m_scene.objects[object_index];
+			object.model_ptr->load_cpu_data();
+			auto mesh_index = std::size_t{0};
+			for (const auto& mesh : object.model_ptr->meshes()) {
+				auto lightmap_coordinates = std::vector<vec2>{};
+				lightmap_coordinates.reserve(mesh.vertices().size());
+				for (const auto& vertex : mesh.vertices()) {
+					lightmap_coordinates.push_back(object.lightmap_offset + vertex.lightmap_coordinates * object.lightmap_scale);
+				}
+				if (const auto area = lightmap_surface_cache::get_covered_area(mesh, lightmap_coordinates, m_options.resolution); area > 0.0f) {
+					covered_area += static_cast<double>(area);
+					m_bake_meshes.push_back(bake_mesh{
+						.object_index = object_index,
+						.mesh_index = mesh_index,
+						.mesh = &mesh,
+						.transform = object.transform,
+						.lightmap_coordinates = std::move(lightmap_coordinates),
+					});
+				}
+				++mesh_index;
+			}
+		}
+		m_covered_texel_count = static_cast<std::size_t>(covered_area);
+		if (m_options.denoise) {
+			auto surfaces = std::vector<lightmap_surface_cache::surface>{};
+			surfaces.reserve(m_bake_meshes.size());
+			for (const auto& bake_mesh : m_bake_meshes) {
+				surfaces.push_back(lightmap_surface_cache::surface{
+					.object_index = static_cast<std::uint32_t>(bake_mesh.object_index),
+					.transform = bake_mesh.transform,
+					.mesh = bake_mesh.mesh,
+					.lightmap_coordinates = bake_mesh.lightmap_coordinates,
+				});
+			}
+			m_surface_cache.emplace(m_options.resolution, surfaces);
+		}
+		m_telemetry.set_settings(lightmap_bake_settings{
+			.resolution = m_options.resolution,
+			.bounce_count = m_options.bounce_count,
+			.encoding = lightmap_texture::get_supported_encoding(m_options.encoding),
+			.hemisphere_size = m_options.hemisphere_size,
+			.interpolation_passes = interpolation_passes,
+			.interpolation_threshold = interpolation_threshold,
+			.denoise = m_options.denoise,
+		});
+		m_telemetry.update_peak_memory();
+		if (m_options.use_preview) {
+			m_preview = std::make_shared<lightmap_texture>(lightmap_texture::create(m_options.resolution, m_pixels.data()));
+		}
+
+		// The first bounce only receives direct and environment lighting.
+		m_scene.lightmap = lightmap_texture::get_default();
+		begin_bounce();
+	}
+
+	~lightmap_baker() = default;
+
+	lightmap_baker(const lightmap_baker&) = delete;
+	lightmap_baker(lightmap_baker&&) = delete;
+	auto operator=(const lightmap_baker&) -> lightmap_baker& = delete;
+	auto operator=(lightmap_baker&&) -> lightmap_baker& = delete;
+
+	// Render hemispheres until either the iteration count or the time budget runs out. Returns true when the bake is complete.
+	auto step(std::size_t max_iterations, std::chrono::steady_clock::duration time_budget) -> bool {
+		static_assert(std::is_same_v<model_index, GLuint> && sizeof(model_index) == 4, "This function assumes 32-bit model indices.");
+
+		if (done()) {
+			return true;
+		}
+
+		const auto start_time = std::chrono::steady_clock::now();
+
+		// Shadow maps are shared with the main renderer, so they have to be rendered again for the bake camera.
+		{
+			const auto timer = m_telemetry.time(lightmap_bake_phase::shadow_render);
+			render_shadows();
+		}
+		{
+			const auto timer = m_telemetry.time(lightmap_bake_phase::hemisphere_render);
+			submit_scene();
+		}
+
+		for (auto iteration = std::size_t{0}; iteration < max_iterations && !done() && std::chrono::steady_clock::now() - start_time < time_budget;) {
+			if (!m_mesh_active) {
+				if (m_bake_mesh_index >= m_bake_meshes.size()) {
+					end_bounce();
+					if (!done()) {
+						begin_bounce();
+						const auto timer = m_telemetry.time(lightmap_bake_phase::hemisphere_render);
+						submit_scene();
+					}
+					continue;
+				}
+				set_geometry(m_bake_meshes[m_bake_mesh_index]);
+			}
+
+			auto viewport = std::array<int, 4>{};
+			auto hemisphere_timer = std::optional<lightmap_bake_telemetry::scoped_timer>{std::in_place, m_telemetry, lightmap_bake_phase::hemisphere_render};
+			if (!lmBegin(m_lightmapper.get(), viewport.data(), glm::value_ptr(m_camera.view_matrix), glm::value_ptr(m_camera.projection_matrix))) {
+				m_mesh_active = false;
+				m_mesh_progress = 0.0f;
+				++m_bake_mesh_index;
+				continue;
+			}
+			try {
+				render_hemisphere(viewport);
+			} catch (...) {
+				lmEnd(m_lightmapper.get());
+				throw;
+			}
+			hemisphere_timer.reset();
+			{
+				// The lightmapper integrates and reads back finished hemisphere batches here.
+				const auto timer = m_telemetry.time(lightmap_bake_phase::readback);
+				lmEnd(m_lightmapper.get());
+			}
+			m_telemetry.add_hemisphere_views(1);
+			m_mesh_progress = lmProgress(m_lightmapper.get());
+			++iteration;
+		}
+
+		if (m_preview && !done()) {
+			if (const auto now = std::chrono::steady_clock::now(); now >= m_next_preview_time) {
+				m_next_preview_time = now + preview_interval;
+				const auto timer = m_telemetry.time(lightmap_bake_phase::upload);
+				m_preview->update(m_pixels.data());
+			}
+		}
+		m_telemetry.update_peak_memory();
+		return done();
+	}
+
+	[[nodiscard]] auto done() const noexcept -> bool {
+		return m_bounce_index >= m_options.bounce_count;
+	}
+
+	[[nodiscard]] auto preview() const noexcept -> const std::shared_ptr<lightmap_texture>& {
+		return (m_preview && !done()) ? m_preview : m_scene.lightmap;
+	}
+
+	[[nodiscard]] auto bounce_index() const noexcept -> std::size_t {
+		return m_bounce_index;
+	}
+
+	[[nodiscard]] auto bounce_count() const noexcept -> std::size_t {
+		return m_options.bounce_count;
+	}
+
+	[[nodiscard]] auto object_index() const noexcept -> std::size_t {
+		return (m_bake_mesh_index < m_bake_meshes.size()) ? m_bake_meshes[m_bake_mesh_index].object_index : m_scene.objects.size();
+	}
+
+	[[nodiscard]] auto object_count() const noexcept -> std::size_t {
+		return m_scene.objects.size();
+	}
+
+	[[nodiscard]] auto mesh_index() const noexcept -> std::size_t {
+		return (m_bake_mesh_index < m_bake_meshes.size()) ? m_bake_meshes[m_bake_mesh_index].mesh_index : std::size_t{0};
+	}
+
+	[[nodiscard]] auto mesh_count() const noexcept -> std::size_t {
+		const auto object_index = this->object_index();
+		return (object_index < m_scene.objects.size()) ? m_scene.objects[object_index].model_ptr->meshes().size() : std::size_t{0};
+	}
+
+	[[nodiscard]] auto mesh_progress() const noexcept -> float {
+		return m_mesh_progress;
+	}
+
+	[[nodiscard]] auto progress() const noexcept -> float {
+		if (done()) {
+			return 1.0f;
+		}
+		const auto bake_mesh_count = m_bake_meshes.size();
+		const auto bounce_progress = (bake_mesh_count == 0) ? 1.0f : (static_cast<float>(m_bake_mesh_index) + m_mesh_progress) / static_cast<float>(bake_mesh_count);
+		return (static_cast<float>(m_bounce_index) + min(bounce_progress, 1.0f)) / static_cast<float>(m_options.bounce_count);
+	}
+
+	// Only built when denoising, null otherwise.
+	[[nodiscard]] auto surface_cache() const noexcept -> const lightmap_surface_cache* {
+		return (m_surface_cache) ? &*m_surface_cache : nullptr;
+	}
+
+	[[nodiscard]] auto telemetry() const noexcept -> const lightmap_bake_telemetry& {
+		return m_telemetry;
+	}
+
+private:
+	struct bake_mesh final {
+		std::size_t object_index;
+		std::size_t mesh_index;
+		const model_mesh* mesh;
+		mat4 transform;
+		std::vector<vec2> lightmap_coordinates;
+	};
+
+	auto begin_bounce() -> void {
+		std::fill(m_pixels.begin(), m_pixels.end(), 0.0f);
+		lmSetTargetLightmap(m_lightmapper.get(),
+			m_pixels.data(),
+			static_cast<int>(m_options.resolution),
+			static_cast<int>(m_options.resolution),
+			static_cast<int>(lightmap_texture::channel_count));
+		m_bake_mesh_index = 0;
+		m_mesh_active = false;
+		m_mesh_progress = 0.0f;
+	}
+
+	auto end_bounce() -> void {
+		auto post_process_timer = std::optional<lightmap_bake_telemetry::scoped_timer>{std::in_place, m_telemetry, lightmap_bake_phase::post_process};
+		const auto resolution = m_options.resolution;
+		const auto sky_color = m_options.sky_color;
+		const auto lightmap_scale = vec2{static_cast<float>(resolution), static_cast<float>(resolution)};
+		const auto default_offset = m_scene.default_lightmap_offset * lightmap_scale;
+		const auto default_scale = m_scene.default_lightmap_scale * lightmap_scale;
+		const auto default_x_begin = static_cast<std::size_t>(default_offset.x);
+		const auto default_x_end = static_cast<std::size_t>(default_offset.x + default_scale.x);
+		const auto default_y_begin = static_cast<std::size_t>(default_offset.y);
+		const auto default_y_end = static_cast<std::size_t>(default_offset.y + default_scale.y);
+		if (default_x_begin > default_x_end || default_y_begin > default_y_end || default_x_end > resolution || default_y_end > resolution) {
+			throw lightmap_error{"Invalid default lightmap pixel coordinates!"};
+		}
+		for (auto y = default_y_begin; y < default_y_end; ++y) {
+			for (auto x = default_x_begin; x < default_x_end; ++x) {
+				auto* const pixel = &m_pixels[((y * resolution) + x) * lightmap_texture::channel_count];
+				const auto sky_pixel = std::array<float, 4>{sky_color.x, sky_color.y, sky_color.z, 0.0f};
+				std::copy_n(sky_pixel.begin(), lightmap_texture::channel_count, pixel);
+			}
+		}
+
+		auto temp = std::vector<float>(m_pixels.size(), 0.0f);
+		if (m_options.denoise) {
+			lightmap_denoiser::denoise(m_pixels, temp, *m_surface_cache);
+		} else {
+			lightmap_filter::smooth(m_pixels, temp, resolution);
+		}
+		lightmap_filter::dilate(temp, m_pixels, resolution);
+
+		// Intermediate bounces are only read by the next bounce, so they keep full precision. The final one is encoded for storage.
+		if (m_bounce_index + 1 < m_options.bounce_count || m_options.encoding == lightmap_encoding::rgba16f) {
+			post_process_timer.reset();
+			const auto timer = m_telemetry.time(lightmap_bake_phase::upload);
+			m_scene.lightmap = std::make_shared<lightmap_texture>(lightmap_texture::create(resolution, m_pixels.data()));
+		} else {
+			const auto encoding = lightmap_texture::get_supported_encoding(m_options.encoding);
+			const auto levels = lightmap_encoder::encode(m_pixels, resolution, encoding);
+			const auto level_views = std::vector<std::span<const std::byte>>(levels.begin(), levels.end());
+			post_process_timer.reset();
+			const auto timer = m_telemetry.time(lightmap_bake_phase::upload);
+			m_scene.lightmap = std::make_shared<lightmap_texture>(lightmap_texture::create_mip_levels(resolution, encoding, level_views));
+		}
+		m_telemetry.add_texels(m_covered_texel_count);
+		++m_bounce_index;
+	}
+
+	auto render_shadows() -> void {
+		auto cam = camera{bake_camera_position, bake_camera_direction, bake_camera_up, camera_options{}};
+		for (const auto& light : m_scene.directional_lights) {
+			m_shadow_baker.draw_directional_light(*light);
+		}
+		for (const auto& light : m_scene.point_lights) {
+			m_shadow_baker.draw_point_light(*light);
+		}
+		for (const auto& light : m_scene.spot_lights) {
+			m_shadow_baker.draw_spot_light(*light);
+		}
+		for (const auto& object : m_scene.objects) {
+			m_shadow_baker.draw_model(*object.model_ptr, object.transform);
+		}
+		m_shadow_baker.render(cam);
+	}
+
+	auto set_geometry(const bake_mesh& mesh) -> void {
+		// The lightmapper keeps pointers to the geometry until the mesh is done, so everything it refers to is owned by the baker.
+		lmSetGeometry(m_lightmapper.get(),
+			glm::value_ptr(mesh.transform),
+			LM_FLOAT,
+			glm::value_ptr(mesh.mesh->vertices()[0].position),
+			sizeof(model_vertex),
+			LM_FLOAT,
+			glm::value_ptr(mesh.mesh->vertices()[0].normal),
+			sizeof(model_vertex),
+			LM_FLOAT,
+			mesh.lightmap_coordinates.data(),
+			sizeof(mesh.lightmap_coordinates[0]),
+			static_cast<int>(mesh.mesh->indices().size()),
+			LM_UNSIGNED_INT, // NOTE: 32-bit model index assumed here.
+			mesh.mesh->indices().data());
+		m_mesh_active = true;
+		m_mesh_progress = 0.0f;
+	}
+
+	auto submit_scene() -> void {
+		m_model_baker.clear();
+		m_model_baker.draw_lightmap(*m_scene.lightmap);
+		m_model_baker.draw_environment(*m_scene.sky);
+		for (const auto& light : m_scene.directional_lights) {
+			m_model_baker.draw_directional_light(*light);
+		}
+		for (const auto& light : m_scene.point_lights) {
+			m_model_baker.draw_point_light(*light);
+		}
+		for (const auto& light : m_scene.spot_lights) {
+			m_model_baker.draw_spot_light(*light);
+		}
+		for (const auto& object : m_scene.objects) {
+			m_model_baker.draw_model(*object.model_ptr, object.transform, object.lightmap_offset, object.lightmap_scale);
+		}
+	}
+
+	auto render_hemisphere(const std::array<int, 4>& viewport) -> void {
+		m_camera.update_cascade_frustums();
+
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		m_skybox_baker.draw_skybox(*m_scene.sky->original());
+		m_model_baker.render_retained(m_camera);
+		m_skybox_baker.render(m_camera.projection_matrix, mat3{m_camera.view_matrix});
+	}
+
+	static constexpr auto bake_camera_position = vec3{0.0f, 100.0f, 0.0f};
+	static constexpr auto bake_camera_direction = vec3{0.0f, -1.0f, 0.0f};
+	static constexpr auto bake_camera_up = vec3{0.0f, 0.0f, 1.0f};
+
+	struct lightmapper_deleter final {
+		auto operator()(lm_context* p) const noexcept -> void {
+			lmDestroy(p);
+		}
+	};
+	using lightmapper_ptr = std::unique_ptr<lm_context, lightmapper_deleter>;
+
+	scene& m_scene;
+	lightmap_bake_options m_options;
+	lightmap_bake_telemetry m_telemetry;
+	lightmapper_ptr m_lightmapper;
+	std::vector<float> m_pixels;
+	std::shared_ptr<lightmap_texture> m_preview{};
+	std::chrono::steady_clock::time_point m_next_preview_time = std::chrono::steady_clock::now();
+	camera m_camera{bake_camera_position, bake_camera_direction, bake_camera_up, camera_options{}};
+	shadow_renderer m_shadow_baker{};
+	model_renderer m_model_baker{true};
+	skybox_renderer m_skybox_baker{};
+	std::optional<lightmap_surface_cache> m_surface_cache{};
+	std::vector<bake_mesh> m_bake_meshes{};
+	std::size_t m_covered_texel_count = 0;
+	std::size_t m_bounce_index = 0;
+	std::size_t m_bake_mesh_index = 0;
+	bool m_mesh_active = false;
+	float m_mesh_progress = 0.0f;
+};
+
+#endif
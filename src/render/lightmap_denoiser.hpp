@@ -0,0 +1,152 @@
+#ifndef LIGHTMAP_DENOISER_HPP
+#define LIGHTMAP_DENOISER_HPP
+
+#include "../core/glsl.hpp"
+#include "../utilities/parallel.hpp"
+#include "lightmap_surface_cache.hpp"
+
+#include <algorithm> // std::copy, std::copy_n
+#include <array>     // std::array
+#include <cmath>     // std::exp, std::pow, std::abs
+#include <cstddef>   // std::size_t, std::ptrdiff_t
+#include <span>      // std::span
+#include <stdexcept> // std::invalid_argument
+#include <vector>    // std::vector
+
+struct lightmap_denoise_options final {
+	std::size_t iteration_count = 3; // The kernel reaches 2 * (2^iteration_count - 1) texels away.
+	float position_sigma = 1.0f;     // Relative to the world-space texel size at the current step.
+	float normal_power = 64.0f;
+	float luminance_sigma = 0.5f; // Relative to the brighter of the two texels. Halved every iteration.
+};
+
+// Edge-avoiding a-trous wavelet filter for noisy RGBA float lightmaps, guided by the world-space position and normal of each texel.
+// Texels only exchange light with texels of the same object that face the same way and lie close by on the surface, so chart seams, corners and contact shadows are kept.
+// Texels that are not covered by the surface cache or were not written by the lightmapper are passed through unchanged.
+class lightmap_denoiser final {
+public:
+	static constexpr auto channel_count = std::size_t{4};
+
+	static auto denoise(std::span<const float> pixels, std::span<float> result, const lightmap_surface_cache& guide, const lightmap_denoise_options& options = {}) -> void {
+		const auto resolution = guide.resolution();
+		if (pixels.size() != resolution * resolution * channel_count || result.size() != pixels.size()) {
+			throw std::invalid_argument{"Invalid lightmap denoiser image size!"};
+		}
+
+		const auto texel_sizes = get_texel_sizes(pixels, guide);
+		auto current = std::vector<float>(pixels.begin(), pixels.end());
+		auto next = std::vector<float>(pixels.size());
+		auto luminance_sigma = options.luminance_sigma;
+		for (auto iteration = std::size_t{0}; iteration < options.iteration_count; ++iteration) {
+			const auto step = std::ptrdiff_t{1} << iteration;
+			parallel_for(resolution, [&](std::size_t y) {
+				for (auto x = std::size_t{0}; x < resolution; ++x) {
+					const auto i = y * resolution + x;
+					const auto* const in = &current[i * channel_count];
+					auto* const out = &next[i * channel_count];
+					const auto texel_size = texel_sizes[i];
+					if (texel_size <= 0.0f) {
+						std::copy_n(in, channel_count, out);
+						continue;
+					}
+					const auto& center = guide.texels()[i];
+					const auto center_luminance = luminance(in);
+					const auto position_scale = 1.0f / (2.0f * square(options.position_sigma * static_cast<float>(step) * texel_size));
+					auto sum = vec3{0.0f, 0.0f, 0.0f};
+					auto weight_sum = 0.0f;
+					for (auto ky = std::ptrdiff_t{0}; ky < kernel_size; ++ky) {
+						const auto ny = static_cast<std::ptrdiff_t>(y) + (ky - kernel_radius) * step;
+						if (ny < 0 || ny >= static_cast<std::ptrdiff_t>(resolution)) {
+							continue;
+						}
+						for (auto kx = std::ptrdiff_t{0}; kx < kernel_size; ++kx) {
+							const auto nx = static_cast<std::ptrdiff_t>(x) + (kx - kernel_radius) * step;
+							if (nx < 0 || nx >= static_cast<std::ptrdiff_t>(resolution)) {
+								continue;
+							}
+							const auto j = static_cast<std::size_t>(ny) * resolution + static_cast<std::size_t>(nx);
+							const auto& neighbor = guide.texels()[j];
+							if (texel_sizes[j] <= 0.0f || neighbor.object_index != center.object_index) {
+								continue;
+							}
+							const auto* const sample = &current[j * channel_count];
+							const auto offset = neighbor.position - center.position;
+							const auto position_weight = std::exp(-dot(offset, offset) * position_scale);
+							const auto normal_weight = std::pow(max(dot(center.normal, neighbor.normal), 0.0f), options.normal_power);
+							const auto sample_luminance = luminance(sample);
+							const auto luminance_weight =
+								std::exp(-std::abs(sample_luminance - center_luminance) / (luminance_sigma * max(center_luminance, sample_luminance) + luminance_epsilon));
+							const auto weight = kernel[static_cast<std::size_t>(kx)] * kernel[static_cast<std::size_t>(ky)] * position_weight * normal_weight * luminance_weight;
+							sum += vec3{sample[0], sample[1], sample[2]} * weight;
+							weight_sum += weight;
+						}
+					}
+					const auto color = (weight_sum > 0.0f) ? sum / weight_sum : vec3{in[0], in[1], in[2]};
+					out[0] = color.x;
+					out[1] = color.y;
+					out[2] = color.z;
+					out[3] = in[3];
+				}
+			});
+			current.swap(next);
+			luminance_sigma *= 0.5f;
+		}
+		std::copy(current.begin(), current.end(), result.begin());
+	}
+
+private:
+	static constexpr auto kernel_radius = std::ptrdiff_t{2};
+	static constexpr auto kernel_size = kernel_radius * 2 + 1;
+	static constexpr auto kernel = std::array<float, static_cast<std::size_t>(kernel_size)>{1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+	static constexpr auto luminance_epsilon = 1e-4f;
+
+	[[nodiscard]] static auto square(float x) noexcept -> float {
+		return x * x;
+	}
+
+	[[nodiscard]] static auto luminance(const float* pixel) noexcept -> float {
+		return pixel[0] * 0.2126f + pixel[1] * 0.7152f + pixel[2] * 0.0722f;
+	}
+
+	// Average world-space distance to the 4-neighbors on the same object, or zero for texels that should not be filtered.
+	[[nodiscard]] static auto get_texel_sizes(std::span<const float> pixels, const lightmap_surface_cache& guide) -> std::vector<float> {
+		const auto resolution = guide.resolution();
+		const auto is_guided = [&](std::size_t x, std::size_t y) {
+			const auto* const pixel = &pixels[(y * resolution + x) * channel_count];
+			return guide.is_covered(x, y) && (pixel[0] > 0.0f || pixel[1] > 0.0f || pixel[2] > 0.0f || pixel[3] > 0.0f);
+		};
+		auto result = std::vector<float>(resolution * resolution, 0.0f);
+		parallel_for(resolution, [&](std::size_t y) {
+			for (auto x = std::size_t{0}; x < resolution; ++x) {
+				if (!is_guided(x, y)) {
+					continue;
+				}
+				const auto& center = guide.get(x, y);
+				auto distance_sum = 0.0f;
+				auto count = 0.0f;
+				const auto add_neighbor = [&](std::size_t nx, std::size_t ny) {
+					if (is_guided(nx, ny) && guide.get(nx, ny).object_index == center.object_index) {
+						distance_sum += distance(center.position, guide.get(nx, ny).position);
+						count += 1.0f;
+					}
+				};
+				if (x > 0) {
+					add_neighbor(x - 1, y);
+				}
+				if (x + 1 < resolution) {
+					add_neighbor(x + 1, y);
+				}
+				if (y > 0) {
+					add_neighbor(x, y - 1);
+				}
+				if (y + 1 < resolution) {
+					add_neighbor(x, y + 1);
+				}
+				result[y * resolution + x] = (count > 0.0f) ? distance_sum / count : 0.0f;
+			}
+		});
+		return result;
+	}
+};
+
+#endif
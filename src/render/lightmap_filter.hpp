@@ -0,0 +1,157 @@
+#ifndef LIGHTMAP_FILTER_HPP
+#define LIGHTMAP_FILTER_HPP
+
+#include "../utilities/parallel.hpp"
+
+#include <algorithm> // std::min, std::copy_n, std::fill_n
+#include <array>     // std::array
+#include <cstddef>   // std::size_t
+#include <cstdint>   // std::uint8_t, std::uint32_t, std::int64_t
+#include <limits>    // std::numeric_limits
+#include <span>      // std::span
+#include <stdexcept> // std::invalid_argument
+#include <vector>    // std::vector
+
+// Multithreaded post-processing of baked RGBA float lightmaps. A texel is considered valid if any of its channels is positive, like in lightmapper.
+class lightmap_filter final {
+public:
+	static constexpr auto channel_count = std::size_t{4};
+
+	// Replace each valid texel by the average of the valid texels in its 3x3 neighborhood. Invalid texels are left as zero.
+	static auto smooth(std::span<const float> pixels, std::span<float> result, std::size_t resolution) -> void {
+		check_size(pixels, result, resolution);
+		const auto valid = get_valid_mask(pixels, resolution);
+		parallel_for(resolution, [&](std::size_t y) {
+			const auto y_begin = (y == 0) ? std::size_t{0} : y - 1;
+			const auto y_end = std::min(y + 2, resolution);
+			for (auto x = std::size_t{0}; x < resolution; ++x) {
+				auto* const out = &result[(y * resolution + x) * channel_count];
+				auto sum = std::array<float, channel_count>{};
+				auto count = 0.0f;
+				if (valid[y * resolution + x] != 0) {
+					const auto x_begin = (x == 0) ? std::size_t{0} : x - 1;
+					const auto x_end = std::min(x + 2, resolution);
+					for (auto neighbor_y = y_begin; neighbor_y < y_end; ++neighbor_y) {
+						for (auto neighbor_x = x_begin; neighbor_x < x_end; ++neighbor_x) {
+							const auto weight = static_cast<float>(valid[neighbor_y * resolution + neighbor_x]);
+							const auto* const in = &pixels[(neighbor_y * resolution + neighbor_x) * channel_count];
+							for (auto channel = std::size_t{0}; channel < channel_count; ++channel) {
+								sum[channel] += in[channel] * weight;
+							}
+							count += weight;
+						}
+					}
+				}
+				const auto scale = (count > 0.0f) ? 1.0f / count : 0.0f;
+				for (auto channel = std::size_t{0}; channel < channel_count; ++channel) {
+					out[channel] = sum[channel] * scale;
+				}
+			}
+		});
+	}
+
+	// Give every invalid texel the value of the nearest valid texel in one pass, using an exact Euclidean distance transform that also tracks the nearest texel.
+	// This replaces repeated 4-neighbor dilation and fills the whole image, so that mip maps and block compression never sample empty texels.
+	static auto dilate(std::span<const float> pixels, std::span<float> result, std::size_t resolution) -> void {
+		check_size(pixels, result, resolution);
+		const auto valid = get_valid_mask(pixels, resolution);
+
+		// Nearest valid texel in the same column. Columns are processed in strips of contiguous texels so that the inner loops run over consecutive memory.
+		auto nearest_y = std::vector<std::uint32_t>(resolution * resolution);
+		const auto strip_count = (resolution + strip_width - 1) / strip_width;
+		parallel_for(strip_count, [&](std::size_t strip) {
+			const auto x_begin = strip * strip_width;
+			const auto x_end = std::min(x_begin + strip_width, resolution);
+			for (auto x = x_begin; x < x_end; ++x) {
+				nearest_y[x] = (valid[x] != 0) ? std::uint32_t{0} : none;
+			}
+			for (auto y = std::size_t{1}; y < resolution; ++y) {
+				for (auto x = x_begin; x < x_end; ++x) {
+					nearest_y[y * resolution + x] = (valid[y * resolution + x] != 0) ? static_cast<std::uint32_t>(y) : nearest_y[(y - 1) * resolution + x];
+				}
+			}
+			for (auto y = resolution - 1; y-- > 0;) {
+				for (auto x = x_begin; x < x_end; ++x) {
+					const auto below = nearest_y[(y + 1) * resolution + x];
+					auto& current = nearest_y[y * resolution + x];
+					if (below != none && (current == none || static_cast<std::size_t>(below) - y < y - static_cast<std::size_t>(current))) {
+						current = below;
+					}
+				}
+			}
+		});
+
+		// Lower envelope of the parabolas rooted at the column results of each row (Felzenszwalb and Huttenlocher).
+		parallel_for(resolution, [&](std::size_t y) {
+			const auto* const row = &nearest_y[y * resolution];
+			auto* const out = &result[y * resolution * channel_count];
+			const auto height = [&](std::size_t x) {
+				const auto dy = static_cast<std::int64_t>(row[x]) - static_cast<std::int64_t>(y);
+				return dy * dy;
+			};
+			auto sites = std::vector<std::size_t>{};
+			auto boundaries = std::vector<double>{};
+			sites.reserve(resolution);
+			boundaries.reserve(resolution);
+			for (auto x = std::size_t{0}; x < resolution; ++x) {
+				if (row[x] == none) {
+					continue;
+				}
+				const auto fx = static_cast<double>(height(x)) + static_cast<double>(x) * static_cast<double>(x);
+				auto boundary = -std::numeric_limits<double>::infinity();
+				while (!sites.empty()) {
+					const auto site = sites.back();
+					const auto fs = static_cast<double>(height(site)) + static_cast<double>(site) * static_cast<double>(site);
+					boundary = (fx - fs) / (2.0 * (static_cast<double>(x) - static_cast<double>(site)));
+					if (boundary > boundaries.back()) {
+						break;
+					}
+					sites.pop_back();
+					boundaries.pop_back();
+					boundary = -std::numeric_limits<double>::infinity();
+				}
+				sites.push_back(x);
+				boundaries.push_back(boundary);
+			}
+			if (sites.empty()) {
+				std::fill_n(out, resolution * channel_count, 0.0f);
+				return;
+			}
+			auto k = std::size_t{0};
+			for (auto x = std::size_t{0}; x < resolution; ++x) {
+				while (k + 1 < sites.size() && boundaries[k + 1] <= static_cast<double>(x)) {
+					++k;
+				}
+				const auto source_x = sites[k];
+				const auto source_y = static_cast<std::size_t>(row[source_x]);
+				std::copy_n(&pixels[(source_y * resolution + source_x) * channel_count], channel_count, &out[x * channel_count]);
+			}
+		});
+	}
+
+private:
+	static constexpr auto none = std::numeric_limits<std::uint32_t>::max();
+	static constexpr auto strip_width = std::size_t{64};
+
+	static auto check_size(std::span<const float> pixels, std::span<float> result, std::size_t resolution) -> void {
+		if (pixels.size() != resolution * resolution * channel_count || result.size() != pixels.size()) {
+			throw std::invalid_argument{"Invalid lightmap filter image size!"};
+		}
+		if (resolution >= none) {
+			throw std::invalid_argument{"Lightmap filter image is too large!"};
+		}
+	}
+
+	[[nodiscard]] static auto get_valid_mask(std::span<const float> pixels, std::size_t resolution) -> std::vector<std::uint8_t> {
+		auto result = std::vector<std::uint8_t>(resolution * resolution);
+		parallel_for(resolution, [&](std::size_t y) {
+			for (auto i = y * resolution; i < (y + 1) * resolution; ++i) {
+				const auto* const pixel = &pixels[i * channel_count];
+				result[i] = static_cast<std::uint8_t>(pixel[0] > 0.0f || pixel[1] > 0.0f || pixel[2] > 0.0f || pixel[3] > 0.0f);
+			}
+		});
+		return result;
+	}
+};
+
+#endif
@@ -3,23 +3,27 @@
 
 #include "../core/glsl.hpp"
 #include "../core/opengl.hpp"
-#include "../render/model_renderer.hpp"
-#include "../render/shadow_renderer.hpp"
-#include "../render/skybox_renderer.hpp"
-#include "../resources/camera.hpp"
 #include "../resources/lightmap.hpp"
+#include "../resources/model.hpp"
 #include "../resources/scene.hpp"
-#include "../resources/texture.hpp"
+#include "lightmap_bake_telemetry.hpp"
+#include "lightmap_baker.hpp"
 
+#include <algorithm>            // std::max
 #include <array>                // std::array
+#include <chrono>               // std::chrono
+#include <cmath>                // std::cbrt
 #include <cstddef>              // std::size_t
 #include <cstdint>              // std::uint32_t
-#include <cstring>              // std::memcpy
+#include <cstdio>               // stderr
+#include <fmt/format.h>         // fmt::print
 #include <functional>           // std::function
 #include <glm/gtc/type_ptr.hpp> // glm::value_ptr
-#include <lightmapper.h>        // lm..., LM_...
-#include <memory>               // std::unique_ptr, std::shared_ptr, std::make_shared
+#include <limits>               // std::numeric_limits
+#include <memory>               // std::unique_ptr
 #include <mutex>                // std::mutex, std::lock_guard
+#include <optional>             // std::optional, std::in_place
+#include <span>                 // std::span
 #include <string_view>          // std::string_view
 #include <type_traits>          // std::is_same_v
 #include <unordered_map>        // std::unordered_map
@@ -29,17 +33,39 @@
 
 class lightmap_generator final {
 public:
-	static constexpr auto hemisphere_size = 64;
-	static constexpr auto near_z = 0.001f;
-	static constexpr auto far_z = 100.0f;
-	static constexpr auto interpolation_passes = 2;
-	static constexpr auto interpolation_threshold = 0.01f;
-	static constexpr auto camera_to_surface_distance_modifier = 0.0f;
+	static constexpr auto progress_interval = std::chrono::milliseconds{100};
 
 	using progress_callback = std::function<bool(std::string_view category, std::size_t bounce_index, std::size_t bounce_count, std::size_t object_index, std::size_t object_count,
 		std::size_t mesh_index, std::size_t mesh_count, float progress)>;
 
-	static auto generate_lightmap_coordinates(scene& scene, const progress_callback& callback) -> void {
+	// Progress callback that prints the progress to stderr at most every progress_interval.
+	struct progress_printer final {
+		auto operator()(std::string_view category, std::size_t bounce_index, std::size_t bounce_count, std::size_t object_index, std::size_t object_count,
+			std::size_t mesh_index, std::size_t mesh_count, float progress) -> bool {
+			if (const auto now = std::chrono::steady_clock::now(); now >= next_print_time) {
+				next_print_time = now + progress_interval;
+				fmt::print(stderr, "\r  {}: ", category);
+				if (bounce_count != 0) {
+					fmt::print(stderr, "Bounce {}/{}: ", bounce_index + 1, bounce_count);
+				}
+				if (object_count != 0) {
+					fmt::print(stderr, "Object {}/{}: ", object_index + 1, object_count);
+				}
+				if (mesh_count != 0) {
+					fmt::print(stderr, "Mesh {}/{}: ", mesh_index + 1, mesh_count);
+				}
+				fmt::print(stderr, "{}%                              \r", progress * 100.0f);
+			}
+			return true;
+		}
+
+		std::chrono::steady_clock::time_point next_print_time = std::chrono::steady_clock::now();
+	};
+
+	// Generate lightmap coordinates for every model and pack one rectangle per object into the scene atlas, sized so that each object gets
+	// texels_per_unit texels per world unit along its surface, multiplied by its lightmap density. Returns the atlas resolution that achieves this density.
+	// A bake at a different resolution scales all objects uniformly. The time spent is added to the uv_unwrap and packing phases of the telemetry.
+	static auto generate_lightmap_coordinates(scene& scene, float texels_per_unit, lightmap_bake_telemetry& telemetry, const progress_callback& callback) -> std::size_t {
 		static_assert(std::is_same_v<model_index, GLuint> && sizeof(model_index) == 4, "This function assumes 32-bit model indices.");
 
 		struct progress_data final {
@@ -79,11 +105,24 @@ public:
 			model_index{2},
 		};
 
+		if (!(texels_per_unit > 0.0f)) {
+			throw lightmap_error{"Invalid lightmap texel density!"};
+		}
+
+		// Each model is unwrapped once, at the density of its most demanding instance.
+		auto model_texel_scales = std::unordered_map<model*, float>{};
+		for (const auto& object : scene.objects) {
+			auto& model_texel_scale = model_texel_scales[object.model_ptr.get()];
+			model_texel_scale = max(model_texel_scale, get_texel_scale(object));
+		}
+
 		auto object_atlas = atlas_ptr{xatlas::Create()};
 		auto generated_model_coordinate_scales = std::unordered_map<model*, vec2>{};
 		for (auto& object : scene.objects) {
+			const auto model_texel_scale = model_texel_scales[object.model_ptr.get()];
 			const auto [it, inserted] = generated_model_coordinate_scales.try_emplace(object.model_ptr.get());
 			if (inserted) {
+				auto unwrap_timer = std::optional<lightmap_bake_telemetry::scoped_timer>{std::in_place, telemetry, lightmap_bake_phase::uv_unwrap};
 				auto atlas = atlas_ptr{xatlas::Create()};
 				xatlas::SetProgressCallback(
 					atlas.get(),
@@ -93,6 +132,7 @@ public:
 					&scene_progress);
 				scene_progress.mesh_index = 0;
 				scene_progress.mesh_count = object.model_ptr->meshes().size();
+				object.model_ptr->load_cpu_data();
 				for (auto& mesh : object.model_ptr->meshes()) {
 					if (const auto error = xatlas::AddMesh(atlas.get(),
 							xatlas::MeshDecl{
@@ -112,10 +152,13 @@ public:
 				}
 				scene_progress.mesh_index = 0;
 				scene_progress.mesh_count = 0;
-				xatlas::Generate(atlas.get(),
-					xatlas::ChartOptions{},
+				xatlas::ComputeCharts(atlas.get(), xatlas::ChartOptions{});
+				unwrap_timer.reset();
+				const auto pack_timer = telemetry.time(lightmap_bake_phase::packing);
+				xatlas::PackCharts(atlas.get(),
 					xatlas::PackOptions{
 						.padding = static_cast<std::uint32_t>(lightmap_texture::padding),
+						.texelsPerUnit = texels_per_unit * model_texel_scale,
 					});
 
 				const auto scale = vec2{static_cast<float>(atlas->width), static_cast<float>(atlas->height)};
@@ -127,41 +170,28 @@ public:
 					const auto& new_mesh = atlas->meshes[mesh_index];
 
 					const auto new_vertex_count = static_cast<std::size_t>(new_mesh.vertexCount);
-					auto new_vertices = std::vector<model_vertex>{};
-					new_vertices.reserve(new_vertex_count);
+					auto vertex_sources = std::vector<model_index>{};
+					auto lightmap_coordinates = std::vector<vec2>{};
+					vertex_sources.reserve(new_vertex_count);
+					lightmap_coordinates.reserve(new_vertex_count);
 					for (const auto& new_vertex : std::span{new_mesh.vertexArray, new_vertex_count}) {
-						const auto old_vertex_index = static_cast<std::size_t>(new_vertex.xref);
-						if (old_vertex_index >= mesh.vertices().size()) {
-							throw lightmap_error{"Invalid old vertex index!"};
-						}
-						const auto& old_vertex = mesh.vertices()[old_vertex_index];
-						new_vertices.push_back(model_vertex{
-							.position = old_vertex.position,
-							.normal = old_vertex.normal,
-							.tangent = old_vertex.tangent,
-							.bitangent = old_vertex.bitangent,
-							.texture_coordinates = old_vertex.texture_coordinates,
-							.lightmap_coordinates = vec2{new_vertex.uv[0], new_vertex.uv[1]} / scale,
-						});
+						vertex_sources.push_back(static_cast<model_index>(new_vertex.xref));
+						lightmap_coordinates.push_back(vec2{new_vertex.uv[0], new_vertex.uv[1]} / scale);
 					}
 
 					const auto new_index_count = static_cast<std::size_t>(new_mesh.indexCount);
 					auto new_indices = std::vector<model_index>{};
 					new_indices.reserve(new_index_count);
 					for (const auto& new_index : std::span{new_mesh.indexArray, new_index_count}) {
-						const auto new_vertex_index = static_cast<model_index>(new_index);
-						if (new_vertex_index >= new_vertex_count) {
-							throw lightmap_error{"Invalid new vertex index!"};
-						}
-						new_indices.push_back(new_vertex_index);
+						new_indices.push_back(static_cast<model_index>(new_index));
 					}
 
-					mesh.set_vertices(std::move(new_vertices), std::move(new_indices));
+					mesh.remap_vertices(vertex_sources, lightmap_coordinates, std::move(new_indices));
 					++mesh_index;
 				}
 				it->second = scale;
 			}
-			const auto scale = it->second;
+			const auto scale = it->second * (get_texel_scale(object) / model_texel_scale);
 			const auto coordinates = std::array<vec2, 4>{
 				vec2{0.0f, 0.0f},
 				vec2{0.0f, scale.y},
@@ -180,6 +210,7 @@ public:
 			++scene_progress.object_index;
 		}
 
+		// The object rectangles are already measured in texels.
 		xatlas::AddUvMesh(object_atlas.get(),
 			xatlas::UvMeshDecl{
 				.vertexUvData = default_coordinates.data(),
@@ -194,12 +225,14 @@ public:
 		scene_progress.mesh_index = 0;
 		scene_progress.mesh_count = 0;
 		scene_progress.update("Packing object coordinates", 0.0f);
+		const auto pack_timer = telemetry.time(lightmap_bake_phase::packing);
 		xatlas::Generate(object_atlas.get(),
 			xatlas::ChartOptions{
 				.useInputMeshUvs = true,
 			},
 			xatlas::PackOptions{
 				.padding = static_cast<std::uint32_t>(lightmap_texture::padding),
+				.texelsPerUnit = 1.0f,
 				.rotateChartsToAxis = false,
 				.rotateCharts = false,
 			});
@@ -250,6 +283,7 @@ public:
 		scene.default_lightmap_offset = default_min_coordinates;
 		scene.default_lightmap_scale = default_max_coordinates - default_min_coordinates;
 		scene_progress.update("Packing object coordinates", 1.0f);
+		return static_cast<std::size_t>(std::max(object_atlas->width, object_atlas->height));
 	}
 
 	static auto reset_lightmap(scene& scene) -> void {
@@ -258,157 +292,38 @@ public:
 		scene.default_lightmap_scale = vec2{1.0f, 1.0f};
 	}
 
-	static auto bake_lightmap(scene& scene, vec3 sky_color, std::size_t resolution, std::size_t bounce_count, const progress_callback& callback) -> void {
-		static_assert(std::is_same_v<model_index, GLuint> && sizeof(model_index) == 4, "This function assumes 32-bit model indices.");
-
-		auto cam = camera{vec3{0.0f, 100.0f, 0.0f}, vec3{0.0f, -1.0f, 0.0f}, vec3{0.0f, 0.0f, 1.0f}, camera_options{}};
-
-		{
-			auto shadow_baker = shadow_renderer{};
-			for (const auto& light : scene.directional_lights) {
-				shadow_baker.draw_directional_light(light);
-			}
-			for (const auto& light : scene.point_lights) {
-				shadow_baker.draw_point_light(light);
-			}
-			for (const auto& light : scene.spot_lights) {
-				shadow_baker.draw_spot_light(light);
+	static auto bake_lightmap(scene& scene, lightmap_bake_options options, lightmap_bake_telemetry& telemetry, const progress_callback& callback) -> void {
+		options.use_preview = false;
+		auto baker = lightmap_baker{scene, options, telemetry};
+		while (!baker.step(std::numeric_limits<std::size_t>::max(), progress_interval)) {
+			if (!callback("Baking lightmaps",
+					baker.bounce_index(),
+					baker.bounce_count(),
+					baker.object_index(),
+					baker.object_count(),
+					baker.mesh_index(),
+					baker.mesh_count(),
+					baker.mesh_progress())) {
+				throw lightmap_error{"Baking cancelled!"};
 			}
-			for (const auto& object : scene.objects) {
-				shadow_baker.draw_model(object.model_ptr, object.transform);
-			}
-			shadow_baker.render(cam);
-		}
-
-		auto model_baker = model_renderer{true};
-		auto skybox_baker = skybox_renderer{};
-
-		const auto width = static_cast<int>(resolution);
-		const auto height = static_cast<int>(resolution);
-		const auto channel_count = static_cast<int>(lightmap_texture::channel_count);
-
-		lightmapper_ptr lightmapper{
-			lmCreate(hemisphere_size, near_z, far_z, sky_color.x, sky_color.y, sky_color.z, interpolation_passes, interpolation_threshold, camera_to_surface_distance_modifier)};
-		if (!lightmapper) {
-			throw lightmap_error{"Failed to initialize lightmapper!"};
 		}
+		telemetry = baker.telemetry();
+	}
 
-		for (auto bounce_index = std::size_t{0}; bounce_index < bounce_count; ++bounce_index) {
-			auto pixels = std::vector<float>(resolution * resolution * lightmap_texture::channel_count, 0.0f);
-			lmSetTargetLightmap(lightmapper.get(), pixels.data(), width, height, channel_count);
-
-			auto object_index = std::size_t{0};
-			for (auto& object : scene.objects) {
-				auto mesh_index = std::size_t{0};
-				for (const auto& mesh : object.model_ptr->meshes()) {
-					auto lightmap_coordinates = std::vector<vec2>();
-					lightmap_coordinates.reserve(mesh.vertices().size());
-					for (const auto& vertex : mesh.vertices()) {
-						lightmap_coordinates.push_back(object.lightmap_offset + vertex.lightmap_coordinates * object.lightmap_scale);
-					}
-					lmSetGeometry(lightmapper.get(),
-						glm::value_ptr(object.transform),
-						LM_FLOAT,
-						glm::value_ptr(mesh.vertices()[0].position),
-						sizeof(model_vertex),
-						LM_FLOAT,
-						glm::value_ptr(mesh.vertices()[0].normal),
-						sizeof(model_vertex),
-						LM_FLOAT,
-						lightmap_coordinates.data(),
-						sizeof(lightmap_coordinates[0]),
-						static_cast<int>(mesh.indices().size()),
-						LM_UNSIGNED_INT, // NOTE: 32-bit model index assumed here.
-						mesh.indices().data());
-					auto viewport = std::array<int, 4>{};
-					while (lmBegin(lightmapper.get(), viewport.data(), glm::value_ptr(cam.view_matrix), glm::value_ptr(cam.projection_matrix))) {
-						try {
-							skybox_baker.draw_skybox(scene.sky->original());
-							model_baker.draw_lightmap(scene.lightmap);
-							model_baker.draw_environment(scene.sky);
-							for (const auto& light : scene.directional_lights) {
-								model_baker.draw_directional_light(light);
-							}
-							for (const auto& light : scene.point_lights) {
-								model_baker.draw_point_light(light);
-							}
-							for (const auto& light : scene.spot_lights) {
-								model_baker.draw_spot_light(light);
-							}
-							for (const auto& object : scene.objects) {
-								model_baker.draw_model(object.model_ptr, object.transform, object.lightmap_offset, object.lightmap_scale);
-							}
-
-							cam.update_cascade_frustums();
-
-							glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
-							model_baker.render(cam);
-							skybox_baker.render(cam.projection_matrix, mat3{cam.view_matrix});
-							if (!callback("Baking lightmaps",
-									bounce_index,
-									bounce_count,
-									object_index,
-									scene.objects.size(),
-									mesh_index,
-									object.model_ptr->meshes().size(),
-									lmProgress(lightmapper.get()))) {
-								throw lightmap_error{"Baking cancelled!"};
-							}
-						} catch (...) {
-							lmEnd(lightmapper.get());
-							throw;
-						}
-						lmEnd(lightmapper.get());
-					}
-					++mesh_index;
-				}
-				++object_index;
-			}
-
-			const auto lightmap_scale = vec2{static_cast<float>(resolution), static_cast<float>(resolution)};
-			const auto default_offset = scene.default_lightmap_offset * lightmap_scale;
-			const auto default_scale = scene.default_lightmap_scale * lightmap_scale;
-			const auto default_x_begin = static_cast<std::size_t>(default_offset.x);
-			const auto default_x_end = static_cast<std::size_t>(default_offset.x + default_scale.x);
-			const auto default_y_begin = static_cast<std::size_t>(default_offset.y);
-			const auto default_y_end = static_cast<std::size_t>(default_offset.y + default_scale.y);
-			if (default_x_begin > default_x_end || default_y_begin > default_y_end || default_x_end > resolution || default_y_end > resolution) {
-				throw lightmap_error{"Invalid default lightmap pixel coordinates!"};
-			}
-			for (auto y = default_y_begin; y < default_y_end; ++y) {
-				for (auto x = default_x_begin; x < default_x_end; ++x) {
-					auto* const pixel = &pixels[((y * resolution) + x) * lightmap_texture::channel_count];
-					const auto sky_pixel = std::array<float, 4>{sky_color.x, sky_color.y, sky_color.z, 0.0f};
-					std::memcpy(pixel, sky_pixel.data(), lightmap_texture::channel_count);
-				}
-			}
-
-			auto temp = std::vector<float>(pixels.size(), 0.0f);
-			for (int i = 0; i < 16; ++i) {
-				lmImageDilate(pixels.data(), temp.data(), width, height, channel_count);
-				lmImageDilate(temp.data(), pixels.data(), width, height, channel_count);
-			}
-			lmImageSmooth(pixels.data(), temp.data(), width, height, channel_count);
-			lmImageDilate(temp.data(), pixels.data(), width, height, channel_count);
+private:
+	static constexpr auto min_texel_scale = 0.001f;
 
-			scene.lightmap = std::make_shared<lightmap_texture>(lightmap_texture::create(resolution, pixels.data()));
-		}
+	// Average linear scale of the object transform, times the density multiplier of the object.
+	[[nodiscard]] static auto get_texel_scale(const scene_object& object) -> float {
+		return max(std::cbrt(abs(glm::determinant(mat3{object.transform}))) * object.lightmap_density, min_texel_scale);
 	}
 
-private:
 	struct atlas_deleter final {
 		auto operator()(xatlas::Atlas* p) const noexcept -> void {
 			xatlas::Destroy(p);
 		}
 	};
 	using atlas_ptr = std::unique_ptr<xatlas::Atlas, atlas_deleter>;
-
-	struct lightmapper_deleter final {
-		auto operator()(lm_context* p) const noexcept -> void {
-			lmDestroy(p);
-		}
-	};
-	using lightmapper_ptr = std::unique_ptr<lm_context, lightmapper_deleter>;
 };
 
 #endif
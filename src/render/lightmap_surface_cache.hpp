@@ -0,0 +1,149 @@
+#ifndef LIGHTMAP_SURFACE_CACHE_HPP
+#define LIGHTMAP_SURFACE_CACHE_HPP
+
+#include "../core/glsl.hpp"
+#include "../resources/model.hpp"
+#include "../utilities/parallel.hpp"
+
+#include <algorithm>                  // std::min, std::max
+#include <cstddef>                    // std::size_t
+#include <cstdint>                    // std::uint32_t
+#include <glm/gtc/matrix_inverse.hpp> // glm::inverseTranspose
+#include <limits>                     // std::numeric_limits
+#include <span>                       // std::span
+#include <utility>                    // std::pair
+#include <vector>                     // std::vector
+
+// World space surface data for every lightmap texel, rasterized on the CPU from the lightmap coordinates of the scene. Used to guide the denoiser.
+class lightmap_surface_cache final {
+public:
+	static constexpr auto no_object = std::numeric_limits<std::uint32_t>::max();
+
+	struct texel final {
+		vec3 position{};
+		vec3 normal{};
+		std::uint32_t object_index = no_object;
+	};
+
+	// A mesh placed in the lightmap, with one atlas coordinate in [0, 1] per vertex.
+	struct surface final {
+		std::uint32_t object_index;
+		mat4 transform;
+		const model_mesh* mesh;
+		std::span<const vec2> lightmap_coordinates;
+	};
+
+	// Rasterize the surfaces in bands of rows on all threads. Each band only visits the surfaces whose atlas bounds overlap it.
+	lightmap_surface_cache(std::size_t resolution, std::span<const surface> surfaces)
+		: m_resolution(resolution)
+		, m_texels(resolution * resolution) {
+		auto y_bounds = std::vector<std::pair<float, float>>{};
+		y_bounds.reserve(surfaces.size());
+		for (const auto& surface : surfaces) {
+			auto bounds = std::pair{std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest()};
+			for (const auto& coordinates : surface.lightmap_coordinates) {
+				bounds = std::pair{min(bounds.first, coordinates.y), max(bounds.second, coordinates.y)};
+			}
+			y_bounds.push_back(bounds);
+		}
+		const auto scale = static_cast<float>(m_resolution);
+		parallel_for((m_resolution + rows_per_band - 1) / rows_per_band, [&](std::size_t band) {
+			const auto y_begin = band * rows_per_band;
+			const auto y_end = std::min(y_begin + rows_per_band, m_resolution);
+			for (auto i = std::size_t{0}; i < surfaces.size(); ++i) {
+				if (y_bounds[i].second * scale >= static_cast<float>(y_begin) && y_bounds[i].first * scale <= static_cast<float>(y_end)) {
+					rasterize(surfaces[i], y_begin, y_end);
+				}
+			}
+		});
+	}
+
+	// Lightmap area covered by a mesh at the given atlas coordinates, in texels of a lightmap with the given resolution.
+	[[nodiscard]] static auto get_covered_area(const model_mesh& mesh, std::span<const vec2> lightmap_coordinates, std::size_t resolution) -> float {
+		const auto scale = static_cast<float>(resolution);
+		const auto indices = mesh.indices();
+		auto result = 0.0f;
+		for (auto i = std::size_t{0}; i + 2 < indices.size(); i += 3) {
+			const auto area = edge(lightmap_coordinates[indices[i]] * scale, lightmap_coordinates[indices[i + 1]] * scale, lightmap_coordinates[indices[i + 2]] * scale);
+			if (abs(area) > std::numeric_limits<float>::epsilon()) {
+				result += abs(area) * 0.5f;
+			}
+		}
+		return result;
+	}
+
+	[[nodiscard]] auto resolution() const noexcept -> std::size_t {
+		return m_resolution;
+	}
+
+	[[nodiscard]] auto texels() const noexcept -> std::span<const texel> {
+		return m_texels;
+	}
+
+	[[nodiscard]] auto get(std::size_t x, std::size_t y) const noexcept -> const texel& {
+		return m_texels[y * m_resolution + x];
+	}
+
+	[[nodiscard]] auto is_covered(std::size_t x, std::size_t y) const noexcept -> bool {
+		return get(x, y).object_index != no_object;
+	}
+
+private:
+	static constexpr auto rows_per_band = std::size_t{32};
+
+	// Rasterize the triangles of a surface into the rows in [y_begin, y_end).
+	auto rasterize(const surface& surface, std::size_t y_begin, std::size_t y_end) -> void {
+		const auto normal_matrix = glm::inverseTranspose(mat3{surface.transform});
+		const auto scale = static_cast<float>(m_resolution);
+		const auto vertices = surface.mesh->vertices();
+		const auto indices = surface.mesh->indices();
+		for (auto i = std::size_t{0}; i + 2 < indices.size(); i += 3) {
+			const auto p0 = surface.lightmap_coordinates[indices[i]] * scale;
+			const auto p1 = surface.lightmap_coordinates[indices[i + 1]] * scale;
+			const auto p2 = surface.lightmap_coordinates[indices[i + 2]] * scale;
+			const auto triangle_y_begin = std::max(clamp_texel(floor(min(p0.y, min(p1.y, p2.y)))), y_begin);
+			const auto triangle_y_end = std::min(clamp_texel(ceil(max(p0.y, max(p1.y, p2.y)))), y_end);
+			if (triangle_y_begin >= triangle_y_end) {
+				continue;
+			}
+			const auto area = edge(p0, p1, p2);
+			if (abs(area) <= std::numeric_limits<float>::epsilon()) {
+				continue;
+			}
+			const auto& v0 = vertices[indices[i]];
+			const auto& v1 = vertices[indices[i + 1]];
+			const auto& v2 = vertices[indices[i + 2]];
+			const auto x_begin = clamp_texel(floor(min(p0.x, min(p1.x, p2.x))));
+			const auto x_end = clamp_texel(ceil(max(p0.x, max(p1.x, p2.x))));
+			const auto inverse_area = 1.0f / area;
+			for (auto y = triangle_y_begin; y < triangle_y_end; ++y) {
+				for (auto x = x_begin; x < x_end; ++x) {
+					const auto center = vec2{static_cast<float>(x) + 0.5f, static_cast<float>(y) + 0.5f};
+					const auto w0 = edge(p1, p2, center) * inverse_area;
+					const auto w1 = edge(p2, p0, center) * inverse_area;
+					const auto w2 = edge(p0, p1, center) * inverse_area;
+					if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) {
+						continue;
+					}
+					auto& result = m_texels[y * m_resolution + x];
+					result.position = vec3{surface.transform * vec4{v0.position * w0 + v1.position * w1 + v2.position * w2, 1.0f}};
+					result.normal = normalize(normal_matrix * (v0.normal * w0 + v1.normal * w1 + v2.normal * w2));
+					result.object_index = surface.object_index;
+				}
+			}
+		}
+	}
+
+	[[nodiscard]] static auto edge(vec2 a, vec2 b, vec2 p) noexcept -> float {
+		return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+	}
+
+	[[nodiscard]] auto clamp_texel(float coordinate) const noexcept -> std::size_t {
+		return static_cast<std::size_t>(clamp(coordinate, 0.0f, static_cast<float>(m_resolution)));
+	}
+
+	std::size_t m_resolution;
+	std::vector<texel> m_texels;
+};
+
+#endif
@@ -9,6 +9,7 @@
 #include "../resources/lightmap.hpp"
 #include "../resources/model.hpp"
 #include "../resources/shader.hpp"
+#include "../resources/texture_streamer.hpp"
 #include "brdf_generator.hpp"
 
 #include <algorithm>                  // std::ranges::sort
@@ -17,10 +18,10 @@
 #include <glm/gtc/matrix_inverse.hpp> // glm::inverseTranspose
 #include <glm/gtc/type_ptr.hpp>       // glm::value_ptr
 #include <glm/gtx/norm.hpp>           // glm::distance2
-#include <memory>                     // std::shared_ptr
+#include <limits>                     // std::numeric_limits
 #include <span>                       // std::span
-#include <unordered_map>              // std::unordered_map
-#include <utility>                    // std::move
+#include <string>                     // std::string
+#include <unordered_map>              // std::unordered_map, std::erase_if
 #include <vector>                     // std::vector
 
 class model_renderer final {
@@ -29,6 +30,7 @@ public:
 	static constexpr auto directional_light_count = std::size_t{1};
 	static constexpr auto point_light_count = std::size_t{2};
 	static constexpr auto spot_light_count = std::size_t{2};
+	static constexpr auto lod_pixel_error = 1.0f; // How many pixels a level of detail may be off by on screen.
 
 	static constexpr auto reserved_texture_units_begin = GLint{0};
 	static constexpr auto lightmap_texture_unit = GLint{reserved_texture_units_begin};
@@ -44,40 +46,72 @@ public:
 	explicit model_renderer(bool baking)
 		: m_baking(baking) {}
 
+	auto resize(int /*width*/, int height) -> void {
+		m_viewport_height = static_cast<float>(height);
+	}
+
 	auto reload_shaders() -> void {
 		m_model_shader = model_shader{m_baking, false, false};
 		m_model_shader_with_alpha_test = model_shader{m_baking, true, false};
 		m_model_shader_with_alpha_blending = model_shader{m_baking, false, true};
 	}
 
-	auto draw_lightmap(std::shared_ptr<lightmap_texture> lightmap) -> void {
-		m_lightmap = std::move(lightmap);
+	auto reload_changed_shaders(std::span<const std::string> filenames) -> void {
+		if (m_model_shader.program.depends_on_any(filenames)) {
+			m_model_shader = model_shader{m_baking, false, false};
+		}
+		if (m_model_shader_with_alpha_test.program.depends_on_any(filenames)) {
+			m_model_shader_with_alpha_test = model_shader{m_baking, true, false};
+		}
+		if (m_model_shader_with_alpha_blending.program.depends_on_any(filenames)) {
+			m_model_shader_with_alpha_blending = model_shader{m_baking, false, true};
+		}
+	}
+
+	// Report how many pixels across the submitted models cover on screen to a texture streamer whenever they are rendered.
+	auto stream_textures(texture_streamer& streamer) -> void {
+		m_texture_streamer = &streamer;
+	}
+
+	// Submissions are not owned by the renderer, and must stay alive until they have been rendered.
+	auto draw_lightmap(const lightmap_texture& lightmap) -> void {
+		m_lightmap = &lightmap;
 	}
 
-	auto draw_environment(std::shared_ptr<environment_cubemap> environment) -> void {
-		m_environment = std::move(environment);
+	auto draw_environment(const environment_cubemap& environment) -> void {
+		m_environment = &environment;
 	}
 
-	auto draw_directional_light(std::shared_ptr<directional_light> light) -> void {
-		m_directional_lights.push_back(std::move(light));
+	auto draw_directional_light(const directional_light& light) -> void {
+		m_directional_lights.push_back(&light);
 	}
 
-	auto draw_point_light(std::shared_ptr<point_light> light) -> void {
-		m_point_lights.push_back(std::move(light));
+	auto draw_point_light(const point_light& light) -> void {
+		m_point_lights.push_back(&light);
 	}
 
-	auto draw_spot_light(std::shared_ptr<spot_light> light) -> void {
-		m_spot_lights.push_back(std::move(light));
+	auto draw_spot_light(const spot_light& light) -> void {
+		m_spot_lights.push_back(&light);
 	}
 
-	auto draw_model(std::shared_ptr<model> model, const mat4& transform, vec2 lightmap_offset, vec2 lightmap_scale) -> void {
-		m_model_instances[std::move(model)].emplace_back(transform, lightmap_offset, lightmap_scale);
+	auto draw_model(const model& model, const mat4& transform, vec2 lightmap_offset, vec2 lightmap_scale) -> void {
+		m_model_instances[&model].emplace_back(transform, lightmap_offset, lightmap_scale);
 	}
 
 	auto render(const camera& camera) -> void {
+		if (m_texture_streamer) {
+			request_textures(camera);
+		}
+		render_retained(camera);
+		clear();
+	}
+
+	// Render the current submissions without clearing them, so that the same draw lists can be rendered again from another camera.
+	auto render_retained(const camera& camera) -> void {
 		if (m_baking) {
 			glDisable(GL_CULL_FACE);
 		}
+		update_instances(camera);
 
 		// Render meshes without alpha.
 		glUseProgram(m_model_shader.program.get());
@@ -99,13 +133,11 @@ public:
 					glUniform1i(m_model_shader.material_roughness.location(), static_cast<GLint>(model_texture_units_begin + material.roughness_texture_offset));
 					glUniform1i(m_model_shader.material_metallic.location(), static_cast<GLint>(model_texture_units_begin + material.metallic_texture_offset));
 					for (const auto& instance : instances) {
-						const auto& model_matrix = instance.transform;
-						const auto normal_matrix = glm::inverseTranspose(mat3{model_matrix});
-						glUniformMatrix4fv(m_model_shader.model_matrix.location(), 1, GL_FALSE, glm::value_ptr(model_matrix));
-						glUniformMatrix3fv(m_model_shader.normal_matrix.location(), 1, GL_FALSE, glm::value_ptr(normal_matrix));
+						glUniformMatrix4fv(m_model_shader.model_matrix.location(), 1, GL_FALSE, glm::value_ptr(instance.transform));
+						glUniformMatrix3fv(m_model_shader.normal_matrix.location(), 1, GL_FALSE, glm::value_ptr(instance.normal_matrix));
 						glUniform2fv(m_model_shader.lightmap_offset.location(), 1, glm::value_ptr(instance.lightmap_offset));
 						glUniform2fv(m_model_shader.lightmap_scale.location(), 1, glm::value_ptr(instance.lightmap_scale));
-						glDrawElements(model_mesh::primitive_type, static_cast<GLsizei>(mesh.indices().size()), model_mesh::index_type, nullptr);
+						mesh.draw(mesh.select_lod(instance.max_lod_error), instance.cluster_view, m_draw_ranges);
 					}
 				}
 			}
@@ -131,7 +163,8 @@ public:
 				if (material.alpha_blending) {
 					for (const auto& instance : instances) {
 						const auto depth = glm::distance2(camera.position, vec3{instance.transform[3]});
-						m_alpha_blended_mesh_instances.emplace_back(model, mesh, instance.transform, instance.lightmap_offset, instance.lightmap_scale, depth);
+						m_alpha_blended_mesh_instances.emplace_back(
+							*model, mesh, mesh.select_lod(instance.max_lod_error), instance.transform, instance.lightmap_offset, instance.lightmap_scale, depth);
 					}
 				} else if (material.alpha_test) {
 					glBindVertexArray(mesh.get());
@@ -140,13 +173,11 @@ public:
 					glUniform1i(m_model_shader_with_alpha_test.material_roughness.location(), static_cast<GLint>(model_texture_units_begin + material.roughness_texture_offset));
 					glUniform1i(m_model_shader_with_alpha_test.material_metallic.location(), static_cast<GLint>(model_texture_units_begin + material.metallic_texture_offset));
 					for (const auto& instance : instances) {
-						const auto& model_matrix = instance.transform;
-						const auto normal_matrix = glm::inverseTranspose(mat3{model_matrix});
-						glUniformMatrix4fv(m_model_shader_with_alpha_test.model_matrix.location(), 1, GL_FALSE, glm::value_ptr(model_matrix));
-						glUniformMatrix3fv(m_model_shader_with_alpha_test.normal_matrix.location(), 1, GL_FALSE, glm::value_ptr(normal_matrix));
+						glUniformMatrix4fv(m_model_shader_with_alpha_test.model_matrix.location(), 1, GL_FALSE, glm::value_ptr(instance.transform));
+						glUniformMatrix3fv(m_model_shader_with_alpha_test.normal_matrix.location(), 1, GL_FALSE, glm::value_ptr(instance.normal_matrix));
 						glUniform2fv(m_model_shader_with_alpha_test.lightmap_offset.location(), 1, glm::value_ptr(instance.lightmap_offset));
 						glUniform2fv(m_model_shader_with_alpha_test.lightmap_scale.location(), 1, glm::value_ptr(instance.lightmap_scale));
-						glDrawElements(model_mesh::primitive_type, static_cast<GLsizei>(mesh.indices().size()), model_mesh::index_type, nullptr);
+						mesh.draw(mesh.select_lod(instance.max_lod_error), instance.two_sided_cluster_view, m_draw_ranges);
 					}
 				}
 			}
@@ -161,7 +192,7 @@ public:
 		upload_uniform_frame_data(m_model_shader_with_alpha_blending, camera);
 		glEnable(GL_BLEND);
 		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-		for (const auto& [model, mesh, transform, lightmap_offset, lightmap_scale, depth] : m_alpha_blended_mesh_instances) {
+		for (const auto& [model, mesh, lod, transform, lightmap_offset, lightmap_scale, depth] : m_alpha_blended_mesh_instances) {
 			const auto model_texture_units_begin = reserved_texture_units_end;
 			auto texture_index = 0;
 			for (const auto& texture : model->textures()) {
@@ -182,17 +213,11 @@ public:
 			glUniformMatrix3fv(m_model_shader_with_alpha_blending.normal_matrix.location(), 1, GL_FALSE, glm::value_ptr(normal_matrix));
 			glUniform2fv(m_model_shader_with_alpha_blending.lightmap_offset.location(), 1, glm::value_ptr(lightmap_offset));
 			glUniform2fv(m_model_shader_with_alpha_blending.lightmap_scale.location(), 1, glm::value_ptr(lightmap_scale));
-			glDrawElements(model_mesh::primitive_type, static_cast<GLsizei>(mesh->indices().size()), model_mesh::index_type, nullptr);
+			mesh->draw(lod);
 		}
 		glBlendFunc(GL_ONE, GL_ZERO);
 		glDisable(GL_BLEND);
 
-		m_lightmap = lightmap_texture::get_default();
-		m_environment = environment_cubemap::get_default();
-		m_directional_lights.clear();
-		m_point_lights.clear();
-		m_spot_lights.clear();
-		m_model_instances.clear();
 		m_alpha_blended_mesh_instances.clear();
 
 		if (m_baking) {
@@ -200,6 +225,17 @@ public:
 		}
 	}
 
+	auto clear() -> void {
+		m_lightmap = lightmap_texture::get_default().get();
+		m_environment = environment_cubemap::get_default().get();
+		m_directional_lights.clear();
+		m_point_lights.clear();
+		m_spot_lights.clear();
+		for (auto& [model, instances] : m_model_instances) {
+			instances.clear();
+		}
+	}
+
 private:
 	struct model_shader final {
 		model_shader(bool baking, bool use_alpha_test, bool use_alpha_blending)
@@ -241,6 +277,7 @@ private:
 		shader_uniform material_roughness{program.get(), "material_roughness"};
 		shader_uniform material_metallic{program.get(), "material_metallic"};
 		shader_uniform lightmap_texture{program.get(), "lightmap_texture"};
+		shader_uniform lightmap_rgbm_range{program.get(), "lightmap_rgbm_range"};
 		shader_uniform lightmap_offset{program.get(), "lightmap_offset"};
 		shader_uniform lightmap_scale{program.get(), "lightmap_scale"};
 		shader_uniform environment_cubemap_texture{program.get(), "environment_cubemap_texture"};
@@ -264,27 +301,35 @@ private:
 	struct model_instance final {
 		model_instance(const mat4& transform, vec2 lightmap_offset, vec2 lightmap_scale) noexcept
 			: transform(transform)
+			, normal_matrix(glm::inverseTranspose(mat3{transform}))
 			, lightmap_offset(lightmap_offset)
 			, lightmap_scale(lightmap_scale) {}
 
 		mat4 transform;
+		mat3 normal_matrix;
 		vec2 lightmap_offset;
 		vec2 lightmap_scale;
+		float max_lod_error = 0.0f;
+		model_cluster_view cluster_view{};
+		model_cluster_view two_sided_cluster_view{}; // For meshes that are drawn without back-face culling.
 	};
 
-	using model_instance_map = std::unordered_map<std::shared_ptr<model>, std::vector<model_instance>>;
+	using model_instance_map = std::unordered_map<const model*, std::vector<model_instance>>;
 
 	struct alpha_blended_mesh_instance final {
-		alpha_blended_mesh_instance(std::shared_ptr<model> model, const model_mesh& mesh, const mat4& transform, vec2 lightmap_offset, vec2 lightmap_scale, float depth) noexcept
-			: model_ptr(std::move(model))
+		alpha_blended_mesh_instance(
+			const model& model, const model_mesh& mesh, std::size_t lod, const mat4& transform, vec2 lightmap_offset, vec2 lightmap_scale, float depth) noexcept
+			: model_ptr(&model)
 			, mesh(&mesh)
+			, lod(lod)
 			, transform(transform)
 			, lightmap_offset(lightmap_offset)
 			, lightmap_scale(lightmap_scale)
 			, depth(depth) {}
 
-		std::shared_ptr<model> model_ptr;
+		const model* model_ptr;
 		const model_mesh* mesh;
+		std::size_t lod;
 		mat4 transform;
 		vec2 lightmap_offset;
 		vec2 lightmap_scale;
@@ -293,6 +338,53 @@ private:
 
 	using alpha_blended_mesh_instance_list = std::vector<alpha_blended_mesh_instance>;
 
+	// Lightmap baking always uses full detail, since the lightmap coordinates of the levels of detail are approximate, and draws back faces.
+	auto update_instances(const camera& camera) -> void {
+		remove_undrawn_models();
+		const auto pixels_per_unit = (m_baking) ? 0.0f : camera.projection_matrix[1][1] * m_viewport_height * 0.5f;
+		const auto projection_view_matrix = camera.projection_matrix * camera.view_matrix;
+		const auto eye = vec4{camera.position, 1.0f};
+		for (auto& [model, instances] : m_model_instances) {
+			for (auto& instance : instances) {
+				instance.max_lod_error = model->get_max_lod_error(instance.transform, camera.position, pixels_per_unit, lod_pixel_error);
+				instance.cluster_view = model_cluster_view{projection_view_matrix, instance.transform, eye, !m_baking};
+				instance.two_sided_cluster_view = model_cluster_view{projection_view_matrix, instance.transform, eye, false};
+			}
+		}
+	}
+
+	// clear() keeps the instance lists of every model so that their memory is reused by the next submissions. Models that were not submitted again are
+	// removed before anything is drawn, since they may no longer exist.
+	auto remove_undrawn_models() -> void {
+		std::erase_if(m_model_instances, [](const auto& kv) {
+			return kv.second.empty();
+		});
+	}
+
+	// Every texture of a model is requested at the largest footprint of its bounding sphere among the instances that are not behind the camera.
+	auto request_textures(const camera& camera) const -> void {
+		const auto pixels_per_unit = camera.projection_matrix[1][1] * m_viewport_height; // Projected diameter of a sphere per unit of radius over distance.
+		for (const auto& [model, instances] : m_model_instances) {
+			auto footprint = 0.0f;
+			for (const auto& instance : instances) {
+				const auto scale = max(length(vec3{instance.transform[0]}), max(length(vec3{instance.transform[1]}), length(vec3{instance.transform[2]})));
+				const auto radius = model->bounding_sphere_radius() * scale;
+				const auto offset = vec3{instance.transform[3]} - camera.position;
+				const auto distance = length(offset);
+				if (distance <= radius) {
+					footprint = std::numeric_limits<float>::infinity();
+				} else if (dot(offset, camera.direction) >= -radius) {
+					footprint = max(footprint, radius / distance * pixels_per_unit);
+				}
+			}
+			if (footprint > 0.0f) {
+				for (const auto& texture : model->textures()) {
+					m_texture_streamer->request(*texture, footprint);
+				}
+			}
+		}
+	}
+
 	auto upload_uniform_frame_data(model_shader& shader, const camera& camera) const -> void {
 		// Upload camera.
 		glUniformMatrix4fv(shader.projection_matrix.location(), 1, GL_FALSE, glm::value_ptr(camera.projection_matrix));
@@ -306,6 +398,7 @@ private:
 		glActiveTexture(GL_TEXTURE0 + lightmap_texture_unit);
 		glBindTexture(GL_TEXTURE_2D, m_lightmap->get());
 		glUniform1i(shader.lightmap_texture.location(), lightmap_texture_unit);
+		glUniform1f(shader.lightmap_rgbm_range.location(), m_lightmap->rgbm_range());
 
 		// Upload environment maps.
 		glActiveTexture(GL_TEXTURE0 + environment_cubemap_texture_unit);
@@ -469,13 +562,16 @@ private:
 	model_shader m_model_shader{m_baking, false, false};
 	model_shader m_model_shader_with_alpha_test{m_baking, true, false};
 	model_shader m_model_shader_with_alpha_blending{m_baking, false, true};
-	std::shared_ptr<lightmap_texture> m_lightmap = lightmap_texture::get_default();
-	std::shared_ptr<environment_cubemap> m_environment = environment_cubemap::get_default();
-	std::vector<std::shared_ptr<directional_light>> m_directional_lights{};
-	std::vector<std::shared_ptr<point_light>> m_point_lights{};
-	std::vector<std::shared_ptr<spot_light>> m_spot_lights{};
+	const lightmap_texture* m_lightmap = lightmap_texture::get_default().get();
+	const environment_cubemap* m_environment = environment_cubemap::get_default().get();
+	std::vector<const directional_light*> m_directional_lights{};
+	std::vector<const point_light*> m_point_lights{};
+	std::vector<const spot_light*> m_spot_lights{};
 	model_instance_map m_model_instances{};
 	alpha_blended_mesh_instance_list m_alpha_blended_mesh_instances{};
+	model_draw_ranges m_draw_ranges{};
+	texture_streamer* m_texture_streamer = nullptr;
+	float m_viewport_height = 0.0f;
 };
 
 #endif
@@ -19,7 +19,8 @@
 #include <cstdio>       // stderr
 #include <fmt/format.h> // fmt::print
 #include <memory>       // std::shared_ptr
-#include <string>       // std::u8string
+#include <span>         // std::span
+#include <string>       // std::string, std::u8string
 #include <string_view>  // std::string_view
 #include <utility>      // std::move
 #include <vector>       // std::vector
@@ -53,6 +54,8 @@ public:
 	}
 
 	auto resize(int width, int height) -> void {
+		m_shadow_renderer.resize(width, height);
+		m_model_renderer.resize(width, height);
 		m_text_renderer.resize(width, height);
 	}
 
@@ -63,6 +66,14 @@ public:
 		m_text_renderer.reload_shaders(width, height);
 	}
 
+	// Reload only the shader programs that were built from any of the given files.
+	auto reload_changed_shaders(std::span<const std::string> filenames, int width, int height) -> void {
+		m_shadow_renderer.reload_changed_shaders(filenames);
+		m_model_renderer.reload_changed_shaders(filenames);
+		m_skybox_renderer.reload_changed_shaders(filenames);
+		m_text_renderer.reload_changed_shaders(filenames, width, height);
+	}
+
 	auto handle_event(const SDL_Event& e) -> void {
 		m_gui_renderer.handle_event(e);
 	}
@@ -13,54 +13,75 @@
 #include <glm/gtc/matrix_transform.hpp> // glm::ortho
 #include <glm/gtc/type_ptr.hpp>         // glm::value_ptr
 #include <limits>                       // std::numeric_limits
-#include <memory>                       // std::shared_ptr
 #include <span>                         // std::span
-#include <unordered_map>                // std::unordered_map
-#include <utility>                      // std::move
+#include <string>                       // std::string
+#include <unordered_map>                // std::unordered_map, std::erase_if
 #include <vector>                       // std::vector
 
 class shadow_renderer final {
 public:
+	// Shadows are blurred by filtering and rarely seen up close, so levels of detail may be much further off than in the camera view.
+	static constexpr auto lod_pixel_error = 4.0f;
+
 	shadow_renderer() {
 		glBindFramebuffer(GL_FRAMEBUFFER, m_fbo.get());
 		glDrawBuffer(GL_NONE);
 		glReadBuffer(GL_NONE);
 	}
 
-	auto draw_directional_light(std::shared_ptr<directional_light> light) -> void {
-		if (light->shadow_map) {
-			m_directional_lights.push_back(std::move(light));
+	// Levels of detail are picked by how large the models appear in the camera view. Until a viewport size is given, full detail is always used.
+	auto resize(int /*width*/, int height) -> void {
+		m_viewport_height = static_cast<float>(height);
+	}
+
+	// Submissions are not owned by the renderer, and must stay alive until they have been rendered.
+	auto draw_directional_light(directional_light& light) -> void {
+		if (light.shadow_map) {
+			m_directional_lights.push_back(&light);
 		}
 	}
 
-	auto draw_point_light(std::shared_ptr<point_light> light) -> void {
-		if (light->shadow_map) {
-			m_point_lights.push_back(std::move(light));
+	auto draw_point_light(point_light& light) -> void {
+		if (light.shadow_map) {
+			m_point_lights.push_back(&light);
 		}
 	}
 
-	auto draw_spot_light(std::shared_ptr<spot_light> light) -> void {
-		if (light->shadow_map) {
-			m_spot_lights.push_back(std::move(light));
+	auto draw_spot_light(spot_light& light) -> void {
+		if (light.shadow_map) {
+			m_spot_lights.push_back(&light);
 		}
 	}
 
-	auto draw_model(std::shared_ptr<model> model, const mat4& transform) -> void {
+	auto draw_model(const model& model, const mat4& transform) -> void {
 		const auto position = vec3{transform[3]};
 		const auto scale = vec3{transform[0][0], transform[1][1], transform[2][2]};
-		const auto extents = vec3{model->bounding_sphere_radius()} * scale;
+		const auto extents = vec3{model.bounding_sphere_radius()} * scale;
 		m_world_aabb_min = min(m_world_aabb_min, position - extents);
 		m_world_aabb_max = max(m_world_aabb_max, position + extents);
-		m_model_instances[std::move(model)].emplace_back(transform);
+		m_model_instances[&model].emplace_back(transform);
 	}
 
 	auto render(const camera& camera) -> void {
+		// The instance lists of every model are kept after rendering so that their memory is reused by the next submissions. Models that were not submitted
+		// again are removed before anything is drawn, since they may no longer exist.
+		std::erase_if(m_model_instances, [](const auto& kv) {
+			return kv.second.empty();
+		});
+
 		glEnable(GL_POLYGON_OFFSET_FILL);
 
 		glUseProgram(m_shadow_shader.program.get());
 
 		glBindFramebuffer(GL_FRAMEBUFFER, m_fbo.get());
 
+		const auto pixels_per_unit = camera.projection_matrix[1][1] * m_viewport_height * 0.5f;
+		for (auto& [model, instances] : m_model_instances) {
+			for (auto& instance : instances) {
+				instance.max_lod_error = model->get_max_lod_error(instance.transform, camera.position, pixels_per_unit, lod_pixel_error);
+			}
+		}
+
 		const auto inverse_view_matrix = inverse(camera.view_matrix);
 		const auto world_aabb_corners = std::array<vec3, 8>{
 			vec3{m_world_aabb_min.x, m_world_aabb_min.y, m_world_aabb_min.z},
@@ -140,6 +161,7 @@ public:
 				light.shadow_near_planes[cascade_level] = light.shadow_near_plane;
 
 				glUniformMatrix4fv(m_shadow_shader.projection_view_matrix.location(), 1, GL_FALSE, glm::value_ptr(shadow_projection_view_matrix));
+				update_cluster_views(shadow_projection_view_matrix, vec4{light.direction, 0.0f});
 				for (const auto& [model, instances] : m_model_instances) {
 					for (const auto& mesh : model->meshes()) {
 						const auto& material = mesh.material();
@@ -147,7 +169,7 @@ public:
 							glBindVertexArray(mesh.get());
 							for (const auto& instance : instances) {
 								glUniformMatrix4fv(m_shadow_shader.model_matrix.location(), 1, GL_FALSE, glm::value_ptr(instance.transform));
-								glDrawElements(model_mesh::primitive_type, static_cast<GLsizei>(mesh.indices().size()), model_mesh::index_type, nullptr);
+								mesh.draw(mesh.select_lod(instance.max_lod_error), instance.cluster_view, m_draw_ranges);
 							}
 						}
 					}
@@ -168,6 +190,7 @@ public:
 
 				const auto& shadow_projection_view_matrix = light.shadow_projection_view_matrices[i];
 				glUniformMatrix4fv(m_shadow_shader.projection_view_matrix.location(), 1, GL_FALSE, glm::value_ptr(shadow_projection_view_matrix));
+				update_cluster_views(shadow_projection_view_matrix, vec4{light.position, 1.0f});
 				for (const auto& [model, instances] : m_model_instances) {
 					for (const auto& mesh : model->meshes()) {
 						const auto& material = mesh.material();
@@ -175,7 +198,7 @@ public:
 							glBindVertexArray(mesh.get());
 							for (const auto& instance : instances) {
 								glUniformMatrix4fv(m_shadow_shader.model_matrix.location(), 1, GL_FALSE, glm::value_ptr(instance.transform));
-								glDrawElements(model_mesh::primitive_type, static_cast<GLsizei>(mesh.indices().size()), model_mesh::index_type, nullptr);
+								mesh.draw(mesh.select_lod(instance.max_lod_error), instance.cluster_view, m_draw_ranges);
 							}
 						}
 					}
@@ -195,6 +218,7 @@ public:
 
 			const auto& shadow_projection_view_matrix = light.shadow_projection_view_matrix;
 			glUniformMatrix4fv(m_shadow_shader.projection_view_matrix.location(), 1, GL_FALSE, glm::value_ptr(shadow_projection_view_matrix));
+			update_cluster_views(shadow_projection_view_matrix, vec4{light.position, 1.0f});
 			for (const auto& [model, instances] : m_model_instances) {
 				for (const auto& mesh : model->meshes()) {
 					const auto& material = mesh.material();
@@ -202,7 +226,7 @@ public:
 						glBindVertexArray(mesh.get());
 						for (const auto& instance : instances) {
 							glUniformMatrix4fv(m_shadow_shader.model_matrix.location(), 1, GL_FALSE, glm::value_ptr(instance.transform));
-							glDrawElements(model_mesh::primitive_type, static_cast<GLsizei>(mesh.indices().size()), model_mesh::index_type, nullptr);
+							mesh.draw(mesh.select_lod(instance.max_lod_error), instance.cluster_view, m_draw_ranges);
 						}
 					}
 				}
@@ -213,7 +237,9 @@ public:
 		glPolygonOffset(0.0f, 0.0f);
 		glDisable(GL_POLYGON_OFFSET_FILL);
 
-		m_model_instances.clear();
+		for (auto& [model, instances] : m_model_instances) {
+			instances.clear();
+		}
 		m_directional_lights.clear();
 		m_point_lights.clear();
 		m_spot_lights.clear();
@@ -225,6 +251,12 @@ public:
 		m_shadow_shader = shadow_shader{};
 	}
 
+	auto reload_changed_shaders(std::span<const std::string> filenames) -> void {
+		if (m_shadow_shader.program.depends_on_any(filenames)) {
+			m_shadow_shader = shadow_shader{};
+		}
+	}
+
 private:
 	struct shadow_shader final {
 		shader_program program{{
@@ -240,18 +272,31 @@ private:
 			: transform(transform) {}
 
 		mat4 transform;
+		float max_lod_error = 0.0f;
+		model_cluster_view cluster_view{};
 	};
 
-	using model_instance_map = std::unordered_map<std::shared_ptr<model>, std::vector<model_instance>>;
+	using model_instance_map = std::unordered_map<const model*, std::vector<model_instance>>;
+
+	// Shadow maps are drawn with back-face culling like the camera view, so clusters that face away from the light are culled too.
+	auto update_cluster_views(const mat4& projection_view_matrix, vec4 eye) -> void {
+		for (auto& [model, instances] : m_model_instances) {
+			for (auto& instance : instances) {
+				instance.cluster_view = model_cluster_view{projection_view_matrix, instance.transform, eye, true};
+			}
+		}
+	}
 
 	shadow_shader m_shadow_shader{};
 	framebuffer m_fbo{};
 	model_instance_map m_model_instances{};
-	std::vector<std::shared_ptr<directional_light>> m_directional_lights{};
-	std::vector<std::shared_ptr<point_light>> m_point_lights{};
-	std::vector<std::shared_ptr<spot_light>> m_spot_lights{};
+	model_draw_ranges m_draw_ranges{};
+	std::vector<directional_light*> m_directional_lights{};
+	std::vector<point_light*> m_point_lights{};
+	std::vector<spot_light*> m_spot_lights{};
 	vec3 m_world_aabb_min{std::numeric_limits<float>::max()};
 	vec3 m_world_aabb_max{-std::numeric_limits<float>::max()};
+	float m_viewport_height = 0.0f;
 };
 
 #endif
@@ -7,15 +7,16 @@
 #include "../resources/shader.hpp"
 
 #include <glm/gtc/type_ptr.hpp> // glm::value_ptr
-#include <memory>               // std::shared_ptr
-#include <utility>              // std::move
+#include <span>                 // std::span
+#include <string>               // std::string
 
 class skybox_renderer final {
 public:
 	static constexpr auto gamma = 2.2f;
 
-	auto draw_skybox(std::shared_ptr<cubemap_texture> texture) -> void {
-		m_skybox_texture = std::move(texture);
+	// The texture is not owned by the renderer, and must stay alive until it has been rendered.
+	auto draw_skybox(const cubemap_texture& texture) -> void {
+		m_skybox_texture = &texture;
 	}
 
 	auto render(const mat4& projection_matrix, const mat3& view_matrix) -> void {
@@ -34,7 +35,7 @@ public:
 			glDrawArrays(cubemap_mesh::primitive_type, 0, static_cast<GLsizei>(cubemap_mesh::vertices.size()));
 
 			glDepthFunc(GL_LESS);
-			m_skybox_texture.reset();
+			m_skybox_texture = nullptr;
 		}
 	}
 
@@ -42,6 +43,12 @@ public:
 		m_skybox_shader = skybox_shader{};
 	}
 
+	auto reload_changed_shaders(std::span<const std::string> filenames) -> void {
+		if (m_skybox_shader.program.depends_on_any(filenames)) {
+			m_skybox_shader = skybox_shader{};
+		}
+	}
+
 private:
 	struct skybox_shader final {
 		skybox_shader() {
@@ -64,7 +71,7 @@ private:
 
 	cubemap_mesh m_cubemap_mesh{};
 	skybox_shader m_skybox_shader{};
-	std::shared_ptr<cubemap_texture> m_skybox_texture{};
+	const cubemap_texture* m_skybox_texture = nullptr;
 };
 
 #endif
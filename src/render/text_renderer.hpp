@@ -11,8 +11,8 @@
 #include <cmath>                        // std::round, std::floor
 #include <glm/gtc/matrix_transform.hpp> // glm::ortho
 #include <glm/gtc/type_ptr.hpp>         // glm::value_ptr
-#include <memory>                       // std::shared_ptr
-#include <string>                       // std::u8string
+#include <span>                         // std::span
+#include <string>                       // std::string, std::u8string
 #include <string_view>                  // std::string_view
 #include <unordered_map>                // std::unordered_map
 #include <utility>                      // std::move
@@ -31,12 +31,19 @@ public:
 		m_glyph_shader.resize(width, height);
 	}
 
-	auto draw_text(std::shared_ptr<font> font, vec2 offset, vec2 scale, vec4 color, std::u8string str) -> void {
-		m_text_instances[std::move(font)].emplace_back(offset, scale, color, std::move(str));
+	auto reload_changed_shaders(std::span<const std::string> filenames, int width, int height) -> void {
+		if (m_glyph_shader.program.depends_on_any(filenames)) {
+			reload_shaders(width, height);
+		}
+	}
+
+	// The font is not owned by the renderer, and must stay alive until the text has been rendered.
+	auto draw_text(font& font, vec2 offset, vec2 scale, vec4 color, std::u8string str) -> void {
+		m_text_instances[&font].emplace_back(offset, scale, color, std::move(str));
 	}
 
-	auto draw_text(std::shared_ptr<font> font, vec2 offset, vec2 scale, vec4 color, std::string_view str) -> void {
-		m_text_instances[std::move(font)].emplace_back(offset, scale, color, std::u8string{str.begin(), str.end()});
+	auto draw_text(font& font, vec2 offset, vec2 scale, vec4 color, std::string_view str) -> void {
+		m_text_instances[&font].emplace_back(offset, scale, color, std::u8string{str.begin(), str.end()});
 	}
 
 	auto render() -> void {
@@ -126,7 +133,7 @@ private:
 		}
 	}
 
-	using text_instance_map = std::unordered_map<std::shared_ptr<font>, std::vector<text_instance>>;
+	using text_instance_map = std::unordered_map<font*, std::vector<text_instance>>;
 
 	glyph_mesh m_glyph_mesh{};
 	glyph_shader m_glyph_shader{};
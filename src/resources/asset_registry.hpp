@@ -0,0 +1,202 @@
+#ifndef ASSET_REGISTRY_HPP
+#define ASSET_REGISTRY_HPP
+
+#include <cstddef>       // std::size_t
+#include <cstdint>       // std::uint32_t, std::uint64_t
+#include <memory>        // std::shared_ptr
+#include <unordered_map> // std::unordered_map
+#include <utility>       // std::move
+#include <vector>        // std::vector
+
+// Identifies a loaded asset by interned strings and a numeric parameter, such as a font size or cubemap resolution, so that lookups never build strings.
+struct asset_key final {
+	std::uint32_t name = 0;
+	std::uint32_t variant = 0;
+	std::uint64_t parameter = 0;
+
+	[[nodiscard]] constexpr auto operator==(const asset_key&) const noexcept -> bool = default;
+};
+
+struct asset_key_hash final {
+	[[nodiscard]] constexpr auto operator()(const asset_key& key) const noexcept -> std::size_t {
+		auto result = std::uint64_t{key.name} << 32 | std::uint64_t{key.variant};
+		result ^= key.parameter + 0x9e3779b97f4a7c15 + (result << 6) + (result >> 2);
+		result ^= result >> 33;
+		result *= 0xff51afd7ed558ccd;
+		result ^= result >> 33;
+		return static_cast<std::size_t>(result);
+	}
+};
+
+// 32-bit reference to a slot in an asset_registry, made up of a 24-bit slot index and an 8-bit generation.
+// The generation changes whenever the slot is released, so a handle to a released asset never resolves to the asset that reuses its slot until the generation wraps around.
+template <typename T>
+class asset_handle final {
+public:
+	static constexpr auto index_bits = 24;
+	static constexpr auto max_index = (std::uint32_t{1} << index_bits) - 1;
+	static constexpr auto generation_mask = std::uint32_t{0xFF};
+
+	constexpr asset_handle() noexcept = default;
+
+	constexpr asset_handle(std::uint32_t index, std::uint32_t generation) noexcept
+		: m_value((generation & generation_mask) << index_bits | (index & max_index)) {}
+
+	[[nodiscard]] constexpr explicit operator bool() const noexcept {
+		return m_value != 0;
+	}
+
+	[[nodiscard]] constexpr auto operator==(const asset_handle&) const noexcept -> bool = default;
+
+	[[nodiscard]] constexpr auto index() const noexcept -> std::uint32_t {
+		return m_value & max_index;
+	}
+
+	[[nodiscard]] constexpr auto generation() const noexcept -> std::uint32_t {
+		return m_value >> index_bits;
+	}
+
+	[[nodiscard]] constexpr auto value() const noexcept -> std::uint32_t {
+		return m_value;
+	}
+
+private:
+	std::uint32_t m_value = 0; // Generation 0 is never used, so 0 is the null handle.
+};
+
+// Densely stored assets of one type, looked up by key and referred to by generational handles.
+// The registry owns each asset until it is released. Resolving a handle is an array access that touches no reference counts.
+template <typename T>
+class asset_registry final {
+public:
+	using handle = asset_handle<T>;
+
+	[[nodiscard]] auto find(const asset_key& key) const -> handle {
+		if (const auto it = m_indices.find(key); it != m_indices.end()) {
+			return handle{it->second, m_slots[it->second].generation};
+		}
+		return handle{};
+	}
+
+	// The key must not already be in the registry.
+	auto insert(const asset_key& key, std::shared_ptr<T> asset) -> handle {
+		auto index = std::uint32_t{0};
+		if (m_free_indices.empty()) {
+			index = static_cast<std::uint32_t>(m_slots.size());
+			m_slots.emplace_back();
+		} else {
+			index = m_free_indices.back();
+			m_free_indices.pop_back();
+		}
+		auto& slot = m_slots[index];
+		slot.asset = std::move(asset);
+		slot.key = key;
+		slot.last_use = 0;
+		m_indices.emplace(key, index);
+		return handle{index, slot.generation};
+	}
+
+	// The key of an asset, or the null key if the handle has been released.
+	[[nodiscard]] auto key(handle h) const noexcept -> asset_key {
+		const auto* const slot = find_slot(h);
+		return (slot) ? slot->key : asset_key{};
+	}
+
+	[[nodiscard]] auto get(handle h) const noexcept -> T* {
+		if (const auto* const slot = find_slot(h)) {
+			return slot->asset.get();
+		}
+		return nullptr;
+	}
+
+	// Get a new owning reference to an asset, or null if the handle has been released.
+	[[nodiscard]] auto share(handle h) const noexcept -> std::shared_ptr<T> {
+		if (const auto* const slot = find_slot(h)) {
+			return slot->asset;
+		}
+		return nullptr;
+	}
+
+	// Check whether anything other than the registry still owns an asset.
+	[[nodiscard]] auto is_shared(handle h) const noexcept -> bool {
+		const auto* const slot = find_slot(h);
+		return slot && slot->asset.use_count() > 1;
+	}
+
+	auto set_last_use(handle h, std::uint64_t time) noexcept -> void {
+		if (auto* const slot = find_slot(h)) {
+			slot->last_use = time;
+		}
+	}
+
+	[[nodiscard]] auto last_use(handle h) const noexcept -> std::uint64_t {
+		const auto* const slot = find_slot(h);
+		return (slot) ? slot->last_use : 0;
+	}
+
+	auto release(handle h) -> void {
+		if (auto* const slot = find_slot(h)) {
+			m_indices.erase(slot->key);
+			slot->asset.reset();
+			slot->generation = (slot->generation % handle::generation_mask) + 1;
+			m_free_indices.push_back(h.index());
+		}
+	}
+
+	// Call function(handle, asset) for every asset in the registry. The function must not insert or release any assets.
+	template <typename Function>
+	auto for_each(Function&& function) const -> void {
+		for (auto i = std::uint32_t{0}; i < static_cast<std::uint32_t>(m_slots.size()); ++i) {
+			if (const auto& slot = m_slots[i]; slot.asset) {
+				function(handle{i, slot.generation}, *slot.asset);
+			}
+		}
+	}
+
+	// Release every asset for which predicate(handle) returns true.
+	template <typename Predicate>
+	auto release_if(Predicate&& predicate) -> void {
+		for (auto i = std::uint32_t{0}; i < static_cast<std::uint32_t>(m_slots.size()); ++i) {
+			if (const auto h = handle{i, m_slots[i].generation}; m_slots[i].asset && predicate(h)) {
+				release(h);
+			}
+		}
+	}
+
+	auto clear() -> void {
+		release_if([](handle) {
+			return true;
+		});
+	}
+
+	[[nodiscard]] auto size() const noexcept -> std::size_t {
+		return m_indices.size();
+	}
+
+private:
+	struct asset_slot final {
+		std::shared_ptr<T> asset{};
+		asset_key key{};
+		std::uint64_t last_use = 0;
+		std::uint32_t generation = 1;
+	};
+
+	[[nodiscard]] auto find_slot(handle h) const noexcept -> const asset_slot* {
+		if (h && h.index() < m_slots.size()) {
+			if (const auto& slot = m_slots[h.index()]; slot.asset && slot.generation == h.generation()) {
+				return &slot;
+			}
+		}
+		return nullptr;
+	}
+
+	[[nodiscard]] auto find_slot(handle h) noexcept -> asset_slot* {
+		return const_cast<asset_slot*>(static_cast<const asset_registry&>(*this).find_slot(h));
+	}
+
+	std::vector<asset_slot> m_slots{};
+	std::vector<std::uint32_t> m_free_indices{};
+	std::unordered_map<asset_key, std::uint32_t, asset_key_hash> m_indices{};
+};
+
+#endif
@@ -0,0 +1,314 @@
+#ifndef BAKED_LIGHTING_HPP
+#define BAKED_LIGHTING_HPP
+
+#include "../core/glsl.hpp"
+#include "../core/opengl.hpp"
+#include "../utilities/mapped_file.hpp"
+#include "lightmap.hpp"
+#include "lightmap_encoder.hpp"
+#include "model.hpp"
+#include "scene.hpp"
+
+#include <algorithm>     // std::ranges::any_of, std::ranges::equal
+#include <array>         // std::array
+#include <cstddef>       // std::byte, std::size_t
+#include <cstdint>       // std::uint32_t
+#include <cstring>       // std::memcpy
+#include <fmt/format.h>  // fmt::format
+#include <fstream>       // std::ofstream
+#include <memory>        // std::make_shared
+#include <numeric>       // std::iota
+#include <ostream>       // std::ostream
+#include <span>          // std::span, std::as_bytes
+#include <stdexcept>     // std::runtime_error
+#include <type_traits>   // std::is_same_v, std::is_trivially_copyable_v
+#include <unordered_map> // std::unordered_map
+#include <utility>       // std::move
+#include <vector>        // std::vector
+
+struct baked_lighting_error : std::runtime_error {
+	explicit baked_lighting_error(const auto& message)
+		: std::runtime_error(message) {}
+};
+
+// The encoded lightmap mip chain followed by the object placements, the default region and, for each unique model in order of
+// first appearance, the remapped vertices of each mesh (as indices into the originally loaded vertices) and their lightmap coordinates.
+class baked_lighting final {
+public:
+	static constexpr auto magic = std::array<char, 8>{'L', 'I', 'G', 'H', 'T', 'M', 'A', 'P'};
+	static constexpr auto version = std::uint32_t{3};
+	static constexpr auto max_resolution = std::size_t{16384};
+
+	static auto save(const scene& scene, const char* filename) -> void {
+		auto file = std::ofstream{filename, std::ios::binary | std::ios::trunc};
+		if (!file) {
+			throw baked_lighting_error{fmt::format("Failed to open \"{}\" for writing!", filename)};
+		}
+		save(scene, file);
+		if (!file) {
+			throw baked_lighting_error{fmt::format("Failed to write \"{}\"!", filename)};
+		}
+	}
+
+	static auto save(const scene& scene, std::ostream& file) -> void {
+		static_assert(std::is_same_v<model_index, std::uint32_t>, "This function assumes 32-bit model indices.");
+
+		if (!scene.lightmap) {
+			throw baked_lighting_error{"No lightmap to save!"};
+		}
+		const auto& texture = scene.lightmap->get_texture();
+		if (texture.width() != texture.height()) {
+			throw baked_lighting_error{"Lightmap must be square!"};
+		}
+		const auto resolution = texture.width();
+		const auto levels = scene.lightmap->read_mip_levels();
+
+		auto models = std::vector<const model*>{};
+		auto model_indices = std::unordered_map<const model*, std::uint32_t>{};
+		auto objects = std::vector<object_record>{};
+		objects.reserve(scene.objects.size());
+		for (const auto& object : scene.objects) {
+			const auto [it, inserted] = model_indices.try_emplace(object.model_ptr.get(), static_cast<std::uint32_t>(models.size()));
+			if (inserted) {
+				object.model_ptr->load_cpu_data();
+				models.push_back(object.model_ptr.get());
+			}
+			objects.push_back(object_record{
+				.model_index = it->second,
+				.lightmap_offset = object.lightmap_offset,
+				.lightmap_scale = object.lightmap_scale,
+			});
+		}
+
+		write(file,
+			file_header{
+				.magic = magic,
+				.version = version,
+				.resolution = static_cast<std::uint32_t>(resolution),
+				.encoding = static_cast<std::uint32_t>(scene.lightmap->encoding()),
+				.level_count = static_cast<std::uint32_t>(levels.size()),
+				.object_count = static_cast<std::uint32_t>(objects.size()),
+				.model_count = static_cast<std::uint32_t>(models.size()),
+				.default_lightmap_offset = scene.default_lightmap_offset,
+				.default_lightmap_scale = scene.default_lightmap_scale,
+			});
+		for (const auto& level : levels) {
+			write(file, static_cast<std::uint32_t>(level.size()));
+			write(file, std::span<const std::byte>{level});
+		}
+		write(file, std::span<const object_record>{objects});
+		auto identity_vertex_sources = std::vector<model_index>{};
+		auto lightmap_coordinates = std::vector<vec2>{};
+		for (const auto* const model_ptr : models) {
+			write(file, static_cast<std::uint32_t>(model_ptr->meshes().size()));
+			for (const auto& mesh : model_ptr->meshes()) {
+				write(file,
+					mesh_header{
+						.source_vertex_count = static_cast<std::uint32_t>(mesh.source_vertex_count()),
+						.vertex_count = static_cast<std::uint32_t>(mesh.vertices().size()),
+						.index_count = static_cast<std::uint32_t>(mesh.indices().size()),
+					});
+				if (mesh.vertex_sources().empty()) {
+					identity_vertex_sources.resize(mesh.vertices().size());
+					std::iota(identity_vertex_sources.begin(), identity_vertex_sources.end(), model_index{0});
+					write(file, std::span<const model_index>{identity_vertex_sources});
+				} else {
+					write(file, mesh.vertex_sources());
+				}
+				lightmap_coordinates.clear();
+				for (const auto& vertex : mesh.vertices()) {
+					lightmap_coordinates.push_back(vertex.lightmap_coordinates);
+				}
+				write(file, std::span<const vec2>{lightmap_coordinates});
+				write(file, mesh.indices());
+			}
+		}
+	}
+
+	static auto load(scene& scene, const char* filename) -> void {
+		const auto file = mapped_file::open(filename);
+		load(scene, file.bytes());
+	}
+
+	static auto load(scene& scene, std::span<const std::byte> bytes) -> void {
+		static_assert(std::is_same_v<model_index, std::uint32_t>, "This function assumes 32-bit model indices.");
+
+		auto reader = byte_reader{bytes};
+
+		const auto header = reader.read<file_header>();
+		if (header.magic != magic) {
+			throw baked_lighting_error{"Not a lightmap file!"};
+		}
+		if (header.version != version) {
+			throw baked_lighting_error{fmt::format("Unsupported lightmap file version {} (expected {})!", header.version, version)};
+		}
+		const auto resolution = static_cast<std::size_t>(header.resolution);
+		if (resolution == 0 || resolution > max_resolution) {
+			throw baked_lighting_error{fmt::format("Invalid lightmap resolution {}!", resolution)};
+		}
+		if (static_cast<std::size_t>(header.object_count) != scene.objects.size()) {
+			throw baked_lighting_error{fmt::format("Lightmap was baked for {} objects, but the scene has {}!", header.object_count, scene.objects.size())};
+		}
+		if (header.encoding > static_cast<std::uint32_t>(lightmap_encoding::bc6h)) {
+			throw baked_lighting_error{fmt::format("Invalid lightmap encoding {}!", header.encoding)};
+		}
+		const auto encoding = static_cast<lightmap_encoding>(header.encoding);
+		if (static_cast<std::size_t>(header.level_count) != lightmap_encoder::mip_level_count(resolution)) {
+			throw baked_lighting_error{fmt::format("Invalid lightmap mip level count {}!", header.level_count)};
+		}
+		auto levels = std::vector<std::span<const std::byte>>{};
+		for (auto level = std::size_t{0}; level < header.level_count; ++level) {
+			const auto level_size = static_cast<std::size_t>(reader.read<std::uint32_t>());
+			if (level_size != lightmap_encoder::level_size(encoding, lightmap_encoder::mip_level_resolution(resolution, level))) {
+				throw baked_lighting_error{fmt::format("Invalid size of lightmap mip level {}!", level)};
+			}
+			levels.push_back(reader.read_bytes(level_size));
+		}
+		const auto objects = reader.read_vector<object_record>(header.object_count);
+
+		auto models = std::vector<model*>{};
+		auto model_indices = std::unordered_map<const model*, std::uint32_t>{};
+		for (auto i = std::size_t{0}; i < scene.objects.size(); ++i) {
+			const auto [it, inserted] = model_indices.try_emplace(scene.objects[i].model_ptr.get(), static_cast<std::uint32_t>(models.size()));
+			if (inserted) {
+				models.push_back(scene.objects[i].model_ptr.get());
+			}
+			if (objects[i].model_index != it->second) {
+				throw baked_lighting_error{fmt::format("Lightmap object {} refers to a different model!", i)};
+			}
+		}
+		if (static_cast<std::size_t>(header.model_count) != models.size()) {
+			throw baked_lighting_error{fmt::format("Lightmap was baked for {} models, but the scene has {}!", header.model_count, models.size())};
+		}
+
+		// Validate all meshes before touching any of them.
+		const auto geometry_reader = reader;
+		for (auto* const model_ptr : models) {
+			const auto mesh_count = static_cast<std::size_t>(reader.read<std::uint32_t>());
+			if (mesh_count != model_ptr->meshes().size()) {
+				throw baked_lighting_error{"Lightmap mesh count does not match the model!"};
+			}
+			for (const auto& mesh : model_ptr->meshes()) {
+				const auto mesh_info = reader.read<mesh_header>();
+				if (static_cast<std::size_t>(mesh_info.source_vertex_count) != mesh.source_vertex_count()) {
+					throw baked_lighting_error{"Lightmap vertex count does not match the model!"};
+				}
+				const auto vertex_sources = reader.read_vector<model_index>(mesh_info.vertex_count);
+				if (std::ranges::any_of(vertex_sources, [&](model_index source) { return static_cast<std::size_t>(source) >= mesh.source_vertex_count(); })) {
+					throw baked_lighting_error{"Invalid lightmap vertex source index!"};
+				}
+				(void)reader.read_bytes(static_cast<std::size_t>(mesh_info.vertex_count) * sizeof(vec2));
+				(void)reader.read_bytes(static_cast<std::size_t>(mesh_info.index_count) * sizeof(model_index));
+			}
+		}
+		if (!reader.empty()) {
+			throw baked_lighting_error{"Unexpected data at end of lightmap file!"};
+		}
+
+		auto lightmap = std::make_shared<lightmap_texture>(lightmap_texture::create_mip_levels(resolution, encoding, levels));
+
+		reader = geometry_reader;
+		for (auto* const model_ptr : models) {
+			(void)reader.read<std::uint32_t>();
+			for (auto& mesh : model_ptr->meshes()) {
+				const auto mesh_info = reader.read<mesh_header>();
+				const auto vertex_sources = reader.read_vector<model_index>(mesh_info.vertex_count);
+				const auto lightmap_coordinates = reader.read_vector<vec2>(mesh_info.vertex_count);
+				auto indices = reader.read_vector<model_index>(mesh_info.index_count);
+				// Models that already have this lightmap applied are left as they are, which lets it be applied again after some of the models have been
+				// reloaded. Models remapped for another lightmap, such as a cancelled bake, are remapped back.
+				if (std::ranges::equal(mesh.vertex_sources(), vertex_sources)) {
+					continue;
+				}
+				mesh.remap_source_vertices(vertex_sources, lightmap_coordinates, std::move(indices));
+			}
+		}
+
+		for (auto i = std::size_t{0}; i < scene.objects.size(); ++i) {
+			scene.objects[i].lightmap_offset = objects[i].lightmap_offset;
+			scene.objects[i].lightmap_scale = objects[i].lightmap_scale;
+		}
+		scene.default_lightmap_offset = header.default_lightmap_offset;
+		scene.default_lightmap_scale = header.default_lightmap_scale;
+		scene.lightmap = std::move(lightmap);
+	}
+
+private:
+	struct file_header final {
+		std::array<char, 8> magic;
+		std::uint32_t version;
+		std::uint32_t resolution;
+		std::uint32_t encoding;
+		std::uint32_t level_count;
+		std::uint32_t object_count;
+		std::uint32_t model_count;
+		vec2 default_lightmap_offset;
+		vec2 default_lightmap_scale;
+	};
+
+	struct object_record final {
+		std::uint32_t model_index;
+		vec2 lightmap_offset;
+		vec2 lightmap_scale;
+	};
+
+	struct mesh_header final {
+		std::uint32_t source_vertex_count;
+		std::uint32_t vertex_count;
+		std::uint32_t index_count;
+	};
+
+	class byte_reader final {
+	public:
+		explicit byte_reader(std::span<const std::byte> bytes) noexcept
+			: m_bytes(bytes) {}
+
+		[[nodiscard]] auto empty() const noexcept -> bool {
+			return m_bytes.empty();
+		}
+
+		[[nodiscard]] auto read_bytes(std::size_t size) -> std::span<const std::byte> {
+			if (size > m_bytes.size()) {
+				throw baked_lighting_error{"Unexpected end of lightmap file!"};
+			}
+			const auto result = m_bytes.first(size);
+			m_bytes = m_bytes.subspan(size);
+			return result;
+		}
+
+		template <typename T>
+		[[nodiscard]] auto read() -> T {
+			static_assert(std::is_trivially_copyable_v<T>);
+			auto result = T{};
+			std::memcpy(&result, read_bytes(sizeof(T)).data(), sizeof(T));
+			return result;
+		}
+
+		template <typename T>
+		[[nodiscard]] auto read_vector(std::size_t count) -> std::vector<T> {
+			static_assert(std::is_trivially_copyable_v<T>);
+			const auto bytes = read_bytes(count * sizeof(T));
+			auto result = std::vector<T>(count);
+			std::memcpy(result.data(), bytes.data(), bytes.size());
+			return result;
+		}
+
+	private:
+		std::span<const std::byte> m_bytes;
+	};
+
+	template <typename T>
+	static auto write(std::ostream& file, const T& value) -> void {
+		static_assert(std::is_trivially_copyable_v<T>);
+		file.write(reinterpret_cast<const char*>(&value), sizeof(T)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+	}
+
+	template <typename T>
+	static auto write(std::ostream& file, std::span<const T> values) -> void {
+		static_assert(std::is_trivially_copyable_v<T>);
+		const auto bytes = std::as_bytes(values);
+		file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size())); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+	}
+};
+
+#endif
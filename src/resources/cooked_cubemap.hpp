@@ -0,0 +1,260 @@
+#ifndef COOKED_CUBEMAP_HPP
+#define COOKED_CUBEMAP_HPP
+
+#include "../core/opengl.hpp"
+#include "../core/profiler.hpp"
+#include "../utilities/mapped_file.hpp"
+#include "cubemap.hpp"
+#include "texture.hpp"
+
+#include <array>        // std::array
+#include <cstddef>      // std::byte, std::size_t
+#include <cstdint>      // std::uint32_t, std::uint64_t, std::int32_t
+#include <cstring>      // std::memcpy
+#include <filesystem>   // std::filesystem::...
+#include <fmt/format.h> // fmt::format
+#include <fstream>      // std::ofstream
+#include <optional>     // std::optional, std::nullopt
+#include <span>         // std::span, std::as_bytes
+#include <stdexcept>    // std::runtime_error
+#include <string>       // std::string
+#include <string_view>  // std::string_view
+#include <system_error> // std::error_code
+#include <type_traits>  // std::is_trivially_copyable_v
+#include <vector>       // std::vector
+
+struct cooked_cubemap_error : std::runtime_error {
+	explicit cooked_cubemap_error(const auto& message)
+		: std::runtime_error(message) {}
+};
+
+// A cubemap with its whole mip chain read back from the GPU as half floats, so that precomputed maps can be uploaded again without running the generator.
+// Cooked cubemaps are stored next to their source image and are keyed by a hash of the sources and of every parameter that went into generating them.
+// The levels of a loaded file point straight into the memory-mapped file.
+class cooked_cubemap final {
+public:
+	static constexpr auto magic = std::array<char, 8>{'C', 'U', 'B', 'E', 'M', 'A', 'P', 'S'};
+	static constexpr auto version = std::uint32_t{1};
+	static constexpr auto alignment = std::size_t{16};
+	static constexpr auto face_count = std::size_t{6};
+
+	[[nodiscard]] static auto get_filename(std::string_view source_filename, std::string_view name) -> std::string {
+		return fmt::format("{}.{}.cooked", source_filename, name);
+	}
+
+	// FNV-1a over the size and modification time of every source file followed by the parameters, or nothing if a source can't be found.
+	[[nodiscard]] static auto get_key(std::span<const std::string> source_filenames, std::span<const std::uint64_t> parameters) -> std::optional<std::uint64_t> {
+		auto result = std::uint64_t{14695981039346656037ull};
+		const auto hash = [&](std::uint64_t value) {
+			for (auto i = std::size_t{0}; i < sizeof(value); ++i) {
+				result = (result ^ ((value >> (i * 8)) & 0xFF)) * std::uint64_t{1099511628211ull};
+			}
+		};
+		for (const auto& source_filename : source_filenames) {
+			auto error = std::error_code{};
+			const auto size = std::filesystem::file_size(source_filename, error);
+			if (error) {
+				return std::nullopt;
+			}
+			const auto time = std::filesystem::last_write_time(source_filename, error);
+			if (error) {
+				return std::nullopt;
+			}
+			hash(static_cast<std::uint64_t>(size));
+			hash(static_cast<std::uint64_t>(time.time_since_epoch().count()));
+		}
+		for (const auto parameter : parameters) {
+			hash(parameter);
+		}
+		return result;
+	}
+
+	// Read the given number of mip levels of a cubemap back from the GPU.
+	[[nodiscard]] static auto download(const cubemap_texture& cubemap, std::size_t level_count) -> cooked_cubemap {
+		const auto zone = profiler::gpu_zone("download_cubemap");
+		const auto& tex = cubemap.get_texture();
+		const auto channel_count = texture::internal_channel_count(tex.internal_format());
+		auto result = cooked_cubemap{};
+		result.m_resolution = tex.width();
+		result.m_internal_format = tex.internal_format();
+		result.m_format = texture::pixel_format(channel_count);
+		result.m_type = GL_HALF_FLOAT;
+		result.m_level_data.reserve(level_count);
+		for (auto level = std::size_t{0}; level < level_count; ++level) {
+			const auto level_resolution = mip_level_dimension(result.m_resolution, level);
+			const auto face_size = level_resolution * level_resolution * channel_count * sizeof(std::uint16_t);
+			result.m_level_data.push_back(tex.read_mip_level_cubemap(level, result.m_format, result.m_type, face_size));
+		}
+		result.m_levels.assign(result.m_level_data.begin(), result.m_level_data.end());
+		return result;
+	}
+
+	[[nodiscard]] static auto load(const char* filename, std::uint64_t key) -> cooked_cubemap {
+		const auto zone = profiler::zone("load_cooked_cubemap", filename);
+		auto result = cooked_cubemap{};
+		result.m_file = mapped_file::open(filename);
+		const auto bytes = result.m_file.bytes();
+
+		const auto header = read<file_header>(bytes, 0);
+		if (header.magic != magic || header.version != version) {
+			throw cooked_cubemap_error{fmt::format("\"{}\" is not a cooked cubemap file of the current version!", filename)};
+		}
+		if (header.key != key) {
+			throw cooked_cubemap_error{fmt::format("\"{}\" is out of date!", filename)};
+		}
+		if (header.level_count == 0 || header.resolution == 0 || header.resolution >> (header.level_count - 1) == 0) {
+			throw cooked_cubemap_error{fmt::format("Invalid level count in \"{}\"!", filename)};
+		}
+		const auto channel_count = get_channel_count(header);
+		if (channel_count == 0) {
+			throw cooked_cubemap_error{fmt::format("Invalid format in \"{}\"!", filename)};
+		}
+		result.m_resolution = header.resolution;
+		result.m_internal_format = header.internal_format;
+		result.m_format = header.format;
+		result.m_type = header.type;
+		result.m_levels.reserve(header.level_count);
+		for (auto level = std::size_t{0}; level < header.level_count; ++level) {
+			const auto record = read<level_record>(bytes, sizeof(file_header) + level * sizeof(level_record));
+			const auto level_resolution = mip_level_dimension(header.resolution, level);
+			const auto face_size = level_resolution * level_resolution * channel_count * sizeof(std::uint16_t);
+			if (record.size != face_size * face_count) {
+				throw cooked_cubemap_error{fmt::format("Invalid size of level {} in \"{}\"!", level, filename)};
+			}
+			result.m_levels.push_back(get_bytes(bytes, record.offset, record.size));
+		}
+		return result;
+	}
+
+	auto save(const char* filename, std::uint64_t key) const -> void {
+		const auto zone = profiler::zone("save_cooked_cubemap", filename);
+		auto offset = sizeof(file_header) + m_levels.size() * sizeof(level_record);
+		auto level_records = std::vector<level_record>{};
+		level_records.reserve(m_levels.size());
+		for (const auto& level : m_levels) {
+			offset = align(offset);
+			level_records.push_back(level_record{.offset = offset, .size = level.size()});
+			offset += level.size();
+		}
+
+		// Write to a temporary file first, so that a cooked file is never seen half-written.
+		const auto temporary_filename = fmt::format("{}.tmp", filename);
+		{
+			auto file = std::ofstream{temporary_filename, std::ios::binary | std::ios::trunc};
+			if (!file) {
+				throw cooked_cubemap_error{fmt::format("Failed to open \"{}\" for writing!", temporary_filename)};
+			}
+			write(file,
+				file_header{
+					.magic = magic,
+					.version = version,
+					.level_count = static_cast<std::uint32_t>(m_levels.size()),
+					.key = key,
+					.resolution = static_cast<std::uint32_t>(m_resolution),
+					.internal_format = m_internal_format,
+					.format = m_format,
+					.type = m_type,
+				});
+			write(file, std::span<const level_record>{level_records});
+			auto position = sizeof(file_header) + level_records.size() * sizeof(level_record);
+			for (auto level = std::size_t{0}; level < m_levels.size(); ++level) {
+				static constexpr auto zeros = std::array<char, alignment>{};
+				file.write(zeros.data(), static_cast<std::streamsize>(level_records[level].offset - position));
+				write(file, m_levels[level]);
+				position = level_records[level].offset + level_records[level].size;
+			}
+			if (!file) {
+				throw cooked_cubemap_error{fmt::format("Failed to write \"{}\"!", temporary_filename)};
+			}
+		}
+		auto error = std::error_code{};
+		std::filesystem::rename(temporary_filename, filename, error);
+		if (error) {
+			std::filesystem::remove(temporary_filename, error);
+			throw cooked_cubemap_error{fmt::format("Failed to replace \"{}\"!", filename)};
+		}
+	}
+
+	[[nodiscard]] auto upload(const texture_options& options) const -> cubemap_texture {
+		const auto zone = profiler::gpu_zone("upload_cubemap");
+		return cubemap_texture{texture::create_cubemap_mip_levels(m_internal_format, m_resolution, m_format, m_type, m_levels, options)};
+	}
+
+private:
+	struct file_header final {
+		std::array<char, 8> magic;
+		std::uint32_t version;
+		std::uint32_t level_count;
+		std::uint64_t key;
+		std::uint32_t resolution;
+		std::int32_t internal_format;
+		std::uint32_t format;
+		std::uint32_t type;
+	};
+
+	struct level_record final {
+		std::uint64_t offset;
+		std::uint64_t size;
+	};
+
+	cooked_cubemap() noexcept = default;
+
+	// Channel count of the half float format that download() stores for the internal format in the header, or 0 if the header describes any other format.
+	[[nodiscard]] static auto get_channel_count(const file_header& header) -> std::size_t {
+		if (header.type != GL_HALF_FLOAT) {
+			return 0;
+		}
+		for (auto channel_count = std::size_t{1}; channel_count <= 4; ++channel_count) {
+			if (header.format == texture::pixel_format(channel_count) && header.internal_format == texture::internal_pixel_format_hdr(channel_count)) {
+				return channel_count;
+			}
+		}
+		return 0;
+	}
+
+	[[nodiscard]] static constexpr auto mip_level_dimension(std::size_t dimension, std::size_t level) noexcept -> std::size_t {
+		return (dimension >> level > 0) ? dimension >> level : std::size_t{1};
+	}
+
+	[[nodiscard]] static constexpr auto align(std::size_t offset) noexcept -> std::size_t {
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	[[nodiscard]] static auto get_bytes(std::span<const std::byte> bytes, std::uint64_t offset, std::uint64_t size) -> std::span<const std::byte> {
+		if (offset > bytes.size() || size > bytes.size() - offset) {
+			throw cooked_cubemap_error{"Unexpected end of cooked cubemap file!"};
+		}
+		return bytes.subspan(static_cast<std::size_t>(offset), static_cast<std::size_t>(size));
+	}
+
+	template <typename T>
+	[[nodiscard]] static auto read(std::span<const std::byte> bytes, std::uint64_t offset) -> T {
+		static_assert(std::is_trivially_copyable_v<T>);
+		auto result = T{};
+		std::memcpy(&result, get_bytes(bytes, offset, sizeof(T)).data(), sizeof(T));
+		return result;
+	}
+
+	template <typename T>
+	static auto write(std::ofstream& file, const T& value) -> void {
+		static_assert(std::is_trivially_copyable_v<T>);
+		file.write(reinterpret_cast<const char*>(&value), sizeof(T)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+	}
+
+	template <typename T>
+	static auto write(std::ofstream& file, std::span<const T> values) -> void {
+		static_assert(std::is_trivially_copyable_v<T>);
+		const auto bytes = std::as_bytes(values);
+		file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size())); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+	}
+
+	mapped_file m_file{};                              // Backs m_levels when loaded from a file.
+	std::vector<std::vector<std::byte>> m_level_data{}; // Backs m_levels when downloaded from the GPU.
+	std::vector<std::span<const std::byte>> m_levels{};
+	GLint m_internal_format = 0;
+	GLenum m_format = 0;
+	GLenum m_type = 0;
+	std::size_t m_resolution = 0;
+};
+
+#endif
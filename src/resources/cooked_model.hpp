@@ -0,0 +1,394 @@
+#ifndef COOKED_MODEL_HPP
+#define COOKED_MODEL_HPP
+
+#include "../core/profiler.hpp"
+#include "../utilities/mapped_file.hpp"
+#include "model.hpp"
+
+#include <algorithm>    // std::min, std::ranges::all_of
+#include <array>        // std::array
+#include <cstddef>      // std::byte, std::size_t
+#include <cstdint>      // std::uint8_t, std::uint32_t, std::uint64_t
+#include <cstdio>       // stderr
+#include <cstring>      // std::memcpy
+#include <exception>    // std::exception
+#include <filesystem>   // std::filesystem::...
+#include <fmt/format.h> // fmt::format, fmt::print
+#include <fstream>      // std::ofstream
+#include <limits>       // std::numeric_limits
+#include <span>         // std::span, std::as_bytes
+#include <stdexcept>    // std::runtime_error
+#include <string>       // std::string
+#include <string_view>  // std::string_view
+#include <system_error> // std::error_code
+#include <type_traits>  // std::is_trivially_copyable_v
+#include <utility>      // std::move
+#include <vector>       // std::vector
+
+struct cooked_model_error : std::runtime_error {
+	explicit cooked_model_error(const auto& message)
+		: std::runtime_error(message) {}
+};
+
+// Imported model data in its final in-memory layout, so that loading it is a memory map and one copy per array instead of an Assimp import.
+// The file holds a header, one record per mesh, the material library and texture filename strings, and then the packed vertex, index, level of detail and
+// cluster arrays of every mesh at aligned offsets. Vertices and indices are stored as they are uploaded, see model_mesh_geometry.
+// It is stored next to the source model and is used as long as it is newer than the source and its material libraries, and was cooked with the same texture
+// filename prefix.
+class cooked_model final {
+public:
+	static constexpr auto magic = std::array<char, 8>{'M', 'O', 'D', 'E', 'L', 'B', 'I', 'N'};
+	static constexpr auto version = std::uint32_t{7};
+	static constexpr auto alignment = std::size_t{16};
+
+	[[nodiscard]] static auto get_filename(std::string_view source_filename) -> std::string {
+		return fmt::format("{}.cooked", source_filename);
+	}
+
+	[[nodiscard]] static auto is_up_to_date(const char* source_filename, const char* cooked_filename) -> bool {
+		auto error = std::error_code{};
+		const auto source_time = std::filesystem::last_write_time(source_filename, error);
+		if (error) {
+			return false;
+		}
+		const auto cooked_time = std::filesystem::last_write_time(cooked_filename, error);
+		return !error && cooked_time >= source_time;
+	}
+
+	// Names of the material libraries that an OBJ file refers to, relative to its directory, which Assimp reads along with it. Missing ones are left out,
+	// since the model is imported without them. Other formats keep their materials in the model file itself.
+	[[nodiscard]] static auto get_material_libraries(const char* filename) -> std::vector<std::string> {
+		auto result = std::vector<std::string>{};
+		if (!std::string_view{filename}.ends_with(".obj")) {
+			return result;
+		}
+		const auto file = mapped_file::open(filename);
+		const auto bytes = file.bytes();
+		auto text = std::string_view{reinterpret_cast<const char*>(bytes.data()), bytes.size()}; // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+		static constexpr auto keyword = std::string_view{"mtllib"};
+		static constexpr auto whitespace = std::string_view{" \t\r"};
+		const auto directory = std::filesystem::path{filename}.parent_path();
+		while (!text.empty()) {
+			const auto line_end = text.find('\n');
+			auto line = text.substr(0, line_end);
+			text = (line_end == std::string_view::npos) ? std::string_view{} : text.substr(line_end + 1);
+			if (!line.starts_with(keyword) || line.size() == keyword.size() || whitespace.find(line[keyword.size()]) == std::string_view::npos) {
+				continue;
+			}
+			// Like Assimp, take the rest of the line as a single filename.
+			line.remove_prefix(keyword.size());
+			line.remove_prefix(std::min(line.find_first_not_of(whitespace), line.size()));
+			line = line.substr(0, line.find_last_not_of(whitespace) + 1);
+			if (auto error = std::error_code{}; !line.empty() && std::filesystem::exists(directory / std::filesystem::path{line}, error)) {
+				result.emplace_back(line);
+			}
+		}
+		return result;
+	}
+
+	// Load the cooked version of a model if it is up to date, otherwise import the source and cook it for next time.
+	// Failing to write the cooked file is not an error, since the imported data is still valid.
+	[[nodiscard]] static auto import(const char* filename, std::string_view textures_filename_prefix) -> model_data {
+		const auto cooked_filename = get_filename(filename);
+		if (is_up_to_date(filename, cooked_filename.c_str())) {
+			try {
+				return load(cooked_filename.c_str(), textures_filename_prefix);
+			} catch (const cooked_model_error&) {
+				// Cooked with a different prefix or by an older version. Cook it again below.
+			} catch (const mapped_file_error&) {
+			}
+		}
+		auto result = model::import(filename, textures_filename_prefix);
+		try {
+			const auto zone = profiler::zone("save_cooked_model", cooked_filename);
+			save(result, textures_filename_prefix, get_material_libraries(filename), cooked_filename.c_str());
+		} catch (const std::exception& e) {
+			fmt::print(stderr, "Failed to cook model \"{}\": {}\n", filename, e.what());
+		}
+		return result;
+	}
+
+	// The material libraries are named relative to the directory of the cooked file, as returned by get_material_libraries.
+	static auto save(const model_data& data, std::string_view textures_filename_prefix, std::span<const std::string> material_libraries, const char* filename)
+		-> void {
+		auto strings = std::vector<std::string_view>{textures_filename_prefix};
+		strings.insert(strings.end(), material_libraries.begin(), material_libraries.end());
+		strings.insert(strings.end(), data.texture_filenames.begin(), data.texture_filenames.end());
+
+		auto offset = sizeof(file_header) + data.meshes.size() * sizeof(mesh_record) + strings.size() * sizeof(string_record);
+		auto string_records = std::vector<string_record>{};
+		string_records.reserve(strings.size());
+		for (const auto& string : strings) {
+			string_records.push_back(string_record{.offset = offset, .size = string.size()});
+			offset += string.size();
+		}
+		auto mesh_records = std::vector<mesh_record>{};
+		mesh_records.reserve(data.meshes.size());
+		for (const auto& mesh : data.meshes) {
+			const auto& geometry = mesh.geometry;
+			const auto vertex_offset = align(offset);
+			const auto index_offset = align(vertex_offset + geometry.vertices.size() * sizeof(packed_model_vertex));
+			const auto lod_offset = align(index_offset + geometry.total_index_count() * get_index_size(geometry.vertices.size()));
+			const auto cluster_offset = align(lod_offset + mesh.lods.size() * sizeof(model_mesh_lod));
+			offset = cluster_offset + mesh.clusters.size() * sizeof(mesh_cluster);
+			mesh_records.push_back(mesh_record{
+				.vertex_offset = vertex_offset,
+				.vertex_count = geometry.vertices.size(),
+				.index_offset = index_offset,
+				.index_count = geometry.index_count,
+				.lod_index_count = geometry.total_index_count() - geometry.index_count,
+				.lod_offset = lod_offset,
+				.lod_count = mesh.lods.size(),
+				.cluster_offset = cluster_offset,
+				.cluster_count = mesh.clusters.size(),
+				.albedo_texture_offset = mesh.material.albedo_texture_offset,
+				.normal_texture_offset = mesh.material.normal_texture_offset,
+				.roughness_texture_offset = mesh.material.roughness_texture_offset,
+				.metallic_texture_offset = mesh.material.metallic_texture_offset,
+				.alpha_blending = static_cast<std::uint8_t>(mesh.material.alpha_blending),
+				.padding = {},
+			});
+		}
+
+		// Write to a temporary file first, so that a cooked file is never seen half-written.
+		const auto temporary_filename = fmt::format("{}.tmp", filename);
+		{
+			auto file = std::ofstream{temporary_filename, std::ios::binary | std::ios::trunc};
+			if (!file) {
+				throw cooked_model_error{fmt::format("Failed to open \"{}\" for writing!", temporary_filename)};
+			}
+			write(file,
+				file_header{
+					.magic = magic,
+					.version = version,
+					.vertex_size = static_cast<std::uint32_t>(sizeof(packed_model_vertex)),
+					.index_size = static_cast<std::uint32_t>(sizeof(model_index)),
+					.mesh_count = static_cast<std::uint32_t>(data.meshes.size()),
+					.string_count = static_cast<std::uint32_t>(strings.size()),
+					.material_library_count = static_cast<std::uint32_t>(material_libraries.size()),
+					.bounding_sphere_radius = data.bounding_sphere_radius,
+				});
+			write(file, std::span<const mesh_record>{mesh_records});
+			write(file, std::span<const string_record>{string_records});
+			for (const auto& string : strings) {
+				file.write(string.data(), static_cast<std::streamsize>(string.size()));
+			}
+			auto position = string_records.back().offset + string_records.back().size;
+			for (auto i = std::size_t{0}; i < data.meshes.size(); ++i) {
+				const auto& geometry = data.meshes[i].geometry;
+				write_padding(file, mesh_records[i].vertex_offset - position);
+				write(file, std::span<const packed_model_vertex>{geometry.vertices});
+				position = mesh_records[i].vertex_offset + mesh_records[i].vertex_count * sizeof(packed_model_vertex);
+				write_padding(file, mesh_records[i].index_offset - position);
+				write(file, std::span<const std::uint16_t>{geometry.small_indices});
+				write(file, std::span<const model_index>{geometry.large_indices});
+				position = mesh_records[i].index_offset + geometry.total_index_count() * get_index_size(geometry.vertices.size());
+				write_padding(file, mesh_records[i].lod_offset - position);
+				write(file, std::span<const model_mesh_lod>{data.meshes[i].lods});
+				position = mesh_records[i].lod_offset + mesh_records[i].lod_count * sizeof(model_mesh_lod);
+				write_padding(file, mesh_records[i].cluster_offset - position);
+				write(file, std::span<const mesh_cluster>{data.meshes[i].clusters});
+				position = mesh_records[i].cluster_offset + mesh_records[i].cluster_count * sizeof(mesh_cluster);
+			}
+			if (!file) {
+				throw cooked_model_error{fmt::format("Failed to write \"{}\"!", temporary_filename)};
+			}
+		}
+		auto error = std::error_code{};
+		std::filesystem::rename(temporary_filename, filename, error);
+		if (error) {
+			std::filesystem::remove(temporary_filename, error);
+			throw cooked_model_error{fmt::format("Failed to replace \"{}\"!", filename)};
+		}
+	}
+
+	[[nodiscard]] static auto load(const char* filename, std::string_view textures_filename_prefix) -> model_data {
+		const auto zone = profiler::zone("load_cooked_model", filename);
+		const auto file = mapped_file::open(filename);
+		const auto bytes = file.bytes();
+
+		const auto header = read<file_header>(bytes, 0);
+		if (header.magic != magic) {
+			throw cooked_model_error{fmt::format("\"{}\" is not a cooked model file!", filename)};
+		}
+		if (header.version != version || header.vertex_size != sizeof(packed_model_vertex) || header.index_size != sizeof(model_index)) {
+			throw cooked_model_error{fmt::format("\"{}\" was cooked by a different version!", filename)};
+		}
+		if (header.string_count == 0 || header.material_library_count > header.string_count - 1) {
+			throw cooked_model_error{fmt::format("\"{}\" has an invalid string count!", filename)};
+		}
+		const auto mesh_records_offset = sizeof(file_header);
+		const auto string_records_offset = mesh_records_offset + std::size_t{header.mesh_count} * sizeof(mesh_record);
+		const auto get_string = [&](std::size_t i) {
+			const auto record = read<string_record>(bytes, string_records_offset + i * sizeof(string_record));
+			const auto string_bytes = get_bytes(bytes, record.offset, record.size);
+			return std::string_view{reinterpret_cast<const char*>(string_bytes.data()), string_bytes.size()}; // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+		};
+		if (get_string(0) != textures_filename_prefix) {
+			throw cooked_model_error{fmt::format("\"{}\" was cooked with a different texture filename prefix!", filename)};
+		}
+		const auto directory = std::filesystem::path{filename}.parent_path();
+		for (auto i = std::size_t{1}; i <= header.material_library_count; ++i) {
+			const auto material_library = (directory / std::filesystem::path{get_string(i)}).string();
+			if (!is_up_to_date(material_library.c_str(), filename)) {
+				throw cooked_model_error{fmt::format("\"{}\" is older than its material library \"{}\"!", filename, material_library)};
+			}
+		}
+
+		auto result = model_data{};
+		result.bounding_sphere_radius = header.bounding_sphere_radius;
+		result.texture_filenames.reserve(header.string_count - 1 - header.material_library_count);
+		for (auto i = std::size_t{1} + header.material_library_count; i < header.string_count; ++i) {
+			result.texture_filenames.emplace_back(get_string(i));
+		}
+		result.meshes.reserve(header.mesh_count);
+		for (auto i = std::size_t{0}; i < header.mesh_count; ++i) {
+			const auto record = read<mesh_record>(bytes, mesh_records_offset + i * sizeof(mesh_record));
+			for (const auto texture_offset :
+				{record.albedo_texture_offset, record.normal_texture_offset, record.roughness_texture_offset, record.metallic_texture_offset}) {
+				if (texture_offset >= result.texture_filenames.size()) {
+					throw cooked_model_error{fmt::format("Invalid texture offset in \"{}\"!", filename)};
+				}
+			}
+			if (record.lod_index_count > std::numeric_limits<std::uint64_t>::max() - record.index_count) {
+				throw cooked_model_error{fmt::format("Invalid index count in \"{}\"!", filename)};
+			}
+			const auto total_index_count = record.index_count + record.lod_index_count;
+			auto geometry = model_mesh_geometry{
+				.vertices = read_vector<packed_model_vertex>(bytes, record.vertex_offset, record.vertex_count),
+				.index_count = static_cast<std::size_t>(record.index_count),
+			};
+			if (model_mesh_geometry::uses_small_indices(geometry.vertices.size())) {
+				geometry.small_indices = read_vector<std::uint16_t>(bytes, record.index_offset, total_index_count);
+			} else {
+				geometry.large_indices = read_vector<model_index>(bytes, record.index_offset, total_index_count);
+			}
+			const auto valid_indices = [&](const auto& indices) {
+				return std::ranges::all_of(indices, [&](auto index) {
+					return static_cast<std::size_t>(index) < geometry.vertices.size();
+				});
+			};
+			if (!valid_indices(geometry.small_indices) || !valid_indices(geometry.large_indices)) {
+				throw cooked_model_error{fmt::format("Invalid vertex index in \"{}\"!", filename)};
+			}
+			result.meshes.push_back(model_mesh_data{
+				.geometry = std::move(geometry),
+				.lods = read_vector<model_mesh_lod>(bytes, record.lod_offset, record.lod_count),
+				.clusters = read_vector<mesh_cluster>(bytes, record.cluster_offset, record.cluster_count),
+				.material =
+					model_material{
+						.albedo_texture_offset = record.albedo_texture_offset,
+						.normal_texture_offset = record.normal_texture_offset,
+						.roughness_texture_offset = record.roughness_texture_offset,
+						.metallic_texture_offset = record.metallic_texture_offset,
+						.alpha_test = false,
+						.alpha_blending = record.alpha_blending != 0,
+					},
+			});
+			const auto& mesh = result.meshes.back();
+			for (const auto& lod : mesh.lods) {
+				if (lod.index_offset > record.lod_index_count || lod.index_count > record.lod_index_count - lod.index_offset) {
+					throw cooked_model_error{fmt::format("Invalid level of detail in \"{}\"!", filename)};
+				}
+			}
+			for (const auto& cluster : mesh.clusters) {
+				if (cluster.index_offset > record.index_count || cluster.index_count > record.index_count - cluster.index_offset) {
+					throw cooked_model_error{fmt::format("Invalid cluster in \"{}\"!", filename)};
+				}
+			}
+		}
+		return result;
+	}
+
+private:
+	struct file_header final {
+		std::array<char, 8> magic;
+		std::uint32_t version;
+		std::uint32_t vertex_size;
+		std::uint32_t index_size;
+		std::uint32_t mesh_count;
+		std::uint32_t string_count;           // The texture filename prefix, the material libraries and then the texture filenames.
+		std::uint32_t material_library_count; // Files besides the source that the model was imported from, such as the .mtl files of an OBJ.
+		float bounding_sphere_radius;
+	};
+
+	struct mesh_record final {
+		std::uint64_t vertex_offset;
+		std::uint64_t vertex_count;
+		std::uint64_t index_offset;
+		std::uint64_t index_count; // Full detail indices, followed by those of the levels of detail in the same array.
+		std::uint64_t lod_index_count;
+		std::uint64_t lod_offset;
+		std::uint64_t lod_count;
+		std::uint64_t cluster_offset;
+		std::uint64_t cluster_count;
+		std::uint8_t albedo_texture_offset;
+		std::uint8_t normal_texture_offset;
+		std::uint8_t roughness_texture_offset;
+		std::uint8_t metallic_texture_offset;
+		std::uint8_t alpha_blending;
+		std::array<std::uint8_t, 3> padding; // Written as zeros, so that cooking the same model always gives the same bytes.
+	};
+	static_assert(sizeof(mesh_record) == 80);
+
+	struct string_record final {
+		std::uint64_t offset;
+		std::uint64_t size;
+	};
+
+	[[nodiscard]] static constexpr auto get_index_size(std::size_t vertex_count) noexcept -> std::size_t {
+		return (model_mesh_geometry::uses_small_indices(vertex_count)) ? sizeof(std::uint16_t) : sizeof(model_index);
+	}
+
+	[[nodiscard]] static constexpr auto align(std::size_t offset) noexcept -> std::size_t {
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	[[nodiscard]] static auto get_bytes(std::span<const std::byte> bytes, std::uint64_t offset, std::uint64_t size) -> std::span<const std::byte> {
+		if (offset > bytes.size() || size > bytes.size() - offset) {
+			throw cooked_model_error{"Unexpected end of cooked model file!"};
+		}
+		return bytes.subspan(static_cast<std::size_t>(offset), static_cast<std::size_t>(size));
+	}
+
+	template <typename T>
+	[[nodiscard]] static auto read(std::span<const std::byte> bytes, std::uint64_t offset) -> T {
+		static_assert(std::is_trivially_copyable_v<T>);
+		auto result = T{};
+		std::memcpy(&result, get_bytes(bytes, offset, sizeof(T)).data(), sizeof(T));
+		return result;
+	}
+
+	// The arrays are stored exactly as they are laid out in memory, so each one is a single copy.
+	template <typename T>
+	[[nodiscard]] static auto read_vector(std::span<const std::byte> bytes, std::uint64_t offset, std::uint64_t count) -> std::vector<T> {
+		static_assert(std::is_trivially_copyable_v<T>);
+		if (count > bytes.size() / sizeof(T)) {
+			throw cooked_model_error{"Unexpected end of cooked model file!"};
+		}
+		const auto source = get_bytes(bytes, offset, count * sizeof(T));
+		auto result = std::vector<T>(static_cast<std::size_t>(count));
+		std::memcpy(result.data(), source.data(), source.size());
+		return result;
+	}
+
+	template <typename T>
+	static auto write(std::ofstream& file, const T& value) -> void {
+		static_assert(std::is_trivially_copyable_v<T>);
+		file.write(reinterpret_cast<const char*>(&value), sizeof(T)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+	}
+
+	template <typename T>
+	static auto write(std::ofstream& file, std::span<const T> values) -> void {
+		static_assert(std::is_trivially_copyable_v<T>);
+		const auto bytes = std::as_bytes(values);
+		file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size())); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+	}
+
+	static auto write_padding(std::ofstream& file, std::size_t size) -> void {
+		static constexpr auto zeros = std::array<char, alignment>{};
+		file.write(zeros.data(), static_cast<std::streamsize>(size));
+	}
+};
+
+#endif
@@ -0,0 +1,396 @@
+#ifndef COOKED_TEXTURE_HPP
+#define COOKED_TEXTURE_HPP
+
+#include "../core/opengl.hpp"
+#include "../core/profiler.hpp"
+#include "../utilities/mapped_file.hpp"
+#include "image.hpp"
+#include "texture.hpp"
+#include "texture_encoder.hpp"
+
+#include <array>        // std::array
+#include <bit>          // std::bit_cast
+#include <cstddef>      // std::byte, std::size_t
+#include <cstdint>      // std::uint8_t, std::uint32_t, std::uint64_t, std::int64_t
+#include <cstdio>       // stderr
+#include <cstring>      // std::memcpy
+#include <exception>    // std::exception
+#include <filesystem>   // std::filesystem::...
+#include <fmt/format.h> // fmt::format, fmt::print
+#include <fstream>      // std::ofstream
+#include <optional>     // std::optional, std::nullopt
+#include <span>         // std::span, std::as_bytes
+#include <stdexcept>    // std::runtime_error
+#include <string>       // std::string
+#include <string_view>  // std::string_view
+#include <system_error> // std::error_code
+#include <type_traits>  // std::is_trivially_copyable_v
+#include <utility>      // std::move
+#include <vector>       // std::vector
+
+struct cooked_texture_error : std::runtime_error {
+	explicit cooked_texture_error(const auto& message)
+		: std::runtime_error(message) {}
+};
+
+// A texture with its whole mip chain prepared on the CPU, ready to be uploaded level by level without decoding or glGenerateMipmap.
+// Cooked textures are stored next to their source image, one file per set of texture options, and are keyed by the size and modification time of the source.
+// The levels of a loaded file point straight into the memory-mapped file.
+class cooked_texture final {
+public:
+	static constexpr auto magic = std::array<char, 8>{'T', 'E', 'X', 'T', 'U', 'R', 'E', 'S'};
+	static constexpr auto version = std::uint32_t{1};
+	static constexpr auto alignment = std::size_t{16};
+	static constexpr auto max_dimension = std::size_t{65536};
+
+	// Block compression is only used for 8-bit textures. BC4 and BC5, used for 1 and 2 channels, are core in OpenGL 3.3, but BC1 and BC3, used for 3 and 4
+	// channels, need EXT_texture_compression_s3tc. Textures whose format is not supported are left uncompressed.
+	[[nodiscard]] static auto is_compression_supported(std::size_t channel_count) noexcept -> bool {
+		return channel_count <= 2 || GLEW_EXT_texture_compression_s3tc;
+	}
+
+	[[nodiscard]] static auto get_filename(std::string_view source_filename, const texture_options& options, bool compress) -> std::string {
+		return fmt::format("{}.{:016x}.cooked", source_filename, get_options_hash(options, compress));
+	}
+
+	// Load the cooked version of a texture if it matches the source, otherwise decode the source and cook it for next time.
+	// Failing to write the cooked file is not an error, since the cooked data is still valid. Does not use OpenGL.
+	[[nodiscard]] static auto import(const std::string& source_filename, const texture_options& options, bool compress) -> cooked_texture {
+		const auto cooked_filename = get_filename(source_filename, options, compress);
+		const auto key = get_source_key(source_filename.c_str(), options, compress);
+		if (key) {
+			try {
+				return load(cooked_filename.c_str(), *key);
+			} catch (const cooked_texture_error&) {
+				// Missing, stale or written by an older version. Cook it again below.
+			} catch (const mapped_file_error&) {
+			}
+		}
+		const auto hdr = source_filename.ends_with(".hdr");
+		const auto img = [&] {
+			const auto zone = profiler::zone("decode_image", source_filename);
+			return (hdr) ? image::load_hdr(source_filename.c_str()) : image::load(source_filename.c_str());
+		}();
+		auto result = cook(img, hdr, options, compress);
+		if (key) {
+			try {
+				const auto zone = profiler::zone("save_cooked_texture", cooked_filename);
+				result.save(cooked_filename.c_str(), *key);
+			} catch (const std::exception& e) {
+				fmt::print(stderr, "Failed to cook texture \"{}\": {}\n", source_filename, e.what());
+			}
+		}
+		return result;
+	}
+
+	// Build the mip chain of a decoded image. HDR images are stored as floats and are never compressed. Does not use OpenGL.
+	[[nodiscard]] static auto cook(const image& img, bool hdr, const texture_options& options, bool compress) -> cooked_texture {
+		const auto zone = profiler::zone("cook_texture");
+		const auto channel_count = img.channel_count();
+		auto result = cooked_texture{};
+		result.m_width = img.width();
+		result.m_height = img.height();
+		result.m_format = texture::pixel_format(channel_count);
+		result.m_compressed = compress && !hdr && is_compression_supported(channel_count);
+		const auto level_count = (options.use_mip_map) ? texture_encoder::mip_level_count(img.width(), img.height()) : std::size_t{1};
+		if (hdr) {
+			result.m_internal_format = texture::internal_pixel_format_hdr(channel_count);
+			result.m_type = GL_FLOAT;
+			result.add_levels(std::span{static_cast<const float*>(img.data()), img.width() * img.height() * channel_count}, level_count);
+		} else {
+			result.m_internal_format = (result.m_compressed) ? texture_encoder::compressed_internal_format(channel_count) : texture::internal_pixel_format_ldr(channel_count);
+			result.m_type = GL_UNSIGNED_BYTE;
+			result.add_levels(std::span{static_cast<const std::uint8_t*>(img.data()), img.width() * img.height() * channel_count}, level_count);
+		}
+		return result;
+	}
+
+	// Upload the levels from the base level onward. The larger levels can be uploaded later with upload_level.
+	[[nodiscard]] auto upload(const texture_options& options, std::size_t base_level = 0) const -> texture {
+		const auto zone = profiler::gpu_zone("upload_texture");
+		if (m_compressed) {
+			return texture::create_2d_compressed_mip_levels(m_internal_format, m_width, m_height, m_levels, options, base_level);
+		}
+		return texture::create_2d_mip_levels(m_internal_format, m_width, m_height, m_format, m_type, m_levels, options, base_level);
+	}
+
+	// Upload a single level into a texture that was uploaded from this one.
+	auto upload_level(texture& tex, std::size_t level) const -> void {
+		const auto zone = profiler::gpu_zone("upload_texture_level");
+		if (m_compressed) {
+			tex.set_compressed_mip_level_2d(level, m_levels[level]);
+		} else {
+			tex.set_mip_level_2d(level, m_format, m_type, m_levels[level]);
+		}
+	}
+
+	[[nodiscard]] auto internal_format() const noexcept -> GLint {
+		return m_internal_format;
+	}
+
+	[[nodiscard]] auto width() const noexcept -> std::size_t {
+		return m_width;
+	}
+
+	[[nodiscard]] auto height() const noexcept -> std::size_t {
+		return m_height;
+	}
+
+	[[nodiscard]] auto levels() const noexcept -> std::span<const std::span<const std::byte>> {
+		return m_levels;
+	}
+
+	// Total size of all levels, which is also roughly what the texture takes up on the GPU.
+	[[nodiscard]] auto size() const noexcept -> std::size_t {
+		auto result = std::size_t{0};
+		for (const auto& level : m_levels) {
+			result += level.size();
+		}
+		return result;
+	}
+
+private:
+	struct source_key final {
+		std::uint64_t source_size;
+		std::int64_t source_time;
+		std::uint64_t options_hash;
+	};
+
+	struct file_header final {
+		std::array<char, 8> magic;
+		std::uint32_t version;
+		std::uint32_t level_count;
+		source_key key;
+		std::uint64_t width;
+		std::uint64_t height;
+		std::int32_t internal_format;
+		std::uint32_t format;
+		std::uint32_t type;
+		std::uint32_t compressed;
+	};
+
+	struct level_record final {
+		std::uint64_t offset;
+		std::uint64_t size;
+	};
+
+	cooked_texture() noexcept = default;
+
+	[[nodiscard]] static auto get_options_hash(const texture_options& options, bool compress) noexcept -> std::uint64_t {
+		// FNV-1a over every option, so that changing any of them gives a different file.
+		auto result = std::uint64_t{14695981039346656037ull};
+		for (const auto value : {std::uint64_t{std::bit_cast<std::uint32_t>(options.max_anisotropy)},
+				 std::uint64_t{options.repeat},
+				 std::uint64_t{options.black_border},
+				 std::uint64_t{options.use_linear_filtering},
+				 std::uint64_t{options.use_mip_map},
+				 std::uint64_t{options.use_compare_mode},
+				 std::uint64_t{compress}}) {
+			for (auto i = std::size_t{0}; i < sizeof(value); ++i) {
+				result = (result ^ ((value >> (i * 8)) & 0xFF)) * std::uint64_t{1099511628211ull};
+			}
+		}
+		return result;
+	}
+
+	[[nodiscard]] static auto get_source_key(const char* source_filename, const texture_options& options, bool compress) -> std::optional<source_key> {
+		auto error = std::error_code{};
+		const auto size = std::filesystem::file_size(source_filename, error);
+		if (error) {
+			return std::nullopt;
+		}
+		const auto time = std::filesystem::last_write_time(source_filename, error);
+		if (error) {
+			return std::nullopt;
+		}
+		return source_key{
+			.source_size = static_cast<std::uint64_t>(size),
+			.source_time = static_cast<std::int64_t>(time.time_since_epoch().count()),
+			.options_hash = get_options_hash(options, compress),
+		};
+	}
+
+	[[nodiscard]] static auto load(const char* filename, const source_key& key) -> cooked_texture {
+		const auto zone = profiler::zone("load_cooked_texture", filename);
+		auto result = cooked_texture{};
+		result.m_file = mapped_file::open(filename);
+		const auto bytes = result.m_file.bytes();
+
+		const auto header = read<file_header>(bytes, 0);
+		if (header.magic != magic || header.version != version) {
+			throw cooked_texture_error{fmt::format("\"{}\" is not a cooked texture file of the current version!", filename)};
+		}
+		if (header.key.source_size != key.source_size || header.key.source_time != key.source_time || header.key.options_hash != key.options_hash) {
+			throw cooked_texture_error{fmt::format("\"{}\" is out of date!", filename)};
+		}
+		if (header.width == 0 || header.height == 0 || header.width > max_dimension || header.height > max_dimension) {
+			throw cooked_texture_error{fmt::format("Invalid size in \"{}\"!", filename)};
+		}
+		if (header.level_count == 0 || header.level_count > texture_encoder::mip_level_count(header.width, header.height)) {
+			throw cooked_texture_error{fmt::format("Invalid level count in \"{}\"!", filename)};
+		}
+		if (!is_valid_format(header)) {
+			throw cooked_texture_error{fmt::format("Invalid or unsupported format in \"{}\"!", filename)};
+		}
+		result.m_width = static_cast<std::size_t>(header.width);
+		result.m_height = static_cast<std::size_t>(header.height);
+		result.m_internal_format = header.internal_format;
+		result.m_format = header.format;
+		result.m_type = header.type;
+		result.m_compressed = header.compressed != 0;
+		result.m_levels.reserve(header.level_count);
+		for (auto level = std::size_t{0}; level < header.level_count; ++level) {
+			const auto record = read<level_record>(bytes, sizeof(file_header) + level * sizeof(level_record));
+			if (record.size != get_level_size(header, level)) {
+				throw cooked_texture_error{fmt::format("Invalid size of level {} in \"{}\"!", level, filename)};
+			}
+			result.m_levels.push_back(get_bytes(bytes, record.offset, record.size));
+		}
+		return result;
+	}
+
+	// Whether the header describes a format that cook() can produce and that can be uploaded on this GPU.
+	[[nodiscard]] static auto is_valid_format(const file_header& header) -> bool {
+		for (auto channel_count = std::size_t{1}; channel_count <= 4; ++channel_count) {
+			if (header.format != texture::pixel_format(channel_count)) {
+				continue;
+			}
+			if (header.compressed != 0) {
+				return header.type == GL_UNSIGNED_BYTE && header.internal_format == texture_encoder::compressed_internal_format(channel_count) &&
+					is_compression_supported(channel_count);
+			}
+			return (header.type == GL_UNSIGNED_BYTE && header.internal_format == texture::internal_pixel_format_ldr(channel_count)) ||
+				(header.type == GL_FLOAT && header.internal_format == texture::internal_pixel_format_hdr(channel_count));
+		}
+		return false;
+	}
+
+	// Size in bytes of a level in the format of a header that has passed is_valid_format.
+	[[nodiscard]] static auto get_level_size(const file_header& header, std::size_t level) -> std::size_t {
+		const auto level_width = texture_encoder::mip_level_dimension(static_cast<std::size_t>(header.width), level);
+		const auto level_height = texture_encoder::mip_level_dimension(static_cast<std::size_t>(header.height), level);
+		if (header.compressed != 0) {
+			return texture::level_size(header.internal_format, level_width, level_height);
+		}
+		const auto texel_size = (header.type == GL_FLOAT) ? sizeof(float) : sizeof(std::uint8_t);
+		return level_width * level_height * texture::channel_count(header.format) * texel_size;
+	}
+
+	auto save(const char* filename, const source_key& key) const -> void {
+		auto offset = sizeof(file_header) + m_levels.size() * sizeof(level_record);
+		auto level_records = std::vector<level_record>{};
+		level_records.reserve(m_levels.size());
+		for (const auto& level : m_levels) {
+			offset = align(offset);
+			level_records.push_back(level_record{.offset = offset, .size = level.size()});
+			offset += level.size();
+		}
+
+		// Write to a temporary file first, so that a cooked file is never seen half-written.
+		const auto temporary_filename = fmt::format("{}.tmp", filename);
+		{
+			auto file = std::ofstream{temporary_filename, std::ios::binary | std::ios::trunc};
+			if (!file) {
+				throw cooked_texture_error{fmt::format("Failed to open \"{}\" for writing!", temporary_filename)};
+			}
+			write(file,
+				file_header{
+					.magic = magic,
+					.version = version,
+					.level_count = static_cast<std::uint32_t>(m_levels.size()),
+					.key = key,
+					.width = m_width,
+					.height = m_height,
+					.internal_format = m_internal_format,
+					.format = m_format,
+					.type = m_type,
+					.compressed = (m_compressed) ? 1u : 0u,
+				});
+			write(file, std::span<const level_record>{level_records});
+			auto position = sizeof(file_header) + level_records.size() * sizeof(level_record);
+			for (auto level = std::size_t{0}; level < m_levels.size(); ++level) {
+				static constexpr auto zeros = std::array<char, alignment>{};
+				file.write(zeros.data(), static_cast<std::streamsize>(level_records[level].offset - position));
+				write(file, m_levels[level]);
+				position = level_records[level].offset + level_records[level].size;
+			}
+			if (!file) {
+				throw cooked_texture_error{fmt::format("Failed to write \"{}\"!", temporary_filename)};
+			}
+		}
+		auto error = std::error_code{};
+		std::filesystem::rename(temporary_filename, filename, error);
+		if (error) {
+			std::filesystem::remove(temporary_filename, error);
+			throw cooked_texture_error{fmt::format("Failed to replace \"{}\"!", filename)};
+		}
+	}
+
+	template <typename T>
+	auto add_levels(std::span<const T> texels, std::size_t level_count) -> void {
+		const auto channel_count = texture::channel_count(m_format);
+		auto current = std::vector<T>(texels.begin(), texels.end());
+		for (auto level = std::size_t{0}; level < level_count; ++level) {
+			const auto level_width = texture_encoder::mip_level_dimension(m_width, level);
+			const auto level_height = texture_encoder::mip_level_dimension(m_height, level);
+			if (level > 0) {
+				current = texture_encoder::downsample(std::span<const T>{current}, texture_encoder::mip_level_dimension(m_width, level - 1),
+					texture_encoder::mip_level_dimension(m_height, level - 1), channel_count);
+			}
+			if constexpr (std::is_same_v<T, std::uint8_t>) {
+				if (m_compressed) {
+					const auto zone = profiler::zone("compress_texture_level");
+					m_level_data.push_back(texture_encoder::compress(current, level_width, level_height, channel_count));
+					continue;
+				}
+			}
+			const auto level_bytes = std::as_bytes(std::span<const T>{current});
+			m_level_data.emplace_back(level_bytes.begin(), level_bytes.end());
+		}
+		m_levels.assign(m_level_data.begin(), m_level_data.end());
+	}
+
+	[[nodiscard]] static constexpr auto align(std::size_t offset) noexcept -> std::size_t {
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	[[nodiscard]] static auto get_bytes(std::span<const std::byte> bytes, std::uint64_t offset, std::uint64_t size) -> std::span<const std::byte> {
+		if (offset > bytes.size() || size > bytes.size() - offset) {
+			throw cooked_texture_error{"Unexpected end of cooked texture file!"};
+		}
+		return bytes.subspan(static_cast<std::size_t>(offset), static_cast<std::size_t>(size));
+	}
+
+	template <typename T>
+	[[nodiscard]] static auto read(std::span<const std::byte> bytes, std::uint64_t offset) -> T {
+		static_assert(std::is_trivially_copyable_v<T>);
+		auto result = T{};
+		std::memcpy(&result, get_bytes(bytes, offset, sizeof(T)).data(), sizeof(T));
+		return result;
+	}
+
+	template <typename T>
+	static auto write(std::ofstream& file, const T& value) -> void {
+		static_assert(std::is_trivially_copyable_v<T>);
+		file.write(reinterpret_cast<const char*>(&value), sizeof(T)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+	}
+
+	template <typename T>
+	static auto write(std::ofstream& file, std::span<const T> values) -> void {
+		static_assert(std::is_trivially_copyable_v<T>);
+		const auto bytes = std::as_bytes(values);
+		file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size())); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+	}
+
+	mapped_file m_file{};                              // Backs m_levels when loaded from a file.
+	std::vector<std::vector<std::byte>> m_level_data{}; // Backs m_levels when cooked in memory.
+	std::vector<std::span<const std::byte>> m_levels{};
+	GLint m_internal_format = 0;
+	GLenum m_format = 0;
+	GLenum m_type = 0;
+	bool m_compressed = false;
+	std::size_t m_width = 0;
+	std::size_t m_height = 0;
+};
+
+#endif
@@ -12,6 +12,7 @@
 #include <fmt/format.h> // fmt::format
 #include <memory>       // std::shared_ptr
 #include <stdexcept>    // std::runtime_error
+#include <string>       // std::string
 #include <string_view>  // std::string_view
 #include <tuple>        // std::tuple
 #include <utility>      // std::move
@@ -96,14 +97,27 @@ public:
 		.use_mip_map = true,
 	};
 
+	// Faces are stored as separate images named by the prefix, the face (px, nx, py, ny, pz or nz) and the extension, in that order.
+	[[nodiscard]] static auto get_face_filenames(std::string_view filename_prefix, std::string_view extension) -> std::array<std::string, 6> {
+		return {
+			fmt::format("{}px{}", filename_prefix, extension),
+			fmt::format("{}nx{}", filename_prefix, extension),
+			fmt::format("{}py{}", filename_prefix, extension),
+			fmt::format("{}ny{}", filename_prefix, extension),
+			fmt::format("{}pz{}", filename_prefix, extension),
+			fmt::format("{}nz{}", filename_prefix, extension),
+		};
+	}
+
 	[[nodiscard]] static auto load(std::string_view filename_prefix, std::string_view extension) -> cubemap_texture {
+		const auto filenames = get_face_filenames(filename_prefix, extension);
 		const auto images = std::array<image, 6>{
-			image::load(fmt::format("{}px{}", filename_prefix, extension).c_str()),
-			image::load(fmt::format("{}nx{}", filename_prefix, extension).c_str()),
-			image::load(fmt::format("{}py{}", filename_prefix, extension).c_str()),
-			image::load(fmt::format("{}ny{}", filename_prefix, extension).c_str()),
-			image::load(fmt::format("{}pz{}", filename_prefix, extension).c_str()),
-			image::load(fmt::format("{}nz{}", filename_prefix, extension).c_str()),
+			image::load(filenames[0].c_str()),
+			image::load(filenames[1].c_str()),
+			image::load(filenames[2].c_str()),
+			image::load(filenames[3].c_str()),
+			image::load(filenames[4].c_str()),
+			image::load(filenames[5].c_str()),
 		};
 		const auto resolution = images[0].width();
 		const auto channel_count = images[0].channel_count();
@@ -124,13 +138,14 @@ public:
 	}
 
 	[[nodiscard]] static auto load_hdr(std::string_view filename_prefix, std::string_view extension) -> cubemap_texture {
+		const auto filenames = get_face_filenames(filename_prefix, extension);
 		const auto images = std::array<image, 6>{
-			image::load_hdr(fmt::format("{}px{}", filename_prefix, extension).c_str()),
-			image::load_hdr(fmt::format("{}nx{}", filename_prefix, extension).c_str()),
-			image::load_hdr(fmt::format("{}py{}", filename_prefix, extension).c_str()),
-			image::load_hdr(fmt::format("{}ny{}", filename_prefix, extension).c_str()),
-			image::load_hdr(fmt::format("{}pz{}", filename_prefix, extension).c_str()),
-			image::load_hdr(fmt::format("{}nz{}", filename_prefix, extension).c_str()),
+			image::load_hdr(filenames[0].c_str()),
+			image::load_hdr(filenames[1].c_str()),
+			image::load_hdr(filenames[2].c_str()),
+			image::load_hdr(filenames[3].c_str()),
+			image::load_hdr(filenames[4].c_str()),
+			image::load_hdr(filenames[5].c_str()),
 		};
 		const auto resolution = images[0].width();
 		const auto channel_count = images[0].channel_count();
@@ -171,13 +186,18 @@ private:
 class environment_cubemap final {
 public:
 	[[nodiscard]] static auto get_default() -> const std::shared_ptr<environment_cubemap>& {
-		static constexpr auto create_default = [] {
+		static const auto env = std::make_shared<environment_cubemap>(create_default());
+		return env;
+	}
+
+	// A uniform white environment, also used in place of environments that are still loading.
+	[[nodiscard]] static auto create_default() -> environment_cubemap {
+		static constexpr auto create_default_cubemap = [] {
 			const auto pixel = std::array<float, 4>{1.0f, 1.0f, 1.0f, 1.0f};
 			return cubemap_texture{texture::create_cubemap(
 				GL_RGBA16F, 1, GL_RGBA, GL_FLOAT, pixel.data(), pixel.data(), pixel.data(), pixel.data(), pixel.data(), pixel.data(), cubemap_texture::options)};
 		};
-		static const auto env = std::make_shared<environment_cubemap>(std::make_shared<cubemap_texture>(create_default()), create_default(), create_default());
-		return env;
+		return environment_cubemap{std::make_shared<cubemap_texture>(create_default_cubemap()), create_default_cubemap(), create_default_cubemap()};
 	}
 
 	environment_cubemap(std::shared_ptr<cubemap_texture> environment, cubemap_texture irradiance, cubemap_texture prefilter)
@@ -2,13 +2,17 @@
 #define LIGHTMAP_HPP
 
 #include "../core/opengl.hpp"
+#include "lightmap_encoder.hpp"
 #include "texture.hpp"
 
 #include <array>     // std::array
-#include <cstddef>   // std::size_t
+#include <cstddef>   // std::size_t, std::byte
+#include <cstdint>   // std::uint8_t
 #include <memory>    // std::shared_ptr, std::make_shared
+#include <span>      // std::span
 #include <stdexcept> // std::runtime_error
 #include <utility>   // std::move
+#include <vector>    // std::vector
 
 struct lightmap_error : std::runtime_error {
 	explicit lightmap_error(const auto& message)
@@ -37,12 +41,82 @@ public:
 		return map;
 	}
 
-	[[nodiscard]] static auto create(std::size_t resolution, const void* pixels) -> lightmap_texture {
-		return lightmap_texture{texture::create_2d(internal_format, resolution, resolution, format, type, pixels, options)};
+	[[nodiscard]] static auto is_supported(lightmap_encoding encoding) noexcept -> bool {
+		return encoding != lightmap_encoding::bc6h || GLEW_ARB_texture_compression_bptc;
 	}
 
-	explicit lightmap_texture(texture texture)
-		: m_texture(std::move(texture)) {}
+	// BC6H falls back to RGB9E5, which has a similar range and is available everywhere.
+	[[nodiscard]] static auto get_supported_encoding(lightmap_encoding encoding) noexcept -> lightmap_encoding {
+		return (is_supported(encoding)) ? encoding : lightmap_encoding::rgb9e5;
+	}
+
+	[[nodiscard]] static auto create(std::size_t resolution, const void* pixels, GLenum pixel_type = type) -> lightmap_texture {
+		return lightmap_texture{texture::create_2d(internal_format, resolution, resolution, format, pixel_type, pixels, options)};
+	}
+
+	// Encode RGBA float pixels into a full mip chain on the CPU and upload it.
+	[[nodiscard]] static auto create_encoded(std::size_t resolution, std::span<const float> pixels, lightmap_encoding encoding) -> lightmap_texture {
+		const auto levels = lightmap_encoder::encode(pixels, resolution, encoding);
+		const auto level_views = std::vector<std::span<const std::byte>>(levels.begin(), levels.end());
+		return create_mip_levels(resolution, encoding, level_views);
+	}
+
+	// Upload an already encoded mip chain, as produced by lightmap_encoder::encode() or read_mip_levels().
+	[[nodiscard]] static auto create_mip_levels(std::size_t resolution, lightmap_encoding encoding, std::span<const std::span<const std::byte>> levels) -> lightmap_texture {
+		if (!is_supported(encoding)) {
+			throw lightmap_error{"Lightmap encoding is not supported by the GPU!"};
+		}
+		const auto info = get_encoding_info(encoding);
+		if (lightmap_encoder::is_block_compressed(encoding)) {
+			return lightmap_texture{texture::create_2d_compressed_mip_levels(info.internal_format, resolution, resolution, levels, options), encoding};
+		}
+		return lightmap_texture{texture::create_2d_mip_levels(info.internal_format, resolution, resolution, info.format, info.type, levels, options), encoding};
+	}
+
+	explicit lightmap_texture(texture texture, lightmap_encoding encoding = lightmap_encoding::rgba16f)
+		: m_texture(std::move(texture))
+		, m_encoding(encoding) {}
+
+	auto update(const void* pixels, GLenum pixel_type = type) -> void {
+		m_texture.paste_2d(m_texture.width(), m_texture.height(), format, pixel_type, pixels, 0, 0);
+		if (options.use_mip_map) {
+			m_texture.generate_mip_map_2d();
+		}
+	}
+
+	[[nodiscard]] auto read_mip_levels() const -> std::vector<std::vector<std::byte>> {
+		const auto resolution = m_texture.width();
+		const auto info = get_encoding_info(m_encoding);
+		auto result = std::vector<std::vector<std::byte>>{};
+		for (auto level = std::size_t{0}; level < lightmap_encoder::mip_level_count(resolution); ++level) {
+			if (lightmap_encoder::is_block_compressed(m_encoding)) {
+				result.push_back(m_texture.read_compressed_mip_level_2d(level));
+			} else {
+				const auto size = lightmap_encoder::level_size(m_encoding, lightmap_encoder::mip_level_resolution(resolution, level));
+				result.push_back(m_texture.read_mip_level_2d(level, info.format, info.type, size));
+			}
+		}
+		return result;
+	}
+
+	// Read back the decoded linear RGBA pixels of the base level.
+	[[nodiscard]] auto read_pixels() const -> std::vector<float> {
+		if (m_encoding != lightmap_encoding::rgbm) {
+			return m_texture.read_pixels_2d_hdr(format);
+		}
+		const auto encoded = m_texture.read_pixels_2d(format);
+		auto result = std::vector<float>(encoded.size());
+		for (auto i = std::size_t{0}; i + channel_count <= encoded.size(); i += channel_count) {
+			const auto rgbm = std::array<std::uint8_t, 4>{std::to_integer<std::uint8_t>(encoded[i]), std::to_integer<std::uint8_t>(encoded[i + 1]),
+				std::to_integer<std::uint8_t>(encoded[i + 2]), std::to_integer<std::uint8_t>(encoded[i + 3])};
+			const auto color = lightmap_encoder::decode_rgbm(rgbm);
+			result[i] = color.x;
+			result[i + 1] = color.y;
+			result[i + 2] = color.z;
+			result[i + 3] = 1.0f;
+		}
+		return result;
+	}
 
 	[[nodiscard]] auto get_texture() const noexcept -> const texture& {
 		return m_texture;
@@ -52,8 +126,34 @@ public:
 		return m_texture.get();
 	}
 
+	[[nodiscard]] auto encoding() const noexcept -> lightmap_encoding {
+		return m_encoding;
+	}
+
+	// Scale that the shader applies to RGBM texels, or zero if the texels are stored as plain RGB.
+	[[nodiscard]] auto rgbm_range() const noexcept -> float {
+		return (m_encoding == lightmap_encoding::rgbm) ? lightmap_encoder::rgbm_range : 0.0f;
+	}
+
 private:
+	struct encoding_info final {
+		GLint internal_format;
+		GLenum format;
+		GLenum type;
+	};
+
+	[[nodiscard]] static auto get_encoding_info(lightmap_encoding encoding) -> encoding_info {
+		switch (encoding) {
+			case lightmap_encoding::rgba16f: return {GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT};
+			case lightmap_encoding::rgb9e5: return {GL_RGB9_E5, GL_RGB, GL_UNSIGNED_INT_5_9_9_9_REV};
+			case lightmap_encoding::rgbm: return {GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE};
+			case lightmap_encoding::bc6h: return {GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, GL_RGB, GL_HALF_FLOAT};
+		}
+		throw lightmap_error{"Invalid lightmap encoding!"};
+	}
+
 	texture m_texture;
+	lightmap_encoding m_encoding;
 };
 
 #endif
@@ -0,0 +1,325 @@
+#ifndef LIGHTMAP_ENCODER_HPP
+#define LIGHTMAP_ENCODER_HPP
+
+#include "../core/glsl.hpp"
+#include "../utilities/parallel.hpp"
+
+#include <algorithm>           // std::min, std::max
+#include <array>               // std::array
+#include <bit>                 // std::bit_width
+#include <cmath>               // std::floor, std::log2, std::exp2, std::ceil, std::round
+#include <cstddef>             // std::byte, std::size_t
+#include <cstdint>             // std::uint8_t, std::uint16_t, std::uint32_t, std::uint64_t
+#include <cstring>             // std::memcpy
+#include <glm/gtc/packing.hpp> // glm::packHalf1x16
+#include <limits>              // std::numeric_limits
+#include <span>                // std::span
+#include <stdexcept>           // std::invalid_argument
+#include <string_view>         // std::string_view
+#include <utility>             // std::swap
+#include <vector>              // std::vector
+
+// Storage format of a finished lightmap on the GPU. The values are stored in lightmap files, so they must not be reordered.
+enum class lightmap_encoding : std::uint32_t {
+	rgba16f, // 8 bytes per texel.
+	rgb9e5,  // 4 bytes per texel, shared exponent.
+	rgbm,    // 4 bytes per texel, RGBA8 with a multiplier in alpha that is decoded in the shader.
+	bc6h,    // 1 byte per texel, block compressed (requires ARB_texture_compression_bptc).
+};
+
+// Encodes linear RGBA float lightmaps into a complete mip chain of a compact encoding on the CPU.
+class lightmap_encoder final {
+public:
+	static constexpr auto channel_count = std::size_t{4};
+	static constexpr auto rgbm_range = 8.0f;
+
+	[[nodiscard]] static auto get_name(lightmap_encoding encoding) noexcept -> std::string_view {
+		switch (encoding) {
+			case lightmap_encoding::rgba16f: return "rgba16f";
+			case lightmap_encoding::rgb9e5: return "rgb9e5";
+			case lightmap_encoding::rgbm: return "rgbm";
+			case lightmap_encoding::bc6h: return "bc6h";
+		}
+		return "unknown";
+	}
+
+	[[nodiscard]] static auto is_block_compressed(lightmap_encoding encoding) noexcept -> bool {
+		return encoding == lightmap_encoding::bc6h;
+	}
+
+	[[nodiscard]] static auto mip_level_count(std::size_t resolution) noexcept -> std::size_t {
+		return static_cast<std::size_t>(std::bit_width(resolution));
+	}
+
+	[[nodiscard]] static auto mip_level_resolution(std::size_t resolution, std::size_t level) noexcept -> std::size_t {
+		return std::max(resolution >> level, std::size_t{1});
+	}
+
+	[[nodiscard]] static auto level_size(lightmap_encoding encoding, std::size_t resolution) -> std::size_t {
+		switch (encoding) {
+			case lightmap_encoding::rgba16f: return resolution * resolution * channel_count * sizeof(std::uint16_t);
+			case lightmap_encoding::rgb9e5: return resolution * resolution * sizeof(std::uint32_t);
+			case lightmap_encoding::rgbm: return resolution * resolution * channel_count * sizeof(std::uint8_t);
+			case lightmap_encoding::bc6h: return block_count(resolution) * block_count(resolution) * bc6h_block_size;
+		}
+		throw std::invalid_argument{"Invalid lightmap encoding!"};
+	}
+
+	// Box filter the pixels down to 1x1 and encode every level. Rows and blocks are processed on all hardware threads.
+	[[nodiscard]] static auto encode(std::span<const float> pixels, std::size_t resolution, lightmap_encoding encoding) -> std::vector<std::vector<std::byte>> {
+		if (pixels.size() != resolution * resolution * channel_count) {
+			throw std::invalid_argument{"Invalid lightmap pixel count!"};
+		}
+		const auto level_count = mip_level_count(resolution);
+		auto result = std::vector<std::vector<std::byte>>{};
+		result.reserve(level_count);
+		result.push_back(encode_level(pixels, resolution, encoding));
+		auto level_pixels = std::vector<float>{};
+		auto previous_pixels = std::vector<float>{};
+		for (auto level = std::size_t{1}; level < level_count; ++level) {
+			previous_pixels.swap(level_pixels);
+			const auto source = (level == 1) ? pixels : std::span<const float>{previous_pixels};
+			const auto source_resolution = mip_level_resolution(resolution, level - 1);
+			const auto level_resolution = mip_level_resolution(resolution, level);
+			level_pixels.resize(level_resolution * level_resolution * channel_count);
+			parallel_for(level_resolution, [&](std::size_t y) {
+				const auto y0 = std::min(y * 2, source_resolution - 1);
+				const auto y1 = std::min(y * 2 + 1, source_resolution - 1);
+				for (auto x = std::size_t{0}; x < level_resolution; ++x) {
+					const auto x0 = std::min(x * 2, source_resolution - 1);
+					const auto x1 = std::min(x * 2 + 1, source_resolution - 1);
+					for (auto channel = std::size_t{0}; channel < channel_count; ++channel) {
+						const auto sum = source[(y0 * source_resolution + x0) * channel_count + channel] + source[(y0 * source_resolution + x1) * channel_count + channel] +
+							source[(y1 * source_resolution + x0) * channel_count + channel] + source[(y1 * source_resolution + x1) * channel_count + channel];
+						level_pixels[(y * level_resolution + x) * channel_count + channel] = sum * 0.25f;
+					}
+				}
+			});
+			result.push_back(encode_level(level_pixels, level_resolution, encoding));
+		}
+		return result;
+	}
+
+	[[nodiscard]] static auto encode_rgb9e5(vec3 color) noexcept -> std::uint32_t {
+		// See the EXT_texture_shared_exponent specification.
+		constexpr auto mantissa_bits = 9;
+		constexpr auto exponent_bias = 15;
+		constexpr auto max_exponent = 31;
+		constexpr auto max_value = static_cast<float>((1 << mantissa_bits) - 1) / static_cast<float>(1 << mantissa_bits) * static_cast<float>(1 << (max_exponent - exponent_bias));
+		const auto r = clamp(color.x, 0.0f, max_value);
+		const auto g = clamp(color.y, 0.0f, max_value);
+		const auto b = clamp(color.z, 0.0f, max_value);
+		const auto max_channel = std::max(r, std::max(g, b));
+		if (max_channel <= 0.0f) {
+			return 0;
+		}
+		auto exponent = std::max(-exponent_bias - 1, static_cast<int>(std::floor(std::log2(max_channel)))) + 1 + exponent_bias;
+		if (static_cast<int>(std::floor(max_channel / std::exp2(static_cast<float>(exponent - exponent_bias - mantissa_bits)) + 0.5f)) == (1 << mantissa_bits)) {
+			++exponent;
+		}
+		const auto scale = std::exp2(static_cast<float>(exponent_bias + mantissa_bits - exponent));
+		const auto mantissa = [&](float value) {
+			return std::min(static_cast<std::uint32_t>(std::floor(value * scale + 0.5f)), std::uint32_t{(1 << mantissa_bits) - 1});
+		};
+		return mantissa(r) | (mantissa(g) << 9) | (mantissa(b) << 18) | (static_cast<std::uint32_t>(exponent) << 27);
+	}
+
+	[[nodiscard]] static auto encode_rgbm(vec3 color) noexcept -> std::array<std::uint8_t, 4> {
+		const auto scaled = max(color, vec3{0.0f}) * (1.0f / rgbm_range);
+		auto multiplier = clamp(std::max(scaled.x, std::max(scaled.y, scaled.z)), 1.0f / 255.0f, 1.0f);
+		multiplier = std::ceil(multiplier * 255.0f) / 255.0f;
+		const auto normalized = clamp(scaled / multiplier, vec3{0.0f}, vec3{1.0f});
+		return {
+			static_cast<std::uint8_t>(std::round(normalized.x * 255.0f)),
+			static_cast<std::uint8_t>(std::round(normalized.y * 255.0f)),
+			static_cast<std::uint8_t>(std::round(normalized.z * 255.0f)),
+			static_cast<std::uint8_t>(std::round(multiplier * 255.0f)),
+		};
+	}
+
+	[[nodiscard]] static auto decode_rgbm(std::span<const std::uint8_t, 4> rgbm) noexcept -> vec3 {
+		const auto multiplier = static_cast<float>(rgbm[3]) * (rgbm_range / (255.0f * 255.0f));
+		return vec3{static_cast<float>(rgbm[0]), static_cast<float>(rgbm[1]), static_cast<float>(rgbm[2])} * multiplier;
+	}
+
+private:
+	static constexpr auto bc6h_block_dimension = std::size_t{4};
+	static constexpr auto bc6h_block_size = std::size_t{16};
+	static constexpr auto bc6h_max_half = 0x7BFF; // Largest finite half-float.
+
+	[[nodiscard]] static auto block_count(std::size_t resolution) noexcept -> std::size_t {
+		return (resolution + bc6h_block_dimension - 1) / bc6h_block_dimension;
+	}
+
+	[[nodiscard]] static auto encode_level(std::span<const float> pixels, std::size_t resolution, lightmap_encoding encoding) -> std::vector<std::byte> {
+		auto result = std::vector<std::byte>(level_size(encoding, resolution));
+		const auto rgb = [&](std::size_t x, std::size_t y) {
+			const auto* const pixel = &pixels[(y * resolution + x) * channel_count];
+			return vec3{pixel[0], pixel[1], pixel[2]};
+		};
+		switch (encoding) {
+			case lightmap_encoding::rgba16f:
+				parallel_for(resolution, [&](std::size_t y) {
+					for (auto i = y * resolution * channel_count; i < (y + 1) * resolution * channel_count; ++i) {
+						const auto half = glm::packHalf1x16(pixels[i]);
+						std::memcpy(&result[i * sizeof(half)], &half, sizeof(half));
+					}
+				});
+				break;
+			case lightmap_encoding::rgb9e5:
+				parallel_for(resolution, [&](std::size_t y) {
+					for (auto x = std::size_t{0}; x < resolution; ++x) {
+						const auto texel = encode_rgb9e5(rgb(x, y));
+						std::memcpy(&result[(y * resolution + x) * sizeof(texel)], &texel, sizeof(texel));
+					}
+				});
+				break;
+			case lightmap_encoding::rgbm:
+				parallel_for(resolution, [&](std::size_t y) {
+					for (auto x = std::size_t{0}; x < resolution; ++x) {
+						const auto texel = encode_rgbm(rgb(x, y));
+						std::memcpy(&result[(y * resolution + x) * sizeof(texel)], texel.data(), sizeof(texel));
+					}
+				});
+				break;
+			case lightmap_encoding::bc6h:
+				parallel_for(block_count(resolution), [&](std::size_t block_y) {
+					auto block = std::array<vec3, bc6h_block_dimension * bc6h_block_dimension>{};
+					for (auto block_x = std::size_t{0}; block_x < block_count(resolution); ++block_x) {
+						// Blocks that hang over the edge repeat the last row and column.
+						for (auto i = std::size_t{0}; i < block.size(); ++i) {
+							const auto x = std::min(block_x * bc6h_block_dimension + i % bc6h_block_dimension, resolution - 1);
+							const auto y = std::min(block_y * bc6h_block_dimension + i / bc6h_block_dimension, resolution - 1);
+							block[i] = rgb(x, y);
+						}
+						const auto encoded = encode_bc6h_block(block);
+						std::memcpy(&result[(block_y * block_count(resolution) + block_x) * bc6h_block_size], encoded.data(), bc6h_block_size);
+					}
+				});
+				break;
+		}
+		return result;
+	}
+
+	// Encode a 4x4 block of texels in BC6H mode 11 (unsigned, one region, 10-bit endpoints, 4-bit indices).
+	// Endpoints are fitted along the principal axis of the block in half-float bit space, where the format interpolates.
+	[[nodiscard]] static auto encode_bc6h_block(const std::array<vec3, bc6h_block_dimension * bc6h_block_dimension>& texels) noexcept -> std::array<std::byte, bc6h_block_size> {
+		constexpr auto weights = std::array<int, 16>{0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+		auto values = std::array<vec3, 16>{};
+		auto mean = vec3{0.0f};
+		for (auto i = std::size_t{0}; i < texels.size(); ++i) {
+			const auto to_half = [](float value) {
+				return static_cast<float>(std::min(static_cast<int>(glm::packHalf1x16(std::max(value, 0.0f))), bc6h_max_half));
+			};
+			values[i] = vec3{to_half(texels[i].x), to_half(texels[i].y), to_half(texels[i].z)};
+			mean += values[i];
+		}
+		mean *= 1.0f / static_cast<float>(values.size());
+
+		auto covariance = std::array<float, 6>{};
+		for (const auto& value : values) {
+			const auto d = value - mean;
+			covariance[0] += d.x * d.x;
+			covariance[1] += d.x * d.y;
+			covariance[2] += d.x * d.z;
+			covariance[3] += d.y * d.y;
+			covariance[4] += d.y * d.z;
+			covariance[5] += d.z * d.z;
+		}
+		auto axis = vec3{1.0f, 1.0f, 1.0f};
+		for (auto iteration = 0; iteration < 8; ++iteration) {
+			axis = vec3{
+				covariance[0] * axis.x + covariance[1] * axis.y + covariance[2] * axis.z,
+				covariance[1] * axis.x + covariance[3] * axis.y + covariance[4] * axis.z,
+				covariance[2] * axis.x + covariance[4] * axis.y + covariance[5] * axis.z,
+			};
+			const auto axis_length = length(axis);
+			if (axis_length <= std::numeric_limits<float>::epsilon()) {
+				axis = vec3{0.0f};
+				break;
+			}
+			axis *= 1.0f / axis_length;
+		}
+		auto t_min = 0.0f;
+		auto t_max = 0.0f;
+		if (axis != vec3{0.0f}) {
+			t_min = std::numeric_limits<float>::max();
+			t_max = std::numeric_limits<float>::lowest();
+			for (const auto& value : values) {
+				const auto t = dot(value - mean, axis);
+				t_min = std::min(t_min, t);
+				t_max = std::max(t_max, t);
+			}
+		}
+
+		// Unquantization of unsigned 10-bit endpoints followed by the final scale to half-float bits, as performed by the hardware.
+		const auto quantize = [](float half) {
+			return clamp(static_cast<int>(std::round((half * 64.0f / 31.0f - 32.0f) / 64.0f)), 0, 1023);
+		};
+		const auto unquantize = [](int endpoint) {
+			return (endpoint == 0) ? 0 : (endpoint == 1023) ? 0xFFFF : endpoint * 64 + 32;
+		};
+		auto endpoints = std::array<std::array<int, 3>, 2>{};
+		const auto first = clamp(mean + axis * t_min, vec3{0.0f}, vec3{static_cast<float>(bc6h_max_half)});
+		const auto second = clamp(mean + axis * t_max, vec3{0.0f}, vec3{static_cast<float>(bc6h_max_half)});
+		for (auto channel = 0; channel < 3; ++channel) {
+			endpoints[0][channel] = quantize(first[channel]);
+			endpoints[1][channel] = quantize(second[channel]);
+		}
+
+		auto palette = std::array<vec3, 16>{};
+		for (auto i = std::size_t{0}; i < palette.size(); ++i) {
+			for (auto channel = 0; channel < 3; ++channel) {
+				const auto a = unquantize(endpoints[0][channel]);
+				const auto b = unquantize(endpoints[1][channel]);
+				palette[i][channel] = static_cast<float>(((((64 - weights[i]) * a + weights[i] * b + 32) >> 6) * 31) >> 6);
+			}
+		}
+		auto indices = std::array<int, 16>{};
+		for (auto i = std::size_t{0}; i < values.size(); ++i) {
+			auto best_error = std::numeric_limits<float>::max();
+			for (auto j = std::size_t{0}; j < palette.size(); ++j) {
+				const auto d = values[i] - palette[j];
+				if (const auto error = dot(d, d); error < best_error) {
+					best_error = error;
+					indices[i] = static_cast<int>(j);
+				}
+			}
+		}
+
+		// The most significant bit of the first index is implicitly zero.
+		if ((indices[0] & 0b1000) != 0) {
+			std::swap(endpoints[0], endpoints[1]);
+			for (auto& index : indices) {
+				index = 15 - index;
+			}
+		}
+
+		auto bits = std::array<std::uint64_t, 2>{};
+		auto bit_offset = std::size_t{0};
+		const auto write_bits = [&](std::uint64_t value, std::size_t count) {
+			for (auto i = std::size_t{0}; i < count; ++i, ++bit_offset) {
+				bits[bit_offset / 64] |= ((value >> i) & 1) << (bit_offset % 64);
+			}
+		};
+		write_bits(0b00011, 5);
+		for (const auto& endpoint : endpoints) {
+			for (const auto channel : endpoint) {
+				write_bits(static_cast<std::uint64_t>(channel), 10);
+			}
+		}
+		write_bits(static_cast<std::uint64_t>(indices[0]), 3);
+		for (auto i = std::size_t{1}; i < indices.size(); ++i) {
+			write_bits(static_cast<std::uint64_t>(indices[i]), 4);
+		}
+
+		auto result = std::array<std::byte, bc6h_block_size>{};
+		for (auto i = std::size_t{0}; i < result.size(); ++i) {
+			result[i] = static_cast<std::byte>((bits[i / 8] >> ((i % 8) * 8)) & 0xFF);
+		}
+		return result;
+	}
+};
+
+#endif
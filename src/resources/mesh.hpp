@@ -5,13 +5,19 @@
 #include "../core/handle.hpp"
 #include "../core/opengl.hpp"
 
-#include <cstddef>     // std::byte, std::size_t
-#include <cstdint>     // std::uintptr_t
-#include <memory>      // std::addressof
-#include <span>        // std::span
-#include <stdexcept>   // std::invalid_argument
-#include <tuple>       // std::tuple, std::apply
-#include <type_traits> // std::is_same_v, std::is_standard_layout_v, std::conditional_t
+#include <algorithm>           // std::clamp, std::max
+#include <array>               // std::array
+#include <cmath>               // std::round
+#include <concepts>            // std::convertible_to
+#include <cstddef>             // std::byte, std::size_t
+#include <cstdint>             // std::uintptr_t, std::uint16_t
+#include <glm/gtc/packing.hpp> // glm::packHalf1x16, glm::unpackHalf1x16
+#include <limits>              // std::numeric_limits
+#include <memory>              // std::addressof
+#include <span>                // std::span
+#include <stdexcept>           // std::invalid_argument
+#include <tuple>               // std::tuple, std::apply
+#include <type_traits>         // std::is_same_v, std::is_standard_layout_v, std::conditional_t, std::is_integral_v, std::is_signed_v
 
 class vertex_buffer final {
 public:
@@ -61,6 +67,71 @@ private:
 	}()};
 };
 
+// Vector attribute stored as normalized integers, which shaders read as floats in [-1, 1] for signed types and in [0, 1] for unsigned types.
+template <typename T, int N>
+struct normalized_vec final {
+	static_assert(std::is_integral_v<T> && sizeof(T) <= 2, "Normalized attributes must be 8-bit or 16-bit integers!");
+
+	static constexpr auto component_count = GLint{N};
+	static constexpr auto component_type = GLenum{(sizeof(T) == 1) ? ((std::is_signed_v<T>) ? GL_BYTE : GL_UNSIGNED_BYTE) : ((std::is_signed_v<T>) ? GL_SHORT : GL_UNSIGNED_SHORT)};
+	static constexpr auto normalized = GLboolean{GL_TRUE};
+
+	[[nodiscard]] static auto pack(const glm::vec<N, float>& v) noexcept -> normalized_vec {
+		constexpr auto min = (std::is_signed_v<T>) ? -1.0f : 0.0f;
+		constexpr auto scale = static_cast<float>(std::numeric_limits<T>::max());
+		auto result = normalized_vec{};
+		for (auto i = 0; i < N; ++i) {
+			result.values[static_cast<std::size_t>(i)] = static_cast<T>(std::round(std::clamp(v[i], min, 1.0f) * scale));
+		}
+		return result;
+	}
+
+	[[nodiscard]] auto unpack() const noexcept -> glm::vec<N, float> {
+		constexpr auto min = (std::is_signed_v<T>) ? -1.0f : 0.0f;
+		constexpr auto scale = static_cast<float>(std::numeric_limits<T>::max());
+		auto result = glm::vec<N, float>{};
+		for (auto i = 0; i < N; ++i) {
+			result[i] = std::max(static_cast<float>(values[static_cast<std::size_t>(i)]) / scale, min);
+		}
+		return result;
+	}
+
+	std::array<T, N> values{};
+};
+
+// Vector attribute stored as half floats, which shaders read as floats.
+template <int N>
+struct half_vec final {
+	static constexpr auto component_count = GLint{N};
+	static constexpr auto component_type = GLenum{GL_HALF_FLOAT};
+	static constexpr auto normalized = GLboolean{GL_FALSE};
+
+	[[nodiscard]] static auto pack(const glm::vec<N, float>& v) noexcept -> half_vec {
+		auto result = half_vec{};
+		for (auto i = 0; i < N; ++i) {
+			result.values[static_cast<std::size_t>(i)] = glm::packHalf1x16(v[i]);
+		}
+		return result;
+	}
+
+	[[nodiscard]] auto unpack() const noexcept -> glm::vec<N, float> {
+		auto result = glm::vec<N, float>{};
+		for (auto i = 0; i < N; ++i) {
+			result[i] = glm::unpackHalf1x16(values[static_cast<std::size_t>(i)]);
+		}
+		return result;
+	}
+
+	std::array<std::uint16_t, N> values{};
+};
+
+template <typename T>
+concept packed_vertex_attribute = requires {
+	{ T::component_count } -> std::convertible_to<GLint>;
+	{ T::component_type } -> std::convertible_to<GLenum>;
+	{ T::normalized } -> std::convertible_to<GLboolean>;
+};
+
 struct no_index final {};
 struct no_instance final {};
 
@@ -230,6 +301,9 @@ private:
 			glVertexAttribPointer(index++, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void*>(offset + sizeof(float) * 8)); // NOLINT(performance-no-int-to-ptr)
 			enable_vertex_attribute<VertexStruct>(index);
 			glVertexAttribPointer(index++, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void*>(offset + sizeof(float) * 12)); // NOLINT(performance-no-int-to-ptr)
+		} else if constexpr (packed_vertex_attribute<T>) {
+			enable_vertex_attribute<VertexStruct>(index);
+			glVertexAttribPointer(index++, T::component_count, T::component_type, T::normalized, stride, reinterpret_cast<const void*>(offset)); // NOLINT(performance-no-int-to-ptr)
 		} else {
 			throw std::invalid_argument{"Invalid vertex attribute type!"};
 		}
@@ -0,0 +1,129 @@
+#ifndef MESH_CLUSTERIZER_HPP
+#define MESH_CLUSTERIZER_HPP
+
+#include "../core/glsl.hpp"
+
+#include <algorithm> // std::min, std::max
+#include <cmath>     // std::sqrt
+#include <cstddef>   // std::size_t
+#include <cstdint>   // std::uint32_t
+#include <span>      // std::span
+#include <stdexcept> // std::invalid_argument
+#include <vector>    // std::vector
+
+// A range of consecutive triangles of a mesh with the bounds needed to cull them as a whole. Stored as-is in cooked model files.
+struct mesh_cluster final {
+	std::uint32_t index_offset = 0;
+	std::uint32_t index_count = 0;
+	vec3 center{}; // Bounding sphere of the vertices.
+	float radius = 0.0f;
+	vec3 cone_axis{};         // Average direction that the triangles face.
+	float cone_cutoff = 1.0f; // Sine of the largest angle between the axis and a triangle normal, or 1 if the triangles face too many ways to ever be culled.
+};
+
+// Splits indexed triangle meshes into clusters of consecutive triangles, so that the triangle order from mesh_optimizer is kept and every cluster is a
+// single range of the index buffer. Clusters end early where the triangles turn away from those before them, which keeps their normal cones narrow.
+class mesh_clusterizer final {
+public:
+	static constexpr auto min_triangle_count = std::size_t{64};
+	static constexpr auto max_triangle_count = std::size_t{128};
+
+	// Once a cluster has reached the minimum size, it ends at the first triangle whose normal is further than this from the average of the cluster so far.
+	static constexpr auto split_cosine = 0.5f;
+
+	// Clusters with a triangle that is this close to perpendicular to the axis, or that faces against it, are seldom back-facing as a whole, so their
+	// normal cones are not tested.
+	static constexpr auto min_cone_cosine = 0.1f;
+
+	// Vertex types only need a vec3 position member.
+	template <typename Vertex>
+	[[nodiscard]] static auto build(std::span<const Vertex> vertices, std::span<const std::uint32_t> indices) -> std::vector<mesh_cluster> {
+		if (indices.size() % 3 != 0) {
+			throw std::invalid_argument{"Index count must be a multiple of 3!"};
+		}
+		for (const auto index : indices) {
+			if (static_cast<std::size_t>(index) >= vertices.size()) {
+				throw std::invalid_argument{"Invalid vertex index!"};
+			}
+		}
+		const auto triangle_count = indices.size() / 3;
+		const auto get_normal = [&](std::size_t triangle) {
+			const auto& a = vertices[indices[triangle * 3]].position;
+			const auto& b = vertices[indices[triangle * 3 + 1]].position;
+			const auto& c = vertices[indices[triangle * 3 + 2]].position;
+			const auto normal = cross(b - a, c - a);
+			const auto normal_length = length(normal);
+			return (normal_length > 0.0f) ? normal / normal_length : vec3{0.0f, 0.0f, 0.0f};
+		};
+
+		auto result = std::vector<mesh_cluster>{};
+		auto begin = std::size_t{0};
+		while (begin < triangle_count) {
+			auto end = begin;
+			auto normal_sum = vec3{0.0f, 0.0f, 0.0f};
+			while (end < triangle_count && end - begin < max_triangle_count) {
+				const auto normal = get_normal(end);
+				if (end - begin >= min_triangle_count) {
+					const auto normal_sum_length = length(normal_sum);
+					if (normal_sum_length > 0.0f && dot(normal, normal_sum / normal_sum_length) < split_cosine) {
+						break;
+					}
+				}
+				normal_sum += normal;
+				++end;
+			}
+			result.push_back(get_cluster(vertices, indices, begin, end, normal_sum));
+			begin = end;
+		}
+		return result;
+	}
+
+private:
+	template <typename Vertex>
+	[[nodiscard]] static auto get_cluster(std::span<const Vertex> vertices, std::span<const std::uint32_t> indices, std::size_t begin, std::size_t end, vec3 normal_sum)
+		-> mesh_cluster {
+		const auto cluster_indices = indices.subspan(begin * 3, (end - begin) * 3);
+
+		// The center of the bounding box is not the smallest bounding sphere, but is close for the compact clusters that the triangle order gives.
+		auto min_position = vertices[cluster_indices.front()].position;
+		auto max_position = min_position;
+		for (const auto index : cluster_indices) {
+			min_position = min(min_position, vertices[index].position);
+			max_position = max(max_position, vertices[index].position);
+		}
+		const auto center = (min_position + max_position) * 0.5f;
+		auto radius = 0.0f;
+		for (const auto index : cluster_indices) {
+			radius = std::max(radius, length(vertices[index].position - center));
+		}
+
+		auto cone_cutoff = 1.0f;
+		auto cone_axis = vec3{0.0f, 0.0f, 0.0f};
+		if (const auto normal_sum_length = length(normal_sum); normal_sum_length > 0.0f) {
+			cone_axis = normal_sum / normal_sum_length;
+			auto min_cosine = 1.0f;
+			for (auto i = std::size_t{0}; i < cluster_indices.size(); i += 3) {
+				const auto& a = vertices[cluster_indices[i]].position;
+				const auto& b = vertices[cluster_indices[i + 1]].position;
+				const auto& c = vertices[cluster_indices[i + 2]].position;
+				const auto normal = cross(b - a, c - a);
+				if (const auto normal_length = length(normal); normal_length > 0.0f) {
+					min_cosine = std::min(min_cosine, dot(normal / normal_length, cone_axis));
+				}
+			}
+			if (min_cosine > min_cone_cosine) {
+				cone_cutoff = std::sqrt(1.0f - min_cosine * min_cosine);
+			}
+		}
+		return mesh_cluster{
+			.index_offset = static_cast<std::uint32_t>(begin * 3),
+			.index_count = static_cast<std::uint32_t>(cluster_indices.size()),
+			.center = center,
+			.radius = radius,
+			.cone_axis = cone_axis,
+			.cone_cutoff = cone_cutoff,
+		};
+	}
+};
+
+#endif
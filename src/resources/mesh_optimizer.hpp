@@ -0,0 +1,381 @@
+#ifndef MESH_OPTIMIZER_HPP
+#define MESH_OPTIMIZER_HPP
+
+#include "../core/glsl.hpp"
+
+#include <algorithm>     // std::ranges::sort, std::ranges::find, std::ranges::copy, std::ranges::max_element
+#include <array>         // std::array
+#include <bit>           // std::bit_cast
+#include <cmath>         // std::pow, std::round, std::abs
+#include <cstddef>       // std::size_t, std::ptrdiff_t
+#include <cstdint>       // std::uint32_t, std::uint64_t
+#include <cstring>       // std::memcpy
+#include <limits>        // std::numeric_limits
+#include <span>          // std::span
+#include <stdexcept>     // std::invalid_argument
+#include <type_traits>   // std::is_trivially_copyable_v
+#include <unordered_map> // std::unordered_map
+#include <utility>       // std::move, std::swap, std::pair
+#include <vector>        // std::vector
+
+struct vertex_cache_statistics final {
+	float acmr = 0.0f; // Average cache miss ratio: vertices transformed per triangle. 0.5 at best, 3 at worst.
+	float atvr = 0.0f; // Average transformed vertex ratio: vertices transformed per vertex. 1 at best.
+};
+
+// Reorders the triangles and vertices of indexed triangle meshes so that the GPU transforms fewer vertices, shades fewer hidden pixels and fetches vertices in order.
+// Vertex types only need a vec3 position member, except for welding, and meshes are expected to hold triangle lists.
+class mesh_optimizer final {
+public:
+	// Size of the FIFO cache that is simulated to measure meshes and to find cluster boundaries, which is within the range of current hardware.
+	static constexpr auto cache_size = std::size_t{16};
+
+	// How much worse the vertex cache may get from reordering clusters for overdraw, as a factor of the ACMR.
+	static constexpr auto overdraw_cache_threshold = 1.05f;
+
+	// Merge vertices whose components are all within epsilon of each other into the first of them, remove the rest and rewrite the indices to match.
+	// Vertices are compared as arrays of floats, so vertex types must only have float members. Candidates are found by hashing every component rounded to a grid
+	// of cells 16 times larger than epsilon, so two nearly equal values on either side of a cell boundary are rarely, but sometimes, kept apart.
+	// Returns the number of vertices that were removed.
+	template <typename Vertex>
+	static auto weld_vertices(std::vector<Vertex>& vertices, std::span<std::uint32_t> indices, float epsilon) -> std::size_t {
+		static_assert(std::is_trivially_copyable_v<Vertex> && sizeof(Vertex) % sizeof(float) == 0);
+		static constexpr auto component_count = sizeof(Vertex) / sizeof(float);
+		using components = std::array<float, component_count>;
+
+		check_indices(indices, vertices.size());
+		const auto get_components = [](const Vertex& vertex) {
+			auto result = components{};
+			std::memcpy(result.data(), &vertex, sizeof(Vertex));
+			return result;
+		};
+		const auto cell_size = epsilon * 16.0f;
+		const auto get_hash = [cell_size](const components& values) {
+			auto result = std::uint64_t{14695981039346656037u}; // FNV-1a.
+			for (const auto value : values) {
+				const auto cell = (cell_size > 0.0f) ? std::round(value / cell_size) : value;
+				result = (result ^ std::bit_cast<std::uint64_t>(static_cast<double>(cell) + 0.0)) * 1099511628211u; // Adding zero turns -0 into +0.
+			}
+			return result;
+		};
+		const auto is_within_epsilon = [epsilon](const components& lhs, const components& rhs) {
+			for (auto i = std::size_t{0}; i < component_count; ++i) {
+				if (!(std::abs(lhs[i] - rhs[i]) <= epsilon)) {
+					return false;
+				}
+			}
+			return true;
+		};
+
+		// Kept vertices with the same hash are chained through next_with_hash, starting from the most recently kept one.
+		auto last_with_hash = std::unordered_map<std::uint64_t, std::uint32_t>{};
+		last_with_hash.reserve(vertices.size());
+		auto next_with_hash = std::vector<std::uint32_t>{};
+		next_with_hash.reserve(vertices.size());
+		auto remap = std::vector<std::uint32_t>(vertices.size(), no_vertex);
+		auto result = std::vector<Vertex>{};
+		result.reserve(vertices.size());
+		for (auto vertex = std::size_t{0}; vertex < vertices.size(); ++vertex) {
+			const auto values = get_components(vertices[vertex]);
+			const auto [it, inserted] = last_with_hash.try_emplace(get_hash(values), no_vertex);
+			for (auto candidate = it->second; candidate != no_vertex; candidate = next_with_hash[candidate]) {
+				if (is_within_epsilon(values, get_components(result[candidate]))) {
+					remap[vertex] = candidate;
+					break;
+				}
+			}
+			if (remap[vertex] == no_vertex) {
+				remap[vertex] = static_cast<std::uint32_t>(result.size());
+				next_with_hash.push_back(it->second);
+				it->second = remap[vertex];
+				result.push_back(vertices[vertex]);
+			}
+		}
+		for (auto& index : indices) {
+			index = remap[index];
+		}
+		const auto removed_vertex_count = vertices.size() - result.size();
+		vertices = std::move(result);
+		return removed_vertex_count;
+	}
+
+	// Run every pass in order: vertex cache, then overdraw, then vertex fetch. Vertices that no triangle uses are removed.
+	template <typename Vertex>
+	static auto optimize(std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices) -> void {
+		optimize_vertex_cache(indices, vertices.size());
+		optimize_overdraw<Vertex>(indices, vertices);
+		optimize_vertex_fetch(vertices, indices);
+	}
+
+	// Greedily emit the triangle whose vertices score the highest, based on how recently they were used and how few triangles they have left.
+	// This is Tom Forsyth's "Linear-Speed Vertex Cache Optimisation", which works well regardless of the actual cache size.
+	static auto optimize_vertex_cache(std::span<std::uint32_t> indices, std::size_t vertex_count) -> void {
+		check_indices(indices, vertex_count);
+		const auto triangle_count = indices.size() / 3;
+
+		// Triangles that use each vertex, of which the first live_triangle_counts[vertex] have not been emitted yet.
+		auto triangle_offsets = std::vector<std::size_t>(vertex_count + 1, 0);
+		for (const auto index : indices) {
+			++triangle_offsets[index + 1];
+		}
+		for (auto vertex = std::size_t{0}; vertex < vertex_count; ++vertex) {
+			triangle_offsets[vertex + 1] += triangle_offsets[vertex];
+		}
+		auto live_triangle_counts = std::vector<std::size_t>(vertex_count, 0);
+		auto vertex_triangles = std::vector<std::size_t>(indices.size());
+		for (auto triangle = std::size_t{0}; triangle < triangle_count; ++triangle) {
+			for (auto corner = std::size_t{0}; corner < 3; ++corner) {
+				const auto vertex = indices[triangle * 3 + corner];
+				vertex_triangles[triangle_offsets[vertex] + live_triangle_counts[vertex]++] = triangle;
+			}
+		}
+
+		auto cache_positions = std::vector<int>(vertex_count, -1);
+		auto vertex_scores = std::vector<float>(vertex_count);
+		for (auto vertex = std::size_t{0}; vertex < vertex_count; ++vertex) {
+			vertex_scores[vertex] = get_vertex_score(-1, live_triangle_counts[vertex]);
+		}
+		auto triangle_scores = std::vector<float>(triangle_count);
+		for (auto triangle = std::size_t{0}; triangle < triangle_count; ++triangle) {
+			triangle_scores[triangle] = vertex_scores[indices[triangle * 3]] + vertex_scores[indices[triangle * 3 + 1]] + vertex_scores[indices[triangle * 3 + 2]];
+		}
+
+		auto emitted = std::vector<bool>(triangle_count, false);
+		auto result = std::vector<std::uint32_t>{};
+		result.reserve(indices.size());
+		auto cache = std::vector<std::uint32_t>{};
+		auto new_cache = std::vector<std::uint32_t>{};
+		cache.reserve(scoring_cache_size + 3);
+		new_cache.reserve(scoring_cache_size + 3);
+		auto next_unemitted_triangle = std::size_t{0};
+		auto best_triangle = (triangle_count > 0) ? static_cast<std::size_t>(std::ranges::max_element(triangle_scores) - triangle_scores.begin()) : no_triangle;
+		while (best_triangle != no_triangle) {
+			emitted[best_triangle] = true;
+			new_cache.clear();
+			for (auto corner = std::size_t{0}; corner < 3; ++corner) {
+				const auto vertex = indices[best_triangle * 3 + corner];
+				result.push_back(vertex);
+				new_cache.push_back(vertex);
+
+				// Move the triangle past the live ones of the vertex.
+				auto* const first = &vertex_triangles[triangle_offsets[vertex]];
+				auto& live_count = live_triangle_counts[vertex];
+				std::swap(*std::ranges::find(first, first + live_count, best_triangle), first[live_count - 1]);
+				--live_count;
+			}
+			for (const auto vertex : cache) {
+				if (std::ranges::find(new_cache, vertex) == new_cache.end()) {
+					new_cache.push_back(vertex);
+				}
+			}
+			for (auto i = std::size_t{0}; i < new_cache.size(); ++i) {
+				cache_positions[new_cache[i]] = (i < scoring_cache_size) ? static_cast<int>(i) : -1;
+			}
+			std::swap(cache, new_cache);
+
+			// Only the scores of the vertices that moved in the cache changed, and the next triangle is most likely one of theirs.
+			best_triangle = no_triangle;
+			auto best_score = -1.0f;
+			for (const auto vertex : cache) {
+				const auto old_score = vertex_scores[vertex];
+				vertex_scores[vertex] = get_vertex_score(cache_positions[vertex], live_triangle_counts[vertex]);
+				const auto score_delta = vertex_scores[vertex] - old_score;
+				const auto* const first = &vertex_triangles[triangle_offsets[vertex]];
+				for (const auto* it = first; it != first + live_triangle_counts[vertex]; ++it) {
+					triangle_scores[*it] += score_delta;
+				}
+			}
+			for (const auto vertex : cache) {
+				const auto* const first = &vertex_triangles[triangle_offsets[vertex]];
+				for (const auto* it = first; it != first + live_triangle_counts[vertex]; ++it) {
+					if (triangle_scores[*it] > best_score) {
+						best_score = triangle_scores[*it];
+						best_triangle = *it;
+					}
+				}
+			}
+			if (cache.size() > scoring_cache_size) {
+				cache.resize(scoring_cache_size);
+			}
+
+			// Continue somewhere else when the cached vertices have no triangles left.
+			if (best_triangle == no_triangle) {
+				while (next_unemitted_triangle < triangle_count && emitted[next_unemitted_triangle]) {
+					++next_unemitted_triangle;
+				}
+				if (next_unemitted_triangle < triangle_count) {
+					best_triangle = next_unemitted_triangle;
+				}
+			}
+		}
+		std::ranges::copy(result, indices.begin());
+	}
+
+	// Split the triangles into clusters where the simulated cache has been flushed, which is where reordering them costs the least, and draw the clusters
+	// that face away from the center of the mesh first, since they are the most likely to occlude the rest. This is the sorting approach of Sander et al.,
+	// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw". The original order is kept if the vertex cache would suffer too much.
+	template <typename Vertex>
+	static auto optimize_overdraw(std::span<std::uint32_t> indices, std::span<const Vertex> vertices) -> void {
+		check_indices(indices, vertices.size());
+		const auto triangle_count = indices.size() / 3;
+		if (triangle_count == 0) {
+			return;
+		}
+
+		auto cluster_offsets = std::vector<std::size_t>{};
+		{
+			auto cache = fifo_cache{vertices.size()};
+			for (auto triangle = std::size_t{0}; triangle < triangle_count; ++triangle) {
+				auto misses = 0;
+				for (auto corner = std::size_t{0}; corner < 3; ++corner) {
+					misses += (cache.access(indices[triangle * 3 + corner])) ? 1 : 0;
+				}
+				if (misses == 3 || triangle == 0) {
+					cluster_offsets.push_back(triangle);
+				}
+			}
+			cluster_offsets.push_back(triangle_count);
+		}
+		const auto cluster_count = cluster_offsets.size() - 1;
+		if (cluster_count < 2) {
+			return;
+		}
+
+		auto mesh_centroid = vec3{0.0f, 0.0f, 0.0f};
+		for (const auto& vertex : vertices) {
+			mesh_centroid += vertex.position;
+		}
+		mesh_centroid /= static_cast<float>(vertices.size());
+
+		auto cluster_keys = std::vector<std::pair<float, std::size_t>>{};
+		cluster_keys.reserve(cluster_count);
+		for (auto cluster = std::size_t{0}; cluster < cluster_count; ++cluster) {
+			auto centroid = vec3{0.0f, 0.0f, 0.0f};
+			auto normal = vec3{0.0f, 0.0f, 0.0f};
+			auto area = 0.0f;
+			for (auto triangle = cluster_offsets[cluster]; triangle < cluster_offsets[cluster + 1]; ++triangle) {
+				const auto& a = vertices[indices[triangle * 3]].position;
+				const auto& b = vertices[indices[triangle * 3 + 1]].position;
+				const auto& c = vertices[indices[triangle * 3 + 2]].position;
+				const auto triangle_normal = cross(b - a, c - a); // Twice the area in length.
+				const auto triangle_area = length(triangle_normal);
+				centroid += (a + b + c) * (triangle_area / 3.0f);
+				normal += triangle_normal;
+				area += triangle_area;
+			}
+			centroid = (area > 0.0f) ? centroid / area : vertices[indices[cluster_offsets[cluster] * 3]].position;
+			const auto normal_length = length(normal);
+			const auto key = (normal_length > 0.0f) ? dot(centroid - mesh_centroid, normal / normal_length) : 0.0f;
+			cluster_keys.emplace_back(key, cluster);
+		}
+		std::ranges::sort(cluster_keys, [](const auto& lhs, const auto& rhs) {
+			return lhs.first > rhs.first;
+		});
+
+		auto result = std::vector<std::uint32_t>{};
+		result.reserve(indices.size());
+		for (const auto& [key, cluster] : cluster_keys) {
+			result.insert(result.end(), indices.begin() + static_cast<std::ptrdiff_t>(cluster_offsets[cluster] * 3),
+				indices.begin() + static_cast<std::ptrdiff_t>(cluster_offsets[cluster + 1] * 3));
+		}
+		if (analyze_vertex_cache(result, vertices.size()).acmr <= analyze_vertex_cache(indices, vertices.size()).acmr * overdraw_cache_threshold) {
+			std::ranges::copy(result, indices.begin());
+		}
+	}
+
+	// Sort the vertices in the order that the triangles first use them, so that vertex fetches walk through memory, and remove the unused ones.
+	template <typename Vertex>
+	static auto optimize_vertex_fetch(std::vector<Vertex>& vertices, std::span<std::uint32_t> indices) -> void {
+		check_indices(indices, vertices.size());
+		auto remap = std::vector<std::uint32_t>(vertices.size(), no_vertex);
+		auto result = std::vector<Vertex>{};
+		result.reserve(vertices.size());
+		for (auto& index : indices) {
+			if (remap[index] == no_vertex) {
+				remap[index] = static_cast<std::uint32_t>(result.size());
+				result.push_back(vertices[index]);
+			}
+			index = remap[index];
+		}
+		vertices = std::move(result);
+	}
+
+	// Simulate a FIFO post-transform cache of the given size over a triangle list.
+	[[nodiscard]] static auto analyze_vertex_cache(std::span<const std::uint32_t> indices, std::size_t vertex_count, std::size_t size = cache_size) -> vertex_cache_statistics {
+		check_indices(indices, vertex_count);
+		if (indices.empty() || vertex_count == 0) {
+			return vertex_cache_statistics{};
+		}
+		auto cache = fifo_cache{vertex_count, size};
+		auto transformed_vertex_count = std::size_t{0};
+		for (const auto index : indices) {
+			transformed_vertex_count += (cache.access(index)) ? 1 : 0;
+		}
+		return vertex_cache_statistics{
+			.acmr = static_cast<float>(transformed_vertex_count) / static_cast<float>(indices.size() / 3),
+			.atvr = static_cast<float>(transformed_vertex_count) / static_cast<float>(vertex_count),
+		};
+	}
+
+private:
+	// Size of the LRU cache in the scoring function, from the paper.
+	static constexpr auto scoring_cache_size = std::size_t{32};
+	static constexpr auto no_triangle = std::numeric_limits<std::size_t>::max();
+	static constexpr auto no_vertex = std::numeric_limits<std::uint32_t>::max();
+
+	// Counts misses by the time at which each vertex entered the cache, so that no queue is needed.
+	class fifo_cache final {
+	public:
+		explicit fifo_cache(std::size_t vertex_count, std::size_t size = cache_size)
+			: m_entry_times(vertex_count, 0)
+			, m_size(size) {}
+
+		// Returns true on a miss.
+		[[nodiscard]] auto access(std::uint32_t vertex) -> bool {
+			if (m_entry_times[vertex] != 0 && m_time - m_entry_times[vertex] < m_size) {
+				return false;
+			}
+			m_entry_times[vertex] = ++m_time;
+			return true;
+		}
+
+	private:
+		std::vector<std::size_t> m_entry_times;
+		std::size_t m_size;
+		std::size_t m_time = 0;
+	};
+
+	[[nodiscard]] static auto get_vertex_score(int cache_position, std::size_t live_triangle_count) -> float {
+		static constexpr auto cache_decay_power = 1.5f;
+		static constexpr auto last_triangle_score = 0.75f;
+		static constexpr auto valence_boost_scale = 2.0f;
+		static constexpr auto valence_boost_power = 0.5f;
+		if (live_triangle_count == 0) {
+			return -1.0f;
+		}
+		auto score = 0.0f;
+		if (cache_position >= 0) {
+			if (cache_position < 3) {
+				// The vertices of the last triangle are penalized a little, so that strips don't keep going back and forth over the same edge.
+				score = last_triangle_score;
+			} else {
+				const auto scaler = 1.0f / static_cast<float>(scoring_cache_size - 3);
+				score = std::pow(1.0f - static_cast<float>(cache_position - 3) * scaler, cache_decay_power);
+			}
+		}
+		return score + valence_boost_scale * std::pow(static_cast<float>(live_triangle_count), -valence_boost_power);
+	}
+
+	static auto check_indices(std::span<const std::uint32_t> indices, std::size_t vertex_count) -> void {
+		if (indices.size() % 3 != 0) {
+			throw std::invalid_argument{"Index count must be a multiple of 3!"};
+		}
+		for (const auto index : indices) {
+			if (static_cast<std::size_t>(index) >= vertex_count) {
+				throw std::invalid_argument{"Invalid vertex index!"};
+			}
+		}
+	}
+};
+
+#endif
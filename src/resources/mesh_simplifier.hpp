@@ -0,0 +1,265 @@
+#ifndef MESH_SIMPLIFIER_HPP
+#define MESH_SIMPLIFIER_HPP
+
+#include "../core/glsl.hpp"
+
+#include <algorithm>     // std::ranges::sort, std::fill, std::max, std::min
+#include <array>         // std::array
+#include <bit>           // std::bit_cast
+#include <cmath>         // std::sqrt
+#include <cstddef>       // std::size_t
+#include <cstdint>       // std::uint32_t, std::uint64_t
+#include <map>           // std::map
+#include <span>          // std::span
+#include <stdexcept>     // std::invalid_argument
+#include <unordered_map> // std::unordered_map
+#include <vector>        // std::vector
+
+struct simplified_mesh final {
+	std::vector<std::uint32_t> indices{};
+	float error = 0.0f; // Estimate of how far the surface has moved, in the same units as the vertex positions.
+};
+
+// Quadric error mesh simplification (Garland and Heckbert) by collapsing edges onto one of their vertices, so that the simplified mesh uses a subset of the
+// original vertices and can share their vertex buffer. Vertices on borders and on attribute seams, where several vertices share a position, are never
+// moved, which keeps the silhouette of open meshes and the texture mapping intact at the cost of how far some meshes can be simplified.
+class mesh_simplifier final {
+public:
+	// Collapse edges in order of increasing error until the mesh has at most the target number of indices, or until the next collapse would move the surface
+	// by more than max_error times the extent of the mesh. Vertex types only need a vec3 position member.
+	template <typename Vertex>
+	[[nodiscard]] static auto simplify(std::span<const Vertex> vertices, std::span<const std::uint32_t> indices, std::size_t target_index_count, float max_error)
+		-> simplified_mesh {
+		if (indices.size() % 3 != 0) {
+			throw std::invalid_argument{"Index count must be a multiple of 3!"};
+		}
+		for (const auto index : indices) {
+			if (static_cast<std::size_t>(index) >= vertices.size()) {
+				throw std::invalid_argument{"Invalid vertex index!"};
+			}
+		}
+		auto positions = std::vector<vec3>{};
+		positions.reserve(vertices.size());
+		auto min_position = vec3{0.0f, 0.0f, 0.0f};
+		auto max_position = vec3{0.0f, 0.0f, 0.0f};
+		for (const auto& vertex : vertices) {
+			if (positions.empty()) {
+				min_position = vertex.position;
+				max_position = vertex.position;
+			}
+			min_position = min(min_position, vertex.position);
+			max_position = max(max_position, vertex.position);
+			positions.push_back(vertex.position);
+		}
+		const auto max_cost = static_cast<double>(max_error) * static_cast<double>(max_error) * static_cast<double>(dot(max_position - min_position, max_position - min_position));
+
+		auto result = simplified_mesh{.indices = std::vector<std::uint32_t>(indices.begin(), indices.end())};
+		const auto locked = get_locked_vertices(positions, result.indices);
+		auto quadrics = std::vector<quadric>(positions.size());
+		for (auto triangle = std::size_t{0}; triangle < result.indices.size() / 3; ++triangle) {
+			const auto& a = positions[result.indices[triangle * 3]];
+			const auto& b = positions[result.indices[triangle * 3 + 1]];
+			const auto& c = positions[result.indices[triangle * 3 + 2]];
+			const auto plane = quadric::from_triangle(a, b, c);
+			for (auto corner = std::size_t{0}; corner < 3; ++corner) {
+				quadrics[result.indices[triangle * 3 + corner]] += plane;
+			}
+		}
+
+		auto max_collapse_cost = 0.0;
+		auto vertex_triangles = std::vector<std::vector<std::uint32_t>>(positions.size());
+		auto collapses = std::vector<collapse>{};
+		auto marked = std::vector<bool>(positions.size());
+		auto remap = std::vector<std::uint32_t>(positions.size());
+		while (result.indices.size() > target_index_count) {
+			for (auto& triangles : vertex_triangles) {
+				triangles.clear();
+			}
+			collapses.clear();
+			for (auto triangle = std::uint32_t{0}; triangle < static_cast<std::uint32_t>(result.indices.size() / 3); ++triangle) {
+				for (auto corner = std::size_t{0}; corner < 3; ++corner) {
+					const auto from = result.indices[triangle * 3 + corner];
+					const auto to = result.indices[triangle * 3 + (corner + 1) % 3];
+					vertex_triangles[from].push_back(triangle);
+					if (!locked[from]) {
+						collapses.push_back(collapse{.from = from, .to = to, .cost = quadrics[from].evaluate(positions[to])});
+					}
+					if (!locked[to]) {
+						collapses.push_back(collapse{.from = to, .to = from, .cost = quadrics[to].evaluate(positions[from])});
+					}
+				}
+			}
+			std::ranges::sort(collapses, {}, &collapse::cost);
+			if (collapses.empty()) {
+				break;
+			}
+
+			// Each pass only collapses edges whose neighborhoods are untouched by the other collapses in it, so that the adjacency stays valid, and only about as
+			// many of the cheapest ones as are needed to reach the target, so that one pass does not have to settle for expensive collapses that a later pass would
+			// have found cheaper alternatives to. Every edge is listed twice in each direction, and most collapses remove two triangles.
+			const auto goal = std::min((result.indices.size() - target_index_count) / 6 * 4, collapses.size() - 1);
+			const auto pass_max_cost = std::min(max_cost, collapses[goal].cost * 1.5);
+			std::fill(marked.begin(), marked.end(), false);
+			for (auto vertex = std::uint32_t{0}; vertex < static_cast<std::uint32_t>(remap.size()); ++vertex) {
+				remap[vertex] = vertex;
+			}
+			auto remaining_index_count = result.indices.size();
+			auto collapse_count = std::size_t{0};
+			for (const auto& [from, to, cost] : collapses) {
+				if (cost > pass_max_cost || remaining_index_count <= target_index_count) {
+					break;
+				}
+				if (marked[from] || marked[to] || flips_triangles(positions, result.indices, vertex_triangles[from], from, to)) {
+					continue;
+				}
+				for (const auto triangle : vertex_triangles[from]) {
+					auto contains_to = false;
+					for (auto corner = std::size_t{0}; corner < 3; ++corner) {
+						const auto vertex = result.indices[triangle * 3 + corner];
+						marked[vertex] = true;
+						contains_to = contains_to || vertex == to;
+					}
+					if (contains_to) {
+						remaining_index_count -= 3;
+					}
+				}
+				remap[from] = to;
+				quadrics[to] += quadrics[from];
+				max_collapse_cost = std::max(max_collapse_cost, cost);
+				++collapse_count;
+			}
+			if (collapse_count == 0) {
+				break;
+			}
+
+			// Remove the triangles that have collapsed into lines.
+			auto write = std::size_t{0};
+			for (auto read = std::size_t{0}; read < result.indices.size(); read += 3) {
+				const auto a = remap[result.indices[read]];
+				const auto b = remap[result.indices[read + 1]];
+				const auto c = remap[result.indices[read + 2]];
+				if (a != b && b != c && c != a) {
+					result.indices[write++] = a;
+					result.indices[write++] = b;
+					result.indices[write++] = c;
+				}
+			}
+			result.indices.resize(write);
+		}
+		result.error = static_cast<float>(std::sqrt(max_collapse_cost));
+		return result;
+	}
+
+private:
+	// Area-weighted sum of squared distances to a set of planes, as a symmetric 4x4 matrix.
+	struct quadric final {
+		std::array<double, 10> m{};
+		double weight = 0.0;
+
+		[[nodiscard]] static auto from_triangle(vec3 a, vec3 b, vec3 c) noexcept -> quadric {
+			const auto normal = cross(b - a, c - a);
+			const auto normal_length = length(normal);
+			if (normal_length == 0.0f) {
+				return quadric{};
+			}
+			const auto n = normal / normal_length;
+			const auto area = 0.5 * static_cast<double>(normal_length);
+			const auto x = static_cast<double>(n.x);
+			const auto y = static_cast<double>(n.y);
+			const auto z = static_cast<double>(n.z);
+			const auto w = -static_cast<double>(dot(n, a));
+			return quadric{
+				.m = {area * x * x, area * x * y, area * x * z, area * x * w, area * y * y, area * y * z, area * y * w, area * z * z, area * z * w, area * w * w},
+				.weight = area,
+			};
+		}
+
+		// Mean squared distance to the planes.
+		[[nodiscard]] auto evaluate(vec3 p) const noexcept -> double {
+			const auto x = static_cast<double>(p.x);
+			const auto y = static_cast<double>(p.y);
+			const auto z = static_cast<double>(p.z);
+			const auto result = m[0] * x * x + 2.0 * m[1] * x * y + 2.0 * m[2] * x * z + 2.0 * m[3] * x + m[4] * y * y + 2.0 * m[5] * y * z + 2.0 * m[6] * y + m[7] * z * z +
+				2.0 * m[8] * z + m[9];
+			return (weight == 0.0) ? 0.0 : std::max(result, 0.0) / weight;
+		}
+
+		auto operator+=(const quadric& other) noexcept -> quadric& {
+			for (auto i = std::size_t{0}; i < m.size(); ++i) {
+				m[i] += other.m[i];
+			}
+			weight += other.weight;
+			return *this;
+		}
+	};
+
+	struct collapse final {
+		std::uint32_t from;
+		std::uint32_t to;
+		double cost;
+	};
+
+	// Vertices that share their position with another vertex, or that lie on an edge with only one triangle.
+	[[nodiscard]] static auto get_locked_vertices(std::span<const vec3> positions, std::span<const std::uint32_t> indices) -> std::vector<bool> {
+		auto result = std::vector<bool>(positions.size(), false);
+		auto first_vertex_at_position = std::map<std::array<std::uint32_t, 3>, std::uint32_t>{};
+		auto welded = std::vector<std::uint32_t>(positions.size());
+		for (auto vertex = std::uint32_t{0}; vertex < static_cast<std::uint32_t>(positions.size()); ++vertex) {
+			const auto& p = positions[vertex];
+			const auto key = std::array<std::uint32_t, 3>{std::bit_cast<std::uint32_t>(p.x), std::bit_cast<std::uint32_t>(p.y), std::bit_cast<std::uint32_t>(p.z)};
+			const auto [it, inserted] = first_vertex_at_position.try_emplace(key, vertex);
+			welded[vertex] = it->second;
+			if (!inserted) {
+				result[vertex] = true;
+				result[it->second] = true;
+			}
+		}
+
+		// Count every edge between welded vertices in both directions. An edge that is only used in one direction has a single triangle.
+		auto edge_counts = std::unordered_map<std::uint64_t, int>{};
+		for (auto triangle = std::size_t{0}; triangle < indices.size() / 3; ++triangle) {
+			for (auto corner = std::size_t{0}; corner < 3; ++corner) {
+				const auto a = welded[indices[triangle * 3 + corner]];
+				const auto b = welded[indices[triangle * 3 + (corner + 1) % 3]];
+				const auto key = (std::uint64_t{std::min(a, b)} << 32) | std::uint64_t{std::max(a, b)};
+				edge_counts[key] += (a < b) ? 1 : -1;
+			}
+		}
+		for (auto triangle = std::size_t{0}; triangle < indices.size() / 3; ++triangle) {
+			for (auto corner = std::size_t{0}; corner < 3; ++corner) {
+				const auto a = indices[triangle * 3 + corner];
+				const auto b = indices[triangle * 3 + (corner + 1) % 3];
+				const auto key = (std::uint64_t{std::min(welded[a], welded[b])} << 32) | std::uint64_t{std::max(welded[a], welded[b])};
+				if (edge_counts[key] != 0) {
+					result[a] = true;
+					result[b] = true;
+				}
+			}
+		}
+		return result;
+	}
+
+	// Whether moving a vertex onto another would turn any of its triangles that remain around.
+	[[nodiscard]] static auto flips_triangles(std::span<const vec3> positions, std::span<const std::uint32_t> indices, std::span<const std::uint32_t> triangles,
+		std::uint32_t from, std::uint32_t to) noexcept -> bool {
+		for (const auto triangle : triangles) {
+			auto corners = std::array<std::uint32_t, 3>{indices[triangle * 3], indices[triangle * 3 + 1], indices[triangle * 3 + 2]};
+			if (corners[0] == to || corners[1] == to || corners[2] == to) {
+				continue;
+			}
+			const auto old_normal = cross(positions[corners[1]] - positions[corners[0]], positions[corners[2]] - positions[corners[0]]);
+			for (auto& corner : corners) {
+				if (corner == from) {
+					corner = to;
+				}
+			}
+			const auto new_normal = cross(positions[corners[1]] - positions[corners[0]], positions[corners[2]] - positions[corners[0]]);
+			if (dot(old_normal, new_normal) <= 0.0f) {
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+#endif
@@ -3,24 +3,40 @@
 
 #include "../core/glsl.hpp"
 #include "../core/opengl.hpp"
-#include "image.hpp"
+#include "../core/profiler.hpp"
+#include "../utilities/parallel.hpp"
+#include "../utilities/thread_pool.hpp"
+#include "cooked_texture.hpp"
 #include "mesh.hpp"
+#include "mesh_clusterizer.hpp"
+#include "mesh_optimizer.hpp"
+#include "mesh_simplifier.hpp"
 #include "texture.hpp"
+#include "texture_streamer.hpp"
 
 #include <algorithm>            // std::ranges::find
+#include <array>                // std::array
 #include <assimp/Importer.hpp>  // Assimp::Importer
 #include <assimp/postprocess.h> // ai...
 #include <assimp/scene.h>       // ai...
-#include <cstdint>              // std::uint8_t
-#include <fmt/format.h>         // fmt::format
+#include <cmath>                // std::abs
+#include <cstddef>              // std::size_t, std::ptrdiff_t
+#include <cstdint>              // std::uint8_t, std::int16_t, std::uint16_t, std::uint32_t
+#include <cstdio>               // stderr
+#include <fmt/format.h>         // fmt::format, fmt::print
+#include <future>               // std::future
 #include <iterator>             // std::distance
-#include <memory>               // std::shared_ptr, std::weak_ptr
+#include <limits>               // std::numeric_limits
+#include <memory>               // std::shared_ptr, std::make_shared
 #include <span>                 // std::span
 #include <stdexcept>            // std::runtime_error, std::exception
 #include <string>               // std::string
-#include <tuple>                // std::tuple
+#include <string_view>          // std::string_view
+#include <tuple>                // std::tuple, std::tie
+#include <type_traits>          // std::is_same_v, std::remove_cvref_t
 #include <unordered_map>        // std::unordered_map
-#include <utility>              // std::move
+#include <utility>              // std::move, std::in_place_type
+#include <variant>              // std::variant, std::holds_alternative, std::visit
 #include <vector>               // std::vector
 
 struct model_error : std::runtime_error {
@@ -39,6 +55,86 @@ struct model_vertex final {
 
 using model_index = GLuint;
 
+// Layout of model vertices in GPU memory, 28 bytes instead of the 64 of model_vertex. Normals and tangents are octahedral encoded, with the sign of the
+// bitangent folded into the tangent, so the bitangent is rebuilt from their cross product. Texture coordinates may repeat outside [0, 1] and are stored as half
+// floats, while lightmap coordinates are always within it and are stored as 16-bit unorm. Decoded in model.vert.
+struct packed_model_vertex final {
+	// Offset that keeps the encoded tangent y away from 0, so that the sign that it carries survives quantization.
+	static constexpr auto tangent_sign_bias = 1.0f / 32767.0f;
+
+	[[nodiscard]] static auto pack(const model_vertex& vertex) noexcept -> packed_model_vertex {
+		const auto normal = encode_octahedral(vertex.normal);
+		const auto tangent = encode_octahedral(vertex.tangent);
+		const auto bitangent_sign = (dot(cross(vertex.normal, vertex.tangent), vertex.bitangent) < 0.0f) ? -1.0f : 1.0f;
+		const auto tangent_y = bitangent_sign * (tangent_sign_bias + (1.0f - tangent_sign_bias) * (tangent.y * 0.5f + 0.5f));
+		return packed_model_vertex{
+			.position = vertex.position,
+			.normal_and_tangent = normalized_vec<std::int16_t, 4>::pack(vec4{normal.x, normal.y, tangent.x, tangent_y}),
+			.texture_coordinates = half_vec<2>::pack(vertex.texture_coordinates),
+			.lightmap_coordinates = normalized_vec<std::uint16_t, 2>::pack(vertex.lightmap_coordinates),
+		};
+	}
+
+	[[nodiscard]] static auto pack(std::span<const model_vertex> vertices) -> std::vector<packed_model_vertex> {
+		auto result = std::vector<packed_model_vertex>{};
+		result.reserve(vertices.size());
+		for (const auto& vertex : vertices) {
+			result.push_back(pack(vertex));
+		}
+		return result;
+	}
+
+	// Inverse of pack, up to quantization. Mirrors the decoding in model.vert, so the result matches what is rendered.
+	[[nodiscard]] auto unpack() const noexcept -> model_vertex {
+		const auto encoded = normal_and_tangent.unpack();
+		const auto bitangent_sign = (encoded.w < 0.0f) ? -1.0f : 1.0f;
+		const auto normal = decode_octahedral(vec2{encoded.x, encoded.y});
+		const auto tangent = decode_octahedral(vec2{encoded.z, (std::abs(encoded.w) - tangent_sign_bias) / (1.0f - tangent_sign_bias) * 2.0f - 1.0f});
+		return model_vertex{
+			.position = position,
+			.normal = normal,
+			.tangent = tangent,
+			.bitangent = bitangent_sign * cross(normal, tangent),
+			.texture_coordinates = texture_coordinates.unpack(),
+			.lightmap_coordinates = lightmap_coordinates.unpack(),
+		};
+	}
+
+	// Map a direction onto the unit octahedron and unfold the lower half over the corners, giving coordinates in [-1, 1].
+	[[nodiscard]] static auto encode_octahedral(vec3 v) noexcept -> vec2 {
+		const auto sign_not_zero = [](float x) {
+			return (x >= 0.0f) ? 1.0f : -1.0f;
+		};
+		const auto length = std::abs(v.x) + std::abs(v.y) + std::abs(v.z);
+		if (length == 0.0f) {
+			return vec2{0.0f, 0.0f};
+		}
+		v /= length;
+		if (v.z < 0.0f) {
+			return vec2{(1.0f - std::abs(v.y)) * sign_not_zero(v.x), (1.0f - std::abs(v.x)) * sign_not_zero(v.y)};
+		}
+		return vec2{v.x, v.y};
+	}
+
+	[[nodiscard]] static auto decode_octahedral(vec2 e) noexcept -> vec3 {
+		const auto sign_not_zero = [](float x) {
+			return (x >= 0.0f) ? 1.0f : -1.0f;
+		};
+		auto v = vec3{e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y)};
+		if (v.z < 0.0f) {
+			v = vec3{(1.0f - std::abs(e.y)) * sign_not_zero(e.x), (1.0f - std::abs(e.x)) * sign_not_zero(e.y), v.z};
+		}
+		return normalize(v);
+	}
+
+	vec3 position{};
+	normalized_vec<std::int16_t, 4> normal_and_tangent{};
+	half_vec<2> texture_coordinates{};
+	normalized_vec<std::uint16_t, 2> lightmap_coordinates{};
+};
+
+static_assert(sizeof(packed_model_vertex) == 28);
+
 struct model_material final {
 	std::uint8_t albedo_texture_offset = 0;
 	std::uint8_t normal_texture_offset = 0;
@@ -48,29 +144,275 @@ struct model_material final {
 	bool alpha_blending = false;
 };
 
+// A simplified version of a mesh that uses a subset of its vertices, as a range of its LOD indices.
+struct model_mesh_lod final {
+	std::uint32_t index_offset = 0;
+	std::uint32_t index_count = 0;
+	float error = 0.0f; // How far the simplified surface may be from the full detail mesh, in model units.
+};
+
+// A view to cull mesh clusters against, in the model space of one instance, so that clusters are tested without being transformed.
+class model_cluster_view final {
+public:
+	// A view that culls nothing.
+	model_cluster_view() noexcept = default;
+
+	// The eye is a position with w = 1, or the direction that an orthographic view looks in with w = 0, in world space. Back-facing clusters should only be
+	// culled when back faces are.
+	model_cluster_view(const mat4& projection_view_matrix, const mat4& model_matrix, vec4 eye, bool cull_back_faces) noexcept
+		: m_eye(inverse(model_matrix) * eye)
+		, m_cull_back_faces(cull_back_faces && determinant(mat3{model_matrix}) > 0.0f) { // Mirroring transforms flip which faces are culled.
+		// Planes of the clip volume, from the rows of the combined matrix (Gribb and Hartmann).
+		const auto matrix = projection_view_matrix * model_matrix;
+		const auto row = [&](int i) {
+			return vec4{matrix[0][i], matrix[1][i], matrix[2][i], matrix[3][i]};
+		};
+		m_planes = {row(3) + row(0), row(3) - row(0), row(3) + row(1), row(3) - row(1), row(3) + row(2), row(3) - row(2)};
+		for (auto& plane : m_planes) {
+			if (const auto normal_length = length(vec3{plane}); normal_length > 0.0f) {
+				plane /= normal_length;
+			}
+		}
+		if (m_eye.w == 0.0f) {
+			m_eye = vec4{normalize(vec3{m_eye}), 0.0f};
+		}
+	}
+
+	// Whether any part of the cluster may be inside the view and facing it.
+	[[nodiscard]] auto is_visible(const mesh_cluster& cluster) const noexcept -> bool {
+		for (const auto& plane : m_planes) {
+			if (dot(vec3{plane}, cluster.center) + plane.w < -cluster.radius) {
+				return false;
+			}
+		}
+		if (!m_cull_back_faces) {
+			return true;
+		}
+		if (m_eye.w == 0.0f) {
+			return dot(vec3{m_eye}, cluster.cone_axis) < cluster.cone_cutoff;
+		}
+		const auto offset = cluster.center - vec3{m_eye};
+		return dot(offset, cluster.cone_axis) < cluster.cone_cutoff * length(offset) + cluster.radius;
+	}
+
+private:
+	std::array<vec4, 6> m_planes{};
+	vec4 m_eye{};
+	bool m_cull_back_faces = false;
+};
+
+// Index ranges of the visible clusters of a mesh, kept by renderers between draws to avoid allocating.
+struct model_draw_ranges final {
+	std::vector<GLsizei> counts{};
+	std::vector<const void*> offsets{};
+};
+
+// Vertices and indices of a mesh in the layout that they have in GPU memory, so that they can be uploaded without any per-vertex work. The index array holds
+// the full detail indices followed by those of every level of detail, and is 16-bit when the mesh has few enough vertices.
+struct model_mesh_geometry final {
+	static constexpr auto max_small_vertex_count = std::size_t{std::numeric_limits<std::uint16_t>::max()} + 1;
+
+	std::vector<packed_model_vertex> vertices{};
+	std::vector<std::uint16_t> small_indices{}; // Used when there are at most max_small_vertex_count vertices.
+	std::vector<model_index> large_indices{};   // Used otherwise.
+	std::size_t index_count = 0;                // Number of full detail indices at the start of the index array.
+
+	[[nodiscard]] static auto pack(std::span<const model_vertex> vertices, std::span<const model_index> indices, std::span<const model_index> lod_indices)
+		-> model_mesh_geometry {
+		auto result = model_mesh_geometry{.vertices = packed_model_vertex::pack(vertices), .index_count = indices.size()};
+		const auto add_indices = [&](auto& all_indices) {
+			using index_type = typename std::remove_cvref_t<decltype(all_indices)>::value_type;
+			all_indices.reserve(indices.size() + lod_indices.size());
+			for (const auto& range : {indices, lod_indices}) {
+				for (const auto index : range) {
+					all_indices.push_back(static_cast<index_type>(index));
+				}
+			}
+		};
+		if (uses_small_indices(vertices.size())) {
+			add_indices(result.small_indices);
+		} else {
+			add_indices(result.large_indices);
+		}
+		return result;
+	}
+
+	[[nodiscard]] static constexpr auto uses_small_indices(std::size_t vertex_count) noexcept -> bool {
+		return vertex_count <= max_small_vertex_count;
+	}
+
+	[[nodiscard]] auto total_index_count() const noexcept -> std::size_t {
+		return small_indices.size() + large_indices.size();
+	}
+
+	// Inverse of pack, up to quantization.
+	auto unpack(std::vector<model_vertex>& unpacked_vertices, std::vector<model_index>& indices, std::vector<model_index>& lod_indices) const -> void {
+		unpacked_vertices.clear();
+		unpacked_vertices.reserve(vertices.size());
+		for (const auto& vertex : vertices) {
+			unpacked_vertices.push_back(vertex.unpack());
+		}
+		const auto split_indices = [&](const auto& all_indices) {
+			const auto lod_begin = all_indices.begin() + static_cast<std::ptrdiff_t>(index_count);
+			indices.assign(all_indices.begin(), lod_begin);
+			lod_indices.assign(lod_begin, all_indices.end());
+		};
+		if (uses_small_indices(vertices.size())) {
+			split_indices(small_indices);
+		} else {
+			split_indices(large_indices);
+		}
+	}
+
+	[[nodiscard]] auto size() const noexcept -> std::size_t {
+		return vertices.size() * sizeof(packed_model_vertex) + small_indices.size() * sizeof(std::uint16_t) + large_indices.size() * sizeof(model_index);
+	}
+};
+
+// CPU side of a mesh, as imported from a model file.
+struct model_mesh_data final {
+	model_mesh_geometry geometry{};
+	std::vector<model_mesh_lod> lods{};
+	std::vector<mesh_cluster> clusters{};
+	model_material material{}; // Texture offsets refer to model_data::texture_filenames.
+};
+
 class model_mesh final {
 public:
 	static constexpr auto primitive_type = GLenum{GL_TRIANGLES};
-	static constexpr auto index_type = GLenum{GL_UNSIGNED_INT};
-
-	model_mesh(std::vector<model_vertex> vertices, std::vector<model_index> indices, const model_material& material)
-		: m_vertices(std::move(vertices))
-		, m_indices(std::move(indices))
-		, m_material(material)
-		, m_mesh(GL_STATIC_DRAW, GL_STATIC_DRAW, m_vertices, m_indices,
-			  std::tuple{
-				  &model_vertex::position,
-				  &model_vertex::normal,
-				  &model_vertex::tangent,
-				  &model_vertex::bitangent,
-				  &model_vertex::texture_coordinates,
-				  &model_vertex::lightmap_coordinates,
-			  }) {}
+
+	// The levels of detail go from the finest to the coarsest, with non-decreasing errors.
+	// The clusters cover the full detail indices in order.
+	// The geometry is uploaded as it is and kept as the CPU copy of the mesh, which load_cpu_data unpacks when it is needed.
+	explicit model_mesh(model_mesh_data data)
+		: m_packed_geometry(std::move(data.geometry))
+		, m_lods(std::move(data.lods))
+		, m_clusters(std::move(data.clusters))
+		, m_material(data.material)
+		, m_mesh(upload(m_packed_geometry))
+		, m_vertex_count(m_packed_geometry.vertices.size())
+		, m_index_count(m_packed_geometry.index_count)
+		, m_lod_index_count(m_packed_geometry.total_index_count() - m_packed_geometry.index_count)
+		, m_source_vertex_count(m_packed_geometry.vertices.size()) {}
 
 	auto set_vertices(std::vector<model_vertex> vertices, std::vector<model_index> indices) -> void {
+		load_cpu_data(); // The levels of detail are uploaded again along with the new vertices.
 		m_vertices = std::move(vertices);
 		m_indices = std::move(indices);
-		m_mesh.set_vertices(GL_STATIC_DRAW, GL_STATIC_DRAW, m_vertices, m_indices);
+		m_mesh = upload(model_mesh_geometry::pack(m_vertices, m_indices, m_lod_indices));
+		// Clusters stay valid for triangles that keep their order, as they do when lightmap coordinates are generated.
+		if (m_indices.size() != m_index_count) {
+			m_clusters.clear();
+		}
+		m_vertex_count = m_vertices.size();
+		m_index_count = m_indices.size();
+		m_lod_index_count = m_lod_indices.size();
+		m_has_cpu_data = true;
+	}
+
+	// Free the CPU copies of the vertices and indices, which rendering does not need once they have been uploaded.
+	auto release_cpu_data() noexcept -> void {
+		m_packed_geometry = model_mesh_geometry{};
+		m_vertices = std::vector<model_vertex>{};
+		m_indices = std::vector<model_index>{};
+		m_lod_indices = std::vector<model_index>{};
+		m_has_cpu_data = false;
+	}
+
+	// Unpack the CPU copies of the vertices and indices from the packed geometry that the mesh was created with, or read them back from GPU memory if it has
+	// been released. Either way, the vertices come back as they were quantized for rendering.
+	auto load_cpu_data() -> void {
+		if (m_has_cpu_data) {
+			return;
+		}
+		if (m_packed_geometry.vertices.size() != m_vertex_count) {
+			m_packed_geometry = read_geometry();
+		}
+		m_packed_geometry.unpack(m_vertices, m_indices, m_lod_indices);
+		m_packed_geometry = model_mesh_geometry{};
+		m_has_cpu_data = true;
+	}
+
+	// Whether vertices(), indices() and lod_indices() are available, which they are after load_cpu_data until release_cpu_data is called.
+	[[nodiscard]] auto has_cpu_data() const noexcept -> bool {
+		return m_has_cpu_data;
+	}
+
+	// Memory taken up by the CPU copies of the mesh, packed or not.
+	[[nodiscard]] auto cpu_size() const noexcept -> std::size_t {
+		return m_packed_geometry.size() + m_vertices.size() * sizeof(model_vertex) + (m_indices.size() + m_lod_indices.size()) * sizeof(model_index) +
+			m_vertex_sources.size() * sizeof(model_index) + m_lods.size() * sizeof(model_mesh_lod) + m_clusters.size() * sizeof(mesh_cluster);
+	}
+
+	auto remap_vertices(std::span<const model_index> vertex_sources, std::span<const vec2> lightmap_coordinates, std::vector<model_index> indices) -> void {
+		if (vertex_sources.size() != lightmap_coordinates.size()) {
+			throw model_error{"Vertex source count does not match lightmap coordinate count!"};
+		}
+		load_cpu_data();
+		auto new_vertices = std::vector<model_vertex>{};
+		auto new_vertex_sources = std::vector<model_index>{};
+		new_vertices.reserve(vertex_sources.size());
+		new_vertex_sources.reserve(vertex_sources.size());
+		for (auto i = std::size_t{0}; i < vertex_sources.size(); ++i) {
+			const auto source = static_cast<std::size_t>(vertex_sources[i]);
+			if (source >= m_vertices.size()) {
+				throw model_error{"Invalid vertex source index!"};
+			}
+			auto& vertex = new_vertices.emplace_back(m_vertices[source]);
+			vertex.lightmap_coordinates = lightmap_coordinates[i];
+
+			// Keep sources relative to the vertices the mesh was originally loaded with.
+			new_vertex_sources.push_back((m_vertex_sources.empty()) ? vertex_sources[i] : m_vertex_sources[source]);
+		}
+		for (const auto index : indices) {
+			if (static_cast<std::size_t>(index) >= new_vertices.size()) {
+				throw model_error{"Invalid vertex index!"};
+			}
+		}
+
+		// Levels of detail use the first new vertex that each old vertex was split into, so their lightmap coordinates may be off across chart seams.
+		static constexpr auto no_vertex = std::numeric_limits<model_index>::max();
+		auto new_vertex_of = std::vector<model_index>(m_vertices.size(), no_vertex);
+		for (auto i = std::size_t{0}; i < vertex_sources.size(); ++i) {
+			if (auto& new_vertex = new_vertex_of[vertex_sources[i]]; new_vertex == no_vertex) {
+				new_vertex = static_cast<model_index>(i);
+			}
+		}
+		for (auto& index : m_lod_indices) {
+			index = new_vertex_of[index];
+		}
+		if (std::ranges::find(m_lod_indices, no_vertex) != m_lod_indices.end()) {
+			m_lod_indices.clear();
+			m_lods.clear();
+		}
+		m_vertex_sources = std::move(new_vertex_sources);
+		set_vertices(std::move(new_vertices), std::move(indices));
+	}
+
+	// Like remap_vertices, but with the sources relative to the vertices that the mesh was originally loaded with, as they are in a saved lightmap, so that it
+	// can be applied again after the mesh has been remapped for another one. Any vertex split from the same source has the same attributes apart from its
+	// lightmap coordinates, which are replaced.
+	auto remap_source_vertices(std::span<const model_index> vertex_sources, std::span<const vec2> lightmap_coordinates, std::vector<model_index> indices) -> void {
+		if (m_vertex_sources.empty()) {
+			remap_vertices(vertex_sources, lightmap_coordinates, std::move(indices));
+			return;
+		}
+		static constexpr auto no_vertex = std::numeric_limits<model_index>::max();
+		auto vertex_of = std::vector<model_index>(m_source_vertex_count, no_vertex);
+		for (auto i = std::size_t{0}; i < m_vertex_sources.size(); ++i) {
+			if (auto& vertex = vertex_of[m_vertex_sources[i]]; vertex == no_vertex) {
+				vertex = static_cast<model_index>(i);
+			}
+		}
+		auto current_vertex_sources = std::vector<model_index>{};
+		current_vertex_sources.reserve(vertex_sources.size());
+		for (const auto source : vertex_sources) {
+			if (static_cast<std::size_t>(source) >= vertex_of.size() || vertex_of[source] == no_vertex) {
+				throw model_error{"Invalid vertex source index!"};
+			}
+			current_vertex_sources.push_back(vertex_of[source]);
+		}
+		remap_vertices(current_vertex_sources, lightmap_coordinates, std::move(indices));
 	}
 
 	[[nodiscard]] auto vertices() const noexcept -> std::span<const model_vertex> {
@@ -81,22 +423,170 @@ public:
 		return m_indices;
 	}
 
+	[[nodiscard]] auto lod_indices() const noexcept -> std::span<const model_index> {
+		return m_lod_indices;
+	}
+
+	[[nodiscard]] auto lods() const noexcept -> std::span<const model_mesh_lod> {
+		return m_lods;
+	}
+
+	[[nodiscard]] auto clusters() const noexcept -> std::span<const mesh_cluster> {
+		return m_clusters;
+	}
+
+	// The coarsest level of detail whose error is within the given distance in model units, where level 0 is the full detail mesh.
+	[[nodiscard]] auto select_lod(float max_error) const noexcept -> std::size_t {
+		auto result = std::size_t{0};
+		while (result < m_lods.size() && m_lods[result].error <= max_error) {
+			++result;
+		}
+		return result;
+	}
+
+	// Draw a level of detail of the mesh while its vertex array is bound.
+	auto draw(std::size_t lod = 0) const noexcept -> void {
+		if (lod == 0 || lod > m_lods.size()) {
+			glDrawElements(primitive_type, static_cast<GLsizei>(m_index_count), index_type(), nullptr);
+		} else {
+			const auto& level = m_lods[lod - 1];
+			const auto offset = (m_index_count + std::size_t{level.index_offset}) * index_size();
+			glDrawElements(primitive_type, static_cast<GLsizei>(level.index_count), index_type(), reinterpret_cast<const void*>(offset)); // NOLINT(performance-no-int-to-ptr)
+		}
+	}
+
+	// Draw the clusters of the full detail mesh that may be visible in a view while its vertex array is bound, with adjacent ones merged into single ranges.
+	// Other levels of detail, and meshes without clusters, are drawn whole.
+	auto draw(std::size_t lod, const model_cluster_view& view, model_draw_ranges& ranges) const -> void {
+		if ((lod != 0 && lod <= m_lods.size()) || m_clusters.empty()) {
+			draw(lod);
+			return;
+		}
+		ranges.counts.clear();
+		ranges.offsets.clear();
+		auto end = std::uint32_t{0};
+		for (const auto& cluster : m_clusters) {
+			if (view.is_visible(cluster)) {
+				if (!ranges.counts.empty() && cluster.index_offset == end) {
+					ranges.counts.back() += static_cast<GLsizei>(cluster.index_count);
+				} else {
+					ranges.counts.push_back(static_cast<GLsizei>(cluster.index_count));
+					ranges.offsets.push_back(reinterpret_cast<const void*>(std::size_t{cluster.index_offset} * index_size())); // NOLINT(performance-no-int-to-ptr)
+				}
+				end = cluster.index_offset + cluster.index_count;
+			}
+		}
+		if (ranges.counts.size() == 1) {
+			glDrawElements(primitive_type, ranges.counts.front(), index_type(), ranges.offsets.front());
+		} else if (!ranges.counts.empty()) {
+			glMultiDrawElements(primitive_type, ranges.counts.data(), index_type(), ranges.offsets.data(), static_cast<GLsizei>(ranges.counts.size()));
+		}
+	}
+
+	[[nodiscard]] auto vertex_sources() const noexcept -> std::span<const model_index> {
+		return m_vertex_sources;
+	}
+
+	[[nodiscard]] auto source_vertex_count() const noexcept -> std::size_t {
+		return m_source_vertex_count;
+	}
+
 	[[nodiscard]] auto material() const noexcept -> const model_material& {
 		return m_material;
 	}
 
+	auto set_alpha_test(bool alpha_test) noexcept -> void {
+		m_material.alpha_test = alpha_test;
+	}
+
+	// Type of the indices in GPU memory, which are 16-bit when the mesh has few enough vertices.
+	[[nodiscard]] auto index_type() const noexcept -> GLenum {
+		return (std::holds_alternative<small_mesh>(m_mesh)) ? GLenum{GL_UNSIGNED_SHORT} : GLenum{GL_UNSIGNED_INT};
+	}
+
+	[[nodiscard]] auto gpu_size() const noexcept -> std::size_t {
+		return m_vertex_count * sizeof(packed_model_vertex) + (m_index_count + m_lod_index_count) * index_size();
+	}
+
 	[[nodiscard]] auto get() const noexcept -> GLuint {
-		return m_mesh.get();
+		return std::visit([](const auto& m) { return m.get(); }, m_mesh);
 	}
 
 private:
-	std::vector<model_vertex> m_vertices;
-	std::vector<model_index> m_indices;
+	using small_mesh = mesh<packed_model_vertex, std::uint16_t>;
+	using large_mesh = mesh<packed_model_vertex, model_index>;
+
+	[[nodiscard]] static auto upload(const model_mesh_geometry& geometry) -> std::variant<small_mesh, large_mesh> {
+		static constexpr auto vertex_attributes = std::tuple{
+			&packed_model_vertex::position,
+			&packed_model_vertex::normal_and_tangent,
+			&packed_model_vertex::texture_coordinates,
+			&packed_model_vertex::lightmap_coordinates,
+		};
+		const auto vertices = std::span<const packed_model_vertex>{geometry.vertices};
+		if (model_mesh_geometry::uses_small_indices(geometry.vertices.size())) {
+			return std::variant<small_mesh, large_mesh>{
+				std::in_place_type<small_mesh>, GL_STATIC_DRAW, GL_STATIC_DRAW, vertices, std::span<const std::uint16_t>{geometry.small_indices}, vertex_attributes};
+		}
+		return std::variant<small_mesh, large_mesh>{
+			std::in_place_type<large_mesh>, GL_STATIC_DRAW, GL_STATIC_DRAW, vertices, std::span<const model_index>{geometry.large_indices}, vertex_attributes};
+	}
+
+	[[nodiscard]] auto read_geometry() const -> model_mesh_geometry {
+		auto result = model_mesh_geometry{.vertices = std::vector<packed_model_vertex>(m_vertex_count), .index_count = m_index_count};
+		const auto index_count = m_index_count + m_lod_index_count;
+		std::visit(
+			[&]<typename Vertex, typename Index>(const mesh<Vertex, Index>& m) {
+				auto& indices = [&]() -> std::vector<Index>& {
+					if constexpr (std::is_same_v<Index, std::uint16_t>) {
+						return result.small_indices;
+					} else {
+						return result.large_indices;
+					}
+				}();
+				indices.resize(index_count);
+				auto read_buffer_binding = GLint{};
+				glGetIntegerv(GL_COPY_READ_BUFFER_BINDING, &read_buffer_binding);
+				glBindBuffer(GL_COPY_READ_BUFFER, m.get_vertex_buffer());
+				glGetBufferSubData(GL_COPY_READ_BUFFER, 0, static_cast<GLsizeiptr>(result.vertices.size() * sizeof(Vertex)), result.vertices.data());
+				glBindBuffer(GL_COPY_READ_BUFFER, m.get_index_buffer());
+				glGetBufferSubData(GL_COPY_READ_BUFFER, 0, static_cast<GLsizeiptr>(indices.size() * sizeof(Index)), indices.data());
+				glBindBuffer(GL_COPY_READ_BUFFER, static_cast<GLuint>(read_buffer_binding));
+			},
+			m_mesh);
+		return result;
+	}
+
+	[[nodiscard]] auto index_size() const noexcept -> std::size_t {
+		return (std::holds_alternative<small_mesh>(m_mesh)) ? sizeof(std::uint16_t) : sizeof(model_index);
+	}
+
+	model_mesh_geometry m_packed_geometry; // Empty once unpacked or released.
+	std::vector<model_vertex> m_vertices{};
+	std::vector<model_index> m_indices{};
+	std::vector<model_index> m_lod_indices{};
+	std::vector<model_mesh_lod> m_lods;
+	std::vector<mesh_cluster> m_clusters;
 	model_material m_material;
-	mesh<model_vertex, model_index> m_mesh;
+	std::variant<small_mesh, large_mesh> m_mesh;
+	std::size_t m_vertex_count;
+	std::size_t m_index_count;
+	std::size_t m_lod_index_count;
+	std::vector<model_index> m_vertex_sources{};
+	std::size_t m_source_vertex_count;
+	bool m_has_cpu_data = false;
 };
 
-using model_texture_cache = std::unordered_map<std::string, std::weak_ptr<texture>>;
+// Textures shared between models by filename. The cache owns them, so that finding one does not have to lock a weak pointer, and whoever owns the cache
+// removes the ones that no model uses any more after releasing models.
+using model_texture_cache = std::unordered_map<std::string, std::shared_ptr<texture>>;
+
+// Everything that can be loaded from a model file without a GL context, so that it can be done on any thread.
+struct model_data final {
+	std::vector<model_mesh_data> meshes{};
+	std::vector<std::string> texture_filenames{};
+	float bounding_sphere_radius = 0.0f;
+};
 
 class model final {
 public:
@@ -107,21 +597,127 @@ public:
 		.use_mip_map = true,
 	};
 
-	[[nodiscard]] static auto load(const char* filename, std::string_view textures_filename_prefix, model_texture_cache& texture_cache) -> model {
-		auto result = model{};
+	// Import a model and upload it. Textures that are not in the cache are imported on the thread pool while the meshes are uploaded.
+	[[nodiscard]] static auto load(const char* filename, std::string_view textures_filename_prefix, model_texture_cache& texture_cache, thread_pool& pool,
+		bool compress_textures = false) -> model {
+		auto data = import(filename, textures_filename_prefix);
+		auto textures = import_textures(data.texture_filenames, get_loaded_textures(texture_cache), pool, compress_textures);
+		return create(std::move(data), textures, texture_cache, compress_textures);
+	}
+
+	// Read a model file and gather its meshes and texture filenames. Does not use OpenGL.
+	[[nodiscard]] static auto import(const char* filename, std::string_view textures_filename_prefix) -> model_data {
+		const auto zone = profiler::zone("import_model", filename);
+		auto result = model_data{};
 		auto importer = Assimp::Importer{};
 		const auto* const scene = importer.ReadFile(filename, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals | aiProcess_CalcTangentSpace);
 		if (!scene || (scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) != 0 || !scene->mRootNode) {
 			throw model_error{fmt::format("Failed to load model \"{}\": {}", filename, importer.GetErrorString())};
 		}
 		try {
-			result.add_node(*scene->mRootNode, *scene, textures_filename_prefix, texture_cache);
+			auto meshes = std::vector<const aiMesh*>{};
+			add_node(meshes, *scene->mRootNode, *scene);
+
+			// The geometry of every mesh is processed in parallel, and the materials are added in order afterwards so that the texture offsets stay the same.
+			result.meshes.resize(meshes.size());
+			parallel_for(meshes.size(), [&](std::size_t i) {
+				import_geometry(result.meshes[i], *meshes[i]);
+			});
+			auto source_vertex_count = std::size_t{0};
+			auto vertex_count = std::size_t{0};
+			for (auto i = std::size_t{0}; i < meshes.size(); ++i) {
+				add_material(result, result.meshes[i], *meshes[i], *scene, textures_filename_prefix);
+				source_vertex_count += meshes[i]->mNumVertices;
+				vertex_count += result.meshes[i].geometry.vertices.size();
+			}
+			if (source_vertex_count > 0) {
+				const auto reduction = 100.0 * static_cast<double>(source_vertex_count - vertex_count) / static_cast<double>(source_vertex_count);
+				fmt::print(stderr, "Imported model \"{}\": {} vertices welded into {} ({:.1f}% fewer).\n", filename, source_vertex_count, vertex_count, reduction);
+			}
 		} catch (const std::exception& e) {
 			throw model_error{fmt::format("Failed to load model \"{}\": {}", filename, e.what())};
 		}
 		return result;
 	}
 
+	// Load a texture referenced by a model with its mip chain, from its cooked file if it is up to date. Does not use OpenGL.
+	[[nodiscard]] static auto import_texture(const std::string& filename, bool compress) -> cooked_texture {
+		return cooked_texture::import(filename, default_texture_options, compress);
+	}
+
+	// Names of the textures in the cache, which do not need to be imported again.
+	[[nodiscard]] static auto get_loaded_textures(const model_texture_cache& texture_cache) -> std::vector<std::string> {
+		auto result = std::vector<std::string>{};
+		result.reserve(texture_cache.size());
+		for (const auto& [filename, texture] : texture_cache) {
+			if (texture) {
+				result.push_back(filename);
+			}
+		}
+		return result;
+	}
+
+	// Start importing every texture that is not already loaded on the thread pool. Loaded textures get an empty future. Does not use OpenGL.
+	[[nodiscard]] static auto import_textures(std::span<const std::string> filenames, std::span<const std::string> loaded_textures, thread_pool& pool, bool compress)
+		-> std::vector<std::future<cooked_texture>> {
+		auto result = std::vector<std::future<cooked_texture>>{};
+		result.reserve(filenames.size());
+		for (const auto& filename : filenames) {
+			if (std::ranges::find(loaded_textures, filename) == loaded_textures.end()) {
+				result.push_back(pool.submit([filename, compress] {
+					return import_texture(filename, compress);
+				}));
+			} else {
+				result.emplace_back();
+			}
+		}
+		return result;
+	}
+
+	// Upload imported model data. The meshes are uploaded first, so that textures which are still being imported in the background can finish in the meantime.
+	// Textures are then taken from the cache if possible, then from the imported textures, which are matched to data.texture_filenames by index and may be empty,
+	// and are imported here as a last resort. New textures are added to the streamer if there is one, which uploads only their smallest levels.
+	[[nodiscard]] static auto create(model_data data, std::span<std::future<cooked_texture>> textures, model_texture_cache& texture_cache, bool compress_textures = false,
+		texture_streamer* streamer = nullptr) -> model {
+		auto result = model{};
+		{
+			const auto zone = profiler::gpu_zone("upload_meshes");
+			result.m_meshes.reserve(data.meshes.size());
+			for (auto& mesh : data.meshes) {
+				result.m_meshes.emplace_back(std::move(mesh));
+			}
+		}
+		result.m_textures.reserve(data.texture_filenames.size());
+		for (auto i = std::size_t{0}; i < data.texture_filenames.size(); ++i) {
+			const auto it = texture_cache.try_emplace(data.texture_filenames[i]).first;
+			auto& ptr = it->second;
+			if (!ptr) {
+				auto imported = [&] {
+					if (i < textures.size() && textures[i].valid()) {
+						const auto zone = profiler::zone("wait_for_texture", it->first);
+						return textures[i].get();
+					}
+					return import_texture(it->first, compress_textures);
+				}();
+				ptr = (streamer) ? streamer->add(std::move(imported), default_texture_options) : std::make_shared<texture>(imported.upload(default_texture_options));
+			}
+			result.m_textures.push_back(ptr);
+		}
+		for (auto& mesh : result.m_meshes) {
+			const auto& material = mesh.material();
+			if (!material.alpha_blending && texture::internal_channel_count(result.m_textures[material.albedo_texture_offset]->internal_format()) == 4) {
+				mesh.set_alpha_test(true);
+			}
+		}
+		result.m_bounding_sphere_radius = data.bounding_sphere_radius;
+		return result;
+	}
+
+	// A model without meshes, used in place of models that are still loading.
+	[[nodiscard]] static auto create_empty() -> model {
+		return model{};
+	}
+
 	[[nodiscard]] auto meshes() noexcept -> std::span<model_mesh> {
 		return m_meshes;
 	}
@@ -130,6 +726,20 @@ public:
 		return m_meshes;
 	}
 
+	// Free the CPU copies of the geometry of every mesh once it lives in GPU memory, see model_mesh::release_cpu_data.
+	auto release_cpu_data() noexcept -> void {
+		for (auto& mesh : m_meshes) {
+			mesh.release_cpu_data();
+		}
+	}
+
+	// Make the geometry of every mesh available on the CPU again, for lightmap generation and baking.
+	auto load_cpu_data() -> void {
+		for (auto& mesh : m_meshes) {
+			mesh.load_cpu_data();
+		}
+	}
+
 	[[nodiscard]] auto textures() const noexcept -> std::span<const std::shared_ptr<texture>> {
 		return m_textures;
 	}
@@ -138,11 +748,27 @@ public:
 		return m_bounding_sphere_radius;
 	}
 
+	// Largest level of detail error in model units that keeps an instance within the given number of pixels of its full detail on screen, where pixels_per_unit
+	// is the projected size of one unit at a distance of one. Instances whose bounding sphere contains the view position get full detail.
+	[[nodiscard]] auto get_max_lod_error(const mat4& transform, vec3 view_position, float pixels_per_unit, float pixel_error) const noexcept -> float {
+		const auto scale = max(length(vec3{transform[0]}), max(length(vec3{transform[1]}), length(vec3{transform[2]})));
+		const auto distance = length(vec3{transform[3]} - view_position) - m_bounding_sphere_radius * scale;
+		if (distance <= 0.0f || pixels_per_unit <= 0.0f || scale <= 0.0f) {
+			return 0.0f;
+		}
+		return pixel_error * distance / (pixels_per_unit * scale);
+	}
+
 private:
+	static constexpr auto weld_epsilon = 1e-5f;           // Largest difference between any two components of vertices that are merged.
+	static constexpr auto max_lod_count = std::size_t{4}; // Levels of detail per mesh, not counting the full detail mesh.
+	static constexpr auto max_lod_error = 0.05f;          // Largest error of a level of detail, relative to the extent of its mesh.
+	static constexpr auto max_lod_triangle_ratio = 0.8f;  // Levels of detail that remove fewer triangles than this from the previous level are not kept.
+
 	model() noexcept = default;
 
-	[[nodiscard]] auto add_texture(
-		const aiMaterial& mat, aiTextureType type, const char* default_name, std::string_view textures_filename_prefix, model_texture_cache& texture_cache) -> std::uint8_t {
+	[[nodiscard]] static auto add_texture(model_data& data, const aiMaterial& mat, aiTextureType type, const char* default_name, std::string_view textures_filename_prefix)
+		-> std::uint8_t {
 		auto name = aiString{};
 		if (const auto texture_count = mat.GetTextureCount(type); texture_count == 0u) {
 			name = default_name;
@@ -151,44 +777,21 @@ private:
 		} else {
 			throw model_error{"Materials cannot have multiple textures of the same type."};
 		}
-		const auto it = texture_cache.try_emplace(fmt::format("{}{}", textures_filename_prefix, name.C_Str())).first;
-		auto ptr = it->second.lock();
-		if (ptr) {
-			if (const auto it_texture = std::ranges::find(m_textures, ptr); it_texture != m_textures.end()) {
-				return static_cast<std::uint8_t>(std::distance(m_textures.begin(), it_texture));
-			}
-		} else {
-			if (it->first.ends_with(".hdr")) {
-				const auto img = image::load_hdr(it->first.c_str());
-				ptr = std::make_shared<texture>(texture::create_2d(texture::internal_pixel_format_hdr(img.channel_count()),
-					img.width(),
-					img.height(),
-					texture::pixel_format(img.channel_count()),
-					GL_FLOAT,
-					img.data(),
-					default_texture_options));
-			} else {
-				const auto img = image::load(it->first.c_str());
-				ptr = std::make_shared<texture>(texture::create_2d(texture::internal_pixel_format_ldr(img.channel_count()),
-					img.width(),
-					img.height(),
-					texture::pixel_format(img.channel_count()),
-					GL_UNSIGNED_BYTE,
-					img.data(),
-					default_texture_options));
-			}
-			it->second = ptr;
+		auto filename = fmt::format("{}{}", textures_filename_prefix, name.C_Str());
+		if (const auto it = std::ranges::find(data.texture_filenames, filename); it != data.texture_filenames.end()) {
+			return static_cast<std::uint8_t>(std::distance(data.texture_filenames.begin(), it));
 		}
-		const auto offset = static_cast<std::uint8_t>(m_textures.size());
-		m_textures.push_back(std::move(ptr));
+		const auto offset = static_cast<std::uint8_t>(data.texture_filenames.size());
+		data.texture_filenames.push_back(std::move(filename));
 		return offset;
 	}
 
-	auto add_mesh(const aiMesh& mesh, const aiScene& scene, std::string_view textures_filename_prefix, model_texture_cache& texture_cache) -> void {
-		auto bounding_sphere_radius_squared = 0.0f;
-
+	// Convert, weld, optimize, simplify and pack the vertices and triangles of a mesh. Independent of other meshes, so that meshes can be imported in parallel.
+	static auto import_geometry(model_mesh_data& data, const aiMesh& mesh) -> void {
 		const auto zero_vector = aiVector3D{};
 		auto vertices = std::vector<model_vertex>{};
+		auto indices = std::vector<model_index>{};
+		vertices.reserve(mesh.mNumVertices);
 		for (auto i = 0u; i < mesh.mNumVertices; ++i) {
 			const auto& position = mesh.mVertices[i];
 			const auto& normal = (mesh.mNormals) ? mesh.mNormals[i] : zero_vector;
@@ -203,48 +806,80 @@ private:
 				.texture_coordinates = vec2{texture_coordinates.x, texture_coordinates.y},
 				.lightmap_coordinates = vec2{texture_coordinates.x, texture_coordinates.y},
 			});
-
-			const auto radius_squared = position.x * position.x + position.y * position.y + position.z * position.z;
-			bounding_sphere_radius_squared = max(bounding_sphere_radius_squared, radius_squared);
 		}
 
-		if (bounding_sphere_radius_squared > 0.0f) {
-			m_bounding_sphere_radius = max(m_bounding_sphere_radius, sqrt(bounding_sphere_radius_squared));
-		}
-
-		auto indices = std::vector<model_index>{};
 		for (auto i = 0u; i < mesh.mNumFaces; ++i) {
-			const auto& face = mesh.mFaces[i];
-			for (auto j = 0u; j < face.mNumIndices; ++j) {
-				indices.push_back(face.mIndices[j]);
+			// Points and lines are left out, since meshes are drawn as triangle lists.
+			if (const auto& face = mesh.mFaces[i]; face.mNumIndices == 3) {
+				indices.insert(indices.end(), face.mIndices, face.mIndices + 3);
 			}
 		}
 
+		// Assimp is not asked to join identical vertices, since it compares them exactly and is slower, so OBJ files come in with one vertex per corner.
+		mesh_optimizer::weld_vertices(vertices, indices, weld_epsilon);
+		mesh_optimizer::optimize(vertices, indices);
+		data.clusters = mesh_clusterizer::build(std::span<const model_vertex>{vertices}, std::span<const model_index>{indices});
+		auto lod_indices = std::vector<model_index>{};
+		std::tie(lod_indices, data.lods) = simplify_mesh(vertices, indices);
+		data.geometry = model_mesh_geometry::pack(vertices, indices, lod_indices);
+	}
+
+	static auto add_material(model_data& data, model_mesh_data& mesh_data, const aiMesh& mesh, const aiScene& scene, std::string_view textures_filename_prefix) -> void {
+		auto bounding_sphere_radius_squared = 0.0f;
+		for (const auto& vertex : mesh_data.geometry.vertices) {
+			bounding_sphere_radius_squared = max(bounding_sphere_radius_squared, dot(vertex.position, vertex.position));
+		}
+		if (bounding_sphere_radius_squared > 0.0f) {
+			data.bounding_sphere_radius = max(data.bounding_sphere_radius, sqrt(bounding_sphere_radius_squared));
+		}
+
 		const auto& mat = *scene.mMaterials[mesh.mMaterialIndex];
 		auto opacity = 0.0f;
 		mat.Get(AI_MATKEY_OPACITY, opacity);
-		auto material = model_material{
-			.albedo_texture_offset = add_texture(mat, aiTextureType_DIFFUSE, "default_albedo.png", textures_filename_prefix, texture_cache),
-			.normal_texture_offset = add_texture(mat, aiTextureType_NORMALS, "default_normal.png", textures_filename_prefix, texture_cache),
-			.roughness_texture_offset = add_texture(mat, aiTextureType_SPECULAR, "default_roughness.png", textures_filename_prefix, texture_cache),
-			.metallic_texture_offset = add_texture(mat, aiTextureType_SHININESS, "default_metallic.png", textures_filename_prefix, texture_cache),
-			.alpha_test = false,
+		mesh_data.material = model_material{
+			.albedo_texture_offset = add_texture(data, mat, aiTextureType_DIFFUSE, "default_albedo.png", textures_filename_prefix),
+			.normal_texture_offset = add_texture(data, mat, aiTextureType_NORMALS, "default_normal.png", textures_filename_prefix),
+			.roughness_texture_offset = add_texture(data, mat, aiTextureType_SPECULAR, "default_roughness.png", textures_filename_prefix),
+			.metallic_texture_offset = add_texture(data, mat, aiTextureType_SHININESS, "default_metallic.png", textures_filename_prefix),
+			.alpha_test = false, // Decided from the albedo texture format when the model is created.
 			.alpha_blending = opacity < 1.0f,
 		};
-		if (!material.alpha_blending) {
-			if (texture::internal_channel_count(m_textures[material.albedo_texture_offset]->internal_format()) == 4) {
-				material.alpha_test = true;
+	}
+
+	// Simplify a mesh into levels of detail with half the triangles of the previous level each, until that no longer pays off or costs too much accuracy.
+	// Every level is simplified from the full detail mesh, so that errors do not add up.
+	[[nodiscard]] static auto simplify_mesh(std::span<const model_vertex> vertices, std::span<const model_index> indices)
+		-> std::tuple<std::vector<model_index>, std::vector<model_mesh_lod>> {
+		auto lod_indices = std::vector<model_index>{};
+		auto lods = std::vector<model_mesh_lod>{};
+		auto previous_index_count = indices.size();
+		auto previous_error = 0.0f;
+		for (auto level = std::size_t{1}; level <= max_lod_count; ++level) {
+			const auto target_index_count = (indices.size() / 3 >> level) * 3;
+			auto lod = mesh_simplifier::simplify(vertices, indices, target_index_count, max_lod_error);
+			if (lod.indices.empty() || static_cast<float>(lod.indices.size()) > static_cast<float>(previous_index_count) * max_lod_triangle_ratio) {
+				break;
 			}
+			mesh_optimizer::optimize_vertex_cache(lod.indices, vertices.size());
+			previous_index_count = lod.indices.size();
+			previous_error = max(previous_error, lod.error);
+			lods.push_back(model_mesh_lod{
+				.index_offset = static_cast<std::uint32_t>(lod_indices.size()),
+				.index_count = static_cast<std::uint32_t>(lod.indices.size()),
+				.error = previous_error,
+			});
+			lod_indices.insert(lod_indices.end(), lod.indices.begin(), lod.indices.end());
 		}
-		m_meshes.emplace_back(vertices, indices, material);
+		return std::tuple{std::move(lod_indices), std::move(lods)};
 	}
 
-	auto add_node(const aiNode& node, const aiScene& scene, std::string_view textures_filename_prefix, model_texture_cache& texture_cache) -> void {
+	// Gather the meshes of every node in depth-first order.
+	static auto add_node(std::vector<const aiMesh*>& meshes, const aiNode& node, const aiScene& scene) -> void {
 		for (auto i = 0u; i < node.mNumMeshes; ++i) {
-			add_mesh(*scene.mMeshes[node.mMeshes[i]], scene, textures_filename_prefix, texture_cache);
+			meshes.push_back(scene.mMeshes[node.mMeshes[i]]);
 		}
 		for (auto i = 0u; i < node.mNumChildren; ++i) {
-			add_node(*node.mChildren[i], scene, textures_filename_prefix, texture_cache);
+			add_node(meshes, *node.mChildren[i], scene);
 		}
 	}
 
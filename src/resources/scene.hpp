@@ -18,15 +18,18 @@ struct scene_object_options final {
 	vec3 scale{};
 	float angle = 0.0f;
 	vec3 axis{0.0f, 1.0f, 0.0f};
+	float lightmap_density = 1.0f;
 };
 
 struct scene_object final {
 	explicit scene_object(const scene_object_options& options)
 		: model_ptr(options.model_ptr)
-		, transform(glm::rotate(glm::scale(glm::translate(mat4{1.0f}, options.position), options.scale), options.angle, options.axis)) {}
+		, transform(glm::rotate(glm::scale(glm::translate(mat4{1.0f}, options.position), options.scale), options.angle, options.axis))
+		, lightmap_density(options.lightmap_density) {}
 
 	std::shared_ptr<model> model_ptr;
 	mat4 transform;
+	float lightmap_density; // Multiplier for the texel density of the scene.
 	vec2 lightmap_offset{0.0f, 0.0f};
 	vec2 lightmap_scale{1.0f, 1.0f};
 };
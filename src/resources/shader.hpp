@@ -3,13 +3,17 @@
 
 #include "../core/handle.hpp"
 #include "../core/opengl.hpp"
+#include "../core/profiler.hpp"
 #include "../utilities/preprocessor.hpp"
 
+#include <algorithm>        // std::ranges::any_of, std::ranges::find
 #include <array>            // std::array
 #include <cstddef>          // std::size_t
+#include <filesystem>       // std::filesystem::path
 #include <fmt/format.h>     // fmt::format
 #include <fstream>          // std::ifstream
 #include <initializer_list> // std::initializer_list
+#include <span>             // std::span
 #include <sstream>          // std::ostringstream
 #include <stdexcept>        // std::runtime_error
 #include <string>           // std::string
@@ -55,24 +59,33 @@ public:
 			throw opengl_error{"Failed to create shader!"};
 		}
 
-		auto file = std::ifstream{filename};
-		if (!file) {
-			throw shader_error{fmt::format("Failed to read shader code file \"{}\"!\n", filename)};
-		}
-		auto stream = std::ostringstream{};
-		stream << file.rdbuf();
-		const auto source = std::move(stream).str();
-		file.close();
-
 		auto processed_strings = std::vector<std::string>{};
-		auto environment = preprocessor_environment{};
-		auto file_cache = preprocessor::file_content_map{};
-		preprocessor::process_file(filename, fmt::format("#version {}\n", glsl_version), processed_strings, environment, file_cache);
-		for (const auto& definition : definitions.values) {
-			preprocessor::process_file(filename, definition.string, processed_strings, environment, file_cache);
+		{
+			const auto zone = profiler::zone("preprocess_shader", filename);
+			auto file = std::ifstream{filename};
+			if (!file) {
+				throw shader_error{fmt::format("Failed to read shader code file \"{}\"!\n", filename)};
+			}
+			auto stream = std::ostringstream{};
+			stream << file.rdbuf();
+			const auto source = std::move(stream).str();
+			file.close();
+
+			auto environment = preprocessor_environment{};
+			auto file_cache = preprocessor::file_content_map{};
+			preprocessor::process_file(filename, fmt::format("#version {}\n", glsl_version), processed_strings, environment, file_cache);
+			for (const auto& definition : definitions.values) {
+				preprocessor::process_file(filename, definition.string, processed_strings, environment, file_cache);
+			}
+			preprocessor::process_file(filename, source, processed_strings, environment, file_cache);
+
+			m_dependencies.reserve(file_cache.size());
+			for (const auto& [included_filename, contents] : file_cache) {
+				m_dependencies.push_back(std::filesystem::path{included_filename}.lexically_normal().generic_string());
+			}
 		}
-		preprocessor::process_file(filename, source, processed_strings, environment, file_cache);
 
+		const auto zone = profiler::zone("compile_shader", filename);
 		auto strings = std::vector<const GLchar*>{};
 		auto lengths = std::vector<GLint>{};
 		for (const auto& processed_string : processed_strings) {
@@ -101,6 +114,13 @@ public:
 		return m_shader.get();
 	}
 
+	// Check whether the shader was built from any of the given files, including the ones it includes. Filenames must be in generic, lexically normal form.
+	[[nodiscard]] auto depends_on_any(std::span<const std::string> filenames) const -> bool {
+		return std::ranges::any_of(m_dependencies, [&](const std::string& dependency) {
+			return std::ranges::find(filenames, dependency) != filenames.end();
+		});
+	}
+
 private:
 	struct shader_deleter final {
 		auto operator()(GLuint p) const noexcept -> void {
@@ -110,6 +130,7 @@ private:
 	using shader_ptr = unique_handle<shader_deleter>;
 
 	shader_ptr m_shader{};
+	std::vector<std::string> m_dependencies{};
 };
 
 struct shader_program_options final {
@@ -146,6 +167,7 @@ public:
 			glAttachShader(m_program.get(), m_tesselation_evaluation_shader.get());
 		}
 
+		const auto zone = profiler::zone("link_shader_program", (options.vertex_shader_filename) ? options.vertex_shader_filename : "");
 		glLinkProgram(m_program.get());
 
 		auto success = GLint{GL_FALSE};
@@ -166,6 +188,11 @@ public:
 		return m_program.get();
 	}
 
+	[[nodiscard]] auto depends_on_any(std::span<const std::string> filenames) const -> bool {
+		return m_vertex_shader.depends_on_any(filenames) || m_fragment_shader.depends_on_any(filenames) || m_geometry_shader.depends_on_any(filenames) ||
+			m_tesselation_control_shader.depends_on_any(filenames) || m_tesselation_evaluation_shader.depends_on_any(filenames);
+	}
+
 private:
 	struct program_deleter final {
 		auto operator()(GLuint p) const noexcept -> void {
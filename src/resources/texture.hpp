@@ -7,6 +7,7 @@
 #include <array>        // std::array
 #include <cstddef>      // std::byte, std::size_t
 #include <fmt/format.h> // fmt::format
+#include <span>         // std::span
 #include <stdexcept>    // std::invalid_argument
 #include <vector>       // std::vector
 
@@ -41,21 +42,52 @@ public:
 		switch (internal_format) {
 			case GL_R8: [[fallthrough]];
 			case GL_R16F: [[fallthrough]];
-			case GL_R32F: return 1;
+			case GL_R32F: [[fallthrough]];
+			case GL_COMPRESSED_RED_RGTC1: return 1;
 			case GL_RG8: [[fallthrough]];
 			case GL_RG16F: [[fallthrough]];
-			case GL_RG32F: return 2;
+			case GL_RG32F: [[fallthrough]];
+			case GL_COMPRESSED_RG_RGTC2: return 2;
 			case GL_RGB8: [[fallthrough]];
 			case GL_RGB16F: [[fallthrough]];
-			case GL_RGB32F: return 3;
+			case GL_RGB32F: [[fallthrough]];
+			case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return 3;
 			case GL_RGBA8: [[fallthrough]];
 			case GL_RGBA16F: [[fallthrough]];
-			case GL_RGBA32F: return 4;
+			case GL_RGBA32F: [[fallthrough]];
+			case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return 4;
 			default: break;
 		}
 		throw std::invalid_argument{fmt::format("Invalid internal texture format \"{}\"!", internal_format)};
 	}
 
+	// Size in bytes of one level of a texture, as far as it can be told from the internal format.
+	[[nodiscard]] static auto level_size(GLint internal_format, std::size_t width, std::size_t height) -> std::size_t {
+		const auto block_count = ((width + 3) / 4) * ((height + 3) / 4);
+		switch (internal_format) {
+			case GL_COMPRESSED_RED_RGTC1: [[fallthrough]];
+			case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return block_count * 8;
+			case GL_COMPRESSED_RG_RGTC2: [[fallthrough]];
+			case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: [[fallthrough]];
+			case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT: return block_count * 16;
+			case GL_RGB9_E5: [[fallthrough]];
+			case GL_DEPTH_COMPONENT: [[fallthrough]];
+			case GL_DEPTH_COMPONENT24: [[fallthrough]];
+			case GL_DEPTH_COMPONENT32F: return width * height * 4;
+			case GL_DEPTH_COMPONENT16: return width * height * 2;
+			case GL_R16F: [[fallthrough]];
+			case GL_RG16F: [[fallthrough]];
+			case GL_RGB16F: [[fallthrough]];
+			case GL_RGBA16F: return width * height * internal_channel_count(internal_format) * 2;
+			case GL_R32F: [[fallthrough]];
+			case GL_RG32F: [[fallthrough]];
+			case GL_RGB32F: [[fallthrough]];
+			case GL_RGBA32F: return width * height * internal_channel_count(internal_format) * 4;
+			default: break;
+		}
+		return width * height * internal_channel_count(internal_format);
+	}
+
 	[[nodiscard]] static auto pixel_format(std::size_t channel_count) -> GLenum {
 		switch (channel_count) {
 			case 1: return GL_RED;
@@ -104,6 +136,50 @@ public:
 		return result;
 	}
 
+	// Create a 2D texture from a precomputed mip chain, where each level has half the dimensions of the previous one.
+	// Only the levels from the base level onward are uploaded, so that the larger ones can be streamed in later with set_mip_level_2d.
+	[[nodiscard]] static auto create_2d_mip_levels(GLint internal_format, std::size_t width, std::size_t height, GLenum format, GLenum type,
+		std::span<const std::span<const std::byte>> levels, const texture_options& options, std::size_t base_level = 0) -> texture {
+		const auto preserver = state_preserver{GL_TEXTURE_2D, GL_TEXTURE_BINDING_2D};
+		auto result = texture{internal_format, width, height};
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glBindTexture(GL_TEXTURE_2D, result.get());
+		for (auto level = base_level; level < levels.size(); ++level) {
+			glTexImage2D(GL_TEXTURE_2D,
+				static_cast<GLint>(level),
+				internal_format,
+				static_cast<GLsizei>(mip_level_dimension(width, level)),
+				static_cast<GLsizei>(mip_level_dimension(height, level)),
+				0,
+				format,
+				type,
+				levels[level].data());
+		}
+		set_mip_level_options(GL_TEXTURE_2D, levels.size(), options, base_level);
+		return result;
+	}
+
+	// Create a 2D texture from a precomputed mip chain of compressed blocks, starting at the base level.
+	[[nodiscard]] static auto create_2d_compressed_mip_levels(GLint internal_format, std::size_t width, std::size_t height, std::span<const std::span<const std::byte>> levels,
+		const texture_options& options, std::size_t base_level = 0) -> texture {
+		const auto preserver = state_preserver{GL_TEXTURE_2D, GL_TEXTURE_BINDING_2D};
+		auto result = texture{internal_format, width, height};
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glBindTexture(GL_TEXTURE_2D, result.get());
+		for (auto level = base_level; level < levels.size(); ++level) {
+			glCompressedTexImage2D(GL_TEXTURE_2D,
+				static_cast<GLint>(level),
+				static_cast<GLenum>(internal_format),
+				static_cast<GLsizei>(mip_level_dimension(width, level)),
+				static_cast<GLsizei>(mip_level_dimension(height, level)),
+				0,
+				static_cast<GLsizei>(levels[level].size()),
+				levels[level].data());
+		}
+		set_mip_level_options(GL_TEXTURE_2D, levels.size(), options, base_level);
+		return result;
+	}
+
 	[[nodiscard]] static auto create_2d_uninitialized(GLint internal_format, std::size_t width, std::size_t height, const texture_options& options) -> texture {
 		const auto is_depth = is_depth_internal_format(internal_format);
 		const auto format = (is_depth) ? GLenum{GL_DEPTH_COMPONENT} : GLenum{GL_RED};
@@ -145,6 +221,32 @@ public:
 		return result;
 	}
 
+	// Create a cubemap texture from a precomputed mip chain, where each level holds all 6 faces in the order +X, -X, +Y, -Y, +Z, -Z.
+	[[nodiscard]] static auto create_cubemap_mip_levels(GLint internal_format, std::size_t resolution, GLenum format, GLenum type,
+		std::span<const std::span<const std::byte>> levels, const texture_options& options) -> texture {
+		const auto preserver = state_preserver{GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BINDING_CUBE_MAP};
+		auto result = texture{internal_format, resolution, resolution};
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, result.get());
+		for (auto level = std::size_t{0}; level < levels.size(); ++level) {
+			const auto level_resolution = static_cast<GLsizei>(mip_level_dimension(resolution, level));
+			const auto face_size = levels[level].size() / 6;
+			for (auto face = std::size_t{0}; face < 6; ++face) {
+				glTexImage2D(static_cast<GLenum>(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face),
+					static_cast<GLint>(level),
+					internal_format,
+					level_resolution,
+					level_resolution,
+					0,
+					format,
+					type,
+					levels[level].subspan(face * face_size, face_size).data());
+			}
+		}
+		set_mip_level_options(GL_TEXTURE_CUBE_MAP, levels.size(), options);
+		return result;
+	}
+
 	[[nodiscard]] static auto create_cubemap_uninitialized(GLint internal_format, std::size_t resolution, const texture_options& options) -> texture {
 		const auto is_depth = is_depth_internal_format(internal_format);
 		const auto format = (is_depth) ? GLenum{GL_DEPTH_COMPONENT} : GLenum{GL_RED};
@@ -180,6 +282,56 @@ public:
 			pixels);
 	}
 
+	// Upload a single level of a texture created from a partial mip chain. The level is not sampled until it is made the base level.
+	auto set_mip_level_2d(std::size_t level, GLenum format, GLenum type, std::span<const std::byte> pixels) -> void {
+		const auto preserver = state_preserver{GL_TEXTURE_2D, GL_TEXTURE_BINDING_2D};
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glBindTexture(GL_TEXTURE_2D, m_texture.get());
+		glTexImage2D(GL_TEXTURE_2D,
+			static_cast<GLint>(level),
+			m_internal_format,
+			static_cast<GLsizei>(mip_level_dimension(m_width, level)),
+			static_cast<GLsizei>(mip_level_dimension(m_height, level)),
+			0,
+			format,
+			type,
+			pixels.data());
+	}
+
+	auto set_compressed_mip_level_2d(std::size_t level, std::span<const std::byte> blocks) -> void {
+		const auto preserver = state_preserver{GL_TEXTURE_2D, GL_TEXTURE_BINDING_2D};
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glBindTexture(GL_TEXTURE_2D, m_texture.get());
+		glCompressedTexImage2D(GL_TEXTURE_2D,
+			static_cast<GLint>(level),
+			static_cast<GLenum>(m_internal_format),
+			static_cast<GLsizei>(mip_level_dimension(m_width, level)),
+			static_cast<GLsizei>(mip_level_dimension(m_height, level)),
+			0,
+			static_cast<GLsizei>(blocks.size()),
+			blocks.data());
+	}
+
+	// Free the memory of a level that is below the base level by giving it a size of zero.
+	auto discard_mip_level_2d(std::size_t level) -> void {
+		const auto preserver = state_preserver{GL_TEXTURE_2D, GL_TEXTURE_BINDING_2D};
+		glBindTexture(GL_TEXTURE_2D, m_texture.get());
+		glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), m_internal_format, 0, 0, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+	}
+
+	// Set the largest level that may be sampled. Levels below it do not have to be uploaded.
+	auto set_base_mip_level_2d(std::size_t level) -> void {
+		const auto preserver = state_preserver{GL_TEXTURE_2D, GL_TEXTURE_BINDING_2D};
+		glBindTexture(GL_TEXTURE_2D, m_texture.get());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(level));
+	}
+
+	auto generate_mip_map_2d() -> void {
+		const auto preserver = state_preserver{GL_TEXTURE_2D, GL_TEXTURE_BINDING_2D};
+		glBindTexture(GL_TEXTURE_2D, m_texture.get());
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+
 	[[nodiscard]] auto read_pixels_2d(GLenum format) const -> std::vector<std::byte> {
 		const auto preserver = state_preserver{GL_TEXTURE_2D, GL_TEXTURE_BINDING_2D};
 		glPixelStorei(GL_PACK_ALIGNMENT, 1);
@@ -198,6 +350,38 @@ public:
 		return result;
 	}
 
+	[[nodiscard]] auto read_mip_level_2d(std::size_t level, GLenum format, GLenum type, std::size_t size) const -> std::vector<std::byte> {
+		const auto preserver = state_preserver{GL_TEXTURE_2D, GL_TEXTURE_BINDING_2D};
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glBindTexture(GL_TEXTURE_2D, m_texture.get());
+		auto result = std::vector<std::byte>(size);
+		glGetTexImage(GL_TEXTURE_2D, static_cast<GLint>(level), format, type, result.data());
+		return result;
+	}
+
+	// Read all 6 faces of a cubemap mip level, in the order +X, -X, +Y, -Y, +Z, -Z. The size is that of a single face.
+	[[nodiscard]] auto read_mip_level_cubemap(std::size_t level, GLenum format, GLenum type, std::size_t face_size) const -> std::vector<std::byte> {
+		const auto preserver = state_preserver{GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BINDING_CUBE_MAP};
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, m_texture.get());
+		auto result = std::vector<std::byte>(face_size * 6);
+		for (auto face = std::size_t{0}; face < 6; ++face) {
+			glGetTexImage(static_cast<GLenum>(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face), static_cast<GLint>(level), format, type, result.data() + face * face_size);
+		}
+		return result;
+	}
+
+	[[nodiscard]] auto read_compressed_mip_level_2d(std::size_t level) const -> std::vector<std::byte> {
+		const auto preserver = state_preserver{GL_TEXTURE_2D, GL_TEXTURE_BINDING_2D};
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glBindTexture(GL_TEXTURE_2D, m_texture.get());
+		auto size = GLint{};
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, static_cast<GLint>(level), GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+		auto result = std::vector<std::byte>(static_cast<std::size_t>(size));
+		glGetCompressedTexImage(GL_TEXTURE_2D, static_cast<GLint>(level), result.data());
+		return result;
+	}
+
 	[[nodiscard]] auto internal_format() const noexcept -> GLint {
 		return m_internal_format;
 	}
@@ -296,6 +480,24 @@ private:
 		}
 	}
 
+	[[nodiscard]] static auto mip_level_dimension(std::size_t dimension, std::size_t level) noexcept -> std::size_t {
+		return (dimension >> level > 0) ? dimension >> level : std::size_t{1};
+	}
+
+	static auto set_mip_level_options(GLenum target, std::size_t level_count, const texture_options& options, std::size_t base_level = 0) noexcept -> void {
+		// The levels are already uploaded, so only the sampling state has to be set up.
+		auto level_options = options;
+		level_options.use_mip_map = false;
+		set_options(target, level_options);
+		if (base_level > 0) {
+			glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(base_level));
+		}
+		if (options.use_mip_map && level_count > 1) {
+			glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(level_count - 1));
+			glTexParameteri(target, GL_TEXTURE_MIN_FILTER, (options.use_linear_filtering) ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST_MIPMAP_LINEAR);
+		}
+	}
+
 	struct texture_deleter final {
 		auto operator()(GLuint p) const noexcept -> void {
 			glDeleteTextures(1, &p);
@@ -0,0 +1,257 @@
+#ifndef TEXTURE_ENCODER_HPP
+#define TEXTURE_ENCODER_HPP
+
+#include "../core/glsl.hpp"
+#include "../core/opengl.hpp"
+
+#include <algorithm>   // std::min, std::max, std::clamp, std::swap
+#include <array>       // std::array
+#include <bit>         // std::bit_width
+#include <cmath>       // std::lround
+#include <cstddef>     // std::byte, std::size_t
+#include <cstdint>     // std::uint8_t, std::uint16_t, std::uint32_t, std::uint64_t
+#include <span>        // std::span
+#include <stdexcept>   // std::invalid_argument
+#include <type_traits> // std::is_same_v
+#include <vector>      // std::vector
+
+// Builds mip chains of 8-bit and float textures on the CPU and optionally block compresses 8-bit levels, so that they can be uploaded level by level.
+// 1 and 2 channel textures are compressed as BC4 and BC5, which are core in OpenGL 3.0, while 3 and 4 channel textures need EXT_texture_compression_s3tc for BC1 and BC3.
+class texture_encoder final {
+public:
+	[[nodiscard]] static auto mip_level_count(std::size_t width, std::size_t height) noexcept -> std::size_t {
+		return static_cast<std::size_t>(std::bit_width(std::max(width, height)));
+	}
+
+	[[nodiscard]] static auto mip_level_dimension(std::size_t dimension, std::size_t level) noexcept -> std::size_t {
+		return std::max(dimension >> level, std::size_t{1});
+	}
+
+	[[nodiscard]] static auto compressed_internal_format(std::size_t channel_count) -> GLint {
+		switch (channel_count) {
+			case 1: return GL_COMPRESSED_RED_RGTC1;
+			case 2: return GL_COMPRESSED_RG_RGTC2;
+			case 3: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+			case 4: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+			default: break;
+		}
+		throw std::invalid_argument{"Invalid texture channel count!"};
+	}
+
+	// Box filter the texels of a level down to the next one, matching the dimensions of glGenerateMipmap.
+	template <typename T>
+	[[nodiscard]] static auto downsample(std::span<const T> texels, std::size_t width, std::size_t height, std::size_t channel_count) -> std::vector<T> {
+		if (texels.size() != width * height * channel_count) {
+			throw std::invalid_argument{"Invalid texture texel count!"};
+		}
+		const auto level_width = mip_level_dimension(width, 1);
+		const auto level_height = mip_level_dimension(height, 1);
+		auto result = std::vector<T>(level_width * level_height * channel_count);
+		for (auto y = std::size_t{0}; y < level_height; ++y) {
+			const auto y0 = std::min(y * 2, height - 1);
+			const auto y1 = std::min(y * 2 + 1, height - 1);
+			for (auto x = std::size_t{0}; x < level_width; ++x) {
+				const auto x0 = std::min(x * 2, width - 1);
+				const auto x1 = std::min(x * 2 + 1, width - 1);
+				for (auto channel = std::size_t{0}; channel < channel_count; ++channel) {
+					const auto sum = static_cast<float>(texels[(y0 * width + x0) * channel_count + channel]) +
+						static_cast<float>(texels[(y0 * width + x1) * channel_count + channel]) + static_cast<float>(texels[(y1 * width + x0) * channel_count + channel]) +
+						static_cast<float>(texels[(y1 * width + x1) * channel_count + channel]);
+					if constexpr (std::is_same_v<T, float>) {
+						result[(y * level_width + x) * channel_count + channel] = sum * 0.25f;
+					} else {
+						result[(y * level_width + x) * channel_count + channel] = static_cast<T>(std::lround(sum * 0.25f));
+					}
+				}
+			}
+		}
+		return result;
+	}
+
+	// Encode one 8-bit level into the blocks of compressed_internal_format(channel_count). Edge blocks repeat the last row and column.
+	[[nodiscard]] static auto compress(std::span<const std::uint8_t> texels, std::size_t width, std::size_t height, std::size_t channel_count) -> std::vector<std::byte> {
+		if (texels.size() != width * height * channel_count) {
+			throw std::invalid_argument{"Invalid texture texel count!"};
+		}
+		const auto block_count_x = (width + block_dimension - 1) / block_dimension;
+		const auto block_count_y = (height + block_dimension - 1) / block_dimension;
+		const auto block_size = compressed_block_size(channel_count);
+		auto result = std::vector<std::byte>(block_count_x * block_count_y * block_size);
+		auto block = block_texels{};
+		for (auto block_y = std::size_t{0}; block_y < block_count_y; ++block_y) {
+			for (auto block_x = std::size_t{0}; block_x < block_count_x; ++block_x) {
+				for (auto i = std::size_t{0}; i < block_texel_count; ++i) {
+					const auto x = std::min(block_x * block_dimension + i % block_dimension, width - 1);
+					const auto y = std::min(block_y * block_dimension + i / block_dimension, height - 1);
+					for (auto channel = std::size_t{0}; channel < channel_count; ++channel) {
+						block[i][channel] = texels[(y * width + x) * channel_count + channel];
+					}
+				}
+				auto* const out = &result[(block_y * block_count_x + block_x) * block_size];
+				switch (channel_count) {
+					case 1: encode_bc4_block(block, 0, out); break;
+					case 2:
+						encode_bc4_block(block, 0, out);
+						encode_bc4_block(block, 1, out + bc4_block_size);
+						break;
+					case 3: encode_bc1_block(block, out); break;
+					case 4:
+						encode_bc4_block(block, 3, out);
+						encode_bc1_block(block, out + bc4_block_size);
+						break;
+					default: break;
+				}
+			}
+		}
+		return result;
+	}
+
+private:
+	static constexpr auto block_dimension = std::size_t{4};
+	static constexpr auto block_texel_count = block_dimension * block_dimension;
+	static constexpr auto bc1_block_size = std::size_t{8};
+	static constexpr auto bc4_block_size = std::size_t{8};
+
+	using block_texels = std::array<std::array<std::uint8_t, 4>, block_texel_count>;
+
+	[[nodiscard]] static auto compressed_block_size(std::size_t channel_count) -> std::size_t {
+		switch (channel_count) {
+			case 1: return bc4_block_size;
+			case 2: return bc4_block_size * 2;
+			case 3: return bc1_block_size;
+			case 4: return bc4_block_size + bc1_block_size;
+			default: break;
+		}
+		throw std::invalid_argument{"Invalid texture channel count!"};
+	}
+
+	// Eight-value mode: the endpoints are the extremes of the block and the six values in between are interpolated.
+	static auto encode_bc4_block(const block_texels& texels, std::size_t channel, std::byte* out) noexcept -> void {
+		auto low = std::uint8_t{255};
+		auto high = std::uint8_t{0};
+		for (const auto& texel : texels) {
+			low = std::min(low, texel[channel]);
+			high = std::max(high, texel[channel]);
+		}
+		auto indices = std::uint64_t{0};
+		if (high > low) {
+			const auto range = static_cast<float>(high - low);
+			for (auto i = std::size_t{0}; i < block_texel_count; ++i) {
+				// Step 0 is the high endpoint (index 0), step 7 the low endpoint (index 1) and steps 1-6 are indices 2-7.
+				const auto step = static_cast<std::uint64_t>(std::lround(static_cast<float>(high - texels[i][channel]) / range * 7.0f));
+				const auto index = (step == 0) ? std::uint64_t{0} : (step == 7) ? std::uint64_t{1} : step + 1;
+				indices |= index << (i * 3);
+			}
+		}
+		out[0] = std::byte{high};
+		out[1] = std::byte{low};
+		for (auto i = std::size_t{0}; i < 6; ++i) {
+			out[2 + i] = static_cast<std::byte>((indices >> (i * 8)) & 0xFF);
+		}
+	}
+
+	// Four-color mode with endpoints at the extremes of the block along its principal axis, slightly inset since the extremes are rarely hit exactly.
+	static auto encode_bc1_block(const block_texels& texels, std::byte* out) noexcept -> void {
+		auto values = std::array<vec3, block_texel_count>{};
+		auto mean = vec3{0.0f};
+		for (auto i = std::size_t{0}; i < block_texel_count; ++i) {
+			values[i] = vec3{static_cast<float>(texels[i][0]), static_cast<float>(texels[i][1]), static_cast<float>(texels[i][2])};
+			mean += values[i];
+		}
+		mean *= 1.0f / static_cast<float>(block_texel_count);
+		auto covariance = std::array<float, 6>{};
+		for (const auto& value : values) {
+			const auto d = value - mean;
+			covariance[0] += d.x * d.x;
+			covariance[1] += d.x * d.y;
+			covariance[2] += d.x * d.z;
+			covariance[3] += d.y * d.y;
+			covariance[4] += d.y * d.z;
+			covariance[5] += d.z * d.z;
+		}
+		// Start from the column of the channel with the largest variance, which is never orthogonal to the principal axis unless the block is flat.
+		auto axis = vec3{covariance[0], covariance[1], covariance[2]};
+		if (covariance[3] > covariance[0] && covariance[3] >= covariance[5]) {
+			axis = vec3{covariance[1], covariance[3], covariance[4]};
+		} else if (covariance[5] > covariance[0] && covariance[5] > covariance[3]) {
+			axis = vec3{covariance[2], covariance[4], covariance[5]};
+		}
+		for (auto iteration = 0; iteration < 8; ++iteration) {
+			axis = vec3{
+				covariance[0] * axis.x + covariance[1] * axis.y + covariance[2] * axis.z,
+				covariance[1] * axis.x + covariance[3] * axis.y + covariance[4] * axis.z,
+				covariance[2] * axis.x + covariance[4] * axis.y + covariance[5] * axis.z,
+			};
+			const auto axis_length = length(axis);
+			if (axis_length <= std::numeric_limits<float>::epsilon()) {
+				axis = vec3{0.0f};
+				break;
+			}
+			axis *= 1.0f / axis_length;
+		}
+		auto t_min = 0.0f;
+		auto t_max = 0.0f;
+		for (const auto& value : values) {
+			const auto t = dot(value - mean, axis);
+			t_min = std::min(t_min, t);
+			t_max = std::max(t_max, t);
+		}
+		const auto inset = (t_max - t_min) / 16.0f;
+		const auto to_color = [](vec3 value) {
+			const auto color = clamp(value, vec3{0.0f}, vec3{255.0f});
+			return std::array<int, 3>{static_cast<int>(std::lround(color.x)), static_cast<int>(std::lround(color.y)), static_cast<int>(std::lround(color.z))};
+		};
+		const auto high = to_color(mean + axis * (t_max - inset));
+		const auto low = to_color(mean + axis * (t_min + inset));
+
+		auto color0 = pack_565(high);
+		auto color1 = pack_565(low);
+		if (color0 < color1) {
+			std::swap(color0, color1);
+		}
+		auto indices = std::uint32_t{0};
+		if (color0 != color1) {
+			const auto endpoint0 = unpack_565(color0);
+			const auto endpoint1 = unpack_565(color1);
+			auto direction = std::array<int, 3>{};
+			auto length_squared = 0;
+			for (auto channel = std::size_t{0}; channel < 3; ++channel) {
+				direction[channel] = endpoint1[channel] - endpoint0[channel];
+				length_squared += direction[channel] * direction[channel];
+			}
+			// Steps along the line from color0 to color1 map to the palette order 0, 2, 3, 1.
+			constexpr auto step_indices = std::array<std::uint32_t, 4>{0, 2, 3, 1};
+			for (auto i = std::size_t{0}; i < block_texel_count; ++i) {
+				auto projection = 0;
+				for (auto channel = std::size_t{0}; channel < 3; ++channel) {
+					projection += (texels[i][channel] - endpoint0[channel]) * direction[channel];
+				}
+				const auto step = std::clamp(static_cast<int>(std::lround(static_cast<float>(projection) / static_cast<float>(length_squared) * 3.0f)), 0, 3);
+				indices |= step_indices[static_cast<std::size_t>(step)] << (i * 2);
+			}
+		}
+		out[0] = static_cast<std::byte>(color0 & 0xFF);
+		out[1] = static_cast<std::byte>(color0 >> 8);
+		out[2] = static_cast<std::byte>(color1 & 0xFF);
+		out[3] = static_cast<std::byte>(color1 >> 8);
+		for (auto i = std::size_t{0}; i < 4; ++i) {
+			out[4 + i] = static_cast<std::byte>((indices >> (i * 8)) & 0xFF);
+		}
+	}
+
+	[[nodiscard]] static auto pack_565(const std::array<int, 3>& color) noexcept -> std::uint16_t {
+		const auto r = static_cast<unsigned>((color[0] * 31 + 127) / 255);
+		const auto g = static_cast<unsigned>((color[1] * 63 + 127) / 255);
+		const auto b = static_cast<unsigned>((color[2] * 31 + 127) / 255);
+		return static_cast<std::uint16_t>((r << 11) | (g << 5) | b);
+	}
+
+	[[nodiscard]] static auto unpack_565(std::uint16_t color) noexcept -> std::array<int, 3> {
+		const auto r = (color >> 11) & 0x1F;
+		const auto g = (color >> 5) & 0x3F;
+		const auto b = color & 0x1F;
+		return {(r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)};
+	}
+};
+
+#endif
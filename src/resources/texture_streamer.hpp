@@ -0,0 +1,202 @@
+#ifndef TEXTURE_STREAMER_HPP
+#define TEXTURE_STREAMER_HPP
+
+#include "cooked_texture.hpp"
+#include "texture.hpp"
+#include "texture_encoder.hpp"
+
+#include <algorithm>     // std::max, std::min, std::ranges::sort
+#include <cmath>         // std::log2, std::floor
+#include <cstddef>       // std::size_t
+#include <cstdint>       // std::uint64_t
+#include <memory>        // std::shared_ptr, std::weak_ptr, std::make_shared
+#include <unordered_map> // std::unordered_map, std::erase_if
+#include <utility>       // std::move
+#include <vector>        // std::vector
+
+struct texture_streamer_options final {
+	std::size_t gpu_size = 0;                                  // Bytes of GPU memory that streamed textures may use, not counting their initial levels. 0 disables streaming.
+	std::size_t initial_resolution = 64;                       // Largest level that is uploaded when a texture is added.
+	std::size_t upload_size_per_update = std::size_t{8} << 20; // Bytes that may be streamed in per update, so that the cost is spread over several frames.
+};
+
+// Keeps only the mip levels of each texture that are needed for how large it appears on screen, within a GPU memory budget.
+// Textures start out with their smallest levels. Renderers report how many pixels across the objects that use a texture cover, and update() then streams in
+// the next larger level of the textures that need it the most, while evicting levels from textures that are sharper than needed, least recently seen first.
+// The mip chain of every texture is kept on the CPU, which is free for cooked files since they are memory-mapped.
+class texture_streamer final {
+public:
+	explicit texture_streamer(const texture_streamer_options& options)
+		: m_options(options) {}
+
+	[[nodiscard]] auto enabled() const noexcept -> bool {
+		return m_options.gpu_size > 0;
+	}
+
+	// Upload the smallest levels of a texture and keep the rest for streaming. Uploads every level if streaming is disabled.
+	[[nodiscard]] auto add(cooked_texture source, const texture_options& options) -> std::shared_ptr<texture> {
+		const auto base_level = get_initial_level(source);
+		auto result = std::make_shared<texture>(source.upload(options, base_level));
+		track(result, std::move(source), base_level);
+		return result;
+	}
+
+	// Replace the contents of a texture, such as when its source file has changed. It starts over from its smallest levels.
+	auto reload(const std::shared_ptr<texture>& tex, cooked_texture source, const texture_options& options) -> void {
+		const auto base_level = get_initial_level(source);
+		*tex = source.upload(options, base_level);
+		track(tex, std::move(source), base_level);
+	}
+
+	// Ask for a texture to be sharp enough to cover the given number of pixels across on screen until the next update. Textures that are not streamed are ignored.
+	auto request(const texture& tex, float footprint) -> void {
+		const auto it = m_textures.find(&tex);
+		if (it == m_textures.end()) {
+			return;
+		}
+		auto& streamed = it->second;
+		const auto size = static_cast<float>(std::max(tex.width(), tex.height()));
+		const auto level = (footprint >= size) ? std::size_t{0} : static_cast<std::size_t>(std::floor(std::log2(size / std::max(footprint, 1.0f))));
+		streamed.wanted_level = std::min(streamed.wanted_level, level);
+		streamed.last_request = m_update_count;
+	}
+
+	// Stream in at most one level per texture, up to the upload size per update. Must be called on the thread that owns the GL context.
+	auto update() -> void {
+		std::erase_if(m_textures, [&](const auto& kv) {
+			if (kv.second.texture_ptr.expired()) {
+				m_resident_size -= kv.second.streamed_size;
+				return true;
+			}
+			return false;
+		});
+
+		// Textures that were seen most recently go first, then the ones that are the furthest from what they need.
+		auto candidates = std::vector<streamed_texture*>{};
+		for (auto& [ptr, streamed] : m_textures) {
+			if (streamed.base_level > streamed.wanted_level) {
+				candidates.push_back(&streamed);
+			}
+		}
+		std::ranges::sort(candidates, [](const streamed_texture* lhs, const streamed_texture* rhs) {
+			if (lhs->last_request != rhs->last_request) {
+				return lhs->last_request > rhs->last_request;
+			}
+			return lhs->base_level - lhs->wanted_level > rhs->base_level - rhs->wanted_level;
+		});
+		auto uploaded_size = std::size_t{0};
+		for (auto* const streamed : candidates) {
+			if (uploaded_size >= m_options.upload_size_per_update) {
+				break;
+			}
+			const auto level = streamed->base_level - 1;
+			const auto level_size = streamed->source.levels()[level].size();
+			if (!make_room(level_size)) {
+				continue;
+			}
+			if (const auto tex = streamed->texture_ptr.lock()) {
+				streamed->source.upload_level(*tex, level);
+				tex->set_base_mip_level_2d(level);
+				streamed->base_level = level;
+				streamed->streamed_size += level_size;
+				m_resident_size += level_size;
+				uploaded_size += level_size;
+			}
+		}
+
+		// Requests only last for one update.
+		for (auto& [ptr, streamed] : m_textures) {
+			streamed.wanted_level = streamed.initial_level;
+		}
+		++m_update_count;
+	}
+
+	auto clear() -> void {
+		m_textures.clear();
+		m_resident_size = 0;
+	}
+
+	// Bytes of GPU memory used by streamed levels.
+	[[nodiscard]] auto resident_size() const noexcept -> std::size_t {
+		return m_resident_size;
+	}
+
+	[[nodiscard]] auto options() const noexcept -> const texture_streamer_options& {
+		return m_options;
+	}
+
+private:
+	struct streamed_texture final {
+		std::weak_ptr<texture> texture_ptr;
+		cooked_texture source;
+		std::size_t base_level;
+		std::size_t initial_level;
+		std::size_t wanted_level;
+		std::size_t streamed_size = 0;
+		std::uint64_t last_request = 0;
+	};
+
+	[[nodiscard]] static auto level_dimension(std::size_t width, std::size_t height, std::size_t level) noexcept -> std::size_t {
+		return std::max(texture_encoder::mip_level_dimension(width, level), texture_encoder::mip_level_dimension(height, level));
+	}
+
+	[[nodiscard]] auto get_initial_level(const cooked_texture& source) const noexcept -> std::size_t {
+		auto result = std::size_t{0};
+		if (enabled()) {
+			while (result + 1 < source.levels().size() && level_dimension(source.width(), source.height(), result) > m_options.initial_resolution) {
+				++result;
+			}
+		}
+		return result;
+	}
+
+	auto track(const std::shared_ptr<texture>& tex, cooked_texture source, std::size_t base_level) -> void {
+		// Forget any previous entry, which is either for the same texture or for a destroyed one whose address has been reused before update() could remove it.
+		if (const auto it = m_textures.find(tex.get()); it != m_textures.end()) {
+			m_resident_size -= it->second.streamed_size;
+			m_textures.erase(it);
+		}
+		if (base_level > 0) {
+			m_textures.emplace(tex.get(),
+				streamed_texture{
+					.texture_ptr = tex,
+					.source = std::move(source),
+					.base_level = base_level,
+					.initial_level = base_level,
+					.wanted_level = base_level,
+				});
+		}
+	}
+
+	// Evict levels that are sharper than needed, from the least recently seen textures first, until the given size fits in the budget.
+	[[nodiscard]] auto make_room(std::size_t size) -> bool {
+		while (m_resident_size + size > m_options.gpu_size) {
+			auto victim = static_cast<streamed_texture*>(nullptr);
+			for (auto& [ptr, streamed] : m_textures) {
+				if (streamed.base_level < streamed.wanted_level && (!victim || streamed.last_request < victim->last_request)) {
+					victim = &streamed;
+				}
+			}
+			if (!victim) {
+				return false;
+			}
+			const auto level = victim->base_level;
+			const auto level_size = victim->source.levels()[level].size();
+			if (const auto tex = victim->texture_ptr.lock()) {
+				tex->set_base_mip_level_2d(level + 1);
+				tex->discard_mip_level_2d(level);
+			}
+			victim->base_level = level + 1;
+			victim->streamed_size -= level_size;
+			m_resident_size -= level_size;
+		}
+		return true;
+	}
+
+	texture_streamer_options m_options;
+	std::unordered_map<const texture*, streamed_texture> m_textures{};
+	std::size_t m_resident_size = 0;
+	std::uint64_t m_update_count = 0;
+};
+
+#endif
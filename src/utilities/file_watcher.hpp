@@ -0,0 +1,148 @@
+#ifndef FILE_WATCHER_HPP
+#define FILE_WATCHER_HPP
+
+#ifdef __linux__
+#include <sys/inotify.h> // inotify_init1, inotify_add_watch, inotify_event, IN_...
+#include <unistd.h>      // read, close
+#endif
+
+#include <algorithm>     // std::ranges::find
+#include <array>         // std::array
+#include <cerrno>        // errno, ENOENT, ENOTDIR
+#include <cstdio>        // stderr
+#include <cstring>       // std::memcpy
+#include <filesystem>    // std::filesystem::...
+#include <fmt/format.h>  // fmt::format, fmt::print
+#include <stdexcept>     // std::runtime_error
+#include <string>        // std::string
+#include <system_error>  // std::error_code
+#include <unordered_map> // std::unordered_map
+#include <utility>       // std::move, std::exchange
+#include <vector>        // std::vector
+
+struct file_watcher_error : std::runtime_error {
+	explicit file_watcher_error(const auto& message)
+		: std::runtime_error(message) {}
+};
+
+// Reports the files in a directory tree that have been written to or moved into place, such as by a text or image editor, so that whatever was loaded from them
+// can be reloaded. Uses inotify on Linux. On other platforms, nothing is ever reported.
+class file_watcher final {
+public:
+	// A watcher that watches nothing.
+	file_watcher() noexcept = default;
+
+	// Watch a directory and every subdirectory in it, including ones that are created later.
+	explicit file_watcher(const char* directory) {
+#ifdef __linux__
+		m_file = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (m_file == -1) {
+			throw file_watcher_error{fmt::format("Failed to watch \"{}\"!", directory)};
+		}
+		add_directory_tree(directory, true);
+#else
+		static_cast<void>(directory);
+#endif
+	}
+
+	~file_watcher() {
+#ifdef __linux__
+		if (m_file != -1) {
+			close(m_file);
+		}
+#endif
+	}
+
+	file_watcher(const file_watcher&) = delete;
+
+	file_watcher(file_watcher&& other) noexcept {
+		*this = std::move(other);
+	}
+
+	auto operator=(const file_watcher&) -> file_watcher& = delete;
+
+	auto operator=(file_watcher&& other) noexcept -> file_watcher& {
+#ifdef __linux__
+		if (m_file != -1) {
+			close(m_file);
+		}
+#endif
+		m_file = std::exchange(other.m_file, -1);
+		m_directories = std::move(other.m_directories);
+		return *this;
+	}
+
+	// Get the files that have changed since the last call without blocking, with each file listed once. The filenames are in generic, lexically normal form.
+	[[nodiscard]] auto poll() -> std::vector<std::string> {
+		auto result = std::vector<std::string>{};
+#ifdef __linux__
+		if (m_file == -1) {
+			return result;
+		}
+		alignas(inotify_event) auto buffer = std::array<char, 4096>{};
+		while (true) {
+			const auto size = read(m_file, buffer.data(), buffer.size());
+			if (size <= 0) {
+				break;
+			}
+			for (auto offset = std::size_t{0}; offset + sizeof(inotify_event) <= static_cast<std::size_t>(size);) {
+				auto event = inotify_event{};
+				std::memcpy(&event, buffer.data() + offset, sizeof(inotify_event));
+				const auto* const name = buffer.data() + offset + sizeof(inotify_event);
+				offset += sizeof(inotify_event) + event.len;
+
+				const auto it = m_directories.find(event.wd);
+				if (event.len == 0 || it == m_directories.end()) {
+					continue;
+				}
+				auto filename = (std::filesystem::path{it->second} / name).lexically_normal().generic_string();
+				if ((event.mask & IN_ISDIR) != 0) {
+					if ((event.mask & (IN_CREATE | IN_MOVED_TO)) != 0) {
+						add_directory_tree(filename, false);
+					}
+				} else if ((event.mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) != 0 && std::ranges::find(result, filename) == result.end()) {
+					result.push_back(std::move(filename));
+				}
+			}
+		}
+#endif
+		return result;
+	}
+
+private:
+#ifdef __linux__
+	// Failures only throw when required. Otherwise, directories that have already been removed again by the time they are watched are skipped, and other
+	// failures are reported on stderr, so that poll() never throws.
+	auto add_directory_tree(const std::string& directory, bool required) -> void {
+		if (!add_directory(directory, required)) {
+			return;
+		}
+		auto error = std::error_code{};
+		for (auto it = std::filesystem::recursive_directory_iterator{directory, error}; !error && it != std::filesystem::recursive_directory_iterator{}; it.increment(error)) {
+			if (it->is_directory(error)) {
+				add_directory(it->path().lexically_normal().generic_string(), required);
+			}
+		}
+	}
+
+	auto add_directory(const std::string& directory, bool required) -> bool {
+		const auto watch = inotify_add_watch(m_file, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR);
+		if (watch == -1) {
+			if (required) {
+				throw file_watcher_error{fmt::format("Failed to watch \"{}\"!", directory)};
+			}
+			if (errno != ENOENT && errno != ENOTDIR) {
+				fmt::print(stderr, "Failed to watch \"{}\"!\n", directory);
+			}
+			return false;
+		}
+		m_directories.insert_or_assign(watch, directory);
+		return true;
+	}
+#endif
+
+	int m_file = -1;
+	std::unordered_map<int, std::string> m_directories{};
+};
+
+#endif
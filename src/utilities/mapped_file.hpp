@@ -0,0 +1,139 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#undef near
+#undef far
+#undef min
+#undef max
+#else
+#include <fcntl.h>    // open, O_RDONLY
+#include <sys/mman.h> // mmap, munmap, MAP_...
+#include <sys/stat.h> // fstat
+#include <unistd.h>   // close
+#endif
+
+#include <cstddef>      // std::byte, std::size_t
+#include <fmt/format.h> // fmt::format
+#include <span>         // std::span
+#include <stdexcept>    // std::runtime_error
+#include <utility>      // std::move, std::exchange
+
+struct mapped_file_error : std::runtime_error {
+	explicit mapped_file_error(const auto& message)
+		: std::runtime_error(message) {}
+};
+
+class mapped_file final {
+public:
+	[[nodiscard]] static auto open(const char* filename) -> mapped_file {
+#ifdef _WIN32
+		const auto file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			throw mapped_file_error{fmt::format("Failed to open file \"{}\"!", filename)};
+		}
+		auto file_size = LARGE_INTEGER{};
+		if (GetFileSizeEx(file, &file_size) == 0) {
+			CloseHandle(file);
+			throw mapped_file_error{fmt::format("Failed to get size of file \"{}\"!", filename)};
+		}
+		const auto size = static_cast<std::size_t>(file_size.QuadPart);
+		if (size == 0) {
+			CloseHandle(file);
+			return mapped_file{};
+		}
+		const auto mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(file);
+		if (!mapping) {
+			throw mapped_file_error{fmt::format("Failed to map file \"{}\"!", filename)};
+		}
+		auto* const data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+		if (!data) {
+			throw mapped_file_error{fmt::format("Failed to map file \"{}\"!", filename)};
+		}
+		return mapped_file{data, size};
+#else
+		const auto file = ::open(filename, O_RDONLY); // NOLINT(cppcoreguidelines-pro-type-vararg)
+		if (file == -1) {
+			throw mapped_file_error{fmt::format("Failed to open file \"{}\"!", filename)};
+		}
+		struct stat file_status {};
+		if (fstat(file, &file_status) == -1) {
+			close(file);
+			throw mapped_file_error{fmt::format("Failed to get size of file \"{}\"!", filename)};
+		}
+		const auto size = static_cast<std::size_t>(file_status.st_size);
+		if (size == 0) {
+			close(file);
+			return mapped_file{};
+		}
+		auto* const data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+		close(file);
+		if (data == MAP_FAILED) { // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+			throw mapped_file_error{fmt::format("Failed to map file \"{}\"!", filename)};
+		}
+		return mapped_file{data, size};
+#endif
+	}
+
+	constexpr mapped_file() noexcept = default;
+
+	~mapped_file() {
+		unmap();
+	}
+
+	mapped_file(const mapped_file&) = delete;
+
+	mapped_file(mapped_file&& other) noexcept {
+		*this = std::move(other);
+	}
+
+	auto operator=(const mapped_file&) -> mapped_file& = delete;
+
+	auto operator=(mapped_file&& other) noexcept -> mapped_file& {
+		unmap();
+		m_data = std::exchange(other.m_data, nullptr);
+		m_size = std::exchange(other.m_size, 0);
+		return *this;
+	}
+
+	[[nodiscard]] auto bytes() const noexcept -> std::span<const std::byte> {
+		return std::span{static_cast<const std::byte*>(m_data), m_size};
+	}
+
+	[[nodiscard]] auto data() const noexcept -> const void* {
+		return m_data;
+	}
+
+	[[nodiscard]] auto size() const noexcept -> std::size_t {
+		return m_size;
+	}
+
+private:
+	mapped_file(void* data, std::size_t size) noexcept
+		: m_data(data)
+		, m_size(size) {}
+
+	auto unmap() noexcept -> void {
+		if (m_data) {
+#ifdef _WIN32
+			UnmapViewOfFile(m_data);
+#else
+			munmap(m_data, m_size);
+#endif
+		}
+	}
+
+	void* m_data = nullptr;
+	std::size_t m_size = 0;
+};
+
+#endif
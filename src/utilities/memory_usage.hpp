@@ -0,0 +1,44 @@
+#ifndef MEMORY_USAGE_HPP
+#define MEMORY_USAGE_HPP
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h> // GetProcessMemoryInfo, PROCESS_MEMORY_COUNTERS
+#undef near
+#undef far
+#undef min
+#undef max
+#else
+#include <sys/resource.h> // getrusage, RUSAGE_SELF
+#endif
+
+#include <cstddef> // std::size_t
+
+// Peak resident memory of the process so far in bytes, or 0 if it is not available.
+[[nodiscard]] inline auto get_peak_memory_usage() noexcept -> std::size_t {
+#ifdef _WIN32
+	auto counters = PROCESS_MEMORY_COUNTERS{};
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) == 0) {
+		return 0;
+	}
+	return static_cast<std::size_t>(counters.PeakWorkingSetSize);
+#else
+	auto usage = rusage{};
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+#ifdef __APPLE__
+	return static_cast<std::size_t>(usage.ru_maxrss);
+#else
+	return static_cast<std::size_t>(usage.ru_maxrss) * std::size_t{1024};
+#endif
+#endif
+}
+
+#endif
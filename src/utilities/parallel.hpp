@@ -0,0 +1,54 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>   // std::min, std::max
+#include <atomic>      // std::atomic
+#include <cstddef>     // std::size_t
+#include <exception>   // std::exception_ptr, std::current_exception, std::rethrow_exception
+#include <mutex>       // std::mutex, std::scoped_lock
+#include <thread>      // std::jthread, std::thread
+#include <vector>      // std::vector
+
+// Call function(i) for every i in [0, count) on all hardware threads and wait for all of them to finish.
+// Indices are handed out one at a time, so each call should do a reasonably large amount of work (e.g. one row of an image).
+// The first exception thrown by any call is rethrown on the calling thread once every thread has stopped.
+template <typename Function>
+auto parallel_for(std::size_t count, Function&& function) -> void {
+	const auto thread_count = std::min(count, std::max(std::size_t{std::thread::hardware_concurrency()}, std::size_t{1}));
+	if (thread_count <= 1) {
+		for (auto i = std::size_t{0}; i < count; ++i) {
+			function(i);
+		}
+		return;
+	}
+
+	auto next_index = std::atomic<std::size_t>{0};
+	auto exception = std::exception_ptr{};
+	auto exception_mutex = std::mutex{};
+	const auto work = [&]() noexcept {
+		try {
+			for (auto i = next_index.fetch_add(1, std::memory_order_relaxed); i < count; i = next_index.fetch_add(1, std::memory_order_relaxed)) {
+				function(i);
+			}
+		} catch (...) {
+			next_index.store(count, std::memory_order_relaxed);
+			const auto lock = std::scoped_lock{exception_mutex};
+			if (!exception) {
+				exception = std::current_exception();
+			}
+		}
+	};
+	{
+		auto threads = std::vector<std::jthread>{};
+		threads.reserve(thread_count - 1);
+		for (auto i = std::size_t{1}; i < thread_count; ++i) {
+			threads.emplace_back(work);
+		}
+		work();
+	}
+	if (exception) {
+		std::rethrow_exception(exception);
+	}
+}
+
+#endif
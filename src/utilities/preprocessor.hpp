@@ -480,20 +480,21 @@ private:
 			throw preprocessor_error{m_filename, m_line_number, "Missing end quote"};
 		}
 		const auto quote = str.substr(quote_begin, quote_end - quote_begin);
-		const auto [it, inserted] = m_file_cache.try_emplace(std::string{quote});
-		const auto filename_prefix = m_filename.substr(0, m_filename.rfind('/') + 1);
-		auto included_filename = std::string{filename_prefix} + it->first;
-		if (inserted) {
-			auto included_file = std::ifstream{};
-			if (quote_char == '\"') {
-				included_file.open(included_filename);
+
+		// Quoted filenames are looked up next to the including file first. The cache is keyed by the filename that was actually opened, so that it lists every file
+		// that the output depends on.
+		auto included_filename = std::string{quote};
+		if (quote_char == '\"') {
+			const auto filename_prefix = m_filename.substr(0, m_filename.rfind('/') + 1);
+			if (auto relative_filename = fmt::format("{}{}", filename_prefix, quote); m_file_cache.contains(relative_filename) || std::ifstream{relative_filename}) {
+				included_filename = std::move(relative_filename);
 			}
+		}
+		const auto [it, inserted] = m_file_cache.try_emplace(std::move(included_filename));
+		if (inserted) {
+			auto included_file = std::ifstream{it->first};
 			if (!included_file) {
-				included_filename.erase(0, filename_prefix.size());
-				included_file.open(included_filename);
-				if (!included_file) {
-					throw preprocessor_error{m_filename, m_line_number, fmt::format("Failed to open included file \"{}\"", included_filename)};
-				}
+				throw preprocessor_error{m_filename, m_line_number, fmt::format("Failed to open included file \"{}\"", it->first)};
 			}
 			auto stream = std::ostringstream{};
 			stream << included_file.rdbuf();
@@ -0,0 +1,46 @@
+#ifndef STRING_INTERNER_HPP
+#define STRING_INTERNER_HPP
+
+#include <cstddef>       // std::size_t
+#include <cstdint>       // std::uint32_t
+#include <deque>         // std::deque
+#include <optional>      // std::optional, std::nullopt
+#include <string>        // std::string
+#include <string_view>   // std::string_view
+#include <unordered_map> // std::unordered_map
+
+// Maps strings to dense 32-bit IDs, starting at 0, and stores each distinct string once.
+// Interning a string that has already been seen does not allocate.
+class string_interner final {
+public:
+	[[nodiscard]] auto intern(std::string_view str) -> std::uint32_t {
+		if (const auto it = m_ids.find(str); it != m_ids.end()) {
+			return it->second;
+		}
+		const auto id = static_cast<std::uint32_t>(m_strings.size());
+		const auto& stored = m_strings.emplace_back(str); // Elements of a deque never move, so views of them stay valid.
+		m_ids.emplace(stored, id);
+		return id;
+	}
+
+	[[nodiscard]] auto find(std::string_view str) const -> std::optional<std::uint32_t> {
+		if (const auto it = m_ids.find(str); it != m_ids.end()) {
+			return it->second;
+		}
+		return std::nullopt;
+	}
+
+	[[nodiscard]] auto get(std::uint32_t id) const -> const std::string& {
+		return m_strings.at(id);
+	}
+
+	[[nodiscard]] auto size() const noexcept -> std::size_t {
+		return m_strings.size();
+	}
+
+private:
+	std::deque<std::string> m_strings{};
+	std::unordered_map<std::string_view, std::uint32_t> m_ids{};
+};
+
+#endif
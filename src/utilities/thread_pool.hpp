@@ -0,0 +1,86 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <algorithm>          // std::max
+#include <condition_variable> // std::condition_variable_any
+#include <cstddef>            // std::size_t
+#include <functional>         // std::function
+#include <future>             // std::future, std::packaged_task
+#include <memory>             // std::make_shared
+#include <mutex>              // std::mutex, std::scoped_lock, std::unique_lock
+#include <queue>              // std::queue
+#include <stop_token>         // std::stop_token
+#include <thread>             // std::jthread, std::thread
+#include <type_traits>        // std::invoke_result_t, std::decay_t
+#include <utility>            // std::move, std::forward
+#include <vector>             // std::vector
+
+// Fixed set of worker threads that run submitted tasks in order of submission.
+// Tasks that have not started when the pool is destroyed are dropped, which makes their futures report a broken promise.
+class thread_pool final {
+public:
+	// Leave one hardware thread for the main thread.
+	[[nodiscard]] static auto default_thread_count() noexcept -> std::size_t {
+		return std::max(std::size_t{std::thread::hardware_concurrency()}, std::size_t{2}) - 1;
+	}
+
+	explicit thread_pool(std::size_t thread_count = default_thread_count()) {
+		m_threads.reserve(thread_count);
+		for (auto i = std::size_t{0}; i < thread_count; ++i) {
+			m_threads.emplace_back([this](std::stop_token stop_token) {
+				run(stop_token);
+			});
+		}
+	}
+
+	~thread_pool() = default;
+
+	thread_pool(const thread_pool&) = delete;
+	thread_pool(thread_pool&&) = delete;
+	auto operator=(const thread_pool&) -> thread_pool& = delete;
+	auto operator=(thread_pool&&) -> thread_pool& = delete;
+
+	// Run function() on a worker thread. Exceptions thrown by the function are rethrown by the future.
+	template <typename Function>
+	[[nodiscard]] auto submit(Function&& function) -> std::future<std::invoke_result_t<std::decay_t<Function>>> {
+		using result_type = std::invoke_result_t<std::decay_t<Function>>;
+		// std::function requires copyable targets, so the move-only task is shared.
+		auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<Function>(function));
+		auto result = task->get_future();
+		{
+			auto lock = std::scoped_lock{m_mutex};
+			m_tasks.emplace([task = std::move(task)] {
+				(*task)();
+			});
+		}
+		m_condition.notify_one();
+		return result;
+	}
+
+	[[nodiscard]] auto thread_count() const noexcept -> std::size_t {
+		return m_threads.size();
+	}
+
+private:
+	auto run(std::stop_token stop_token) -> void {
+		while (true) {
+			auto task = std::function<void()>{};
+			{
+				auto lock = std::unique_lock{m_mutex};
+				if (!m_condition.wait(lock, stop_token, [&] { return !m_tasks.empty(); }) || stop_token.stop_requested()) {
+					return;
+				}
+				task = std::move(m_tasks.front());
+				m_tasks.pop();
+			}
+			task();
+		}
+	}
+
+	std::mutex m_mutex{};
+	std::condition_variable_any m_condition{};
+	std::queue<std::function<void()>> m_tasks{};
+	std::vector<std::jthread> m_threads{}; // Declared last so that the threads are stopped and joined before the queue is destroyed.
+};
+
+#endif